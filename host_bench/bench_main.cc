@@ -0,0 +1,957 @@
+// hitony_bench - 主机回放基准：RingBuffer/内存池、TTS批量帧解析、Opus编解码、VAD端点
+// 直接编译main/下的原始实现（shim/提供最小IDF接口），用于改动前后在同一台机器上对比
+//
+// 用法：hitony_bench [--json] [-v] <mode> [args]
+//   ring                  PCM/多通道RingBuffer吞吐（拷贝和零拷贝两种接口）
+//   pool                  内存池分配/释放耗时、耗尽行为
+//   batch [trace.bin]     回放WS下行trace：批量帧/二进制控制帧解析 + 池拷贝（+ Opus解码）
+//   gen-trace <out.bin>   生成合成trace（格式见README.md）
+//   opus [in.wav]         按OpusRateController档位编码/解码/PLC，逐帧计时
+//   vad [in.wav]          能量VAD + VadEndpointer，统计端点类型和端点延迟
+//   stress [seconds]      双线程SPSC RingBuffer序列校验 + 多线程内存池压力（失败时退出码1）
+//   all                   以上全部（合成输入，stress 2秒）
+
+#include "audio_buffers.h"
+#include "ws_control.h"
+#include "vad_endpoint.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#if HOST_BENCH_OPUS
+#include "opus_encoder.h"
+#include "opus_decoder.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// shim状态：日志、分配计数
+// ============================================================================
+
+int g_host_log_level = 0;
+host_alloc_counters_t g_host_allocs = {};
+
+void host_log(int level, const char* tag, const char* fmt, ...) {
+    if (level > g_host_log_level) return;
+    static const char kLevel[] = {'E', 'W', 'I', 'D'};
+    fprintf(stderr, "%c (%s) ", kLevel[level & 3], tag);
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void* operator new(size_t size) {
+    __atomic_add_fetch(&g_host_allocs.new_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_host_allocs.new_bytes, size, __ATOMIC_RELAXED);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const char* TAG = "bench";
+
+// ============================================================================
+// 计时 / 报告
+// ============================================================================
+
+static uint64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Metric {
+    std::string section;
+    std::string key;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Metric> s_metrics;
+static bool s_json = false;
+
+static void section(const char* name) {
+    if (!s_json) printf("\n=== %s ===\n", name);
+}
+
+static void metric(const char* sec, const char* key, double value, const char* unit) {
+    s_metrics.push_back({sec, key, value, unit});
+    if (!s_json) printf("  %-32s %14.3f %s\n", key, value, unit);
+}
+
+static void note(const char* fmt, ...) {
+    if (s_json) return;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("  ");
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+static void print_json() {
+    printf("{");
+    std::string cur;
+    for (size_t i = 0; i < s_metrics.size(); i++) {
+        const Metric& m = s_metrics[i];
+        if (m.section != cur) {
+            printf("%s\"%s\":{", cur.empty() ? "" : "},", m.section.c_str());
+            cur = m.section;
+        } else {
+            printf(",");
+        }
+        printf("\"%s\":%.3f", m.key.c_str(), m.value);
+    }
+    printf("%s}\n", cur.empty() ? "" : "}");
+}
+
+// 逐帧耗时（预先reserve，计时循环内不分配）
+struct FrameTimes {
+    std::vector<uint32_t> ns;
+
+    explicit FrameTimes(size_t n) { ns.reserve(n); }
+    void add(uint64_t t) { if (ns.size() < ns.capacity()) ns.push_back((uint32_t)std::min<uint64_t>(t, UINT32_MAX)); }
+
+    void report(const char* sec, const char* prefix) {
+        if (ns.empty()) return;
+        std::vector<uint32_t> sorted(ns);
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t sum = 0;
+        for (uint32_t v : sorted) sum += v;
+        std::string k(prefix);
+        metric(sec, (k + "_avg").c_str(), sum / 1000.0 / sorted.size(), "us");
+        metric(sec, (k + "_p95").c_str(), sorted[sorted.size() * 95 / 100] / 1000.0, "us");
+        metric(sec, (k + "_max").c_str(), sorted.back() / 1000.0, "us");
+    }
+};
+
+// 分配计数快照：报告计时循环内发生的堆分配（期望为0）
+struct AllocSnapshot {
+    uint64_t heap_caps;
+    uint64_t news;
+
+    static AllocSnapshot take() {
+        return {__atomic_load_n(&g_host_allocs.heap_caps_allocs, __ATOMIC_RELAXED),
+                __atomic_load_n(&g_host_allocs.new_allocs, __ATOMIC_RELAXED)};
+    }
+
+    void report(const char* sec) const {
+        AllocSnapshot now = take();
+        metric(sec, "allocs_in_loop", (double)((now.heap_caps - heap_caps) + (now.news - news)), "");
+    }
+};
+
+// ============================================================================
+// 输入：WAV / 合成语音
+// ============================================================================
+
+static const int SAMPLE_RATE = 16000;
+static const int FRAME_20MS = SAMPLE_RATE / 50;
+
+static bool load_wav(const char* path, std::vector<int16_t>* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return false;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t tmp[4096];
+    size_t n;
+    while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) buf.insert(buf.end(), tmp, tmp + n);
+    fclose(f);
+
+    if (buf.size() < 12 || memcmp(&buf[0], "RIFF", 4) != 0 || memcmp(&buf[8], "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s: not a RIFF/WAVE file", path);
+        return false;
+    }
+
+    uint16_t channels = 0, bits = 0, format = 0;
+    uint32_t rate = 0;
+    size_t pos = 12;
+    while (pos + 8 <= buf.size()) {
+        uint32_t sz = buf[pos + 4] | (buf[pos + 5] << 8) | (buf[pos + 6] << 16) | ((uint32_t)buf[pos + 7] << 24);
+        const uint8_t* body = &buf[pos + 8];
+        if (pos + 8 + sz > buf.size()) sz = buf.size() - pos - 8;
+
+        if (memcmp(&buf[pos], "fmt ", 4) == 0 && sz >= 16) {
+            format = body[0] | (body[1] << 8);
+            channels = body[2] | (body[3] << 8);
+            rate = body[4] | (body[5] << 8) | (body[6] << 16) | ((uint32_t)body[7] << 24);
+            bits = body[14] | (body[15] << 8);
+        } else if (memcmp(&buf[pos], "data", 4) == 0) {
+            if (format != 1 || bits != 16 || channels == 0) {
+                ESP_LOGE(TAG, "%s: only PCM16 is supported (format=%u bits=%u)", path, format, bits);
+                return false;
+            }
+            if (rate != SAMPLE_RATE) {
+                ESP_LOGW(TAG, "%s: %uHz, processed as %dHz (no resampling)", path, rate, SAMPLE_RATE);
+            }
+            size_t frames = sz / (2 * channels);
+            out->resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                const uint8_t* s = body + i * 2 * channels;  // 多声道只取第一个通道
+                (*out)[i] = (int16_t)(s[0] | (s[1] << 8));
+            }
+            return true;
+        }
+        pos += 8 + sz + (sz & 1);
+    }
+    ESP_LOGE(TAG, "%s: no data chunk", path);
+    return false;
+}
+
+// 合成"语音"：谐波+音节包络，段落之间是低噪声静音
+// 段落设计覆盖端点的几种情况：正常短句、句内停顿、超长连续说话（触发最长录音）
+static std::vector<int16_t> synth_speech() {
+    static const struct { uint32_t ms; bool voice; } kScript[] = {
+        {500, false}, {1500, true}, {1200, false},
+        {900, true}, {300, false}, {900, true}, {300, false}, {900, true}, {2000, false},
+        {12000, true}, {1500, false},
+    };
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> noise(0.0f, 30.0f);
+    std::vector<int16_t> pcm;
+    double phase = 0;
+    for (const auto& seg : kScript) {
+        size_t n = (size_t)seg.ms * SAMPLE_RATE / 1000;
+        for (size_t i = 0; i < n; i++) {
+            float s = noise(rng);
+            if (seg.voice) {
+                double t = (double)i / SAMPLE_RATE;
+                double f0 = 140 + 30 * sin(2 * M_PI * 0.7 * t);
+                double env = 0.55 + 0.45 * sin(2 * M_PI * 4.0 * t);  // ~4音节/秒
+                phase += 2 * M_PI * f0 / SAMPLE_RATE;
+                double v = 0;
+                for (int h = 1; h <= 6; h++) v += sin(h * phase) / h;
+                s += (float)(4000.0 * env * v);
+            }
+            pcm.push_back((int16_t)std::max(-32768.0f, std::min(32767.0f, s)));
+        }
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> load_or_synth(const char* path) {
+    std::vector<int16_t> pcm;
+    if (path && load_wav(path, &pcm)) {
+        note("input: %s (%.1fs)", path, pcm.size() / (double)SAMPLE_RATE);
+        return pcm;
+    }
+    pcm = synth_speech();
+    note("input: synthetic speech (%.1fs)", pcm.size() / (double)SAMPLE_RATE);
+    return pcm;
+}
+
+// ============================================================================
+// ring：RingBuffer吞吐
+// ============================================================================
+
+static int bench_ring() {
+    const char* sec = "ring";
+    section(sec);
+
+    pcm_ringbuffer_t rb = {};
+    if (!ringbuffer_init(&rb, 16000)) return 1;
+    std::vector<int16_t> in(FRAME_20MS, 1), out(FRAME_20MS);
+    const int iters = 200000;
+
+    AllocSnapshot a0 = AllocSnapshot::take();
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < iters; i++) {
+        ringbuffer_write(&rb, in.data(), FRAME_20MS);
+        ringbuffer_read(&rb, out.data(), FRAME_20MS);
+    }
+    uint64_t copy_ns = now_ns() - t0;
+
+    ringbuffer_span_t span;
+    t0 = now_ns();
+    for (int i = 0; i < iters; i++) {
+        size_t got = ringbuffer_reserve(&rb, FRAME_20MS, &span);
+        if (span.ptr1) memcpy(span.ptr1, in.data(), span.len1 * sizeof(int16_t));
+        if (span.ptr2) memcpy(span.ptr2, in.data() + span.len1, span.len2 * sizeof(int16_t));
+        ringbuffer_commit(&rb, got);
+        got = ringbuffer_peek(&rb, FRAME_20MS, &span);
+        ringbuffer_consume(&rb, got);
+    }
+    uint64_t zc_ns = now_ns() - t0;
+    a0.report(sec);
+
+    const double samples = (double)iters * FRAME_20MS;
+    metric(sec, "copy_msamples_per_s", samples / (copy_ns / 1e9) / 1e6, "M/s");
+    metric(sec, "copy_ns_per_20ms_chunk", (double)copy_ns / iters, "ns");
+    metric(sec, "zerocopy_msamples_per_s", samples / (zc_ns / 1e9) / 1e6, "M/s");
+    metric(sec, "zerocopy_ns_per_20ms_chunk", (double)zc_ns / iters, "ns");
+    ringbuffer_free(&rb);
+
+    // 多通道（MMR=3通道，10ms块，与I2S→AFE一致）
+    pcm_mc_ringbuffer_t mc = {};
+    if (!mc_ringbuffer_init(&mc, 4096, 3)) return 1;
+    const size_t chunk = SAMPLE_RATE / 100;
+    t0 = now_ns();
+    for (int i = 0; i < iters; i++) {
+        size_t got = mc_ringbuffer_reserve(&mc, chunk, &span);
+        mc_ringbuffer_commit(&mc, got);
+        got = mc_ringbuffer_peek(&mc, chunk, &span);
+        mc_ringbuffer_consume(&mc, got);
+    }
+    uint64_t mc_ns = now_ns() - t0;
+    metric(sec, "mc3_ns_per_10ms_chunk", (double)mc_ns / iters, "ns");
+    mc_ringbuffer_free(&mc);
+    return 0;
+}
+
+// ============================================================================
+// pool：内存池
+// ============================================================================
+
+static bool s_pools_ready = false;
+
+static bool ensure_pools() {
+    if (!s_pools_ready) s_pools_ready = init_memory_pools();
+    return s_pools_ready;
+}
+
+static int bench_pool() {
+    const char* sec = "pool";
+    section(sec);
+    if (!ensure_pools()) return 1;
+
+    static const char* kNames[POOL_COUNT] = {"s64", "s128", "s256", "l2k", "l4k"};
+    const int iters = 500000;
+
+    pool_stats_t st;
+    pool_get_stats(POOL_S_64, &st);
+    std::vector<void*> held;
+    held.reserve(st.block_count);
+    uint64_t cycle_ns[POOL_COUNT];
+
+    AllocSnapshot a0 = AllocSnapshot::take();
+    for (int t = 0; t < POOL_COUNT; t++) {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < iters; i++) {
+            void* p = pool_alloc((pool_type_t)t);
+            pool_free(p);
+        }
+        cycle_ns[t] = now_ns() - t0;
+    }
+
+    // 共享块：retain + 两次free（WS接收帧被播放切片共享的路径）
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < iters; i++) {
+        void* p = pool_alloc(POOL_S_256);
+        pool_retain(p);
+        pool_free(p);
+        pool_free(p);
+    }
+    const uint64_t shared_ns = now_ns() - t0;
+
+    // 占满后的分配（最坏情况：扫描整个位图后返回NULL）
+    while (void* p = pool_alloc(POOL_S_64)) held.push_back(p);
+    t0 = now_ns();
+    for (int i = 0; i < 10000; i++) pool_alloc(POOL_S_64);
+    const uint64_t exhausted_ns = now_ns() - t0;
+    for (void* p : held) pool_free(p);
+    a0.report(sec);
+
+    for (int t = 0; t < POOL_COUNT; t++) {
+        metric(sec, (std::string(kNames[t]) + "_alloc_free_ns").c_str(), (double)cycle_ns[t] / iters, "ns");
+    }
+    metric(sec, "s256_shared_cycle_ns", (double)shared_ns / iters, "ns");
+    metric(sec, "s64_exhausted_alloc_ns", (double)exhausted_ns / 10000, "ns");
+
+    for (int t = 0; t < POOL_COUNT; t++) {
+        pool_get_stats((pool_type_t)t, &st);
+        if (st.used != 0) {
+            ESP_LOGE(TAG, "pool %s leaked %u blocks", kNames[t], st.used);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ============================================================================
+// batch：WS下行trace回放
+// ============================================================================
+
+// trace文件：8字节魔数 + 记录 [u32 LE rx_us][u8 kind][u32 LE len][payload]
+static const char TRACE_MAGIC[8] = {'H', 'T', 'W', 'S', 'T', 'R', 'C', '1'};
+enum : uint8_t { TRACE_BINARY = 1, TRACE_TEXT = 2 };
+
+struct TraceFrame {
+    uint32_t rx_us;
+    uint8_t kind;
+    std::vector<uint8_t> data;
+};
+
+static void put_le32(std::vector<uint8_t>& v, uint32_t x) {
+    for (int i = 0; i < 4; i++) v.push_back((uint8_t)(x >> (8 * i)));
+}
+
+static uint32_t get_le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool load_trace(const char* path, std::vector<TraceFrame>* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return false;
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+        ESP_LOGE(TAG, "%s: bad trace magic", path);
+        fclose(f);
+        return false;
+    }
+    uint8_t hdr[9];
+    while (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr)) {
+        TraceFrame fr;
+        fr.rx_us = get_le32(hdr);
+        fr.kind = hdr[4];
+        fr.data.resize(get_le32(hdr + 5));
+        if (fread(fr.data.data(), 1, fr.data.size(), f) != fr.data.size()) {
+            ESP_LOGW(TAG, "%s: truncated record at frame %zu", path, out->size());
+            break;
+        }
+        out->push_back(std::move(fr));
+    }
+    fclose(f);
+    return true;
+}
+
+// 合成TTS会话：tts_start(二进制控制帧) + 每100ms一个5包批量帧 + tts_end，到达时间带抖动
+static std::vector<TraceFrame> synth_trace() {
+    std::vector<TraceFrame> frames;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> jitter(-15000, 40000);
+
+    std::vector<std::vector<uint8_t>> packets;
+#if HOST_BENCH_OPUS
+    OpusEncoder enc;
+    enc.init(SAMPLE_RATE, 1, 32000);
+    std::vector<int16_t> pcm = synth_speech();
+    uint8_t buf[512];
+    for (size_t off = 0; off + FRAME_20MS <= pcm.size() && packets.size() < 1000; off += FRAME_20MS) {
+        int n = enc.encode(&pcm[off], FRAME_20MS, buf, sizeof(buf));
+        if (n > 0) packets.emplace_back(buf, buf + n);
+    }
+#else
+    std::uniform_int_distribution<int> plen(40, 120);
+    for (int i = 0; i < 1000; i++) {
+        std::vector<uint8_t> p(plen(rng));
+        for (auto& b : p) b = (uint8_t)rng();
+        packets.push_back(std::move(p));
+    }
+#endif
+
+    auto ctrl = [&](uint8_t id, uint32_t rx_us) {
+        uint8_t buf[64];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, buf, sizeof(buf), id);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_SESSION_ID, "bench");
+        ws_ctrl_end(&w);
+        frames.push_back({rx_us, TRACE_BINARY, std::vector<uint8_t>(buf, buf + w.len)});
+    };
+
+    uint32_t t = 1000;
+    ctrl(WS_CTRL_MSG_TTS_START, t);
+    for (size_t i = 0; i < packets.size(); i += 5) {
+        TraceFrame fr = {t + (uint32_t)std::max(0, 100000 + jitter(rng)), TRACE_BINARY, {}};
+        for (size_t j = i; j < i + 5 && j < packets.size(); j++) {
+            fr.data.push_back((uint8_t)(packets[j].size() >> 8));
+            fr.data.push_back((uint8_t)packets[j].size());
+            fr.data.insert(fr.data.end(), packets[j].begin(), packets[j].end());
+        }
+        t = fr.rx_us;
+        frames.push_back(std::move(fr));
+    }
+    ctrl(WS_CTRL_MSG_TTS_END, t + 20000);
+    return frames;
+}
+
+static int gen_trace(const char* path) {
+    std::vector<TraceFrame> frames = synth_trace();
+    std::vector<uint8_t> out(TRACE_MAGIC, TRACE_MAGIC + 8);
+    for (const TraceFrame& fr : frames) {
+        put_le32(out, fr.rx_us);
+        out.push_back(fr.kind);
+        put_le32(out, (uint32_t)fr.data.size());
+        out.insert(out.end(), fr.data.begin(), fr.data.end());
+    }
+    FILE* f = fopen(path, "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+        ESP_LOGE(TAG, "Cannot write %s", path);
+        if (f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+    printf("wrote %zu frames (%zu bytes) to %s\n", frames.size(), out.size(), path);
+    return 0;
+}
+
+static int bench_batch(const char* path) {
+    const char* sec = "batch";
+    section(sec);
+    if (!ensure_pools()) return 1;
+
+    std::vector<TraceFrame> frames;
+    if (path) {
+        if (!load_trace(path, &frames)) return 1;
+        note("input: %s (%zu frames)", path, frames.size());
+    } else {
+        frames = synth_trace();
+        note("input: synthetic TTS trace (%zu frames)", frames.size());
+    }
+
+#if HOST_BENCH_OPUS
+    OpusDecoder dec;
+    dec.init(SAMPLE_RATE, 1);
+    std::vector<int16_t> pcm(dec.frame_size() * 2);
+    FrameTimes dec_times(frames.size() * 8);
+#endif
+    FrameTimes parse_times(frames.size());
+    uint32_t packets = 0, ctrl_msgs = 0, text_frames = 0, malformed = 0, pool_fail = 0;
+    uint64_t payload_bytes = 0, parse_total_ns = 0;
+    uint32_t max_gap_us = 0;
+
+    AllocSnapshot a0 = AllocSnapshot::take();
+    for (size_t i = 0; i < frames.size(); i++) {
+        const TraceFrame& fr = frames[i];
+        if (i > 0 && fr.rx_us - frames[i - 1].rx_us > max_gap_us) max_gap_us = fr.rx_us - frames[i - 1].rx_us;
+        if (fr.kind != TRACE_BINARY) {
+            text_frames++;
+            continue;
+        }
+        const uint8_t* data = fr.data.data();
+        const size_t len = fr.data.size();
+
+        uint64_t t0 = now_ns();
+        if (ws_ctrl_is_frame(data, len)) {
+            size_t offset = 0;
+            ws_ctrl_msg_view_t msg;
+            while (ws_ctrl_next(data, len, &offset, &msg)) ctrl_msgs++;
+            if (offset != len) malformed++;
+            parse_times.add(now_ns() - t0);
+            continue;
+        }
+
+        // 与handle_ws_binary相同：整帧复制到池块，包切片共享该块
+        void* block = pool_alloc_by_size(len);
+        if (!block) {
+            pool_fail++;
+            continue;
+        }
+        memcpy(block, data, len);
+        size_t offset = 0, pkt_offset = 0;
+        uint16_t pkt_len = 0;
+        uint32_t frame_pkts = 0;
+        while (ws_batch_next((const uint8_t*)block, len, &offset, &pkt_offset, &pkt_len)) {
+            pool_retain(block);
+            frame_pkts++;
+            payload_bytes += pkt_len;
+        }
+        if (offset != len) malformed++;
+        uint64_t parse_ns = now_ns() - t0;
+        parse_times.add(parse_ns);
+        parse_total_ns += parse_ns;
+        packets += frame_pkts;
+
+#if HOST_BENCH_OPUS
+        offset = 0;
+        while (ws_batch_next((const uint8_t*)block, len, &offset, &pkt_offset, &pkt_len)) {
+            uint64_t d0 = now_ns();
+            dec.decode((const uint8_t*)block + pkt_offset, pkt_len, pcm.data(), pcm.size());
+            dec_times.add(now_ns() - d0);
+        }
+#endif
+        for (uint32_t k = 0; k < frame_pkts; k++) pool_free(block);
+        pool_free(block);
+    }
+    a0.report(sec);
+
+    metric(sec, "packets", packets, "");
+    metric(sec, "ctrl_msgs", ctrl_msgs, "");
+    metric(sec, "text_frames", text_frames, "");
+    metric(sec, "malformed_frames", malformed, "");
+    metric(sec, "pool_alloc_failures", pool_fail, "");
+    metric(sec, "max_arrival_gap", max_gap_us / 1000.0, "ms");
+    if (parse_total_ns > 0) {
+        metric(sec, "parse_mb_per_s", payload_bytes / (parse_total_ns / 1e9) / 1e6, "MB/s");
+    }
+    parse_times.report(sec, "parse_per_frame");
+#if HOST_BENCH_OPUS
+    dec_times.report(sec, "decode_per_packet");
+#else
+    note("opus decode skipped (built without libopus)");
+#endif
+    return malformed > 0 && !path ? 1 : 0;
+}
+
+// ============================================================================
+// opus：编码/解码/PLC
+// ============================================================================
+
+static int bench_opus(const char* wav) {
+    const char* sec = "opus";
+    section(sec);
+#if HOST_BENCH_OPUS
+    std::vector<int16_t> pcm = load_or_synth(wav);
+    const size_t frames = pcm.size() / FRAME_20MS;
+
+    // 与OpusRateController的档位一致
+    static const struct { const char* name; OpusEncoder::Params params; } kProfiles[] = {
+        {"high", {48000, 8, false}},
+        {"normal", {32000, 5, false}},
+        {"low", {24000, 3, true}},
+        {"min", {16000, 1, true}},
+    };
+
+    for (const auto& prof : kProfiles) {
+        OpusEncoder enc;
+        if (!enc.init(SAMPLE_RATE, 1, prof.params.bitrate) || !enc.apply(prof.params, true)) return 1;
+        OpusDecoder dec;
+        if (!dec.init(SAMPLE_RATE, 1)) return 1;
+
+        std::vector<std::vector<uint8_t>> packets;
+        packets.reserve(frames);
+        FrameTimes enc_times(frames), dec_times(frames), plc_times(frames / 10 + 1);
+        std::vector<int16_t> out(dec.frame_size() * 2);
+        uint8_t buf[512];
+        uint64_t bytes = 0;
+
+        for (size_t i = 0; i < frames; i++) {
+            uint64_t t0 = now_ns();
+            int n = enc.encode(&pcm[i * FRAME_20MS], FRAME_20MS, buf, sizeof(buf));
+            enc_times.add(now_ns() - t0);
+            if (n < 0) return 1;
+            bytes += n;
+            packets.emplace_back(buf, buf + n);
+        }
+
+        AllocSnapshot a0 = AllocSnapshot::take();
+        for (size_t i = 0; i < packets.size(); i++) {
+            uint64_t t0 = now_ns();
+            if (i % 10 == 9) {
+                // 每10包丢1包：PLC补偿
+                dec.conceal(nullptr, 0, out.data(), out.size());
+                plc_times.add(now_ns() - t0);
+                continue;
+            }
+            if (!packets[i].empty()) dec.decode(packets[i].data(), packets[i].size(), out.data(), out.size());
+            dec_times.add(now_ns() - t0);
+        }
+
+        std::string sub = std::string(sec) + "." + prof.name;
+        note("profile %s: %dbps c%d dtx=%d", prof.name, prof.params.bitrate, prof.params.complexity,
+             prof.params.dtx);
+        a0.report(sub.c_str());
+        metric(sub.c_str(), "bytes_per_frame", (double)bytes / frames, "B");
+        enc_times.report(sub.c_str(), "encode");
+        dec_times.report(sub.c_str(), "decode");
+        plc_times.report(sub.c_str(), "plc");
+    }
+    return 0;
+#else
+    (void)wav;
+    note("skipped (built without libopus)");
+    return 0;
+#endif
+}
+
+// ============================================================================
+// vad：端点判断
+// ============================================================================
+
+static const char* endpoint_name(VadEndpointer::Result r) {
+    switch (r) {
+        case VadEndpointer::Result::SILENCE:      return "silence";
+        case VadEndpointer::Result::TOO_SHORT:    return "too_short";
+        case VadEndpointer::Result::MAX_DURATION: return "max_duration";
+        default:                                  return "none";
+    }
+}
+
+static int bench_vad(const char* wav) {
+    const char* sec = "vad";
+    section(sec);
+    std::vector<int16_t> pcm = load_or_synth(wav);
+
+    // 与audio_main_task的端点参数一致；能量门限代替AFE VAD（-40dBFS）
+    VadEndpointer ep({800, 500, 10000});
+    const double threshold = 32768.0 * pow(10.0, -40.0 / 20.0);
+    const size_t frames = pcm.size() / FRAME_20MS;
+
+    uint32_t counts[4] = {};
+    uint32_t last_voice_ms = 0;
+    uint64_t delay_sum_ms = 0;
+    uint32_t delay_count = 0;
+    uint64_t update_ns = 0;
+
+    for (size_t i = 0; i < frames; i++) {
+        const int16_t* f = &pcm[i * FRAME_20MS];
+        double energy = 0;
+        for (int k = 0; k < FRAME_20MS; k++) energy += (double)f[k] * f[k];
+        const bool voice = sqrt(energy / FRAME_20MS) > threshold;
+        const uint32_t now_ms = (uint32_t)((i + 1) * 20);
+
+        if (voice) last_voice_ms = now_ms;
+        if (!ep.active()) {
+            if (voice) ep.start(now_ms);  // 代替唤醒词：第一帧语音开始录音
+            continue;
+        }
+
+        const uint32_t recorded_ms = ep.duration_ms(now_ms);
+        uint64_t t0 = now_ns();
+        VadEndpointer::Result r = ep.update(now_ms, voice);
+        update_ns += now_ns() - t0;
+        if (r == VadEndpointer::Result::NONE) continue;
+
+        counts[(int)r]++;
+        note("endpoint @%6.2fs: %-12s recorded=%ums, since_last_voice=%ums",
+             now_ms / 1000.0, endpoint_name(r), recorded_ms, now_ms - last_voice_ms);
+        if (r != VadEndpointer::Result::MAX_DURATION) {
+            delay_sum_ms += now_ms - last_voice_ms;
+            delay_count++;
+        }
+    }
+
+    metric(sec, "endpoints_silence", counts[(int)VadEndpointer::Result::SILENCE], "");
+    metric(sec, "endpoints_too_short", counts[(int)VadEndpointer::Result::TOO_SHORT], "");
+    metric(sec, "endpoints_max_duration", counts[(int)VadEndpointer::Result::MAX_DURATION], "");
+    if (delay_count) metric(sec, "avg_endpoint_delay", (double)delay_sum_ms / delay_count, "ms");
+    if (frames) metric(sec, "update_ns", (double)update_ns / frames, "ns");
+    return 0;
+}
+
+// ============================================================================
+// stress：并发正确性
+// ============================================================================
+
+// 生产者按递增序列写入（拷贝/零拷贝交替，随机块长），消费者逐样本校验
+static bool stress_ring(double seconds) {
+    const char* sec = "stress.ring";
+    section(sec);
+
+    pcm_ringbuffer_t rb = {};
+    if (!ringbuffer_init(&rb, 4096)) return false;
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> produced(0);
+    uint64_t consumed = 0, errors = 0;
+
+    std::thread producer([&]() {
+        std::mt19937 rng(1);
+        std::vector<int16_t> buf(1024);
+        uint16_t seq = 0;
+        uint64_t total = 0;
+        const uint64_t end = now_ns() + (uint64_t)(seconds * 1e9);
+        while (now_ns() < end) {
+            size_t n = 1 + rng() % buf.size();
+            if (rng() & 1) {
+                for (size_t i = 0; i < n; i++) buf[i] = (int16_t)(seq + i);
+                size_t w = ringbuffer_write(&rb, buf.data(), n);
+                if (w == 0) std::this_thread::yield();
+                seq += w;
+                total += w;
+            } else {
+                ringbuffer_span_t span;
+                size_t got = ringbuffer_reserve(&rb, n, &span);
+                for (size_t i = 0; i < span.len1; i++) span.ptr1[i] = (int16_t)seq++;
+                for (size_t i = 0; i < span.len2; i++) span.ptr2[i] = (int16_t)seq++;
+                ringbuffer_commit(&rb, got);
+                total += got;
+            }
+            produced.store(total, std::memory_order_release);
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    std::mt19937 rng(2);
+    std::vector<int16_t> buf(1024);
+    uint16_t expect = 0;
+    auto check = [&](const int16_t* p, size_t n) {
+        for (size_t i = 0; i < n; i++, expect++) {
+            if ((uint16_t)p[i] != expect) {
+                if (errors++ < 5) ESP_LOGE(TAG, "ring: sample %llu = %u, expected %u",
+                                           (unsigned long long)(consumed + i), (uint16_t)p[i], expect);
+                expect = (uint16_t)p[i];
+            }
+        }
+    };
+    while (!done.load(std::memory_order_acquire) || consumed < produced.load(std::memory_order_acquire)) {
+        size_t n = 1 + rng() % buf.size();
+        size_t got;
+        if (rng() & 1) {
+            got = ringbuffer_read(&rb, buf.data(), n);
+            check(buf.data(), got);
+        } else {
+            ringbuffer_span_t span;
+            got = ringbuffer_peek(&rb, n, &span);
+            check(span.ptr1, span.len1);
+            if (span.ptr2) check(span.ptr2, span.len2);
+            ringbuffer_consume(&rb, got);
+        }
+        if (got == 0) std::this_thread::yield();
+        consumed += got;
+    }
+    producer.join();
+    ringbuffer_free(&rb);
+
+    metric(sec, "samples", (double)consumed, "");
+    metric(sec, "msamples_per_s", consumed / seconds / 1e6, "M/s");
+    metric(sec, "sequence_errors", (double)errors, "");
+    return errors == 0 && consumed == produced.load();
+}
+
+// 多线程随机分配/共享/释放，块内写入持有者标记，释放前校验（检测重复分配和提前释放）
+static bool stress_pool(double seconds) {
+    const char* sec = "stress.pool";
+    section(sec);
+    if (!ensure_pools()) return false;
+
+    const int THREADS = 4;
+    std::atomic<uint64_t> errors(0), ops(0);
+    pool_stats_t before[POOL_COUNT];
+    for (int t = 0; t < POOL_COUNT; t++) pool_get_stats((pool_type_t)t, &before[t]);
+
+    auto worker = [&](int id) {
+        std::mt19937 rng(100 + id);
+        struct Held { uint8_t* p; uint32_t tag; int refs; };
+        Held held[8];
+        int count = 0;
+        uint32_t tag = (uint32_t)id << 24;
+        uint64_t local_ops = 0;
+        const uint64_t end = now_ns() + (uint64_t)(seconds * 1e9);
+
+        auto verify = [&](const Held& h) {
+            uint32_t v;
+            memcpy(&v, h.p, sizeof(v));
+            if (v != h.tag) {
+                if (errors.fetch_add(1) < 5) ESP_LOGE(TAG, "pool: block %p tag %08x, expected %08x", h.p, v, h.tag);
+            }
+        };
+
+        while (now_ns() < end) {
+            if (count < 8 && (count == 0 || (rng() & 1))) {
+                uint8_t* p = (uint8_t*)pool_alloc((pool_type_t)(rng() % POOL_COUNT));
+                if (!p) continue;  // 小池被其他线程占满是正常的
+                Held h = {p, ++tag, 1};
+                memcpy(p, &h.tag, sizeof(h.tag));
+                if (pool_owner(p) >= POOL_S_256 && (rng() & 1) && pool_retain(p)) h.refs = 2;
+                held[count++] = h;
+            } else {
+                int i = rng() % count;
+                verify(held[i]);
+                pool_free(held[i].p);
+                if (--held[i].refs == 0) held[i] = held[--count];  // 还有引用时块仍属于本线程
+            }
+            local_ops++;
+        }
+        for (int i = 0; i < count; i++) {
+            verify(held[i]);
+            while (held[i].refs-- > 0) pool_free(held[i].p);
+        }
+        ops.fetch_add(local_ops);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREADS; i++) threads.emplace_back(worker, i);
+    for (auto& t : threads) t.join();
+
+    uint64_t leaked = 0, exhausted = 0;
+    for (int t = 0; t < POOL_COUNT; t++) {
+        pool_stats_t st;
+        pool_get_stats((pool_type_t)t, &st);
+        leaked += st.used;
+        exhausted += st.exhausted - before[t].exhausted;
+    }
+
+    metric(sec, "threads", THREADS, "");
+    metric(sec, "mops_per_s", ops.load() / seconds / 1e6, "M/s");
+    metric(sec, "exhausted", (double)exhausted, "");
+    metric(sec, "tag_errors", (double)errors.load(), "");
+    metric(sec, "leaked_blocks", (double)leaked, "");
+    return errors.load() == 0 && leaked == 0;
+}
+
+// ============================================================================
+// main
+// ============================================================================
+
+static void usage() {
+    fprintf(stderr,
+            "usage: hitony_bench [--json] [-v] <mode> [args]\n"
+            "  ring | pool | batch [trace.bin] | gen-trace <out.bin> | opus [in.wav] | vad [in.wav]\n"
+            "  stress [seconds] | all\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            s_json = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            g_host_log_level++;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    const std::string mode = args.empty() ? "all" : args[0];
+    const char* arg = args.size() > 1 ? args[1] : nullptr;
+
+    int rc = 0;
+    if (mode == "ring") {
+        rc = bench_ring();
+    } else if (mode == "pool") {
+        rc = bench_pool();
+    } else if (mode == "batch") {
+        rc = bench_batch(arg);
+    } else if (mode == "gen-trace") {
+        if (!arg) {
+            usage();
+            return 2;
+        }
+        return gen_trace(arg);
+    } else if (mode == "opus") {
+        rc = bench_opus(arg);
+    } else if (mode == "vad") {
+        rc = bench_vad(arg);
+    } else if (mode == "stress") {
+        double seconds = arg ? atof(arg) : 2.0;
+        if (seconds <= 0) seconds = 2.0;
+        bool ok = stress_ring(seconds);
+        ok = stress_pool(seconds) && ok;
+        rc = ok ? 0 : 1;
+    } else if (mode == "all") {
+        rc |= bench_ring();
+        rc |= bench_pool();
+        rc |= bench_batch(nullptr);
+        rc |= bench_opus(nullptr);
+        rc |= bench_vad(nullptr);
+        bool ok = stress_ring(2.0);
+        ok = stress_pool(2.0) && ok;
+        rc |= ok ? 0 : 1;
+    } else {
+        usage();
+        return 2;
+    }
+
+    if (s_json) print_json();
+    if (rc != 0) fprintf(stderr, "FAILED\n");
+    return rc;
+}
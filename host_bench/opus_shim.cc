@@ -0,0 +1,171 @@
+// esp_audio_codec Opus接口的主机实现（基于libopus），让main/opus_encoder.cc、opus_decoder.cc原样编译
+// （本文件只包含libopus头文件：libopus的OpusEncoder/OpusDecoder类型与固件的同名类不能同时出现）
+// 注意：测到的是主机libopus的耗时，只用于同一台机器上的前后对比，不代表ESP32-S3上的绝对值
+
+#include "esp_opus_enc.h"
+#include "esp_opus_dec.h"
+#include <opus.h>
+#include <new>
+
+namespace {
+
+struct HostOpusEnc {
+    OpusEncoder* enc;
+    int channels;
+    int frame_samples;   // 每通道样本数
+};
+
+struct HostOpusDec {
+    OpusDecoder* dec;
+    int channels;
+    int max_samples;     // 每通道最大输出（120ms）
+    int last_samples;    // 上一帧每通道样本数（FEC/PLC按此长度补偿）
+};
+
+int frame_ms_x10(esp_opus_enc_frame_duration_t d) {
+    switch (d) {
+        case ESP_OPUS_ENC_FRAME_DURATION_2_5_MS: return 25;
+        case ESP_OPUS_ENC_FRAME_DURATION_5_MS:   return 50;
+        case ESP_OPUS_ENC_FRAME_DURATION_10_MS:  return 100;
+        case ESP_OPUS_ENC_FRAME_DURATION_40_MS:  return 400;
+        case ESP_OPUS_ENC_FRAME_DURATION_60_MS:  return 600;
+        default:                                 return 200;
+    }
+}
+
+}  // namespace
+
+// ============================================================================
+// 编码器
+// ============================================================================
+
+esp_audio_err_t esp_opus_enc_open(void* cfg, uint32_t cfg_sz, void** enc_hd) {
+    if (!cfg || cfg_sz != sizeof(esp_opus_enc_config_t) || !enc_hd) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    const esp_opus_enc_config_t* c = (const esp_opus_enc_config_t*)cfg;
+
+    int app = c->application_mode == ESP_OPUS_ENC_APPLICATION_AUDIO ? OPUS_APPLICATION_AUDIO :
+              c->application_mode == ESP_OPUS_ENC_APPLICATION_LOWDELAY ? OPUS_APPLICATION_RESTRICTED_LOWDELAY :
+              OPUS_APPLICATION_VOIP;
+    int err = OPUS_OK;
+    OpusEncoder* enc = opus_encoder_create(c->sample_rate, c->channel, app, &err);
+    if (err != OPUS_OK || !enc) return ESP_AUDIO_ERR_FAIL;
+
+    opus_encoder_ctl(enc, OPUS_SET_BITRATE(c->bitrate));
+    opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(c->complexity));
+    opus_encoder_ctl(enc, OPUS_SET_INBAND_FEC(c->enable_fec ? 1 : 0));
+    opus_encoder_ctl(enc, OPUS_SET_DTX(c->enable_dtx ? 1 : 0));
+    opus_encoder_ctl(enc, OPUS_SET_VBR(c->enable_vbr ? 1 : 0));
+    if (c->enable_fec) opus_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(10));
+
+    HostOpusEnc* h = new (std::nothrow) HostOpusEnc{enc, c->channel,
+                                                    c->sample_rate * frame_ms_x10(c->frame_duration) / 10000};
+    if (!h) {
+        opus_encoder_destroy(enc);
+        return ESP_AUDIO_ERR_MEM_LACK;
+    }
+    *enc_hd = h;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_get_frame_size(void* enc_hd, int* in_size, int* out_size) {
+    HostOpusEnc* h = (HostOpusEnc*)enc_hd;
+    if (!h || !in_size || !out_size) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    *in_size = h->frame_samples * h->channels * (int)sizeof(int16_t);
+    *out_size = 1276 * 3;  // libopus单帧上限 × 3（与esp_audio_codec一致的保守值）
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_set_bitrate(void* enc_hd, int bitrate) {
+    HostOpusEnc* h = (HostOpusEnc*)enc_hd;
+    if (!h) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    return opus_encoder_ctl(h->enc, OPUS_SET_BITRATE(bitrate)) == OPUS_OK ? ESP_AUDIO_ERR_OK : ESP_AUDIO_ERR_FAIL;
+}
+
+esp_audio_err_t esp_opus_enc_process(void* enc_hd, esp_audio_enc_in_frame_t* in_frame,
+                                     esp_audio_enc_out_frame_t* out_frame) {
+    HostOpusEnc* h = (HostOpusEnc*)enc_hd;
+    if (!h || !in_frame || !out_frame) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    if (in_frame->len < (uint32_t)(h->frame_samples * h->channels * sizeof(int16_t))) {
+        return ESP_AUDIO_ERR_BUFF_NOT_ENOUGH;
+    }
+
+    opus_int32 n = opus_encode(h->enc, (const opus_int16*)in_frame->buffer, h->frame_samples,
+                               out_frame->buffer, (opus_int32)out_frame->len);
+    if (n < 0) return n == OPUS_BUFFER_TOO_SMALL ? ESP_AUDIO_ERR_BUFF_NOT_ENOUGH : ESP_AUDIO_ERR_FAIL;
+    out_frame->encoded_bytes = (uint32_t)n;
+    return ESP_AUDIO_ERR_OK;
+}
+
+void esp_opus_enc_close(void* enc_hd) {
+    HostOpusEnc* h = (HostOpusEnc*)enc_hd;
+    if (!h) return;
+    opus_encoder_destroy(h->enc);
+    delete h;
+}
+
+// ============================================================================
+// 解码器
+// ============================================================================
+
+esp_audio_err_t esp_opus_dec_open(void* cfg, uint32_t cfg_sz, void** dec_handle) {
+    if (!cfg || cfg_sz != sizeof(esp_opus_dec_cfg_t) || !dec_handle) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    const esp_opus_dec_cfg_t* c = (const esp_opus_dec_cfg_t*)cfg;
+    if (c->self_delimited) return ESP_AUDIO_ERR_INVALID_PARAMETER;  // 固件不用，主机不实现
+
+    int err = OPUS_OK;
+    OpusDecoder* dec = opus_decoder_create((opus_int32)c->sample_rate, c->channel, &err);
+    if (err != OPUS_OK || !dec) return ESP_AUDIO_ERR_FAIL;
+
+    HostOpusDec* h = new (std::nothrow) HostOpusDec{dec, c->channel, (int)c->sample_rate * 120 / 1000,
+                                                    (int)c->sample_rate * 20 / 1000};
+    if (!h) {
+        opus_decoder_destroy(dec);
+        return ESP_AUDIO_ERR_MEM_LACK;
+    }
+    *dec_handle = h;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_decode(void* dec_handle, esp_audio_dec_in_raw_t* raw,
+                                    esp_audio_dec_out_frame_t* out_frame, esp_audio_dec_info_t* dec_info) {
+    HostOpusDec* h = (HostOpusDec*)dec_handle;
+    if (!h || !raw || !out_frame || !out_frame->buffer) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+
+    int cap = (int)(out_frame->len / (h->channels * sizeof(int16_t)));
+    if (cap > h->max_samples) cap = h->max_samples;
+    opus_int16* pcm = (opus_int16*)out_frame->buffer;
+
+    int n;
+    if (raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_PLC) {
+        // 有数据：用下一包的带内FEC重建丢失帧；无数据：PLC。长度按上一帧
+        int want = h->last_samples < cap ? h->last_samples : cap;
+        if (raw->buffer && raw->len > 0) {
+            n = opus_decode(h->dec, raw->buffer, (opus_int32)raw->len, pcm, want, 1);
+        } else {
+            n = opus_decode(h->dec, nullptr, 0, pcm, want, 0);
+        }
+        raw->consumed = 0;  // 补偿不消耗数据，下一包仍需正常解码
+    } else {
+        if (!raw->buffer || raw->len == 0) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+        n = opus_decode(h->dec, raw->buffer, (opus_int32)raw->len, pcm, cap, 0);
+        if (n > 0) h->last_samples = n;
+        raw->consumed = raw->len;
+    }
+    if (n < 0) return n == OPUS_BUFFER_TOO_SMALL ? ESP_AUDIO_ERR_BUFF_NOT_ENOUGH : ESP_AUDIO_ERR_FAIL;
+
+    out_frame->decoded_size = (uint32_t)(n * h->channels * sizeof(int16_t));
+    if (dec_info) {
+        dec_info->channel = (uint8_t)h->channels;
+        dec_info->bits_per_sample = 16;
+        dec_info->frame_size = out_frame->decoded_size;
+    }
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_close(void* dec_handle) {
+    HostOpusDec* h = (HostOpusDec*)dec_handle;
+    if (!h) return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    opus_decoder_destroy(h->dec);
+    delete h;
+    return ESP_AUDIO_ERR_OK;
+}
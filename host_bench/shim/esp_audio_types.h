@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// esp_audio_codec的公共类型（只保留opus_encoder.cc / opus_decoder.cc用到的部分）
+typedef enum {
+    ESP_AUDIO_ERR_OK = 0,
+    ESP_AUDIO_ERR_FAIL = -1,
+    ESP_AUDIO_ERR_MEM_LACK = -2,
+    ESP_AUDIO_ERR_INVALID_PARAMETER = -4,
+    ESP_AUDIO_ERR_BUFF_NOT_ENOUGH = -6,
+} esp_audio_err_t;
+
+#define ESP_AUDIO_SAMPLE_RATE_8K   8000
+#define ESP_AUDIO_SAMPLE_RATE_16K  16000
+#define ESP_AUDIO_SAMPLE_RATE_24K  24000
+#define ESP_AUDIO_SAMPLE_RATE_48K  48000
+
+#define ESP_AUDIO_MONO  1
+#define ESP_AUDIO_DUAL  2
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdlib.h>
+#include "host_shim.h"
+
+// 主机上所有capability都落到malloc，只统计次数和字节数
+#define MALLOC_CAP_8BIT      (1 << 2)
+#define MALLOC_CAP_DMA       (1 << 3)
+#define MALLOC_CAP_SPIRAM    (1 << 10)
+#define MALLOC_CAP_INTERNAL  (1 << 11)
+#define MALLOC_CAP_DEFAULT   (1 << 12)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    __atomic_add_fetch(&g_host_allocs.heap_caps_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_host_allocs.heap_caps_bytes, size, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static inline void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    (void)caps;
+    __atomic_add_fetch(&g_host_allocs.heap_caps_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_host_allocs.heap_caps_bytes, n * size, __ATOMIC_RELAXED);
+    return calloc(n, size);
+}
+
+static inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    (void)caps;
+    __atomic_add_fetch(&g_host_allocs.heap_caps_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_host_allocs.heap_caps_bytes, size, __ATOMIC_RELAXED);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static inline void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+// 主机上视为内存充足（放置策略的HOT路径总能拿到"内部RAM"）
+static inline size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return (size_t)1 << 30;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    (void)caps;
+    return (size_t)1 << 30;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "host_shim.h"
+
+#define ESP_LOGE(tag, fmt, ...) host_log(0, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) host_log(1, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) host_log(2, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) host_log(3, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) do {} while (0)
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+static inline int64_t esp_timer_get_time() {
+    using namespace std::chrono;
+    static const steady_clock::time_point t0 = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_timer.h"
+
+// 主机上只提供类型和时钟：1 tick = 1ms，不在ISR中
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTICKS_TO_MS(t)  ((uint32_t)(t))
+
+static inline BaseType_t xPortInIsrContext() { return pdFALSE; }
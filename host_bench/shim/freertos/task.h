@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+
+static inline TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief 主机shim的共享状态：日志级别和分配计数（定义在bench_main.cc）
+ */
+
+// 0=仅错误 1=+警告 2=+信息 3=+调试
+extern int g_host_log_level;
+
+typedef struct {
+    uint64_t heap_caps_allocs;   // heap_caps_malloc/calloc次数（固件中的显式分配）
+    uint64_t heap_caps_bytes;
+    uint64_t new_allocs;         // operator new次数（C++容器等隐式分配）
+    uint64_t new_bytes;
+} host_alloc_counters_t;
+
+extern host_alloc_counters_t g_host_allocs;
+
+void host_log(int level, const char* tag, const char* fmt, ...);
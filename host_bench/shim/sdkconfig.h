@@ -0,0 +1,4 @@
+#pragma once
+
+// 主机基准用的最小sdkconfig：只定义被编进来的模块用到的选项
+#define CONFIG_ECHOEAR_PROFILER 0
@@ -1,6 +1,9 @@
 #include "advanced_afe.h"
 #include "task_manager.h"
+#include "audio_dsp.h"
+#include "diagnostics.h"
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <string.h>
 #include <esp_heap_caps.h>
 #include <esp_afe_sr_models.h>
@@ -15,6 +18,24 @@ static const char* TAG = "advanced_afe";
 // 使用全局AFE输出队列（定义在app_queues.cc）
 extern QueueHandle_t g_afe_output_queue;
 
+// AFE档位表（按AdvancedAFE::Profile顺序）
+// SE/BSS在init时已禁用，各档位都是单路AFE输出；只开关init时创建的模块
+struct AfeProfileSpec {
+    const char* name;
+    bool ns;
+    bool vad;
+    bool wakenet;
+    bool aec;       // 播放期间是否启用AEC
+};
+
+static const AfeProfileSpec kAfeProfiles[] = {
+    // name            NS     VAD    WakeNet AEC
+    {"idle-listen",    false, true,  true,   false},  // VAD保留给空闲VAD触发录音
+    {"conversation",   true,  true,  true,   true },
+    {"meeting",        true,  true,  false,  false},
+    {"music",          false, false, true,   true },  // AEC消除音乐回声，WakeNet打断
+};
+
 AdvancedAFE::AdvancedAFE() {
 }
 
@@ -193,6 +214,8 @@ bool AdvancedAFE::init(const Config& config) {
                  heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
     }
 
+    wakenet_init_ = afe_config->wakenet_init;
+
     // 7. 释放配置（afe_data_已经拷贝了配置）
     afe_config_free(afe_config);
     afe_config = nullptr;
@@ -221,10 +244,9 @@ bool AdvancedAFE::init(const Config& config) {
     afe_handle_->print_pipeline(afe_data_);
 
     // 分配临时缓冲区（使用total_channels_包含参考通道）
+    // 每次feed都可能经过（积累/跨环绕线性化），放内部RAM scratch arena而不是PSRAM
     temp_buffer_size_ = afe_chunk_size * total_channels_;
-    temp_buffer_ = (int16_t*)heap_caps_malloc(
-        temp_buffer_size_ * sizeof(int16_t),
-        MALLOC_CAP_SPIRAM);
+    temp_buffer_ = (int16_t*)scratch_alloc("afe.feed", temp_buffer_size_ * sizeof(int16_t));
 
     if (!temp_buffer_) {
         ESP_LOGE(TAG, "Failed to allocate temp buffer");
@@ -237,6 +259,14 @@ bool AdvancedAFE::init(const Config& config) {
         return false;
     }
 
+    // 模块初始开关状态与init配置一致，档位变更从这里开始做差量切换
+    ns_on_ = config_.enable_ns;
+    vad_on_ = config_.enable_vad;
+    wakenet_on_ = wakenet_init_;
+    aec_on_ = config_.enable_aec;
+    profile_ = requested_profile_ = Profile::CONVERSATION;
+    reconfig_pending_ = true;  // 按当前档位和播放状态收敛（空闲时关闭AEC）
+
     ESP_LOGI(TAG, "AFE ready");
     return true;
 }
@@ -250,7 +280,7 @@ void AdvancedAFE::deinit() {
     }
 
     if (temp_buffer_) {
-        heap_caps_free(temp_buffer_);
+        scratch_free(temp_buffer_);
         temp_buffer_ = nullptr;
     }
 
@@ -258,7 +288,7 @@ void AdvancedAFE::deinit() {
         // 清空队列
         int16_t* buf;
         while (xQueueReceive(input_queue_, &buf, 0) == pdTRUE) {
-            heap_caps_free(buf);
+            pool_free(buf);
         }
         vQueueDelete(input_queue_);
         input_queue_ = nullptr;
@@ -268,10 +298,7 @@ void AdvancedAFE::deinit() {
     if (output_queue_) {
         audio_data_msg_t* msg;
         while (xQueueReceive(output_queue_, &msg, 0) == pdTRUE) {
-            if (msg && msg->data) {
-                heap_caps_free(msg->data);
-            }
-            heap_caps_free(msg);
+            free_audio_msg(msg);
         }
         output_queue_ = nullptr;  // 不删除，只是解除引用
     }
@@ -312,26 +339,65 @@ void AdvancedAFE::stop() {
     }
 }
 
-void AdvancedAFE::enable_aec(bool enable) {
-    if (!afe_handle_ || !afe_data_) return;
-    if (enable) {
-        afe_handle_->enable_aec(afe_data_);
-        aec_counter_reset_ = true;  // 重置零输出计数器
-        ESP_LOGI(TAG, "AEC dynamically ENABLED (TTS playback)");
-    } else {
-        afe_handle_->disable_aec(afe_data_);
-        ESP_LOGI(TAG, "AEC dynamically DISABLED (idle/recording)");
-    }
+const char* AdvancedAFE::profile_name(Profile profile) {
+    return kAfeProfiles[(int)profile].name;
 }
 
-void AdvancedAFE::enable_wakenet(bool enable) {
-    if (!afe_handle_ || !afe_data_) return;
-    if (enable) {
-        afe_handle_->enable_wakenet(afe_data_);
-        ESP_LOGI(TAG, "WakeNet dynamically ENABLED (meeting ended)");
-    } else {
-        afe_handle_->disable_wakenet(afe_data_);
-        ESP_LOGI(TAG, "WakeNet dynamically DISABLED (meeting mode, saving CPU)");
+void AdvancedAFE::set_profile(Profile profile) {
+    requested_profile_ = profile;
+    reconfig_pending_ = true;
+    if (task_handle_) xTaskNotifyGive(task_handle_);
+}
+
+void AdvancedAFE::set_playback_active(bool active) {
+    playback_active_ = active;
+    reconfig_pending_ = true;
+    if (task_handle_) xTaskNotifyGive(task_handle_);
+}
+
+void AdvancedAFE::apply_reconfig() {
+    if (!reconfig_pending_) return;
+    reconfig_pending_ = false;
+
+    const Profile next = requested_profile_;
+    const AfeProfileSpec& spec = kAfeProfiles[(int)next];
+    const bool want_aec = spec.aec && playback_active_;
+
+    // 在两次feed之间切换：ESP-SR内部缓冲和输入/输出RingBuffer都不受影响
+    if (config_.enable_ns && spec.ns != ns_on_) {
+        spec.ns ? afe_handle_->enable_ns(afe_data_) : afe_handle_->disable_ns(afe_data_);
+        ns_on_ = spec.ns;
+    }
+    if (config_.enable_vad && spec.vad != vad_on_) {
+        spec.vad ? afe_handle_->enable_vad(afe_data_) : afe_handle_->disable_vad(afe_data_);
+        vad_on_ = spec.vad;
+        if (!vad_on_ && vad_active_) {
+            // 关闭VAD时结束进行中的语音段，避免状态停留在"有声"
+            vad_active_ = false;
+            if (vad_cb_) vad_cb_(false);
+        }
+    }
+    if (wakenet_init_ && spec.wakenet != wakenet_on_) {
+        spec.wakenet ? afe_handle_->enable_wakenet(afe_data_) : afe_handle_->disable_wakenet(afe_data_);
+        wakenet_on_ = spec.wakenet;
+    }
+    if (config_.enable_aec && want_aec != aec_on_) {
+        if (want_aec) {
+            afe_handle_->enable_aec(afe_data_);
+            aec_counter_reset_ = true;  // 重置零输出计数器
+        } else {
+            afe_handle_->disable_aec(afe_data_);
+        }
+        aec_on_ = want_aec;
+        ESP_LOGI(TAG, "AEC %s (profile %s, playback %s)", want_aec ? "ENABLED" : "DISABLED",
+                 spec.name, playback_active_ ? "on" : "off");
+    }
+
+    if (next != profile_) {
+        ESP_LOGI(TAG, "AFE profile %s -> %s (NS %s, VAD %s, WakeNet %s)",
+                 kAfeProfiles[(int)profile_].name, spec.name,
+                 ns_on_ ? "on" : "off", vad_on_ ? "on" : "off", wakenet_on_ ? "on" : "off");
+        profile_ = next;
     }
 }
 
@@ -354,7 +420,7 @@ void AdvancedAFE::feed(const int16_t* data, size_t samples) {
     // 发送到输入队列（非阻塞）
     if (xQueueSend(input_queue_, &buf, 0) != pdTRUE) {
         ESP_LOGW(TAG, "Input queue full, dropping frame");
-        pool_free(POOL_L_2K, buf);
+        pool_free(buf);
     }
 }
 
@@ -389,9 +455,41 @@ int AdvancedAFE::fetch(int16_t* out, size_t max_samples) {
     return 0;
 }
 
+void AdvancedAFE::notify_input() {
+    if (task_handle_) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void AdvancedAFE::flush_input() {
+    flush_input_ = true;
+    notify_input();
+}
+
+size_t AdvancedAFE::peek_output(size_t max_samples, ringbuffer_span_t* span) {
+    if (!config_.output_ring) return 0;
+    return ringbuffer_peek(config_.output_ring, max_samples, span);
+}
+
+void AdvancedAFE::consume_output(size_t samples) {
+    if (!config_.output_ring) return;
+    ringbuffer_consume(config_.output_ring, samples);
+}
+
+void AdvancedAFE::discard_output() {
+    if (!config_.output_ring) return;
+    size_t n = ringbuffer_data_available(config_.output_ring);
+    ringbuffer_consume(config_.output_ring, n);
+    out_stamps_.pop(n, nullptr);
+}
+
 void AdvancedAFE::afe_task(void* arg) {
     AdvancedAFE* self = (AdvancedAFE*)arg;
-    self->process_loop();
+    if (self->is_streaming()) {
+        self->process_stream_loop();
+    } else {
+        self->process_loop();
+    }
 }
 
 void AdvancedAFE::process_loop() {
@@ -420,9 +518,11 @@ void AdvancedAFE::process_loop() {
                 accumulated_samples += input_samples;
             }
 
-            pool_free(POOL_L_2K, input_buf);
+            pool_free(input_buf);
 
             // 当累积的样本达到AFE chunk size时，进行处理
+            apply_reconfig();
+
             size_t required_samples = afe_chunk_size * total_channels_;
             while (accumulated_samples >= required_samples) {
                 // 喂入AFE
@@ -434,99 +534,7 @@ void AdvancedAFE::process_loop() {
                 // 获取AFE输出
                 afe_fetch_result_t* res = afe_handle_->fetch(afe_data_);
                 if (res && res->data) {
-                    // 计算样本数（单声道）
-                    int samples = res->data_size / sizeof(int16_t);
-
-                    // AEC零输出检测：如果连续100帧全零，自动禁用AEC（防止MR格式bug）
-                    static uint32_t consecutive_zero_frames = 0;
-                    if (aec_counter_reset_) {
-                        consecutive_zero_frames = 0;
-                        aec_counter_reset_ = false;
-                    }
-                    bool all_zero = true;
-                    int16_t* pcm = (int16_t*)res->data;
-                    for (int i = 0; i < samples && all_zero; i++) {
-                        if (pcm[i] != 0) all_zero = false;
-                    }
-                    if (all_zero) {
-                        if (++consecutive_zero_frames == 100) {
-                            ESP_LOGE(TAG, "❌ AEC FAILURE: 100 consecutive zero-output frames! Disabling AEC as fallback");
-                            afe_handle_->disable_aec(afe_data_);
-                        }
-                    } else {
-                        consecutive_zero_frames = 0;
-                    }
-
-                    // 分配音频消息
-                    audio_data_msg_t* msg = alloc_audio_msg(samples, 1);
-                    if (msg) {
-                        memcpy(msg->data, res->data, res->data_size);
-
-                        // 发送到全局AFE输出队列
-                        if (xQueueSend(output_queue_, &msg, 0) != pdTRUE) {
-                            ESP_LOGW(TAG, "AFE output queue full, dropping frame");
-                            free_audio_msg(msg);
-                        } else {
-                            // 每100帧打印一次发送成功
-                            static uint32_t send_count = 0;
-                            send_count++;
-                            if (send_count % 1000 == 0) {
-                                ESP_LOGI(TAG, "✅ AFE sent %lu msgs to queue (samples=%d)", send_count, samples);
-                            }
-                        }
-                    } else {
-                        // alloc失败
-                        static uint32_t alloc_fail_count = 0;
-                        alloc_fail_count++;
-                        if (alloc_fail_count % 50 == 0) {
-                            ESP_LOGW(TAG, "⚠️ AFE alloc failed %lu times", alloc_fail_count);
-                        }
-                    }
-
-                    // 检测唤醒词（添加调试日志）
-                    // WakeNet状态值：0=未检测，1=检测中，2=已检测(WAKENET_DETECTED)
-                    static uint32_t wakenet_frame_count = 0;
-                    wakenet_frame_count++;
-
-                    // 每100帧打印一次WakeNet状态（即使未检测到）
-                    if (wakenet_frame_count % 1000 == 0) {
-                        ESP_LOGI(TAG, "🔍 WakeNet: state=%d, volume=%.2f, vad=%d (frame #%lu)",
-                                 res->wakeup_state, res->data_volume, res->vad_state, wakenet_frame_count);
-                    }
-
-                    if (res->wakeup_state == WAKENET_DETECTED) {
-                        const char* wake_word = "wake";
-                        if (res->wake_word_index > 0 && config_.wake_words &&
-                            res->wake_word_index <= config_.wake_word_count) {
-                            wake_word = config_.wake_words[res->wake_word_index - 1];
-                        }
-
-                        wake_detected_ = true;
-                        ESP_LOGI(TAG, "🎉🎉🎉 Wake word detected: %s (index=%d)",
-                                 wake_word, res->wake_word_index);
-
-                        if (wake_cb_) {
-                            wake_cb_(wake_word);
-                        }
-                    } else if (res->wakeup_state > 0) {
-                        // WakeNet正在处理但未检测到（状态=1表示检测中）
-                        ESP_LOGI(TAG, "⚠️ WakeNet processing (state=%d, volume=%.2f)",
-                                 res->wakeup_state, res->data_volume);
-                    }
-
-                    // 检测VAD
-                    if (config_.enable_vad) {
-                        bool new_vad_state = (res->vad_state == VAD_SPEECH);
-                        if (new_vad_state != vad_active_) {
-                            vad_active_ = new_vad_state;
-                            if (vad_cb_) {
-                                vad_cb_(vad_active_);
-                            }
-                        }
-                    }
-
-                    // 更新音频能量（用于UI动画）
-                    audio_energy_ = (int)(res->data_volume * 10);
+                    handle_fetch_result(res);
                 }
 
                 // 移动剩余数据到缓冲区开头
@@ -546,3 +554,195 @@ void AdvancedAFE::process_loop() {
         }
     }
 }
+
+void AdvancedAFE::process_stream_loop() {
+    ESP_LOGI(TAG, "AFE streaming loop started on core %d (ring in/out)", xPortGetCoreID());
+
+    pcm_mc_ringbuffer_t* in = config_.input_ring;
+    const size_t afe_chunk_size = afe_handle_->get_feed_chunksize(afe_data_);
+    const uint32_t chunk_us = afe_chunk_size * 1000000ULL / config_.sample_rate;
+    uint32_t frame_count = 0;
+
+    if (in->channels != total_channels_) {
+        ESP_LOGE(TAG, "Input ring has %u ch, AFE expects %d", in->channels, total_channels_);
+    }
+
+    while (true) {
+        // 等待生产者通知（超时兜底，防止漏通知）
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+        if (flush_input_) {
+            flush_input_ = false;
+            size_t n = mc_ringbuffer_frames_available(in);
+            mc_ringbuffer_consume(in, n);
+            in_stamps_.pop(n, nullptr);
+        }
+        apply_reconfig();
+
+        // 每次feed一个chunk后立即fetch一个chunk，保持ESP-SR内部ringbuffer不积压
+        ringbuffer_span_t span;
+        while (mc_ringbuffer_peek(in, afe_chunk_size, &span) == afe_chunk_size) {
+            int64_t t0 = esp_timer_get_time();
+            if (span.len2 == 0) {
+                // 直接把RingBuffer内存交给ESP-SR（feed内部会拷贝）
+                afe_handle_->feed(afe_data_, span.ptr1);
+            } else {
+                // 跨环绕：线性化到temp_buffer_（容量为chunk整数倍时不会发生）
+                memcpy(temp_buffer_, span.ptr1, span.len1 * total_channels_ * sizeof(int16_t));
+                memcpy(temp_buffer_ + span.len1 * total_channels_, span.ptr2,
+                       span.len2 * total_channels_ * sizeof(int16_t));
+                afe_handle_->feed(afe_data_, temp_buffer_);
+            }
+            const uint32_t feed_us = (uint32_t)(esp_timer_get_time() - t0);
+            mc_ringbuffer_consume(in, afe_chunk_size);
+            latency_stamp_t stamp;
+            const bool traced = in_stamps_.pop(afe_chunk_size, &stamp);
+            frame_count++;
+
+            afe_fetch_result_t* res = afe_handle_->fetch(afe_data_);
+
+            // 负载 = feed+fetch耗时 / chunk实时时长（EWMA α=1/8）
+            uint32_t busy_us = (uint32_t)(esp_timer_get_time() - t0);
+            load_pct_ = (load_pct_ * 7 + busy_us * 100 / chunk_us) / 8;
+            PROFILE_RECORD("afe_feed", feed_us);
+            PROFILE_RECORD("afe_fetch", busy_us - feed_us);
+            TaskManager::instance().pm_report_afe_load(load_pct_);
+
+            if (traced) {
+                const uint32_t now = latency_now_us();
+                SystemMonitor::instance().record_latency(
+                    SystemMonitor::LatencyStage::CAPTURE_TO_AFE, now - stamp.stage_us, stamp.seq);
+                stamp.stage_us = now;
+            }
+
+            if (res && res->data) {
+                handle_fetch_result(res, traced ? &stamp : nullptr);
+            }
+
+            // 每5秒打印一次统计
+            if (frame_count % 1560 == 0) {
+                ESP_LOGI(TAG, "AFE stats: processed=%lu, energy=%d, vad=%d, load=%lu%%",
+                         frame_count, audio_energy_, vad_active_, load_pct_);
+            }
+        }
+    }
+}
+
+void AdvancedAFE::handle_fetch_result(afe_fetch_result_t* res, const latency_stamp_t* stamp) {
+    // 计算样本数（单声道）
+    int samples = res->data_size / sizeof(int16_t);
+
+    // AEC零输出检测：如果连续100帧全零，自动禁用AEC（防止MR格式bug）
+    static uint32_t consecutive_zero_frames = 0;
+    if (aec_counter_reset_) {
+        consecutive_zero_frames = 0;
+        aec_counter_reset_ = false;
+    }
+    int16_t* pcm = (int16_t*)res->data;
+    if (dsp_is_all_zero(pcm, samples)) {
+        if (++consecutive_zero_frames == 100) {
+            ESP_LOGE(TAG, "❌ AEC FAILURE: 100 consecutive zero-output frames! Disabling AEC as fallback");
+            afe_handle_->disable_aec(afe_data_);
+            aec_on_ = false;  // 下次播放开始时重新尝试启用
+        }
+    } else {
+        consecutive_zero_frames = 0;
+    }
+
+    if (is_streaming()) {
+        // 直接写入输出RingBuffer（唯一一次拷贝，res->data归ESP-SR所有）
+        // 时间戳须在commit之前入队，消费者才能按位置取到
+        ringbuffer_span_t dst;
+        size_t written = ringbuffer_reserve(config_.output_ring, samples, &dst);
+        if (written > 0) {
+            memcpy(dst.ptr1, pcm, dst.len1 * sizeof(int16_t));
+            if (dst.len2) {
+                memcpy(dst.ptr2, pcm + dst.len1, dst.len2 * sizeof(int16_t));
+            }
+            out_stamps_.push(written, stamp);
+            ringbuffer_commit(config_.output_ring, written);
+        }
+        if (written < (size_t)samples) {
+            static uint32_t overflow_count = 0;
+            overflow_count++;
+            if (overflow_count <= 3 || overflow_count % 100 == 0) {
+                ESP_LOGW(TAG, "AFE output ring full, dropped %d samples (#%lu)",
+                         samples - (int)written, overflow_count);
+            }
+        }
+        if (written > 0 && output_cb_) {
+            output_cb_();
+        }
+    } else {
+        // 分配音频消息
+        audio_data_msg_t* msg = alloc_audio_msg(samples, 1);
+        if (msg) {
+            memcpy(msg->data, res->data, res->data_size);
+
+            // 发送到全局AFE输出队列
+            if (xQueueSend(output_queue_, &msg, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "AFE output queue full, dropping frame");
+                free_audio_msg(msg);
+            } else {
+                // 每100帧打印一次发送成功
+                static uint32_t send_count = 0;
+                send_count++;
+                if (send_count % 1000 == 0) {
+                    ESP_LOGI(TAG, "✅ AFE sent %lu msgs to queue (samples=%d)", send_count, samples);
+                }
+            }
+        } else {
+            // alloc失败
+            static uint32_t alloc_fail_count = 0;
+            alloc_fail_count++;
+            if (alloc_fail_count % 50 == 0) {
+                ESP_LOGW(TAG, "⚠️ AFE alloc failed %lu times", alloc_fail_count);
+            }
+        }
+    }
+
+    // 检测唤醒词（添加调试日志）
+    // WakeNet状态值：0=未检测，1=检测中，2=已检测(WAKENET_DETECTED)
+    static uint32_t wakenet_frame_count = 0;
+    wakenet_frame_count++;
+
+    // 每100帧打印一次WakeNet状态（即使未检测到）
+    if (wakenet_frame_count % 1000 == 0) {
+        ESP_LOGI(TAG, "🔍 WakeNet: state=%d, volume=%.2f, vad=%d (frame #%lu)",
+                 res->wakeup_state, res->data_volume, res->vad_state, wakenet_frame_count);
+    }
+
+    if (res->wakeup_state == WAKENET_DETECTED) {
+        const char* wake_word = "wake";
+        if (res->wake_word_index > 0 && config_.wake_words &&
+            res->wake_word_index <= config_.wake_word_count) {
+            wake_word = config_.wake_words[res->wake_word_index - 1];
+        }
+
+        wake_detected_ = true;
+        ESP_LOGI(TAG, "🎉🎉🎉 Wake word detected: %s (index=%d)",
+                 wake_word, res->wake_word_index);
+
+        if (wake_cb_) {
+            wake_cb_(wake_word);
+        }
+    } else if (res->wakeup_state > 0) {
+        // WakeNet正在处理但未检测到（状态=1表示检测中）
+        ESP_LOGI(TAG, "⚠️ WakeNet processing (state=%d, volume=%.2f)",
+                 res->wakeup_state, res->data_volume);
+    }
+
+    // 检测VAD
+    if (vad_on_) {
+        bool new_vad_state = (res->vad_state == VAD_SPEECH);
+        if (new_vad_state != vad_active_) {
+            vad_active_ = new_vad_state;
+            if (vad_cb_) {
+                vad_cb_(vad_active_);
+            }
+        }
+    }
+
+    // 更新音频能量（用于UI动画）
+    audio_energy_ = (int)(res->data_volume * 10);
+}
@@ -8,6 +8,8 @@
 #include <esp_wn_iface.h>
 #include <esp_wn_models.h>
 #include <functional>
+#include "task_manager.h"
+#include "system_monitor.h"
 
 /**
  * @brief 先进的AFE音频前端处理器
@@ -19,12 +21,14 @@
  * - 波束形成 (Beamforming) - 双麦克风
  * - 语音活动检测 (VAD)
  * - 唤醒词检测
+ * - 功耗/性能档位（idle-listen/conversation/meeting/music，运行时切换）
  */
 class AdvancedAFE {
 public:
     // 回调函数类型
     using WakeCallback = std::function<void(const char* wake_word)>;
     using VadCallback = std::function<void(bool voice_active)>;
+    using OutputCallback = std::function<void()>;
 
     // AFE配置
     struct Config {
@@ -47,6 +51,11 @@ public:
         int wake_threshold = 0;      // 唤醒阈值（0=auto）
         const char** wake_words = nullptr;  // 唤醒词列表
         int wake_word_count = 0;
+
+        // 流式模式（两者均非空时启用）：afe_task直接从input_ring取feed块，
+        // fetch输出写入output_ring，不再经过内存池和队列
+        pcm_mc_ringbuffer_t* input_ring = nullptr;  // 交织帧（生产者：audio_main_task）
+        pcm_ringbuffer_t* output_ring = nullptr;    // 单声道输出（消费者：audio_main_task）
     };
 
     AdvancedAFE();
@@ -74,6 +83,11 @@ public:
      */
     void on_vad_changed(VadCallback cb) { vad_cb_ = cb; }
 
+    /**
+     * @brief 设置输出就绪回调（流式模式，每次写入output_ring后在afe_task中调用）
+     */
+    void on_output_ready(OutputCallback cb) { output_cb_ = cb; }
+
     /**
      * @brief 启动AFE处理任务
      */
@@ -99,6 +113,51 @@ public:
      */
     int fetch(int16_t* out, size_t max_samples);
 
+    /**
+     * @brief 流式模式：通知afe_task输入RingBuffer有新帧（生产者commit后调用）
+     */
+    void notify_input();
+
+    /**
+     * @brief 流式模式：为接下来commit到输入RingBuffer的frames帧打延迟时间戳
+     * 生产者在mc_ringbuffer_commit之前调用（每次commit都要调用，stamp可为nullptr）
+     */
+    void stamp_input(size_t frames, const latency_stamp_t* stamp) { in_stamps_.push(frames, stamp); }
+
+    /**
+     * @brief 流式模式：请求afe_task丢弃输入RingBuffer中未处理的帧
+     * 由消费者一侧执行，生产者调用是安全的
+     */
+    void flush_input();
+
+    /**
+     * @brief 流式模式：借用输出RingBuffer中的已处理样本（零拷贝视图）
+     * @return 可读样本数（≤max_samples），处理完后调用consume_output
+     */
+    size_t peek_output(size_t max_samples, ringbuffer_span_t* span);
+
+    /**
+     * @brief 流式模式：取出peek到的这段输出样本携带的延迟时间戳（stage_us=AFE输出时间）
+     * 每段输出样本在consume_output之前恰好调用一次
+     * @return 是否取到时间戳
+     */
+    bool take_output_stamp(size_t samples, latency_stamp_t* stamp) { return out_stamps_.pop(samples, stamp); }
+
+    /**
+     * @brief 流式模式：归还已处理的输出样本
+     */
+    void consume_output(size_t samples);
+
+    /**
+     * @brief 流式模式：丢弃输出RingBuffer中所有样本（消费者调用）
+     */
+    void discard_output();
+
+    /**
+     * @brief 是否工作在流式模式
+     */
+    bool is_streaming() const { return config_.input_ring && config_.output_ring; }
+
     /**
      * @brief 获取唤醒词检测状态
      */
@@ -120,21 +179,53 @@ public:
     int get_audio_energy() const { return audio_energy_; }
 
     /**
-     * @brief 动态启用/禁用AEC（运行时切换）
-     * 播放TTS时启用AEC消除扬声器回声，空闲时禁用以保证WakeNet正常检测
+     * @brief AFE处理负载（流式模式）：feed+fetch耗时占chunk实时时长的百分比（EWMA）
+     * ≥100表示AFE跟不上实时，Core 1没有余量
      */
-    void enable_aec(bool enable);
+    uint32_t get_load_percent() const { return load_pct_; }
 
     /**
-     * @brief 动态启用/禁用WakeNet（运行时切换）
-     * 会议录音模式下禁用WakeNet节省CPU，会议结束后恢复
+     * @brief AFE功耗/性能档位
+     * 只在init时已创建的模块之间做运行时开关（ESP-SR enable_/disable_接口），
+     * 输入格式、通道数和RingBuffer不变，切换不需要重建AFE
      */
-    void enable_wakenet(bool enable);
+    enum class Profile : uint8_t {
+        IDLE_LISTEN,    // 待机监听：WakeNet + VAD，关闭NS/AEC
+        CONVERSATION,   // 对话：NS + VAD + WakeNet，播放TTS时AEC
+        MEETING,        // 会议录音：NS + VAD，关闭WakeNet
+        MUSIC,          // 音乐：播放时AEC + WakeNet（语音打断），关闭NS/VAD
+    };
+
+    /**
+     * @brief 切换AFE档位（任意任务调用，afe_task在两次feed之间应用）
+     */
+    void set_profile(Profile profile);
+
+    /**
+     * @brief 当前已生效的档位
+     */
+    Profile profile() const { return profile_; }
+
+    /**
+     * @brief 档位名称（日志/统计用）
+     */
+    static const char* profile_name(Profile profile);
+
+    /**
+     * @brief 通知播放状态：AEC仅在播放期间且当前档位允许时启用
+     * 空闲时禁用AEC以保证WakeNet正常检测
+     */
+    void set_playback_active(bool active);
 
 private:
     // AFE处理任务
     static void afe_task(void* arg);
     void process_loop();
+    void process_stream_loop();
+
+    // 处理一次ESP-SR fetch结果（零输出检测、输出、唤醒词、VAD、能量）
+    // stamp：本次feed块的延迟时间戳（流式模式，可为nullptr）
+    void handle_fetch_result(afe_fetch_result_t* res, const latency_stamp_t* stamp = nullptr);
 
     // 唤醒词检测
     void detect_wake_word(const int16_t* data, int samples);
@@ -142,6 +233,9 @@ private:
     // VAD检测
     void detect_vad(int vad_state);
 
+    // 应用挂起的档位/播放状态变更（仅afe_task调用）
+    void apply_reconfig();
+
     Config config_;
 
     // AFE接口和数据
@@ -162,12 +256,30 @@ private:
     // 回调
     WakeCallback wake_cb_;
     VadCallback vad_cb_;
+    OutputCallback output_cb_;
 
     // 状态
     volatile bool wake_detected_ = false;
     volatile bool vad_active_ = false;
     volatile int audio_energy_ = 0;
     volatile bool aec_counter_reset_ = false;  // 重置AEC零输出计数器
+    volatile bool flush_input_ = false;        // 流式模式：请求丢弃未处理输入
+    volatile uint32_t load_pct_ = 0;           // 流式模式：处理负载EWMA（%）
+
+    // 档位：请求由任意任务写入，afe_task应用；*_on_为模块当前开关状态（仅afe_task访问）
+    volatile Profile profile_ = Profile::CONVERSATION;
+    volatile Profile requested_profile_ = Profile::CONVERSATION;
+    volatile bool playback_active_ = false;
+    volatile bool reconfig_pending_ = false;
+    bool wakenet_init_ = false;
+    bool ns_on_ = false;
+    bool vad_on_ = false;
+    bool wakenet_on_ = false;
+    bool aec_on_ = false;
+
+    // 延迟时间戳（流式模式）：输入帧位置 / 输出样本位置
+    LatencyStampFifo in_stamps_;
+    LatencyStampFifo out_stamps_;
 
     // 通道
     int total_channels_ = 0;  // 总通道数 (mic + ref)
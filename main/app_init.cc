@@ -1,5 +1,6 @@
 #include "task_manager.h"
 #include <esp_log.h>
+#include <sdkconfig.h>
 
 static const char* TAG = "app_init";
 
@@ -49,7 +50,11 @@ bool create_all_tasks() {
         {
             .name = "audio_main",
             .func = audio_main_task,
-            .stack_size = 40960,  // 40KB (Opus encoder needs ~31KB stack)
+#if CONFIG_ECHOEAR_UPLINK_ENCODE_TASK
+            .stack_size = 19456,  // 19KB (Opus编码已移至uplink_enc任务；I2S缓冲在scratch arena)
+#else
+            .stack_size = 35840,  // 35KB (Opus encoder needs ~31KB stack；采集帧数组/I2S缓冲已移出栈)
+#endif
             .priority = 20,       // 高优先级保证实时性
             .core_id = 1,
             .param = nullptr,
@@ -76,10 +81,10 @@ bool create_all_tasks() {
 
     ESP_LOGI(TAG, "==================================================");
     ESP_LOGI(TAG, "2-task architecture created successfully!");
-    ESP_LOGI(TAG, "Total stack: 44KB (32+12)");
+    ESP_LOGI(TAG, "Total stack: 48KB (36+12)");
     ESP_LOGI(TAG, "Core 0: main_ctrl (12KB) - WebSocket, FSM, UI, LED, Heartbeat");
-    ESP_LOGI(TAG, "Core 1: audio_main (32KB) - I2S, AFE, Wake, Opus, Mixer");
-    ESP_LOGI(TAG, "AFE task (12KB) + LED task (2KB) created separately");
+    ESP_LOGI(TAG, "Core 1: audio_main (36KB) - I2S, AFE, Wake, Opus, Mixer");
+    ESP_LOGI(TAG, "AFE task (12KB) + LED task (2KB, event-driven) created separately");
     ESP_LOGI(TAG, "Total app stack: 56KB (vs 82KB before optimization, -32%%)");
     ESP_LOGI(TAG, "==================================================");
 
@@ -20,6 +20,8 @@ QueueHandle_t g_opus_playback_queue = nullptr;
 EventGroupHandle_t g_audio_event_bits = nullptr;
 QueueHandle_t g_fsm_event_queue = nullptr;
 QueueHandle_t g_ws_rx_queue = nullptr;
+TaskHandle_t g_audio_task_handle = nullptr;
+TaskHandle_t g_main_task_handle = nullptr;
 
 bool init_global_queues() {
     ESP_LOGI(TAG, "Initializing global queues (2-task architecture)...");
@@ -38,21 +40,24 @@ bool init_global_queues() {
         return false;
     }
 
-    // 初始化PCM RingBuffer（16KB PSRAM — 实际只需几百samples缓冲）
-    if (!ringbuffer_init(&g_pcm_ringbuffer, 8192)) {  // 8K samples = 16KB（节省240KB）
-        ESP_LOGE(TAG, "Failed to init PCM RingBuffer");
+    // 采集 RingBuffer（MMR交织帧，4096帧槽位 × 3ch × 2B → 24KB，HOT）
+    // 留一个空槽区分满/空，可存4095帧；按256帧（16ms）整块最多积压15块 = 240ms @ 16kHz
+    // 替代原 g_pcm_ringbuffer(16KB) + g_mic1_ringbuffer(8KB)，槽位数为256帧整数倍，AFE取帧不会跨环绕
+    // 每16ms被I2S写入、AFE读取各一次，放内部SRAM
+    if (!mc_ringbuffer_init(&g_capture_ringbuffer, 4096, 3, MEM_HOT)) {
+        ESP_LOGE(TAG, "Failed to init Capture RingBuffer");
         return false;
     }
 
-    // 初始化参考音频 RingBuffer (AEC用，4096 samples = 256ms @ 16kHz)
-    if (!ringbuffer_init(&g_ref_ringbuffer, 4096)) {
-        ESP_LOGE(TAG, "Failed to init Reference RingBuffer");
+    // AFE输出 RingBuffer（流式模式，4096槽位 = 8KB，可存4095 samples ≈ 256ms @ 16kHz，HOT：AFE写、编码读）
+    if (!ringbuffer_init(&g_afe_out_ringbuffer, 4096, MEM_HOT)) {
+        ESP_LOGE(TAG, "Failed to init AFE output RingBuffer");
         return false;
     }
 
-    // MIC1 RingBuffer (双麦克风，与 g_ref_ringbuffer 同容量)
-    if (!ringbuffer_init(&g_mic1_ringbuffer, 4096)) {
-        ESP_LOGE(TAG, "Failed to init MIC1 RingBuffer");
+    // 初始化参考音频 RingBuffer (AEC用，4096槽位，可存4095 samples ≈ 256ms @ 16kHz，COLD：只在播放时写入)
+    if (!ringbuffer_init(&g_ref_ringbuffer, 4096)) {
+        ESP_LOGE(TAG, "Failed to init Reference RingBuffer");
         return false;
     }
 
@@ -75,7 +80,8 @@ bool init_global_queues() {
         return false;
     }
 
-    g_opus_playback_queue = xQueueCreate(24, sizeof(opus_packet_msg_t*));  // 24项≈1.44s缓冲，留8个pool slot余量
+    // 24项≈1.44s缓冲；切片按值入队，不占pool块（共享WS接收帧）
+    g_opus_playback_queue = xQueueCreate(24, sizeof(opus_slice_t));
     if (!g_opus_playback_queue) {
         ESP_LOGE(TAG, "Failed to create opus_playback_queue");
         return false;
@@ -101,28 +107,71 @@ bool init_global_queues() {
     }
 
     ESP_LOGI(TAG, "All queues initialized successfully");
-    ESP_LOGI(TAG, "PCM RingBuffer (16KB) and Memory Pools (44KB) initialized");
+    ESP_LOGI(TAG, "Capture RingBuffer (24KB) and Memory Pools (44KB) initialized");
     ESP_LOGI(TAG, "2-task communication queues initialized");
     return true;
 }
 
+// ============================================================================
+// Audio Task 唤醒接口
+// ============================================================================
+
+void audio_task_notify(uint32_t bits) {
+    TaskHandle_t h = g_audio_task_handle;
+    if (h) {
+        xTaskNotify(h, bits, eSetBits);
+    }
+}
+
+// ============================================================================
+// Main Control Task 唤醒接口
+// ============================================================================
+
+void main_task_notify(uint32_t bits) {
+    TaskHandle_t h = g_main_task_handle;
+    if (h) {
+        xTaskNotify(h, bits, eSetBits);
+    }
+}
+
+void audio_post_event(EventBits_t bits) {
+    xEventGroupSetBits(g_audio_event_bits, bits);
+    main_task_notify(MAIN_NOTIFY_AUDIO_EVENT);
+}
+
+bool audio_send_cmd(audio_cmd_t cmd) {
+    if (xQueueSend(g_audio_cmd_queue, &cmd, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Audio cmd queue full, dropped cmd %d", cmd);
+        return false;
+    }
+    audio_task_notify(AUDIO_NOTIFY_CMD);
+    return true;
+}
+
+bool audio_send_playback(const opus_slice_t* slice, TickType_t wait) {
+    // 播放队列的消费者是AudioPlayout任务，它直接阻塞在队列上，无需额外通知
+    return xQueueSend(g_opus_playback_queue, slice, wait) == pdTRUE;
+}
+
+void opus_slice_release(opus_slice_t* slice) {
+    if (!slice || !slice->data) return;
+    pool_free(slice->data);  // 块内部指针，引用计数归零时释放整帧
+    slice->data = nullptr;
+}
+
 // ============================================================================
 // 消息分配和释放（使用PSRAM）
 // ============================================================================
 
 audio_data_msg_t* alloc_audio_msg(size_t samples, int channels) {
     size_t data_size = samples * channels * sizeof(int16_t);
-    pool_type_t pool_type;
-
-    // 选择合适的内存池
-    if (data_size <= 2048) {
-        pool_type = POOL_L_2K;
-    } else if (data_size <= 4096) {
-        pool_type = POOL_L_4K;
-    } else {
+
+    // 选择合适的内存池（音频数据只使用Pool-L）
+    if (data_size > 4096) {
         ESP_LOGE(TAG, "Audio msg too large: %zu bytes", data_size);
         return nullptr;
     }
+    pool_type_t pool_type = (data_size <= 2048) ? POOL_L_2K : POOL_L_4K;
 
     // 从Pool-S分配消息结构体
     audio_data_msg_t* msg = (audio_data_msg_t*)pool_alloc(POOL_S_64);
@@ -135,13 +184,14 @@ audio_data_msg_t* alloc_audio_msg(size_t samples, int channels) {
     msg->data = (int16_t*)pool_alloc(pool_type);
     if (!msg->data) {
         ESP_LOGE(TAG, "Failed to allocate audio data from pool");
-        pool_free(POOL_S_64, msg);
+        pool_free(msg);
         return nullptr;
     }
 
     msg->samples = samples;
     msg->channels = channels;
     msg->timestamp = xTaskGetTickCount();
+    msg->stamp = {};
 
     return msg;
 }
@@ -149,28 +199,17 @@ audio_data_msg_t* alloc_audio_msg(size_t samples, int channels) {
 void free_audio_msg(audio_data_msg_t* msg) {
     if (!msg) return;
 
-    // 确定数据池类型
-    size_t data_size = msg->samples * msg->channels * sizeof(int16_t);
-    pool_type_t pool_type = (data_size <= 2048) ? POOL_L_2K : POOL_L_4K;
-
-    // 释放数据和消息结构体
+    // 释放数据和消息结构体（pool_free根据地址自动定位所属池）
     if (msg->data) {
-        pool_free(pool_type, msg->data);
+        pool_free(msg->data);
     }
-    pool_free(POOL_S_64, msg);
+    pool_free(msg);
 }
 
 opus_packet_msg_t* alloc_opus_msg(size_t len) {
-    pool_type_t pool_type;
-
-    // 选择合适的内存池
-    if (len <= 256) {
-        pool_type = POOL_S_256;
-    } else if (len <= 2048) {
-        pool_type = POOL_L_2K;
-    } else if (len <= 4096) {
-        pool_type = POOL_L_4K;
-    } else {
+    // 选择合适的内存池（最小256B）
+    pool_type_t pool_type = pool_type_for_size(len < 256 ? 256 : len);
+    if (pool_type >= POOL_COUNT) {
         ESP_LOGE(TAG, "Opus msg too large: %zu bytes", len);
         return nullptr;
     }
@@ -186,12 +225,13 @@ opus_packet_msg_t* alloc_opus_msg(size_t len) {
     msg->data = (uint8_t*)pool_alloc(pool_type);
     if (!msg->data) {
         ESP_LOGE(TAG, "Failed to allocate opus data from pool");
-        pool_free(POOL_S_64, msg);
+        pool_free(msg);
         return nullptr;
     }
 
     msg->len = len;
     msg->timestamp = xTaskGetTickCount();
+    msg->stamp = {};  // seq=0：未追踪
 
     return msg;
 }
@@ -199,263 +239,17 @@ opus_packet_msg_t* alloc_opus_msg(size_t len) {
 void free_opus_msg(opus_packet_msg_t* msg) {
     if (!msg) return;
 
-    // 确定数据池类型
-    pool_type_t pool_type;
-    if (msg->len <= 256) {
-        pool_type = POOL_S_256;
-    } else if (msg->len <= 2048) {
-        pool_type = POOL_L_2K;
-    } else {
-        pool_type = POOL_L_4K;
-    }
-
-    // 释放数据和消息结构体
+    // 释放数据和消息结构体（msg->len可能已被调用方修改，不再用于定位池）
     if (msg->data) {
-        pool_free(pool_type, msg->data);
+        pool_free(msg->data);
     }
-    pool_free(POOL_S_64, msg);
+    pool_free(msg);
 }
 
-
 // ============================================================================
-// PCM RingBuffer Implementation
+// 全局PCM RingBuffer（实现见audio_buffers.cc）
 // ============================================================================
 
-pcm_ringbuffer_t g_pcm_ringbuffer;
 pcm_ringbuffer_t g_ref_ringbuffer;
-pcm_ringbuffer_t g_mic1_ringbuffer;
-
-bool ringbuffer_init(pcm_ringbuffer_t* rb, size_t capacity) {
-    rb->buffer = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
-    if (!rb->buffer) {
-        ESP_LOGE(TAG, "Failed to allocate RingBuffer in PSRAM");
-        return false;
-    }
-
-    rb->capacity = capacity;
-    rb->write_pos = 0;
-    rb->read_pos = 0;
-
-    ESP_LOGI(TAG, "RingBuffer initialized (lock-free SPSC): %zu samples (%zuKB)",
-             capacity, (capacity * sizeof(int16_t)) / 1024);
-    return true;
-}
-
-size_t ringbuffer_write(pcm_ringbuffer_t* rb, const int16_t* data, size_t samples) {
-    if (!rb || !data || samples == 0) return 0;
-
-    // 读取消费者指针的快照（volatile确保每次从内存读取）
-    const size_t read_pos = rb->read_pos;
-    const size_t write_pos = rb->write_pos;
-
-    // 计算可用空间（保留1个样本防止满/空混淆）
-    size_t available_space = (read_pos - write_pos - 1 + rb->capacity) % rb->capacity;
-    size_t to_write = (samples < available_space) ? samples : available_space;
-
-    if (to_write == 0) return 0;
-
-    // 处理wrap-around
-    size_t part1 = rb->capacity - write_pos;
-    if (to_write <= part1) {
-        memcpy(&rb->buffer[write_pos], data, to_write * sizeof(int16_t));
-    } else {
-        memcpy(&rb->buffer[write_pos], data, part1 * sizeof(int16_t));
-        memcpy(&rb->buffer[0], data + part1, (to_write - part1) * sizeof(int16_t));
-    }
-
-    // 内存屏障：确保数据写入对消费者可见后再更新write_pos
-    __sync_synchronize();
-    rb->write_pos = (write_pos + to_write) % rb->capacity;
-
-    return to_write;
-}
-
-size_t ringbuffer_read(pcm_ringbuffer_t* rb, int16_t* out, size_t samples) {
-    if (!rb || !out || samples == 0) return 0;
-
-    // 读取生产者指针的快照
-    const size_t write_pos = rb->write_pos;
-    const size_t read_pos = rb->read_pos;
-
-    // 计算可读数据量
-    size_t available = (write_pos - read_pos + rb->capacity) % rb->capacity;
-    size_t to_read = (samples < available) ? samples : available;
-
-    if (to_read == 0) return 0;
-
-    // 内存屏障：确保读取write_pos后再读数据
-    __sync_synchronize();
-
-    // 处理wrap-around
-    size_t part1 = rb->capacity - read_pos;
-    if (to_read <= part1) {
-        memcpy(out, &rb->buffer[read_pos], to_read * sizeof(int16_t));
-    } else {
-        memcpy(out, &rb->buffer[read_pos], part1 * sizeof(int16_t));
-        memcpy(out + part1, &rb->buffer[0], (to_read - part1) * sizeof(int16_t));
-    }
-
-    // 内存屏障：确保数据读完后再更新read_pos
-    __sync_synchronize();
-    rb->read_pos = (read_pos + to_read) % rb->capacity;
-
-    return to_read;
-}
-
-size_t ringbuffer_data_available(pcm_ringbuffer_t* rb) {
-    if (!rb) return 0;
-    // volatile读取确保获取最新值
-    return (rb->write_pos - rb->read_pos + rb->capacity) % rb->capacity;
-}
-
-void ringbuffer_reset(pcm_ringbuffer_t* rb) {
-    if (!rb) return;
-    // 仅在idle状态调用（无并发访问）
-    rb->write_pos = 0;
-    rb->read_pos = 0;
-}
-
-// ============================================================================
-// Fixed Memory Pool Implementation
-// ============================================================================
-
-memory_pool_t g_memory_pools[POOL_COUNT];
-
-// 调试计数器
-static uint32_t pool_alloc_count[POOL_COUNT] = {0};
-static uint32_t pool_free_count[POOL_COUNT] = {0};
-
-bool init_memory_pools() {
-    const struct {
-        uint32_t block_size;
-        uint32_t block_count;
-    } pool_configs[POOL_COUNT] = {
-        {64, 32},    // POOL_S_64: 64B × 32 = 2KB (bitmap最大32块)
-        {128, 32},   // POOL_S_128: 128B × 32 = 4KB
-        {256, 32},   // POOL_S_256: 256B × 32 = 8KB (match playback queue capacity)
-        {2048, 16},  // POOL_L_2K: 2KB × 16 = 32KB
-        {4096, 8},   // POOL_L_4K: 4KB × 8 = 32KB (增加到8块)
-    };
-
-    uint32_t total_size = 0;
-
-    for (int i = 0; i < POOL_COUNT; i++) {
-        memory_pool_t* pool = &g_memory_pools[i];
-        pool->block_size = pool_configs[i].block_size;
-        pool->block_count = pool_configs[i].block_count;
-
-        // 修复：当block_count=32时，(1U << 32)是UB（未定义行为）
-        if (pool->block_count == 32) {
-            pool->free_bitmap = 0xFFFFFFFF;  // 所有32位都是1（空闲）
-        } else if (pool->block_count < 32) {
-            pool->free_bitmap = (1U << pool->block_count) - 1;  // 所有块初始为空闲
-        } else {
-            ESP_LOGE(TAG, "Pool %d block_count %lu exceeds 32!", i, pool->block_count);
-            return false;
-        }
-
-        pool->mutex = xSemaphoreCreateMutex();
-
-        if (!pool->mutex) {
-            ESP_LOGE(TAG, "Failed to create mutex for pool %d", i);
-            return false;
-        }
-
-        // 从PSRAM分配内存池
-        pool->memory = heap_caps_malloc(pool->block_size * pool->block_count, MALLOC_CAP_SPIRAM);
-        if (!pool->memory) {
-            ESP_LOGE(TAG, "Failed to allocate pool %d: %lu bytes", i,
-                     pool->block_size * pool->block_count);
-            return false;
-        }
-
-        total_size += pool->block_size * pool->block_count;
-        ESP_LOGI(TAG, "Pool %d: %lu x %lu bytes = %lu KB",
-                 i, pool->block_count, pool->block_size,
-                 (pool->block_size * pool->block_count) / 1024);
-    }
-
-    ESP_LOGI(TAG, "Memory pools initialized: total %lu KB", total_size / 1024);
-    return true;
-}
-
-void* pool_alloc(pool_type_t type) {
-    if (type >= POOL_COUNT) return nullptr;
-
-    memory_pool_t* pool = &g_memory_pools[type];
-    xSemaphoreTake(pool->mutex, portMAX_DELAY);
-
-    // 池分配统计（仅前3次打印，之后静默）
-    static uint32_t total_calls[POOL_COUNT] = {0};
-    total_calls[type]++;
-    if (total_calls[type] <= 3) {
-        ESP_LOGD(TAG, "pool_alloc(type=%d) called #%lu, bitmap=0x%08lX",
-                 type, total_calls[type], pool->free_bitmap);
-    }
-
-    // 查找第一个空闲块（使用__builtin_ctz计数尾部零）
-    if (pool->free_bitmap == 0) {
-        xSemaphoreGive(pool->mutex);
-        ESP_LOGW(TAG, "Pool %d exhausted! (bitmap=0x%08lX)", type, pool->free_bitmap);
-        return nullptr;
-    }
-
-    int block_idx = __builtin_ctz(pool->free_bitmap);
-    pool->free_bitmap &= ~(1U << block_idx);  // 标记为已使用
-
-    pool_alloc_count[type]++;  // 调试计数
-
-    xSemaphoreGive(pool->mutex);
-
-    void* ptr = (uint8_t*)pool->memory + (block_idx * pool->block_size);
-    return ptr;
-}
-
-void pool_free(pool_type_t type, void* ptr) {
-    if (!ptr || type >= POOL_COUNT) return;
-
-    memory_pool_t* pool = &g_memory_pools[type];
-    xSemaphoreTake(pool->mutex, portMAX_DELAY);
-
-    // 计算块索引
-    ptrdiff_t offset = (uint8_t*)ptr - (uint8_t*)pool->memory;
-    int block_idx = offset / pool->block_size;
-
-    // 验证并标记为空闲
-    if (block_idx >= 0 && block_idx < (int)pool->block_count) {
-        pool->free_bitmap |= (1U << block_idx);
-        pool_free_count[type]++;  // 调试计数
-    } else {
-        ESP_LOGE(TAG, "Invalid pool_free: ptr not in pool %d", type);
-    }
-
-    xSemaphoreGive(pool->mutex);
-}
-
-void pool_free_by_size(void* ptr, size_t len) {
-    if (!ptr) return;
-    pool_type_t type;
-    if (len <= 64) type = POOL_S_64;
-    else if (len <= 128) type = POOL_S_128;
-    else if (len <= 256) type = POOL_S_256;
-    else if (len <= 2048) type = POOL_L_2K;
-    else type = POOL_L_4K;
-    pool_free(type, ptr);
-}
-
-void pool_print_stats() {
-    ESP_LOGI(TAG, "=== Memory Pool Stats ===");
-    for (int i = 0; i < POOL_COUNT; i++) {
-        memory_pool_t* pool = &g_memory_pools[i];
-        xSemaphoreTake(pool->mutex, portMAX_DELAY);
-        int free_blocks = __builtin_popcount(pool->free_bitmap);
-        int used_blocks = pool->block_count - free_blocks;
-        xSemaphoreGive(pool->mutex);
-
-        ESP_LOGI(TAG, "Pool %d (%lu B): used=%d/%lu (%d%%), alloc=%lu, free=%lu, leak=%ld",
-                 i, pool->block_size, used_blocks, pool->block_count,
-                 (used_blocks * 100) / pool->block_count,
-                 pool_alloc_count[i], pool_free_count[i],
-                 (int32_t)(pool_alloc_count[i] - pool_free_count[i]));
-    }
-}
+pcm_ringbuffer_t g_afe_out_ringbuffer;
+pcm_mc_ringbuffer_t g_capture_ringbuffer;
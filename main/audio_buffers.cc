@@ -0,0 +1,616 @@
+#include "audio_buffers.h"
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <string.h>
+
+static const char* TAG = "audio_buffers";
+
+// 主机基准（host_bench/）不走Kconfig，使用默认值
+#ifndef CONFIG_ECHOEAR_MEM_HOT_BUDGET_KB
+#define CONFIG_ECHOEAR_MEM_HOT_BUDGET_KB 40
+#endif
+#ifndef CONFIG_ECHOEAR_MEM_HOT_MIN_FREE_KB
+#define CONFIG_ECHOEAR_MEM_HOT_MIN_FREE_KB 48
+#endif
+#ifndef CONFIG_ECHOEAR_SCRATCH_ARENA_KB
+#define CONFIG_ECHOEAR_SCRATCH_ARENA_KB 8
+#endif
+
+// ============================================================================
+// Memory Placement Policy
+// ============================================================================
+
+static const size_t HOT_BUDGET_BYTES = (size_t)CONFIG_ECHOEAR_MEM_HOT_BUDGET_KB * 1024;
+static const size_t HOT_MIN_FREE_BYTES = (size_t)CONFIG_ECHOEAR_MEM_HOT_MIN_FREE_KB * 1024;
+
+static volatile uint32_t s_hot_bytes = 0;       // 已放入内部SRAM的HOT字节
+static volatile uint32_t s_hot_fallbacks = 0;   // HOT退回PSRAM次数
+
+void* mem_tier_alloc(size_t bytes, mem_tier_t tier, const char* name, bool* internal) {
+    if (internal) *internal = false;
+    if (bytes == 0) return nullptr;
+
+    if (tier == MEM_HOT) {
+        // 先占预算（并发init时不会超额），内部RAM余量不足时归还并退回PSRAM
+        uint32_t used = __atomic_add_fetch(&s_hot_bytes, (uint32_t)bytes, __ATOMIC_RELAXED);
+        void* p = nullptr;
+        if (used <= HOT_BUDGET_BYTES &&
+            heap_caps_get_free_size(MALLOC_CAP_INTERNAL) >= bytes + HOT_MIN_FREE_BYTES &&
+            heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) >= bytes) {
+            p = heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (p) {
+            if (internal) *internal = true;
+            ESP_LOGI(TAG, "%s: %zu B in internal SRAM (hot budget %lu/%u KB)",
+                     name, bytes, (unsigned long)(used / 1024), (unsigned)(HOT_BUDGET_BYTES / 1024));
+            return p;
+        }
+        __atomic_sub_fetch(&s_hot_bytes, (uint32_t)bytes, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s_hot_fallbacks, 1, __ATOMIC_RELAXED);
+        ESP_LOGW(TAG, "%s: hot placement denied (%zu B, budget %lu/%u KB, internal free %u), using PSRAM",
+                 name, bytes, (unsigned long)((used - bytes) / 1024), (unsigned)(HOT_BUDGET_BYTES / 1024),
+                 (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    }
+
+    return heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+}
+
+void mem_tier_free(void* ptr, size_t bytes, bool internal) {
+    if (!ptr) return;
+    heap_caps_free(ptr);
+    if (internal) {
+        __atomic_sub_fetch(&s_hot_bytes, (uint32_t)bytes, __ATOMIC_RELAXED);
+    }
+}
+
+// ============================================================================
+// Scratch Arena（内部RAM，.bss）
+// ============================================================================
+
+// 每帧使用的临时缓冲（I2S读取、AFE线性化、解码输出、编码包），原来在任务栈或堆上。
+// 启动时按owner划分，之后只复用不归还：没有碎片，也不占用各任务的栈
+static const size_t SCRATCH_ARENA_BYTES = (size_t)CONFIG_ECHOEAR_SCRATCH_ARENA_KB * 1024;
+static const int SCRATCH_MAX_SLOTS = 8;
+
+typedef struct {
+    const char* owner;
+    uint32_t offset;
+    uint32_t size;
+    volatile uint32_t in_use;
+    volatile uint32_t ready;        // 字段写完后置1（并发划分时其他任务跳过未就绪的槽）
+} scratch_slot_t;
+
+alignas(16) static uint8_t s_scratch_arena[SCRATCH_ARENA_BYTES ? SCRATCH_ARENA_BYTES : 16];
+static scratch_slot_t s_scratch_slots[SCRATCH_MAX_SLOTS];
+static volatile uint32_t s_scratch_slot_count = 0;
+static volatile uint32_t s_scratch_used = 0;
+static volatile uint32_t s_scratch_fallbacks = 0;
+
+static bool scratch_in_arena(const void* ptr) {
+    return (const uint8_t*)ptr >= s_scratch_arena &&
+           (const uint8_t*)ptr < s_scratch_arena + SCRATCH_ARENA_BYTES;
+}
+
+void* scratch_alloc(const char* owner, size_t bytes) {
+    if (!owner || bytes == 0) return nullptr;
+    const uint32_t size = (uint32_t)((bytes + 15) & ~(size_t)15);
+
+    // 同一owner的空闲块直接复用
+    uint32_t count = __atomic_load_n(&s_scratch_slot_count, __ATOMIC_ACQUIRE);
+    if (count > SCRATCH_MAX_SLOTS) count = SCRATCH_MAX_SLOTS;
+    for (uint32_t i = 0; i < count; i++) {
+        scratch_slot_t* slot = &s_scratch_slots[i];
+        if (!__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE)) continue;
+        if (slot->size < size || strcmp(slot->owner, owner) != 0) continue;
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&slot->in_use, &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return s_scratch_arena + slot->offset;
+        }
+    }
+
+    // 划分新块：先占槽位，再CAS推进偏移
+    uint32_t idx = __atomic_fetch_add(&s_scratch_slot_count, 1, __ATOMIC_ACQ_REL);
+    if (idx < SCRATCH_MAX_SLOTS) {
+        uint32_t off = __atomic_load_n(&s_scratch_used, __ATOMIC_RELAXED);
+        while (off + size <= SCRATCH_ARENA_BYTES &&
+               !__atomic_compare_exchange_n(&s_scratch_used, &off, off + size, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+        scratch_slot_t* slot = &s_scratch_slots[idx];
+        if (off + size <= SCRATCH_ARENA_BYTES) {
+            slot->owner = owner;
+            slot->offset = off;
+            slot->size = size;
+            slot->in_use = 1;
+            __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+            ESP_LOGI(TAG, "Scratch %s: %lu B at +%lu (arena %lu/%u B)",
+                     owner, (unsigned long)size, (unsigned long)off,
+                     (unsigned long)(off + size), (unsigned)SCRATCH_ARENA_BYTES);
+            return s_scratch_arena + off;
+        }
+        // 空间不足：槽位保持未就绪（只浪费一个槽，不影响其他owner）
+    }
+
+    __atomic_add_fetch(&s_scratch_fallbacks, 1, __ATOMIC_RELAXED);
+    ESP_LOGW(TAG, "Scratch arena full (%lu/%u B), %s: %lu B from internal heap",
+             (unsigned long)s_scratch_used, (unsigned)SCRATCH_ARENA_BYTES, owner, (unsigned long)size);
+    return heap_caps_aligned_alloc(16, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+void scratch_free(void* ptr) {
+    if (!ptr) return;
+    if (!scratch_in_arena(ptr)) {
+        heap_caps_free(ptr);
+        return;
+    }
+    const uint32_t off = (uint32_t)((uint8_t*)ptr - s_scratch_arena);
+    uint32_t count = __atomic_load_n(&s_scratch_slot_count, __ATOMIC_ACQUIRE);
+    if (count > SCRATCH_MAX_SLOTS) count = SCRATCH_MAX_SLOTS;
+    for (uint32_t i = 0; i < count; i++) {
+        scratch_slot_t* slot = &s_scratch_slots[i];
+        if (__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE) && slot->offset == off) {
+            __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "Invalid scratch_free: %p", ptr);
+}
+
+void mem_placement_get_stats(mem_placement_stats_t* out) {
+    if (!out) return;
+    out->hot_bytes = s_hot_bytes;
+    out->hot_budget = (uint32_t)HOT_BUDGET_BYTES;
+    out->hot_fallbacks = s_hot_fallbacks;
+    out->scratch_used = s_scratch_used;
+    out->scratch_size = (uint32_t)SCRATCH_ARENA_BYTES;
+    out->scratch_fallbacks = s_scratch_fallbacks;
+}
+
+// ============================================================================
+// PCM RingBuffer Implementation
+// ============================================================================
+
+// SPSC公共实现：位置以"单元"计（单声道=样本，多通道=帧），stride为每单元样本数
+// 保留1个单元防止满/空混淆
+
+static size_t rb_span_reserve(int16_t* buffer, size_t capacity, size_t stride,
+                              size_t write_pos, size_t read_pos,
+                              size_t units, ringbuffer_span_t* span) {
+    size_t available_space = (read_pos - write_pos - 1 + capacity) % capacity;
+    size_t n = (units < available_space) ? units : available_space;
+
+    size_t part1 = capacity - write_pos;
+    span->ptr1 = buffer + write_pos * stride;
+    span->len1 = (n <= part1) ? n : part1;
+    span->ptr2 = (n > part1) ? buffer : nullptr;
+    span->len2 = n - span->len1;
+    return n;
+}
+
+static size_t rb_span_peek(int16_t* buffer, size_t capacity, size_t stride,
+                           size_t write_pos, size_t read_pos,
+                           size_t units, ringbuffer_span_t* span) {
+    size_t available = (write_pos - read_pos + capacity) % capacity;
+    size_t n = (units < available) ? units : available;
+
+    // 内存屏障：确保读取write_pos后再读数据
+    __sync_synchronize();
+
+    size_t part1 = capacity - read_pos;
+    span->ptr1 = buffer + read_pos * stride;
+    span->len1 = (n <= part1) ? n : part1;
+    span->ptr2 = (n > part1) ? buffer : nullptr;
+    span->len2 = n - span->len1;
+    return n;
+}
+
+bool ringbuffer_init(pcm_ringbuffer_t* rb, size_t capacity, mem_tier_t tier) {
+    rb->buffer = (int16_t*)mem_tier_alloc(capacity * sizeof(int16_t), tier, "RingBuffer", &rb->internal);
+    if (!rb->buffer) {
+        ESP_LOGE(TAG, "Failed to allocate RingBuffer (%zu samples)", capacity);
+        return false;
+    }
+
+    rb->capacity = capacity;
+    rb->write_pos = 0;
+    rb->read_pos = 0;
+
+    ESP_LOGI(TAG, "RingBuffer initialized (lock-free SPSC): %zu samples (%zuKB, %s)",
+             capacity, (capacity * sizeof(int16_t)) / 1024, rb->internal ? "SRAM" : "PSRAM");
+    return true;
+}
+
+void ringbuffer_free(pcm_ringbuffer_t* rb) {
+    if (!rb || !rb->buffer) return;
+    mem_tier_free(rb->buffer, rb->capacity * sizeof(int16_t), rb->internal);
+    rb->buffer = nullptr;
+    rb->capacity = 0;
+    rb->internal = false;
+}
+
+size_t ringbuffer_reserve(pcm_ringbuffer_t* rb, size_t samples, ringbuffer_span_t* span) {
+    if (!rb || !span) return 0;
+    // 读取消费者指针的快照（volatile确保每次从内存读取）
+    return rb_span_reserve(rb->buffer, rb->capacity, 1,
+                           rb->write_pos, rb->read_pos, samples, span);
+}
+
+void ringbuffer_commit(pcm_ringbuffer_t* rb, size_t samples) {
+    if (!rb || samples == 0) return;
+    // 内存屏障：确保数据写入对消费者可见后再更新write_pos
+    __sync_synchronize();
+    rb->write_pos = (rb->write_pos + samples) % rb->capacity;
+}
+
+size_t ringbuffer_peek(pcm_ringbuffer_t* rb, size_t samples, ringbuffer_span_t* span) {
+    if (!rb || !span) return 0;
+    return rb_span_peek(rb->buffer, rb->capacity, 1,
+                        rb->write_pos, rb->read_pos, samples, span);
+}
+
+void ringbuffer_consume(pcm_ringbuffer_t* rb, size_t samples) {
+    if (!rb || samples == 0) return;
+    // 内存屏障：确保数据读完后再更新read_pos
+    __sync_synchronize();
+    rb->read_pos = (rb->read_pos + samples) % rb->capacity;
+}
+
+size_t ringbuffer_write(pcm_ringbuffer_t* rb, const int16_t* data, size_t samples) {
+    if (!rb || !data || samples == 0) return 0;
+
+    ringbuffer_span_t span;
+    size_t to_write = ringbuffer_reserve(rb, samples, &span);
+    if (to_write == 0) return 0;
+
+    memcpy(span.ptr1, data, span.len1 * sizeof(int16_t));
+    if (span.len2) {
+        memcpy(span.ptr2, data + span.len1, span.len2 * sizeof(int16_t));
+    }
+
+    ringbuffer_commit(rb, to_write);
+    return to_write;
+}
+
+size_t ringbuffer_read(pcm_ringbuffer_t* rb, int16_t* out, size_t samples) {
+    if (!rb || !out || samples == 0) return 0;
+
+    ringbuffer_span_t span;
+    size_t to_read = ringbuffer_peek(rb, samples, &span);
+    if (to_read == 0) return 0;
+
+    memcpy(out, span.ptr1, span.len1 * sizeof(int16_t));
+    if (span.len2) {
+        memcpy(out + span.len1, span.ptr2, span.len2 * sizeof(int16_t));
+    }
+
+    ringbuffer_consume(rb, to_read);
+    return to_read;
+}
+
+size_t ringbuffer_data_available(pcm_ringbuffer_t* rb) {
+    if (!rb) return 0;
+    // volatile读取确保获取最新值
+    return (rb->write_pos - rb->read_pos + rb->capacity) % rb->capacity;
+}
+
+void ringbuffer_reset(pcm_ringbuffer_t* rb) {
+    if (!rb) return;
+    // 仅在idle状态调用（无并发访问）
+    rb->write_pos = 0;
+    rb->read_pos = 0;
+}
+
+// ============================================================================
+// Multi-channel (interleaved) RingBuffer Implementation
+// ============================================================================
+
+bool mc_ringbuffer_init(pcm_mc_ringbuffer_t* rb, size_t frames, uint8_t channels, mem_tier_t tier) {
+    if (!rb || frames == 0 || channels == 0) return false;
+
+    rb->buffer = (int16_t*)mem_tier_alloc(frames * channels * sizeof(int16_t), tier,
+                                          "MC RingBuffer", &rb->internal);
+    if (!rb->buffer) {
+        ESP_LOGE(TAG, "Failed to allocate MC RingBuffer (%zu frames x %u ch)", frames, channels);
+        return false;
+    }
+
+    rb->capacity = frames;
+    rb->channels = channels;
+    rb->write_pos = 0;
+    rb->read_pos = 0;
+
+    ESP_LOGI(TAG, "MC RingBuffer initialized (lock-free SPSC): %zu frames x %u ch (%zuKB, %s)",
+             frames, channels, (frames * channels * sizeof(int16_t)) / 1024,
+             rb->internal ? "SRAM" : "PSRAM");
+    return true;
+}
+
+void mc_ringbuffer_free(pcm_mc_ringbuffer_t* rb) {
+    if (!rb || !rb->buffer) return;
+    mem_tier_free(rb->buffer, rb->capacity * rb->channels * sizeof(int16_t), rb->internal);
+    rb->buffer = nullptr;
+    rb->capacity = 0;
+    rb->internal = false;
+}
+
+size_t mc_ringbuffer_reserve(pcm_mc_ringbuffer_t* rb, size_t frames, ringbuffer_span_t* span) {
+    if (!rb || !span) return 0;
+    return rb_span_reserve(rb->buffer, rb->capacity, rb->channels,
+                           rb->write_pos, rb->read_pos, frames, span);
+}
+
+void mc_ringbuffer_commit(pcm_mc_ringbuffer_t* rb, size_t frames) {
+    if (!rb || frames == 0) return;
+    __sync_synchronize();
+    rb->write_pos = (rb->write_pos + frames) % rb->capacity;
+}
+
+size_t mc_ringbuffer_peek(pcm_mc_ringbuffer_t* rb, size_t frames, ringbuffer_span_t* span) {
+    if (!rb || !span) return 0;
+    return rb_span_peek(rb->buffer, rb->capacity, rb->channels,
+                        rb->write_pos, rb->read_pos, frames, span);
+}
+
+void mc_ringbuffer_consume(pcm_mc_ringbuffer_t* rb, size_t frames) {
+    if (!rb || frames == 0) return;
+    __sync_synchronize();
+    rb->read_pos = (rb->read_pos + frames) % rb->capacity;
+}
+
+size_t mc_ringbuffer_frames_available(pcm_mc_ringbuffer_t* rb) {
+    if (!rb) return 0;
+    return (rb->write_pos - rb->read_pos + rb->capacity) % rb->capacity;
+}
+
+void mc_ringbuffer_reset(pcm_mc_ringbuffer_t* rb) {
+    if (!rb) return;
+    // 仅在idle状态调用（无并发访问）
+    rb->write_pos = 0;
+    rb->read_pos = 0;
+}
+
+// ============================================================================
+// Fixed Memory Pool Implementation
+// ============================================================================
+
+memory_pool_t g_memory_pools[POOL_COUNT];
+
+bool init_memory_pools() {
+    // shared：块可被多个持有者引用（WS接收帧被播放切片共享），需要内部RAM引用计数
+    // tier：S_64是每个队列消息的头（每帧多次访问），放内部SRAM；大块池容量大、按包访问，放PSRAM
+    const struct {
+        uint32_t block_size;
+        uint32_t block_count;
+        bool shared;
+        mem_tier_t tier;
+    } pool_configs[POOL_COUNT] = {
+        {64, 128, false, MEM_HOT},    // POOL_S_64: 64B × 128 = 8KB (afe_output 64 + opus消息头)
+        {128, 32, false, MEM_COLD},   // POOL_S_128: 128B × 32 = 4KB
+        {256, 64, true, MEM_COLD},    // POOL_S_256: 256B × 64 = 16KB (WS接收帧 + 上行Opus包)
+        {2048, 32, true, MEM_COLD},   // POOL_L_2K: 2KB × 32 = 64KB (TTS批量帧 + AFE output)
+        {4096, 8, true, MEM_COLD},    // POOL_L_4K: 4KB × 8 = 32KB (分片重组帧)
+    };
+
+    uint32_t total_size = 0;
+
+    for (int i = 0; i < POOL_COUNT; i++) {
+        memory_pool_t* pool = &g_memory_pools[i];
+        pool->block_size = pool_configs[i].block_size;
+        pool->block_count = pool_configs[i].block_count;
+        pool->bitmap_words = (pool->block_count + 31) / 32;
+        pool->used = 0;
+        pool->high_water = 0;
+        pool->exhausted = 0;
+        pool->alloc_count = 0;
+        pool->free_count = 0;
+
+        // 位图必须在内部RAM：ESP32-S3的原子指令(S32C1I)不支持PSRAM地址
+        pool->free_bitmap = (volatile uint32_t*)heap_caps_calloc(
+            pool->bitmap_words, sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!pool->free_bitmap) {
+            ESP_LOGE(TAG, "Failed to allocate bitmap for pool %d", i);
+            return false;
+        }
+        for (uint32_t w = 0; w < pool->bitmap_words; w++) {
+            uint32_t bits = pool->block_count - w * 32;
+            // 修复：bits=32时(1U << 32)是UB
+            pool->free_bitmap[w] = (bits >= 32) ? 0xFFFFFFFF : ((1U << bits) - 1);
+        }
+
+        // 引用计数同样需要原子操作，放内部RAM
+        pool->refcount = nullptr;
+        if (pool_configs[i].shared) {
+            pool->refcount = (volatile uint32_t*)heap_caps_calloc(
+                pool->block_count, sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            if (!pool->refcount) {
+                ESP_LOGE(TAG, "Failed to allocate refcounts for pool %d", i);
+                return false;
+            }
+        }
+
+        // 按放置等级分配块内存（HOT超出预算时退回PSRAM）
+        static const char* const kPoolNames[POOL_COUNT] = {"Pool S_64", "Pool S_128", "Pool S_256",
+                                                           "Pool L_2K", "Pool L_4K"};
+        pool->memory = mem_tier_alloc(pool->block_size * pool->block_count, pool_configs[i].tier,
+                                      kPoolNames[i], &pool->internal);
+        if (!pool->memory) {
+            ESP_LOGE(TAG, "Failed to allocate pool %d: %lu bytes", i,
+                     pool->block_size * pool->block_count);
+            return false;
+        }
+
+        total_size += pool->block_size * pool->block_count;
+        ESP_LOGI(TAG, "Pool %d: %lu x %lu bytes = %lu KB (%s)",
+                 i, pool->block_count, pool->block_size,
+                 (pool->block_size * pool->block_count) / 1024, pool->internal ? "SRAM" : "PSRAM");
+    }
+
+    ESP_LOGI(TAG, "Memory pools initialized (lock-free): total %lu KB", total_size / 1024);
+    return true;
+}
+
+void* pool_alloc(pool_type_t type) {
+    if (type >= POOL_COUNT) return nullptr;
+
+    memory_pool_t* pool = &g_memory_pools[type];
+    if (!pool->free_bitmap) return nullptr;
+
+    // 逐word查找空闲位，CAS清除该位即占有该块（失败则用最新值重试）
+    for (uint32_t w = 0; w < pool->bitmap_words; w++) {
+        uint32_t cur = __atomic_load_n(&pool->free_bitmap[w], __ATOMIC_RELAXED);
+        while (cur != 0) {
+            int bit = __builtin_ctz(cur);
+            uint32_t next = cur & ~(1U << bit);
+            if (__atomic_compare_exchange_n(&pool->free_bitmap[w], &cur, next, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                uint32_t used = __atomic_add_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+                uint32_t hw = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+                while (used > hw &&
+                       !__atomic_compare_exchange_n(&pool->high_water, &hw, used, true,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                }
+                __atomic_add_fetch(&pool->alloc_count, 1, __ATOMIC_RELAXED);
+
+                uint32_t block_idx = w * 32 + bit;
+                if (pool->refcount) {
+                    __atomic_store_n(&pool->refcount[block_idx], 1, __ATOMIC_RELAXED);
+                }
+                return (uint8_t*)pool->memory + (block_idx * pool->block_size);
+            }
+        }
+    }
+
+    uint32_t n = __atomic_add_fetch(&pool->exhausted, 1, __ATOMIC_RELAXED);
+    // ISR中不打印日志；任务中仅打印前3次和之后每100次
+    if (!xPortInIsrContext() && (n <= 3 || n % 100 == 0)) {
+        ESP_LOGW(TAG, "Pool %d exhausted! (%lu blocks used, %lu times)",
+                 type, pool->used, n);
+    }
+    return nullptr;
+}
+
+pool_type_t pool_type_for_size(size_t len) {
+    if (len <= 64) return POOL_S_64;
+    if (len <= 128) return POOL_S_128;
+    if (len <= 256) return POOL_S_256;
+    if (len <= 2048) return POOL_L_2K;
+    if (len <= 4096) return POOL_L_4K;
+    return POOL_COUNT;
+}
+
+void* pool_alloc_by_size(size_t len) {
+    pool_type_t type = pool_type_for_size(len);
+    if (type >= POOL_COUNT) return nullptr;
+    return pool_alloc(type);
+}
+
+pool_type_t pool_owner(const void* ptr) {
+    if (!ptr) return POOL_COUNT;
+    for (int i = 0; i < POOL_COUNT; i++) {
+        const memory_pool_t* pool = &g_memory_pools[i];
+        const uint8_t* base = (const uint8_t*)pool->memory;
+        if (base && (const uint8_t*)ptr >= base &&
+            (const uint8_t*)ptr < base + pool->block_size * pool->block_count) {
+            return (pool_type_t)i;
+        }
+    }
+    return POOL_COUNT;
+}
+
+void pool_free(void* ptr) {
+    if (!ptr) return;
+
+    pool_type_t type = pool_owner(ptr);
+    if (type >= POOL_COUNT) {
+        if (!xPortInIsrContext()) {
+            ESP_LOGE(TAG, "Invalid pool_free: %p not in any pool", ptr);
+        }
+        return;
+    }
+
+    memory_pool_t* pool = &g_memory_pools[type];
+    uint32_t block_idx = ((uint8_t*)ptr - (uint8_t*)pool->memory) / pool->block_size;
+    uint32_t mask = 1U << (block_idx % 32);
+
+    // 共享块：引用计数减一，仍有持有者时不释放
+    if (pool->refcount) {
+        uint32_t refs = __atomic_load_n(&pool->refcount[block_idx], __ATOMIC_RELAXED);
+        do {
+            if (refs == 0) {
+                if (!xPortInIsrContext()) {
+                    ESP_LOGE(TAG, "Double pool_free: pool %d block %lu (refcount 0)", type, block_idx);
+                }
+                return;
+            }
+        } while (!__atomic_compare_exchange_n(&pool->refcount[block_idx], &refs, refs - 1, true,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        if (refs > 1) {
+            return;
+        }
+    }
+
+    uint32_t prev = __atomic_fetch_or(&pool->free_bitmap[block_idx / 32], mask, __ATOMIC_RELEASE);
+    if (prev & mask) {
+        if (!xPortInIsrContext()) {
+            ESP_LOGE(TAG, "Double pool_free: pool %d block %lu", type, block_idx);
+        }
+        return;
+    }
+
+    __atomic_sub_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->free_count, 1, __ATOMIC_RELAXED);
+}
+
+bool pool_retain(void* ptr) {
+    pool_type_t type = pool_owner(ptr);
+    if (type >= POOL_COUNT) return false;
+
+    memory_pool_t* pool = &g_memory_pools[type];
+    if (!pool->refcount) return false;
+
+    uint32_t block_idx = ((uint8_t*)ptr - (uint8_t*)pool->memory) / pool->block_size;
+    uint32_t refs = __atomic_load_n(&pool->refcount[block_idx], __ATOMIC_RELAXED);
+    do {
+        if (refs == 0) return false;  // 未分配的块不能被引用
+    } while (!__atomic_compare_exchange_n(&pool->refcount[block_idx], &refs, refs + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+bool pool_get_stats(pool_type_t type, pool_stats_t* out) {
+    if (type >= POOL_COUNT || !out) return false;
+    const memory_pool_t* pool = &g_memory_pools[type];
+    out->block_size = pool->block_size;
+    out->block_count = pool->block_count;
+    out->used = pool->used;
+    out->high_water = pool->high_water;
+    out->exhausted = pool->exhausted;
+    out->alloc_count = pool->alloc_count;
+    out->free_count = pool->free_count;
+    out->internal = pool->internal;
+    return true;
+}
+
+void pool_print_stats() {
+    ESP_LOGI(TAG, "=== Memory Pool Stats ===");
+    for (int i = 0; i < POOL_COUNT; i++) {
+        pool_stats_t st;
+        pool_get_stats((pool_type_t)i, &st);
+        if (st.block_count == 0) continue;
+
+        ESP_LOGI(TAG, "Pool %d (%lu B, %s): used=%lu/%lu (%lu%%), peak=%lu, exhausted=%lu, alloc=%lu, free=%lu, leak=%ld",
+                 i, st.block_size, st.internal ? "SRAM" : "PSRAM", st.used, st.block_count,
+                 (st.used * 100) / st.block_count,
+                 st.high_water, st.exhausted,
+                 st.alloc_count, st.free_count,
+                 (int32_t)(st.alloc_count - st.free_count));
+    }
+
+    mem_placement_stats_t mp;
+    mem_placement_get_stats(&mp);
+    ESP_LOGI(TAG, "Placement: hot %lu/%lu B in SRAM (%lu fallbacks), scratch %lu/%lu B (%lu fallbacks)",
+             mp.hot_bytes, mp.hot_budget, mp.hot_fallbacks,
+             mp.scratch_used, mp.scratch_size, mp.scratch_fallbacks);
+}
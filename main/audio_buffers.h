@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief 音频数据通路的缓冲原语（不依赖FreeRTOS对象，可在主机上编译，见host_bench/）
+ *
+ * - pcm_ringbuffer_t / pcm_mc_ringbuffer_t：lock-free SPSC环形缓冲，支持零拷贝reserve/peek
+ * - memory_pool_t：固定块内存池，位图CAS分配，ISR安全，可共享块带引用计数
+ * - 放置策略：每个环/池声明热(HOT)或冷(COLD)，热数据在预算内放内部SRAM
+ * - 临时缓冲区：每帧使用的线性化/解码缓冲从内部RAM静态arena分配（不占任务栈）
+ */
+
+// 内存放置等级
+// HOT：每帧访问（I2S→AFE→编码），放内部SRAM避免PSRAM cache miss；
+//      受CONFIG_ECHOEAR_MEM_HOT_BUDGET_KB和内部RAM剩余下限约束，不满足时退回PSRAM
+// COLD：容量大/访问稀疏（抖动缓冲、预录、TTS帧），放PSRAM
+typedef enum {
+    MEM_COLD = 0,
+    MEM_HOT,
+} mem_tier_t;
+
+// PCM RingBuffer（Lock-free SPSC，单生产者单消费者无锁环形缓冲区）
+// 留一个空槽区分满/空：最多存capacity-1个样本（4096槽位可存4095个，不是4096）
+typedef struct {
+    int16_t* buffer;           // PSRAM或内部SRAM（见internal）
+    size_t capacity;           // 槽位数（样本），可用容量 = capacity - 1
+    volatile size_t write_pos; // 写指针（仅生产者写）
+    volatile size_t read_pos;  // 读指针（仅消费者写）
+    bool internal;             // 实际放在内部SRAM（HOT且预算允许）
+} pcm_ringbuffer_t;
+
+// RingBuffer零拷贝视图（reserve/peek返回，环绕时拆成两段，不环绕时ptr2=NULL/len2=0）
+// 单声道RingBuffer中len单位为样本，多通道RingBuffer中len单位为帧
+typedef struct {
+    int16_t* ptr1;
+    size_t len1;
+    int16_t* ptr2;
+    size_t len2;
+} ringbuffer_span_t;
+
+// 多通道交织 RingBuffer（Lock-free SPSC，以帧为单位，每帧 channels 个样本）
+// I2S读取后直接解交织写入 [M0, M1, R] 布局，AFE直接取用整帧，无需再交织
+// 与单声道环相同留一个空帧：最多存capacity-1帧
+typedef struct {
+    int16_t* buffer;           // capacity × channels 个样本（PSRAM或内部SRAM，见internal）
+    size_t capacity;           // 槽位数（帧），可用容量 = capacity - 1
+    uint8_t channels;          // 每帧通道数（MMR=3, MM=2）
+    volatile size_t write_pos; // 写帧索引（仅生产者写）
+    volatile size_t read_pos;  // 读帧索引（仅消费者写）
+    bool internal;             // 实际放在内部SRAM（HOT且预算允许）
+} pcm_mc_ringbuffer_t;
+
+// 固定内存池（5个池，124KB总计，S_64为HOT，其余在PSRAM）
+typedef enum {
+    POOL_S_64 = 0,   // 64B × 128块 = 8KB（消息结构体）
+    POOL_S_128,      // 128B × 32块 = 4KB
+    POOL_S_256,      // 256B × 64块 = 16KB（Opus包，TTS突发）
+    POOL_L_2K,       // 2KB × 32块 = 64KB（音频缓冲）
+    POOL_L_4K,       // 4KB × 8块 = 32KB（大音频缓冲）
+    POOL_COUNT
+} pool_type_t;
+
+// Lock-free 内存池：空闲位图按32位word存放在内部RAM（PSRAM不支持原子指令），
+// 分配/释放用CAS完成，无互斥锁，可在ISR和任意任务中调用
+typedef struct {
+    void* memory;                   // 预分配块（PSRAM或内部SRAM，见internal）
+    uint32_t block_size;            // 每块大小
+    uint32_t block_count;           // 总块数（不限于32）
+    uint32_t bitmap_words;          // 位图word数 = ceil(block_count / 32)
+    volatile uint32_t* free_bitmap; // 空闲块位图（1=空闲，内部RAM）
+    volatile uint32_t* refcount;    // 每块引用计数（内部RAM，仅可共享的池，否则NULL）
+    volatile uint32_t used;         // 当前已用块数
+    volatile uint32_t high_water;   // 已用块数峰值
+    volatile uint32_t exhausted;    // 分配失败（池耗尽）次数
+    volatile uint32_t alloc_count;  // 累计分配次数
+    volatile uint32_t free_count;   // 累计释放次数
+    bool internal;                  // 块内存在内部SRAM
+} memory_pool_t;
+
+extern memory_pool_t g_memory_pools[POOL_COUNT];
+
+/**
+ * @brief 按放置等级分配缓冲区（环/池的底层分配）
+ * @param name 日志用名称
+ * @param internal 输出：实际是否放在内部SRAM（释放时传回mem_tier_free）
+ * @return nullptr 分配失败（HOT退回PSRAM后仍失败）
+ */
+void* mem_tier_alloc(size_t bytes, mem_tier_t tier, const char* name, bool* internal);
+
+/**
+ * @brief 释放mem_tier_alloc分配的缓冲区（内部SRAM的归还热预算）
+ */
+void mem_tier_free(void* ptr, size_t bytes, bool internal);
+
+/**
+ * @brief 从内部RAM静态arena分配每帧临时缓冲（16字节对齐）
+ *
+ * 同一owner释放后再次申请复用原来的块（模块反复init/deinit不会耗尽arena）；
+ * arena不足时退回内部RAM堆分配。必须用scratch_free释放
+ * @param owner 模块名（字符串常量）
+ */
+void* scratch_alloc(const char* owner, size_t bytes);
+
+/**
+ * @brief 释放scratch_alloc分配的缓冲（arena块标记为空闲，堆块直接释放）
+ */
+void scratch_free(void* ptr);
+
+// 放置统计快照
+typedef struct {
+    uint32_t hot_bytes;          // 放在内部SRAM的HOT缓冲总字节
+    uint32_t hot_budget;         // HOT预算（字节）
+    uint32_t hot_fallbacks;      // HOT退回PSRAM次数
+    uint32_t scratch_used;       // arena已划分字节
+    uint32_t scratch_size;       // arena总字节
+    uint32_t scratch_fallbacks;  // arena不足退回堆分配次数
+} mem_placement_stats_t;
+
+/**
+ * @brief 获取放置策略统计
+ */
+void mem_placement_get_stats(mem_placement_stats_t* out);
+
+/**
+ * @brief 初始化PCM RingBuffer
+ * @param tier 放置等级（默认COLD = PSRAM）
+ */
+bool ringbuffer_init(pcm_ringbuffer_t* rb, size_t capacity, mem_tier_t tier = MEM_COLD);
+
+/**
+ * @brief 释放RingBuffer内存（之后需重新init才能使用）
+ */
+void ringbuffer_free(pcm_ringbuffer_t* rb);
+
+/**
+ * @brief 零拷贝写入RingBuffer（Audio Task使用）
+ */
+size_t ringbuffer_write(pcm_ringbuffer_t* rb, const int16_t* data, size_t samples);
+
+/**
+ * @brief 零拷贝读取RingBuffer（Main Task使用）
+ */
+size_t ringbuffer_read(pcm_ringbuffer_t* rb, int16_t* out, size_t samples);
+
+/**
+ * @brief 查询RingBuffer可读样本数
+ */
+size_t ringbuffer_data_available(pcm_ringbuffer_t* rb);
+
+/**
+ * @brief 重置RingBuffer读写指针
+ */
+void ringbuffer_reset(pcm_ringbuffer_t* rb);
+
+/**
+ * @brief 预留可写空间（生产者零拷贝写入，之后调用ringbuffer_commit）
+ * @return 实际可写样本数（≤samples），span指向RingBuffer内部内存
+ */
+size_t ringbuffer_reserve(pcm_ringbuffer_t* rb, size_t samples, ringbuffer_span_t* span);
+
+/**
+ * @brief 提交已写入的样本（samples ≤ reserve返回值）
+ */
+void ringbuffer_commit(pcm_ringbuffer_t* rb, size_t samples);
+
+/**
+ * @brief 查看可读数据（消费者零拷贝读取，之后调用ringbuffer_consume）
+ * @return 实际可读样本数（≤samples）
+ */
+size_t ringbuffer_peek(pcm_ringbuffer_t* rb, size_t samples, ringbuffer_span_t* span);
+
+/**
+ * @brief 释放已读取的样本（samples ≤ peek返回值）
+ */
+void ringbuffer_consume(pcm_ringbuffer_t* rb, size_t samples);
+
+/**
+ * @brief 初始化多通道交织RingBuffer
+ * @param frames 槽位数（帧，可用frames-1），建议为AFE feed块大小的整数倍：
+ *               读写位置按块对齐时整块不会被环绕拆分，但满载时只能放下frames/块大小-1个整块
+ * @param tier 放置等级（默认COLD = PSRAM）
+ */
+bool mc_ringbuffer_init(pcm_mc_ringbuffer_t* rb, size_t frames, uint8_t channels,
+                        mem_tier_t tier = MEM_COLD);
+
+/**
+ * @brief 释放多通道RingBuffer内存
+ */
+void mc_ringbuffer_free(pcm_mc_ringbuffer_t* rb);
+
+/**
+ * @brief 预留可写帧（span长度单位为帧），之后调用mc_ringbuffer_commit
+ */
+size_t mc_ringbuffer_reserve(pcm_mc_ringbuffer_t* rb, size_t frames, ringbuffer_span_t* span);
+
+/**
+ * @brief 提交已写入的帧
+ */
+void mc_ringbuffer_commit(pcm_mc_ringbuffer_t* rb, size_t frames);
+
+/**
+ * @brief 查看可读帧（span长度单位为帧），之后调用mc_ringbuffer_consume
+ */
+size_t mc_ringbuffer_peek(pcm_mc_ringbuffer_t* rb, size_t frames, ringbuffer_span_t* span);
+
+/**
+ * @brief 释放已读取的帧
+ */
+void mc_ringbuffer_consume(pcm_mc_ringbuffer_t* rb, size_t frames);
+
+/**
+ * @brief 查询多通道RingBuffer可读帧数
+ */
+size_t mc_ringbuffer_frames_available(pcm_mc_ringbuffer_t* rb);
+
+/**
+ * @brief 重置多通道RingBuffer读写指针
+ */
+void mc_ringbuffer_reset(pcm_mc_ringbuffer_t* rb);
+
+/**
+ * @brief 初始化固定内存池
+ */
+bool init_memory_pools();
+
+/**
+ * @brief 从内存池分配块（lock-free，ISR安全）
+ */
+void* pool_alloc(pool_type_t type);
+
+/**
+ * @brief 按数据大小选择能容纳的最小内存池
+ * @return 对应池类型，超过4KB返回POOL_COUNT
+ */
+pool_type_t pool_type_for_size(size_t len);
+
+/**
+ * @brief 按数据大小分配内存池块（lock-free，ISR安全）
+ */
+void* pool_alloc_by_size(size_t len);
+
+/**
+ * @brief 归还内存池块（根据指针地址查找所属池，lock-free，ISR安全）
+ * ptr可以指向块内部；可共享的池中引用计数归零时才真正释放
+ */
+void pool_free(void* ptr);
+
+/**
+ * @brief 为内存池块增加一个引用（ptr可指向块内部，lock-free，ISR安全）
+ * 每次pool_retain都需要一次对应的pool_free
+ * @return false 该池不支持共享（S_64/S_128）或块未分配
+ */
+bool pool_retain(void* ptr);
+
+/**
+ * @brief 查找指针所属的内存池
+ * @return 池类型，不属于任何池时返回POOL_COUNT
+ */
+pool_type_t pool_owner(const void* ptr);
+
+/**
+ * @brief 打印内存池使用统计
+ */
+void pool_print_stats();
+
+// 内存池统计快照
+typedef struct {
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t used;
+    uint32_t high_water;
+    uint32_t exhausted;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    bool internal;
+} pool_stats_t;
+
+/**
+ * @brief 获取内存池统计快照（无锁读取）
+ */
+bool pool_get_stats(pool_type_t type, pool_stats_t* out);
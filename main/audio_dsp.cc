@@ -0,0 +1,567 @@
+#include "audio_dsp.h"
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <sdkconfig.h>
+#include <string.h>
+
+static const char* TAG = "audio_dsp";
+
+#if CONFIG_IDF_TARGET_ESP32S3 && CONFIG_ECHOEAR_DSP_PIE
+#define DSP_HAS_PIE 1
+#else
+#define DSP_HAS_PIE 0
+#endif
+
+static bool s_pie_ok = false;   // dsp_init()自检通过后才启用
+
+static inline int16_t sat16(int32_t v) {
+    return (int16_t)((v > 32767) ? 32767 : (v < -32768) ? -32768 : v);
+}
+
+// ============================================================================
+// 标量实现（回退路径 + PIE自检基准）
+// ============================================================================
+
+static void scalar_deinterleave_stereo(const int16_t* in, int16_t* out0, int16_t* out1, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4, in += 8) {
+        out0[i]     = in[0];
+        out0[i + 1] = in[2];
+        out0[i + 2] = in[4];
+        out0[i + 3] = in[6];
+        if (out1) {
+            out1[i]     = in[1];
+            out1[i + 1] = in[3];
+            out1[i + 2] = in[5];
+            out1[i + 3] = in[7];
+        }
+    }
+    for (; i < frames; i++, in += 2) {
+        out0[i] = in[0];
+        if (out1) out1[i] = in[1];
+    }
+}
+
+static void scalar_interleave_mmr(const int16_t* stereo, const int16_t* ref, int16_t* out, size_t frames) {
+    size_t i = 0;
+    if (ref) {
+        for (; i + 4 <= frames; i += 4, stereo += 8, out += 12) {
+            out[0] = stereo[0]; out[1]  = stereo[1]; out[2]  = ref[i];
+            out[3] = stereo[2]; out[4]  = stereo[3]; out[5]  = ref[i + 1];
+            out[6] = stereo[4]; out[7]  = stereo[5]; out[8]  = ref[i + 2];
+            out[9] = stereo[6]; out[10] = stereo[7]; out[11] = ref[i + 3];
+        }
+        for (; i < frames; i++, stereo += 2, out += 3) {
+            out[0] = stereo[0]; out[1] = stereo[1]; out[2] = ref[i];
+        }
+    } else {
+        for (; i + 4 <= frames; i += 4, stereo += 8, out += 12) {
+            out[0] = stereo[0]; out[1]  = stereo[1]; out[2]  = 0;
+            out[3] = stereo[2]; out[4]  = stereo[3]; out[5]  = 0;
+            out[6] = stereo[4]; out[7]  = stereo[5]; out[8]  = 0;
+            out[9] = stereo[6]; out[10] = stereo[7]; out[11] = 0;
+        }
+        for (; i < frames; i++, stereo += 2, out += 3) {
+            out[0] = stereo[0]; out[1] = stereo[1]; out[2] = 0;
+        }
+    }
+}
+
+static void scalar_gain_sat(int16_t* buf, size_t n, uint8_t gain) {
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = sat16((int32_t)buf[i] * gain);
+    }
+}
+
+static uint64_t scalar_sum_squares(const int16_t* x, size_t n, size_t stride) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++, x += stride) {
+        int32_t s = *x;
+        sum += (uint32_t)(s * s);
+    }
+    return sum;
+}
+
+static bool scalar_is_all_zero(const int16_t* x, size_t n) {
+    size_t i = 0;
+    // 对齐时按32位字OR累积（每次2样本），命中非零立即返回
+    if (((uintptr_t)x & 3) == 0) {
+        const uint32_t* w = (const uint32_t*)x;
+        for (; i + 8 <= n; i += 8, w += 4) {
+            if (w[0] | w[1] | w[2] | w[3]) return false;
+        }
+    }
+    for (; i < n; i++) {
+        if (x[i] != 0) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// PIE实现（ESP32-S3 128位向量单元，q0-q7，每次8×int16）
+// 所有指针必须16字节对齐；blocks = 8样本块数
+// ============================================================================
+
+#if DSP_HAS_PIE
+
+static inline bool aligned16(const void* p) {
+    return ((uintptr_t)p & 15) == 0;
+}
+
+// 到下一个16字节边界前的样本数（int16指针）
+static inline size_t head_to_align16(const int16_t* p) {
+    return ((16 - ((uintptr_t)p & 15)) & 15) / sizeof(int16_t);
+}
+
+static void pie_deinterleave_stereo(const int16_t* in, int16_t* out0, int16_t* out1, size_t blocks) {
+    // q0=[L0 R0 .. L3 R3], q1=[L4 R4 .. L7 R7] → vunzip → q0=[L0..L7], q1=[R0..R7]
+    for (size_t b = 0; b < blocks; b++) {
+        asm volatile(
+            "ee.vld.128.ip q0, %0, 16\n"
+            "ee.vld.128.ip q1, %0, 16\n"
+            "ee.vunzip.16  q0, q1\n"
+            "ee.vst.128.ip q0, %1, 16\n"
+            "ee.vst.128.ip q1, %2, 16\n"
+            : "+r"(in), "+r"(out0), "+r"(out1)
+            :
+            : "memory");
+    }
+}
+
+// 单通道版本：只保留一个通道（另一通道写入scratch）
+static void pie_deinterleave_one(const int16_t* in, int16_t* out0, size_t blocks) {
+    alignas(16) int16_t scratch[8];
+    int16_t* s = scratch;
+    for (size_t b = 0; b < blocks; b++) {
+        asm volatile(
+            "ee.vld.128.ip q0, %0, 16\n"
+            "ee.vld.128.ip q1, %0, 16\n"
+            "ee.vunzip.16  q0, q1\n"
+            "ee.vst.128.ip q0, %1, 16\n"
+            "ee.vst.128.ip q1, %2, 0\n"
+            : "+r"(in), "+r"(out0), "+r"(s)
+            :
+            : "memory");
+    }
+}
+
+// 饱和增益：ee.vadds.s16逐lane饱和加。x·2 = x+x，x·3 = sat(x+x)+x
+// （饱和单调且同号，逐次饱和与一次性sat16(x·gain)结果一致）
+static void pie_gain_sat(int16_t* buf, size_t blocks, uint8_t gain) {
+    if (gain == 2) {
+        for (size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip q0, %0, 0\n"
+                "ee.vadds.s16  q1, q0, q0\n"
+                "ee.vst.128.ip q1, %0, 16\n"
+                : "+r"(buf)
+                :
+                : "memory");
+        }
+    } else {  // gain == 3
+        for (size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip q0, %0, 0\n"
+                "ee.vadds.s16  q1, q0, q0\n"
+                "ee.vadds.s16  q1, q1, q0\n"
+                "ee.vst.128.ip q1, %0, 16\n"
+                : "+r"(buf)
+                :
+                : "memory");
+        }
+    }
+}
+
+// ACCX为40位累加器：每块最大 8 × 2^30 = 2^33，每轮最多64块（2^39）后读出清零
+static const size_t PIE_ACCX_BLOCKS = 64;
+
+static inline uint64_t pie_read_accx() {
+    uint32_t lo, hi;
+    asm volatile(
+        "rur.accx_0 %0\n"
+        "rur.accx_1 %1\n"
+        : "=r"(lo), "=r"(hi));
+    return ((uint64_t)(hi & 0xFF) << 32) | lo;
+}
+
+static uint64_t pie_sum_squares(const int16_t* x, size_t blocks) {
+    uint64_t sum = 0;
+    while (blocks) {
+        size_t run = (blocks < PIE_ACCX_BLOCKS) ? blocks : PIE_ACCX_BLOCKS;
+        asm volatile("ee.zero.accx\n");
+        for (size_t b = 0; b < run; b++) {
+            asm volatile(
+                "ee.vld.128.ip q0, %0, 16\n"
+                "ee.vmulas.s16.accx q0, q0\n"
+                : "+r"(x)
+                :
+                : "memory");
+        }
+        sum += pie_read_accx();
+        blocks -= run;
+    }
+    return sum;
+}
+
+// 立体声单通道平方和：vunzip后只对目标通道做乘累加（blocks = 8帧块数）
+static uint64_t pie_sum_squares_stereo(const int16_t* in, size_t blocks, int channel) {
+    uint64_t sum = 0;
+    while (blocks) {
+        size_t run = (blocks < PIE_ACCX_BLOCKS) ? blocks : PIE_ACCX_BLOCKS;
+        asm volatile("ee.zero.accx\n");
+        if (channel == 0) {
+            for (size_t b = 0; b < run; b++) {
+                asm volatile(
+                    "ee.vld.128.ip q0, %0, 16\n"
+                    "ee.vld.128.ip q1, %0, 16\n"
+                    "ee.vunzip.16  q0, q1\n"
+                    "ee.vmulas.s16.accx q0, q0\n"
+                    : "+r"(in)
+                    :
+                    : "memory");
+            }
+        } else {
+            for (size_t b = 0; b < run; b++) {
+                asm volatile(
+                    "ee.vld.128.ip q0, %0, 16\n"
+                    "ee.vld.128.ip q1, %0, 16\n"
+                    "ee.vunzip.16  q0, q1\n"
+                    "ee.vmulas.s16.accx q1, q1\n"
+                    : "+r"(in)
+                    :
+                    : "memory");
+            }
+        }
+        sum += pie_read_accx();
+        blocks -= run;
+    }
+    return sum;
+}
+
+// 全零检测：每8块（64样本）OR归约一次，非零提前返回
+static bool pie_is_all_zero(const int16_t* x, size_t blocks) {
+    alignas(16) uint32_t acc[4];
+    uint32_t* a = acc;
+    while (blocks) {
+        size_t run = (blocks < 8) ? blocks : 8;
+        asm volatile("ee.zero.q q2\n");
+        for (size_t b = 0; b < run; b++) {
+            asm volatile(
+                "ee.vld.128.ip q0, %0, 16\n"
+                "ee.orq q2, q2, q0\n"
+                : "+r"(x)
+                :
+                : "memory");
+        }
+        asm volatile("ee.vst.128.ip q2, %0, 0\n" : "+r"(a) : : "memory");
+        if (acc[0] | acc[1] | acc[2] | acc[3]) return false;
+        blocks -= run;
+    }
+    return true;
+}
+
+#endif  // DSP_HAS_PIE
+
+// ============================================================================
+// 公共接口（PIE可用且对齐时走SIMD，其余走标量）
+// ============================================================================
+
+bool dsp_pie_enabled() {
+    return s_pie_ok;
+}
+
+void dsp_deinterleave_stereo(const int16_t* in, int16_t* out0, int16_t* out1, size_t frames) {
+#if DSP_HAS_PIE
+    if (s_pie_ok && aligned16(in) && aligned16(out0) && (!out1 || aligned16(out1))) {
+        size_t blocks = frames / 8;
+        if (out1) {
+            pie_deinterleave_stereo(in, out0, out1, blocks);
+            out1 += blocks * 8;
+        } else {
+            pie_deinterleave_one(in, out0, blocks);
+        }
+        in += blocks * 16;
+        out0 += blocks * 8;
+        frames -= blocks * 8;
+    }
+#endif
+    scalar_deinterleave_stereo(in, out0, out1, frames);
+}
+
+void dsp_interleave_mmr(const int16_t* stereo, const int16_t* ref, int16_t* out,
+                        size_t frames, uint8_t channels) {
+    if (channels == 2) {
+        // MM格式与I2S立体声布局相同
+        memcpy(out, stereo, frames * 2 * sizeof(int16_t));
+        return;
+    }
+    // 3通道没有对应的PIE重排指令（vzip只支持2路），标量4帧展开
+    scalar_interleave_mmr(stereo, ref, out, frames);
+}
+
+void dsp_gain_sat(int16_t* buf, size_t n, uint8_t gain) {
+#if DSP_HAS_PIE
+    if (s_pie_ok && (gain == 2 || gain == 3)) {
+        size_t head = head_to_align16(buf);
+        if (head > n) head = n;
+        scalar_gain_sat(buf, head, gain);
+        buf += head;
+        n -= head;
+        size_t blocks = n / 8;
+        pie_gain_sat(buf, blocks, gain);
+        buf += blocks * 8;
+        n -= blocks * 8;
+    }
+#endif
+    scalar_gain_sat(buf, n, gain);
+}
+
+uint64_t dsp_sum_squares(const int16_t* x, size_t n) {
+    uint64_t sum = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok) {
+        size_t head = head_to_align16(x);
+        if (head > n) head = n;
+        sum += scalar_sum_squares(x, head, 1);
+        x += head;
+        n -= head;
+        size_t blocks = n / 8;
+        sum += pie_sum_squares(x, blocks);
+        x += blocks * 8;
+        n -= blocks * 8;
+    }
+#endif
+    return sum + scalar_sum_squares(x, n, 1);
+}
+
+uint64_t dsp_sum_squares_stereo(const int16_t* in, size_t frames, int channel) {
+    uint64_t sum = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok && aligned16(in)) {
+        size_t blocks = frames / 8;
+        sum += pie_sum_squares_stereo(in, blocks, channel);
+        in += blocks * 16;
+        frames -= blocks * 8;
+    }
+#endif
+    return sum + scalar_sum_squares(in + channel, frames, 2);
+}
+
+bool dsp_is_all_zero(const int16_t* x, size_t n) {
+#if DSP_HAS_PIE
+    if (s_pie_ok) {
+        size_t head = head_to_align16(x);
+        if (head > n) head = n;
+        if (!scalar_is_all_zero(x, head)) return false;
+        x += head;
+        n -= head;
+        size_t blocks = n / 8;
+        if (!pie_is_all_zero(x, blocks)) return false;
+        x += blocks * 8;
+        n -= blocks * 8;
+    }
+#endif
+    return scalar_is_all_zero(x, n);
+}
+
+// ============================================================================
+// 自检 + micro-benchmark
+// ============================================================================
+
+// 测试帧长：AFE feed块（256帧）与Opus编码帧（320样本）
+static const size_t BENCH_FRAMES = 256;
+static const size_t BENCH_ENC_SAMPLES = 320;
+static const int BENCH_ITERATIONS = 50;
+
+struct dsp_bench_bufs_t {
+    int16_t* stereo;   // 2 * BENCH_FRAMES
+    int16_t* ref;      // BENCH_FRAMES
+    int16_t* out0;     // BENCH_FRAMES
+    int16_t* out1;     // BENCH_FRAMES
+    int16_t* mmr;      // 3 * BENCH_FRAMES
+    int16_t* gain_a;   // BENCH_ENC_SAMPLES
+    int16_t* gain_b;   // BENCH_ENC_SAMPLES
+};
+
+static bool bench_alloc(dsp_bench_bufs_t* b) {
+    const size_t total = (2 + 1 + 1 + 1 + 3) * BENCH_FRAMES + 2 * BENCH_ENC_SAMPLES;
+    int16_t* base = (int16_t*)heap_caps_aligned_alloc(16, total * sizeof(int16_t),
+                                                      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!base) return false;
+    b->stereo = base;
+    b->ref    = b->stereo + 2 * BENCH_FRAMES;
+    b->out0   = b->ref + BENCH_FRAMES;
+    b->out1   = b->out0 + BENCH_FRAMES;
+    b->mmr    = b->out1 + BENCH_FRAMES;
+    b->gain_a = b->mmr + 3 * BENCH_FRAMES;
+    b->gain_b = b->gain_a + BENCH_ENC_SAMPLES;
+
+    // 伪随机满幅测试信号（覆盖饱和边界）
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < 2 * BENCH_FRAMES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        b->stereo[i] = (int16_t)(seed >> 16);
+    }
+    for (size_t i = 0; i < BENCH_FRAMES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        b->ref[i] = (int16_t)(seed >> 16);
+    }
+    return true;
+}
+
+#if DSP_HAS_PIE
+/**
+ * @brief PIE与标量结果逐样本比对（指令语义与预期不符时禁用PIE，不影响功能）
+ */
+static bool pie_self_test(dsp_bench_bufs_t* b) {
+    const size_t blocks = BENCH_FRAMES / 8;
+
+    // 解交织
+    scalar_deinterleave_stereo(b->stereo, b->gain_a, b->gain_b, BENCH_FRAMES);
+    pie_deinterleave_stereo(b->stereo, b->out0, b->out1, blocks);
+    if (memcmp(b->out0, b->gain_a, BENCH_FRAMES * sizeof(int16_t)) != 0 ||
+        memcmp(b->out1, b->gain_b, BENCH_FRAMES * sizeof(int16_t)) != 0) {
+        ESP_LOGE(TAG, "PIE self-test failed: deinterleave");
+        return false;
+    }
+
+    // 饱和增益
+    for (uint8_t gain = 2; gain <= 3; gain++) {
+        memcpy(b->gain_a, b->stereo, BENCH_ENC_SAMPLES * sizeof(int16_t));
+        memcpy(b->gain_b, b->stereo, BENCH_ENC_SAMPLES * sizeof(int16_t));
+        scalar_gain_sat(b->gain_a, BENCH_ENC_SAMPLES, gain);
+        pie_gain_sat(b->gain_b, BENCH_ENC_SAMPLES / 8, gain);
+        if (memcmp(b->gain_a, b->gain_b, BENCH_ENC_SAMPLES * sizeof(int16_t)) != 0) {
+            ESP_LOGE(TAG, "PIE self-test failed: gain x%u", gain);
+            return false;
+        }
+    }
+
+    // 平方和（含交织单通道）
+    if (pie_sum_squares(b->stereo, 2 * blocks) != scalar_sum_squares(b->stereo, 2 * BENCH_FRAMES, 1) ||
+        pie_sum_squares_stereo(b->stereo, blocks, 0) != scalar_sum_squares(b->stereo, BENCH_FRAMES, 2) ||
+        pie_sum_squares_stereo(b->stereo, blocks, 1) != scalar_sum_squares(b->stereo + 1, BENCH_FRAMES, 2)) {
+        ESP_LOGE(TAG, "PIE self-test failed: sum of squares");
+        return false;
+    }
+
+    // 全零检测
+    memset(b->gain_a, 0, BENCH_ENC_SAMPLES * sizeof(int16_t));
+    if (!pie_is_all_zero(b->gain_a, BENCH_ENC_SAMPLES / 8)) {
+        ESP_LOGE(TAG, "PIE self-test failed: all-zero (zeros)");
+        return false;
+    }
+    b->gain_a[BENCH_ENC_SAMPLES - 1] = 1;
+    if (pie_is_all_zero(b->gain_a, BENCH_ENC_SAMPLES / 8)) {
+        ESP_LOGE(TAG, "PIE self-test failed: all-zero (non-zero)");
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool dsp_init() {
+    s_pie_ok = false;
+#if DSP_HAS_PIE
+    dsp_bench_bufs_t b;
+    if (!bench_alloc(&b)) {
+        ESP_LOGW(TAG, "Self-test buffer allocation failed, using scalar kernels");
+        return false;
+    }
+    s_pie_ok = pie_self_test(&b);
+    heap_caps_free(b.stereo);
+#endif
+    ESP_LOGI(TAG, "DSP kernels: %s", s_pie_ok ? "PIE SIMD (8x int16)" : "scalar");
+
+#if CONFIG_ECHOEAR_DSP_BENCHMARK
+    dsp_run_benchmark();
+#endif
+    return s_pie_ok;
+}
+
+// 测量一段代码的最小cycles（最小值排除中断/缓存抖动）
+#define DSP_BENCH(result, expr)                                    \
+    do {                                                           \
+        uint32_t best = UINT32_MAX;                                \
+        for (int it = 0; it < BENCH_ITERATIONS; it++) {            \
+            uint32_t t0 = esp_cpu_get_cycle_count();               \
+            expr;                                                  \
+            uint32_t dt = esp_cpu_get_cycle_count() - t0;          \
+            if (dt < best) best = dt;                              \
+        }                                                          \
+        (result) = best;                                           \
+    } while (0)
+
+static void bench_report(const char* name, size_t samples, uint32_t scalar, uint32_t pie) {
+    if (pie) {
+        ESP_LOGI(TAG, "  %-18s %4zu samples: scalar=%6lu  pie=%6lu cycles/frame (x%.1f)",
+                 name, samples, scalar, pie, (float)scalar / pie);
+    } else {
+        ESP_LOGI(TAG, "  %-18s %4zu samples: scalar=%6lu cycles/frame",
+                 name, samples, scalar);
+    }
+}
+
+void dsp_run_benchmark() {
+    dsp_bench_bufs_t b;
+    if (!bench_alloc(&b)) {
+        ESP_LOGE(TAG, "Benchmark buffer allocation failed");
+        return;
+    }
+
+    // 防止编译器优化掉无副作用的调用
+    volatile uint64_t sink64 = 0;
+    volatile bool sink_b = false;
+    uint32_t s = 0, p = 0;
+
+    ESP_LOGI(TAG, "=== DSP kernel benchmark (core %d, min of %d runs) ===",
+             xPortGetCoreID(), BENCH_ITERATIONS);
+
+    DSP_BENCH(s, scalar_deinterleave_stereo(b.stereo, b.out0, b.out1, BENCH_FRAMES));
+#if DSP_HAS_PIE
+    if (s_pie_ok) DSP_BENCH(p, pie_deinterleave_stereo(b.stereo, b.out0, b.out1, BENCH_FRAMES / 8));
+#endif
+    bench_report("deinterleave", BENCH_FRAMES, s, p);
+
+    DSP_BENCH(s, scalar_interleave_mmr(b.stereo, b.ref, b.mmr, BENCH_FRAMES));
+    bench_report("interleave_mmr", BENCH_FRAMES, s, 0);
+    DSP_BENCH(s, memcpy(b.mmr, b.stereo, BENCH_FRAMES * 2 * sizeof(int16_t)));
+    bench_report("interleave_mm", BENCH_FRAMES, s, 0);
+
+    memcpy(b.gain_a, b.stereo, BENCH_ENC_SAMPLES * sizeof(int16_t));
+    DSP_BENCH(s, scalar_gain_sat(b.gain_a, BENCH_ENC_SAMPLES, 3));
+    p = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok) DSP_BENCH(p, pie_gain_sat(b.gain_a, BENCH_ENC_SAMPLES / 8, 3));
+#endif
+    bench_report("gain_sat x3", BENCH_ENC_SAMPLES, s, p);
+
+    DSP_BENCH(s, sink64 = scalar_sum_squares(b.stereo, BENCH_ENC_SAMPLES, 1));
+    p = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok) DSP_BENCH(p, sink64 = pie_sum_squares(b.stereo, BENCH_ENC_SAMPLES / 8));
+#endif
+    bench_report("sum_squares", BENCH_ENC_SAMPLES, s, p);
+
+    DSP_BENCH(s, sink64 = scalar_sum_squares(b.stereo, BENCH_FRAMES, 2));
+    p = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok) DSP_BENCH(p, sink64 = pie_sum_squares_stereo(b.stereo, BENCH_FRAMES / 8, 0));
+#endif
+    bench_report("sum_squares_mic0", BENCH_FRAMES, s, p);
+
+    // 最坏情况（全零帧需扫描完整帧）
+    memset(b.gain_b, 0, BENCH_ENC_SAMPLES * sizeof(int16_t));
+    DSP_BENCH(s, sink_b = scalar_is_all_zero(b.gain_b, BENCH_ENC_SAMPLES));
+    p = 0;
+#if DSP_HAS_PIE
+    if (s_pie_ok) DSP_BENCH(p, sink_b = pie_is_all_zero(b.gain_b, BENCH_ENC_SAMPLES / 8));
+#endif
+    bench_report("is_all_zero", BENCH_ENC_SAMPLES, s, p);
+
+    (void)sink64;
+    (void)sink_b;
+    heap_caps_free(b.stereo);
+}
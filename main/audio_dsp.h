@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+/**
+ * @brief 音频DSP热点内核 - ESP32-S3 PIE SIMD（8×int16/指令）+ 标量回退
+ *
+ * 覆盖每帧都在跑的逐样本循环：
+ * - 立体声解交织 [M0,M1,...] → M0[] / M1[]
+ * - MM/MMR交织（I2S立体声 + 参考通道 → 采集RingBuffer）
+ * - 固定整数倍饱和增益（Opus编码前3x）
+ * - 平方和（RMS能量：麦克风诊断、TTS节奏动画）
+ * - 全零检测（AEC零输出检测）
+ *
+ * PIE路径要求16字节对齐；单指针内核会先用标量处理未对齐的头部，
+ * 多指针内核在任一指针未对齐时整体走标量。尾部不足8样本的部分总是标量。
+ * dsp_init()会用测试向量比对PIE与标量结果，不一致时自动禁用PIE。
+ */
+
+/**
+ * @brief 初始化DSP内核：PIE自检（可选运行micro-benchmark）
+ * @return PIE路径是否启用
+ */
+bool dsp_init();
+
+/**
+ * @brief PIE SIMD路径是否启用
+ */
+bool dsp_pie_enabled();
+
+/**
+ * @brief 立体声解交织：in[2*frames] → out0[frames], out1[frames]（out1可为nullptr）
+ */
+void dsp_deinterleave_stereo(const int16_t* in, int16_t* out0, int16_t* out1, size_t frames);
+
+/**
+ * @brief I2S立体声 + 参考通道交织：[M0,M1] + R → [M0,M1,R]（channels=3）或 [M0,M1]（channels=2）
+ * @param ref 参考通道（channels=3时有效，nullptr填零）
+ */
+void dsp_interleave_mmr(const int16_t* stereo, const int16_t* ref, int16_t* out,
+                        size_t frames, uint8_t channels);
+
+/**
+ * @brief 原地整数倍饱和增益：buf[i] = sat16(buf[i] * gain)
+ */
+void dsp_gain_sat(int16_t* buf, size_t n, uint8_t gain);
+
+/**
+ * @brief 平方和 Σx²（64位累加，不溢出）
+ */
+uint64_t dsp_sum_squares(const int16_t* x, size_t n);
+
+/**
+ * @brief 立体声交织数据中单个通道的平方和（channel = 0 或 1）
+ */
+uint64_t dsp_sum_squares_stereo(const int16_t* in, size_t frames, int channel);
+
+/**
+ * @brief 是否全部为零
+ */
+bool dsp_is_all_zero(const int16_t* x, size_t n);
+
+/**
+ * @brief RMS（便捷封装）
+ */
+static inline float dsp_rms(const int16_t* x, size_t n) {
+    return n ? sqrtf((float)dsp_sum_squares(x, n) / n) : 0.0f;
+}
+
+/**
+ * @brief 运行micro-benchmark，打印每个内核的cycles/frame（标量 vs PIE）
+ */
+void dsp_run_benchmark();
@@ -12,6 +12,25 @@
 
 static const char* TAG = "audio_i2s";
 
+// RX DMA完成通知目标（ISR中读取）
+static volatile TaskHandle_t s_rx_notify_task = nullptr;
+static volatile uint32_t s_rx_notify_bits = 0;
+// RX DMA收满字节累计与单个buffer大小（仅ISR写），读取侧据此计算未读积压
+static volatile uint32_t s_rx_recv_bytes = 0;
+static volatile uint32_t s_rx_buf_bytes = 0;
+
+static const uint32_t I2S_DMA_DESC_NUM = 4;
+
+static bool IRAM_ATTR i2s_rx_done_cb(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    s_rx_recv_bytes = s_rx_recv_bytes + (uint32_t)event->size;
+    s_rx_buf_bytes = (uint32_t)event->size;
+    TaskHandle_t task = s_rx_notify_task;
+    if (!task) return false;
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(task, s_rx_notify_bits, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
 // 轻量级初始化：只创建I2C总线（用于配网模式触摸检测）
 bool AudioI2S::init_i2c_only() {
     if (i2c_bus_) {
@@ -69,7 +88,7 @@ bool AudioI2S::init() {
     i2s_chan_config_t chan_cfg = {};
     chan_cfg.id = I2S_NUM_0;
     chan_cfg.role = I2S_ROLE_MASTER;
-    chan_cfg.dma_desc_num = 4;
+    chan_cfg.dma_desc_num = I2S_DMA_DESC_NUM;
     chan_cfg.dma_frame_num = 128;
     chan_cfg.auto_clear_after_cb = true;
     chan_cfg.auto_clear_before_cb = false;
@@ -129,6 +148,11 @@ bool AudioI2S::init() {
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode((i2s_chan_handle_t)tx_chan_, &std_cfg));
     ESP_ERROR_CHECK(i2s_channel_init_tdm_mode((i2s_chan_handle_t)rx_chan_, &tdm_cfg));
+
+    // RX完成回调必须在enable前注册；通知目标稍后由set_rx_notify()设置
+    i2s_event_callbacks_t rx_cbs = {};
+    rx_cbs.on_recv = i2s_rx_done_cb;
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback((i2s_chan_handle_t)rx_chan_, &rx_cbs, nullptr));
     ESP_ERROR_CHECK(i2s_channel_enable((i2s_chan_handle_t)tx_chan_));
     ESP_ERROR_CHECK(i2s_channel_enable((i2s_chan_handle_t)rx_chan_));
 
@@ -226,6 +250,11 @@ bool AudioI2S::init() {
     return true;
 }
 
+void AudioI2S::set_rx_notify(TaskHandle_t task, uint32_t bits) {
+    s_rx_notify_bits = bits;
+    s_rx_notify_task = task;
+}
+
 int AudioI2S::read_frame(uint8_t* buf, size_t len) {
     if (!input_dev_) return -1;
     esp_err_t err = esp_codec_dev_read((esp_codec_dev_handle_t)input_dev_, buf, len);
@@ -233,9 +262,22 @@ int AudioI2S::read_frame(uint8_t* buf, size_t len) {
         ESP_LOGE(TAG, "Failed to read audio frame: %d", err);
         return -1;
     }
+    rx_read_bytes_ += (uint32_t)len;
     return (int)len;
 }
 
+size_t AudioI2S::rx_pending_bytes() {
+    const uint32_t recv = s_rx_recv_bytes;
+    const uint32_t cap = I2S_DMA_DESC_NUM * s_rx_buf_bytes;
+    uint32_t pending = recv - rx_read_bytes_;
+    if (pending > cap) {
+        // DMA溢出：最旧的buffer已被覆盖，只剩cap字节可读
+        rx_read_bytes_ = recv - cap;
+        pending = cap;
+    }
+    return pending;
+}
+
 int AudioI2S::play_frame(const uint8_t* buf, size_t len) {
     if (!output_dev_) return -1;
     esp_err_t err = esp_codec_dev_write((esp_codec_dev_handle_t)output_dev_, (void*)buf, len);
@@ -2,6 +2,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 class AudioI2S {
 public:
@@ -17,6 +19,11 @@ public:
     void play_test_tone();
     void* i2c_bus() const { return i2c_bus_; }
 
+    // RX DMA完成通知：每个DMA buffer收满时在ISR中对task置位bits（task=nullptr关闭）
+    void set_rx_notify(TaskHandle_t task, uint32_t bits);
+    // 已收满但尚未read_frame()读走的RX字节数（通知合并时据此判断是否继续读）
+    size_t rx_pending_bytes();
+
     // Volume control (0-100)
     void set_volume(int vol);
     int  get_volume() const { return volume_; }
@@ -32,4 +39,5 @@ private:
     void* input_dev_ = nullptr;  // esp_codec_dev_handle_t
     int volume_ = 80;    // Default 80%
     bool muted_ = false;
+    uint32_t rx_read_bytes_ = 0;  // read_frame()累计读走的字节（与ISR的收满累计对比）
 };
@@ -1,11 +1,17 @@
 #include "task_manager.h"
 #include "audio_i2s.h"
 #include "advanced_afe.h"
-#include "opus_encoder.h"
-#include "opus_decoder.h"
+#include "audio_uplink.h"
+#include "audio_playout.h"
+#include "audio_dsp.h"
 #include "lvgl_ui.h"
+#include "system_monitor.h"
+#include "diagnostics.h"
+#include "vad_endpoint.h"
+#include "boot_sequence.h"
 #include "config.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <string.h>
 #include <cmath>
 
@@ -19,8 +25,72 @@ typedef enum {
     AUDIO_MODE_PLAYING,    // 播放TTS
 } audio_mode_t;
 
-// Opus编码统计（用于屏幕显示）
-static uint32_t g_opus_encode_count = 0;
+// AFE feed块大小（每通道样本数，与afe_cfg.frame_size一致）
+static const size_t AFE_FEED_FRAMES = 256;
+
+/**
+ * @brief I2S立体声 [M0, M1] → 采集RingBuffer交织帧 [M0, M1, (R)]
+ *
+ * 参考通道来自g_ref_ringbuffer（播放中=实际PCM，不足一整块时填零），
+ * 直接写入RingBuffer内部内存，不经过中间缓冲。
+ * @param stamp 本块的延迟时间戳（commit前交给AFE输入时间戳队列）
+ * @return 写入帧数（空间不足时整块丢弃，返回0，保持256帧对齐）
+ */
+static size_t capture_deinterleave_to_ring(AdvancedAFE& afe, const int16_t* i2s, size_t frames,
+                                           const latency_stamp_t* stamp) {
+    pcm_mc_ringbuffer_t* rb = &g_capture_ringbuffer;
+    const uint8_t ch = rb->channels;
+
+    ringbuffer_span_t dst;
+    if (mc_ringbuffer_reserve(rb, frames, &dst) < frames) {
+        return 0;
+    }
+
+    ringbuffer_span_t ref = {};
+    bool has_ref = false;
+    if (ch == 3 && ringbuffer_peek(&g_ref_ringbuffer, frames, &ref) == frames) {
+        has_ref = true;
+    }
+
+    // 按"目标段 × 参考段"都连续的片段调用交织内核（最多3段）
+    size_t k = 0;
+    int16_t* seg_ptr[2] = {dst.ptr1, dst.ptr2};
+    size_t seg_len[2] = {dst.len1, dst.len2};
+    for (int seg = 0; seg < 2; seg++) {
+        int16_t* out = seg_ptr[seg];
+        size_t len = seg_len[seg];
+        while (len > 0) {
+            const int16_t* r = nullptr;
+            size_t run = len;
+            if (has_ref) {
+                if (k < ref.len1) {
+                    r = ref.ptr1 + k;
+                    if (run > ref.len1 - k) run = ref.len1 - k;
+                } else {
+                    r = ref.ptr2 + (k - ref.len1);
+                }
+            }
+            dsp_interleave_mmr(i2s + k * 2, r, out, run, ch);
+            out += run * ch;
+            len -= run;
+            k += run;
+        }
+    }
+
+    if (has_ref) {
+        ringbuffer_consume(&g_ref_ringbuffer, frames);
+    }
+    afe.stamp_input(frames, stamp);
+    mc_ringbuffer_commit(rb, frames);
+    return frames;
+}
+
+/**
+ * @brief 丢弃参考RingBuffer中的残留数据（消费者侧，不与播放任务的写入竞争）
+ */
+static void discard_ref_ring() {
+    ringbuffer_consume(&g_ref_ringbuffer, ringbuffer_data_available(&g_ref_ringbuffer));
+}
 
 /**
  * @brief Audio Main Task - 整合所有音频处理
@@ -42,6 +112,9 @@ void audio_main_task(void* arg) {
     // NOTE: AudioI2S和触摸传感器已在main.cc中提前初始化
     // 这里直接使用即可
 
+    // 1.5. DSP内核自检（PIE SIMD，在音频核上运行）
+    dsp_init();
+
     // 2. AFE音频前端处理器（使用xiaozhi的afe_config_init()方法）
     //   ✅ 修复成功：使用afe_config_init()替代手动配置
     AdvancedAFE afe;
@@ -59,6 +132,22 @@ void audio_main_task(void* arg) {
         .wake_threshold = 0,
     };
 
+    // 流式模式：afe_task直接读采集RingBuffer、写AFE输出RingBuffer
+    afe_cfg.input_ring = &g_capture_ringbuffer;
+    afe_cfg.output_ring = &g_afe_out_ringbuffer;
+
+    // 采集RingBuffer通道数需与AFE输入格式一致（MMR=3, MM=2）
+    const uint8_t afe_channels = afe_cfg.enable_aec ? 3 : 2;
+    if (g_capture_ringbuffer.channels != afe_channels) {
+        size_t frames = g_capture_ringbuffer.capacity;
+        mc_ringbuffer_free(&g_capture_ringbuffer);
+        if (!mc_ringbuffer_init(&g_capture_ringbuffer, frames, afe_channels, MEM_HOT)) {
+            ESP_LOGE(TAG, "Failed to re-init capture RingBuffer (%u ch)", afe_channels);
+            vTaskDelete(NULL);
+            return;
+        }
+    }
+
     if (!afe.init(afe_cfg)) {
         ESP_LOGE(TAG, "Failed to initialize AFE");
         vTaskDelete(NULL);
@@ -75,7 +164,7 @@ void audio_main_task(void* arg) {
             return;
         }
         ESP_LOGI(TAG, "🎤🎤🎤 Wake word detected: %s", wake_word);
-        xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_WAKE_DETECTED);
+        audio_post_event(AUDIO_EVENT_WAKE_DETECTED);
     });
 
     // 启动AFE处理任务
@@ -87,360 +176,249 @@ void audio_main_task(void* arg) {
     }
     ESP_LOGI(TAG, "AFE processing task started with WakeNet (AEC: %s)", afe_cfg.enable_aec ? "ON" : "OFF");
 
-    // 3. Opus编码器/解码器
-    OpusEncoder opus_enc;
+    // 3. 上行编码级（AFE输出 → 帧RingBuffer → Opus编码任务）
     // 激进优化：32kbps → 48kbps，最大化快速说话识别准确度
     // 48kbps接近Opus在16kHz单声道的最优码率（理论上限约64kbps）
-    if (!opus_enc.init(16000, 1, 48000)) {  // 16kHz, mono, 48kbps
-        ESP_LOGE(TAG, "Failed to initialize Opus encoder");
+    AudioUplink& uplink = AudioUplink::instance();
+    if (!uplink.init(&afe, 16000, 1, 48000)) {  // 16kHz, mono, 48kbps
+        ESP_LOGE(TAG, "Failed to initialize audio uplink");
         vTaskDelete(NULL);
         return;
     }
 
-    OpusDecoder opus_dec;
-    if (!opus_dec.init(16000, 1)) {  // 16kHz, mono
-        ESP_LOGE(TAG, "Failed to initialize Opus decoder");
-        opus_enc.deinit();
+    // 播放输出级：独立任务解码+抖动缓冲，播放不再阻塞本任务的采集/AFE
+    AudioPlayout& playout = AudioPlayout::instance();
+    if (!playout.init(16000, 1)) {  // 16kHz, mono
+        ESP_LOGE(TAG, "Failed to initialize audio playout");
         vTaskDelete(NULL);
         return;
     }
 
+    // 自适应编码档位（由编码级驱动，初始HIGH = 上面的48kbps/c8配置）
+    OpusRateController& rate_ctrl = OpusRateController::instance();
+
     ESP_LOGI(TAG, "All audio components initialized successfully");
 
     // === 本地状态变量 ===
     audio_mode_t mode = AUDIO_MODE_IDLE;
-    alignas(16) int16_t i2s_buffer[512];           // I2S读取缓冲区（512 samples = ~32ms @ 16kHz）
-    alignas(16) int16_t afe_accumulator[320];      // AFE输出累积器（Opus 20ms帧 = 320 samples @ 16kHz）
-    size_t afe_accum_count = 0;
-    const size_t enc_frame_size = opus_enc.frame_size();  // 320 for 20ms @ 16kHz
+    // I2S读取缓冲区（512 samples = ~32ms @ 16kHz，内部RAM scratch arena，不占任务栈）
+    static const size_t I2S_BUFFER_SAMPLES = 512;
+    int16_t* i2s_buffer = (int16_t*)scratch_alloc("audio_main.i2s", I2S_BUFFER_SAMPLES * sizeof(int16_t));
+    if (!i2s_buffer) {
+        ESP_LOGE(TAG, "Failed to allocate I2S read buffer");
+        vTaskDelete(NULL);
+        return;
+    }
 
     uint32_t frame_count = 0;
     uint32_t i2s_read_count = 0;  // I2S成功读取次数
     uint32_t i2s_samples_total = 0;  // 总采样数
     uint32_t last_stats_time = 0;
-    uint32_t silence_start_time = 0;  // 静音计时器（跨代码块共享）
-    uint32_t recording_start_time = 0;  // 录音开始时间
-    uint32_t vad_trigger_count = 0;    // VAD连续触发次数
-    uint32_t last_vad_trigger_time = 0; // 上次VAD触发时间（冷却计时）
     uint32_t thinking_start_time = 0;   // THINKING模式开始时间
-    uint32_t tts_play_count = 0;        // TTS播放帧计数（每次PLAYING重置）
-    uint32_t tts_underrun_count = 0;    // TTS underrun计数（每次PLAYING重置）
     const uint32_t MAX_RECORDING_MS = 10000;  // 最大录音时间10秒
+    const uint32_t SILENCE_END_MS = 800;      // 静音多久结束录音
+    const uint32_t SHORT_RECORDING_MS = 500;  // 短于此的录音直接回IDLE
+    VadEndpointer endpointer({SILENCE_END_MS, SHORT_RECORDING_MS, MAX_RECORDING_MS});
     const uint32_t THINKING_TIMEOUT_MS = 15000; // THINKING超时15秒
 
+    BootSequence::instance().mark(BootSequence::Stage::WAKE_READY);
     ESP_LOGI(TAG, "Entering main audio processing loop...");
 
-    // === 主循环 ===
+    // === 主循环（事件驱动）===
+    // 所有工作来源都通过任务通知唤醒本任务：I2S RX DMA完成(ISR)、AFE输出就绪、
+    // 控制命令。没有通知时阻塞等待，不再1ms轮询。播放由AudioPlayout任务独立完成。
+    g_audio_task_handle = xTaskGetCurrentTaskHandle();
+    afe.on_output_ready([]() { audio_task_notify(AUDIO_NOTIFY_AFE_OUT); });
+    audio_i2s.set_rx_notify(g_audio_task_handle, AUDIO_NOTIFY_I2S_RX);
+
+    uint32_t idle_iterations = 0;   // 被唤醒但没有任何工作的迭代次数
+    uint32_t notify_bits = AUDIO_NOTIFY_I2S_RX;  // 首轮主动读取一次I2S
+
     while (1) {
         frame_count++;
+        bool did_work = false;
+        const bool timed_out = (notify_bits == 0);
 
         // 每10000帧打印一次当前模式
         if (frame_count % 10000 == 0) {
-            ESP_LOGI(TAG, "Main loop: frame=%lu, mode=%d (0=IDLE,1=REC,2=THINK,3=PLAY)",
-                     frame_count, mode);
-        }
-
-        // === 播放模式：解码+播放，同时保持WakeNet活跃 ===
-        // 全双工设计：播放1帧TTS(~60ms DMA阻塞)后，I2S RX DMA已收集输入数据，
-        // read_frame近乎即时返回。继续feed AFE保持WakeNet检测，实现TTS打断。
-        // Opus编码在section 4中已有mode==RECORDING守卫，PLAYING时不会编码。
-        if (mode == AUDIO_MODE_PLAYING) {
-            // 检查控制命令
-            audio_cmd_t play_cmd;
-            if (xQueueReceive(g_audio_cmd_queue, &play_cmd, 0) == pdTRUE) {
-                if (play_cmd == AUDIO_CMD_STOP_PLAYBACK) {
-                    ESP_LOGI(TAG, "Stop playback mode, resetting for next wake");
-                    mode = AUDIO_MODE_IDLE;
-                    last_vad_trigger_time = xTaskGetTickCount();
-                    vad_trigger_count = 0;
-                    opus_dec.reset();
-                    ringbuffer_reset(&g_pcm_ringbuffer);  // 清除echo污染数据
-                    ringbuffer_reset(&g_ref_ringbuffer);   // 清除残留参考数据
-                    ringbuffer_reset(&g_mic1_ringbuffer);  // 清除MIC1残留数据
-                    if (afe_cfg.enable_aec) afe.enable_aec(false);  // 停止播放→禁用AEC
-                    afe_accum_count = 0;  // 重置AFE累积器
-                    // 打印内存状态（检测泄漏）
-                    ESP_LOGI(TAG, "Post-playback: heap=%lu, PSRAM=%lu",
-                             esp_get_free_heap_size(),
-                             heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-                    pool_print_stats();
-                } else if (play_cmd == AUDIO_CMD_START_RECORDING) {
-                    ESP_LOGI(TAG, "Start recording (interrupting playback)");
-                    mode = AUDIO_MODE_RECORDING;
-                    afe_accum_count = 0;
-                    silence_start_time = 0;
-                    recording_start_time = xTaskGetTickCount();
-                    opus_dec.reset();
-                    ringbuffer_reset(&g_pcm_ringbuffer);
-                    ringbuffer_reset(&g_ref_ringbuffer);  // 清除残留参考数据
-                    ringbuffer_reset(&g_mic1_ringbuffer);  // 清除MIC1残留数据
-                    if (afe_cfg.enable_aec) afe.enable_aec(false);  // 录音时禁用AEC
-                }
-            }
-
-            // 解码+播放1帧（~60ms DMA阻塞，期间RX DMA自动收集麦克风数据）
-            opus_packet_msg_t* rx_msg = nullptr;
-            if (mode == AUDIO_MODE_PLAYING &&
-                xQueueReceive(g_opus_playback_queue, &rx_msg, pdMS_TO_TICKS(20)) == pdTRUE) {
-                tts_play_count++;
-                tts_underrun_count = 0;  // 收到数据，重置连续underrun
-
-                if (rx_msg->len >= 3) {
-                    int16_t pcm_decoded[960];
-                    int decoded_samples = opus_dec.decode(rx_msg->data, rx_msg->len,
-                                                          pcm_decoded, 960);
-                    if (decoded_samples > 0) {
-                        if (tts_play_count <= 3 || tts_play_count % 50 == 0) {
-                            UBaseType_t q_depth = uxQueueMessagesWaiting(g_opus_playback_queue);
-                            ESP_LOGI(TAG, "TTS play #%lu: %d samples, queue=%u/24",
-                                     tts_play_count, decoded_samples, (unsigned)q_depth);
-                        }
-
-                        // 音乐节奏动画：计算音频能量并更新UI
-                        // 降低更新频率以减少CPU负载：每3帧（180ms）更新一次，而非每60ms
-                        static uint32_t energy_update_counter = 0;
-                        energy_update_counter++;
-
-                        if (energy_update_counter % 3 == 0) {
-                            // 计算RMS能量
-                            int64_t sum_squares = 0;
-                            for (int i = 0; i < decoded_samples; i++) {
-                                int32_t sample = pcm_decoded[i];
-                                sum_squares += (int64_t)sample * sample;
-                            }
-                            float rms = sqrtf((float)sum_squares / decoded_samples);
-                            float energy = rms / 32768.0f;  // 归一化到0.0-1.0
-
-                            // UI会根据当前状态决定是否显示耳机图标
-                            lvgl_ui_set_music_energy(energy);
-                        }
-
-                        audio_i2s.play_frame((uint8_t*)pcm_decoded, decoded_samples * sizeof(int16_t));
-                        // 喂入参考 RingBuffer 供 AEC 回声消除使用
-                        ringbuffer_write(&g_ref_ringbuffer, pcm_decoded, decoded_samples);
-                    }
-                }
-                free_opus_msg(rx_msg);
-            } else if (mode == AUDIO_MODE_PLAYING) {
-                tts_underrun_count++;
-                // Log sparingly: first 3 + every 200
-                if (tts_underrun_count <= 3 || tts_underrun_count % 200 == 0) {
-                    ESP_LOGW(TAG, "TTS underrun #%lu (played %lu)", tts_underrun_count, tts_play_count);
-                }
-                vTaskDelay(pdMS_TO_TICKS(5));
-            }
-            // 不再continue — 落入下面的I2S读取和AFE处理，保持WakeNet活跃
+            ESP_LOGI(TAG, "Main loop: frame=%lu, mode=%d (0=IDLE,1=REC,2=THINK,3=PLAY), idle=%lu",
+                     frame_count, mode, idle_iterations);
         }
 
-        // === 1. I2S 音频输入（IDLE, RECORDING, PLAYING模式）===
-        int n = audio_i2s.read_frame((uint8_t*)i2s_buffer, sizeof(i2s_buffer));
-
-        if (n > 0) {
-            int stereo_samples = n / sizeof(int16_t);  // I2S立体声总样本数
-            int mono_samples = stereo_samples / 2;      // 单声道样本数
-            i2s_read_count++;
-            i2s_samples_total += mono_samples;
-
-            // === 计算原始I2S音频的RMS音量（诊断麦克风）===
-            static uint32_t volume_check_count = 0;
-            static uint32_t last_volume_print = 0;
-            volume_check_count++;
-
-            // 每30秒打印一次原始音量（减少日志噪声）
-            // PLAYING模式下跳过音量日志（会拾取TTS回声，不具参考价值）
-            if (mode != AUDIO_MODE_PLAYING && volume_check_count - last_volume_print >= 930) {
-                // 计算 RMS 音量（只看MIC0）
-                int64_t sum_squares = 0;
-                for (int i = 0; i < mono_samples; i++) {
-                    int32_t sample = i2s_buffer[i * 2];  // MIC0
-                    sum_squares += (int64_t)sample * sample;
-                }
-                float rms = sqrtf((float)sum_squares / mono_samples);
-                float volume_percent = (rms / 32768.0f) * 100.0f;
-
-                ESP_LOGI(TAG, "🎤 I2S MIC0 音量: RMS=%.1f (%.2f%%), samples=%d",
-                         rms, volume_percent, mono_samples);
-                last_volume_print = volume_check_count;
-            }
-
-            // 从立体声I2S数据提取MIC0和MIC1，分别写入RingBuffer
-            int16_t mono_buffer[256];
-            int16_t mic1_buffer[256];
-            for (int i = 0; i < mono_samples && i < 256; i++) {
-                mono_buffer[i] = i2s_buffer[i * 2];      // MIC0（偶数索引）
-                mic1_buffer[i] = i2s_buffer[i * 2 + 1];  // MIC1（奇数索引）
-            }
-            size_t written = ringbuffer_write(&g_pcm_ringbuffer, mono_buffer, mono_samples);
-            ringbuffer_write(&g_mic1_ringbuffer, mic1_buffer, mono_samples);
-
-            // 前3次写入打印详细信息
-            static int write_count = 0;
-            if (write_count < 3) {
-                size_t rb_available = ringbuffer_data_available(&g_pcm_ringbuffer);
-                ESP_LOGI(TAG, "RingBuffer write #%d: mono_samples=%d, written=%zu, avail=%zu",
-                         write_count, mono_samples, written, rb_available);
-                write_count++;
-            }
-
-            if (written < (size_t)mono_samples) {
-                ESP_LOGW(TAG, "RingBuffer full, dropped %zu samples", mono_samples - written);
-            }
-        } else if (n < 0) {
-            static int error_count = 0;
-            if (error_count < 5) {
-                ESP_LOGW(TAG, "⚠️ I2S读取失败: n=%d", n);
-                error_count++;
-            }
-        }
-
-        // === 2. 检查Main Task的控制命令（非阻塞）===
+        // === 1. 检查Main Task的控制命令（一次处理完所有排队命令）===
         audio_cmd_t cmd;
-        if (xQueueReceive(g_audio_cmd_queue, &cmd, 0) == pdTRUE) {
+        while (xQueueReceive(g_audio_cmd_queue, &cmd, 0) == pdTRUE) {
+            did_work = true;
             switch (cmd) {
                 case AUDIO_CMD_START_RECORDING:
-                    ESP_LOGI(TAG, "Start recording mode");
+                    if (mode == AUDIO_MODE_PLAYING) {
+                        ESP_LOGI(TAG, "Start recording (interrupting playback)");
+                        playout.stop();
+                        discard_ref_ring();  // 清除残留参考数据
+                        afe.set_playback_active(false);  // 录音时禁用AEC
+                    } else {
+                        ESP_LOGI(TAG, "Start recording mode");
+                    }
                     mode = AUDIO_MODE_RECORDING;
-                    afe_accum_count = 0;
-                    silence_start_time = 0;
-                    recording_start_time = xTaskGetTickCount();
-                    ringbuffer_reset(&g_pcm_ringbuffer);
-                    ringbuffer_reset(&g_mic1_ringbuffer);
+                    endpointer.start(pdTICKS_TO_MS(xTaskGetTickCount()));
+                    afe.flush_input();
+                    uplink.start();
                     break;
 
                 case AUDIO_CMD_STOP_RECORDING:
                     ESP_LOGI(TAG, "Stop recording, entering THINKING mode (waiting for server)");
                     mode = AUDIO_MODE_THINKING;
                     thinking_start_time = xTaskGetTickCount();
-                    afe_accum_count = 0;
-                    vad_trigger_count = 0;
+                    uplink.stop();
+                    endpointer.stop();
 
                     // 更新屏幕显示
-                    lvgl_ui_update_recording_stats(g_opus_encode_count, false);
+                    lvgl_ui_update_recording_stats(uplink.encoded_frames(), false);
                     lvgl_ui_set_status("Thinking...");
                     break;
 
                 case AUDIO_CMD_START_PLAYBACK:
                     ESP_LOGI(TAG, "Start playback mode (AEC: %s)", afe_cfg.enable_aec ? "ON" : "OFF");
                     mode = AUDIO_MODE_PLAYING;
-                    tts_play_count = 0;
-                    tts_underrun_count = 0;
+                    playout.start();
+                    uplink.reset_preroll();  // 播放期间不预录（含回声），也不保留播放前的旧音频
+                    afe.set_playback_active(true);  // 播放时启用AEC（档位允许时）
                     if (afe_cfg.enable_aec) {
-                        afe.enable_aec(true);  // 播放时启用AEC
                         s_aec_convergence_until = xTaskGetTickCount() + pdMS_TO_TICKS(300);
                     }
                     break;
 
-                case AUDIO_CMD_STOP_PLAYBACK:
-                    ESP_LOGI(TAG, "Stop playback mode");
+                case AUDIO_CMD_STOP_PLAYBACK: {
+                    const bool was_playing = (mode == AUDIO_MODE_PLAYING);
+                    ESP_LOGI(TAG, was_playing ? "Stop playback mode, resetting for next wake"
+                                              : "Stop playback mode");
                     mode = AUDIO_MODE_IDLE;
-                    // 设置冷却时间防止立即触发VAD录音
-                    last_vad_trigger_time = xTaskGetTickCount();
-                    vad_trigger_count = 0;
-                    ringbuffer_reset(&g_ref_ringbuffer);  // 清除残留参考数据
-                    ringbuffer_reset(&g_mic1_ringbuffer);  // 清除MIC1残留数据
-                    if (afe_cfg.enable_aec) afe.enable_aec(false);  // 停止播放→禁用AEC
+                    playout.stop();
+                    discard_ref_ring();  // 清除残留参考数据
+                    afe.set_playback_active(false);  // 停止播放→禁用AEC
+                    if (was_playing) {
+                        afe.flush_input();    // 清除echo污染数据
+                        uplink.stop();
+                        // 打印内存状态（检测泄漏）
+                        ESP_LOGI(TAG, "Post-playback: heap=%lu, PSRAM=%lu",
+                                 esp_get_free_heap_size(),
+                                 heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+                        pool_print_stats();
+                    }
                     break;
+                }
 
-                case AUDIO_CMD_MEETING_START:
-                    ESP_LOGI(TAG, "Meeting mode: disabling WakeNet to save CPU");
-                    afe.enable_wakenet(false);
+                // AFE档位：afe_task在两次feed之间切换，采集/输出RingBuffer不受影响
+                case AUDIO_CMD_AFE_PROFILE_IDLE:
+                    afe.set_profile(AdvancedAFE::Profile::IDLE_LISTEN);
                     break;
 
-                case AUDIO_CMD_MEETING_END:
-                    ESP_LOGI(TAG, "Meeting ended: re-enabling WakeNet");
-                    afe.enable_wakenet(true);
+                case AUDIO_CMD_AFE_PROFILE_CONVERSATION:
+                    afe.set_profile(AdvancedAFE::Profile::CONVERSATION);
                     break;
-            }
-        }
 
-        // === 3. AFE处理（如果RingBuffer有足够数据）===
-        size_t available = ringbuffer_data_available(&g_pcm_ringbuffer);
-
-        // 前2次检查打印RingBuffer状态
-        static int check_count = 0;
-        if (check_count < 2) {
-            ESP_LOGI(TAG, "RingBuffer check #%d: available=%zu (need>=256)", check_count, available);
-            check_count++;
-        }
+                case AUDIO_CMD_AFE_PROFILE_MEETING:
+                    afe.set_profile(AdvancedAFE::Profile::MEETING);
+                    break;
 
-        if (available >= 256) {  // AFE处理块大小（256个int16 = 256 samples 单声道）
-            // 首次进入AFE处理时打印
-            static bool first_afe_process = true;
-            if (first_afe_process) {
-                ESP_LOGI(TAG, "✅ 首次进入AFE处理块！available=%zu, aec=%d", available, afe_cfg.enable_aec);
-                first_afe_process = false;
+                case AUDIO_CMD_AFE_PROFILE_MUSIC:
+                    afe.set_profile(AdvancedAFE::Profile::MUSIC);
+                    break;
             }
+        }
 
-            if (afe_cfg.enable_aec) {
-                // AEC "MMR"模式：3通道交织 [M0, M1, R, M0, M1, R, ...]
-                int16_t mic0_input[256];
-                ringbuffer_read(&g_pcm_ringbuffer, mic0_input, 256);
+        // === 2. 播放由AudioPlayout任务完成（预解码+抖动缓冲，见audio_playout.cc）===
+        // 本任务在PLAYING时继续采集并feed AFE，保持WakeNet检测，实现TTS打断。
+        // Opus编码在section 4中已有mode==RECORDING守卫，PLAYING时不会编码。
 
-                int16_t mic1_input[256];
-                size_t mic1_avail = ringbuffer_data_available(&g_mic1_ringbuffer);
-                if (mic1_avail >= 256) {
-                    ringbuffer_read(&g_mic1_ringbuffer, mic1_input, 256);
-                } else {
-                    memset(mic1_input, 0, sizeof(mic1_input));
+        // === 3. I2S 音频输入（RX DMA完成通知或等待超时兜底时读取）===
+        // 通知位会合并：任务晚醒时可能已有多个DMA buffer收满，只读一次会留下积压
+        // （采集延迟变大直至DMA溢出丢帧），所以一直读到不足一次读取长度为止
+        const size_t i2s_read_bytes = I2S_BUFFER_SAMPLES * sizeof(int16_t);
+        bool read_i2s = (notify_bits & AUDIO_NOTIFY_I2S_RX) || timed_out;
+        while (read_i2s) {
+            int n = audio_i2s.read_frame((uint8_t*)i2s_buffer, i2s_read_bytes);
+            read_i2s = n > 0 && audio_i2s.rx_pending_bytes() >= i2s_read_bytes;
+
+            if (n > 0) {
+                did_work = true;
+                int stereo_samples = n / sizeof(int16_t);  // I2S立体声总样本数
+                int mono_samples = stereo_samples / 2;      // 单声道样本数
+                i2s_read_count++;
+                i2s_samples_total += mono_samples;
+
+                // === 计算原始I2S音频的RMS音量（诊断麦克风）===
+                static uint32_t volume_check_count = 0;
+                static uint32_t last_volume_print = 0;
+                volume_check_count++;
+
+                // 每30秒打印一次原始音量（减少日志噪声）
+                // PLAYING模式下跳过音量日志（会拾取TTS回声，不具参考价值）
+                if (mode != AUDIO_MODE_PLAYING && volume_check_count - last_volume_print >= 930) {
+                    // 计算 RMS 音量（只看MIC0）
+                    uint64_t sum_squares = dsp_sum_squares_stereo(i2s_buffer, mono_samples, 0);
+                    float rms = sqrtf((float)sum_squares / mono_samples);
+                    float volume_percent = (rms / 32768.0f) * 100.0f;
+
+                    ESP_LOGI(TAG, "🎤 I2S MIC0 音量: RMS=%.1f (%.2f%%), samples=%d",
+                             rms, volume_percent, mono_samples);
+                    last_volume_print = volume_check_count;
                 }
 
-                // 获取参考音频（播放中=实际PCM，空闲=零）
-                int16_t ref_input[256];
-                size_t ref_avail = ringbuffer_data_available(&g_ref_ringbuffer);
-                if (ref_avail >= 256) {
-                    ringbuffer_read(&g_ref_ringbuffer, ref_input, 256);
-                } else {
-                    memset(ref_input, 0, sizeof(ref_input));
-                }
+                // 采集块时间戳：延迟追踪起点（序号跳过0，0表示未追踪）
+                static uint32_t capture_seq = 0;
+                if (++capture_seq == 0) capture_seq = 1;
+                const uint32_t capture_us = latency_now_us();
+                const latency_stamp_t capture_stamp = {capture_seq, capture_us, capture_us};
 
-                // 交织为 [M0, M1, R, M0, M1, R, ...] (3ch) — "MMR"格式
-                int16_t afe_input[768];
-                for (int i = 0; i < 256; i++) {
-                    afe_input[i * 3]     = mic0_input[i];   // Mic 0
-                    afe_input[i * 3 + 1] = mic1_input[i];   // Mic 1
-                    afe_input[i * 3 + 2] = ref_input[i];    // Reference
-                }
+                // 基准测试回环检测（未运行时只有一次判断）
+                Diagnostics::instance().on_capture(i2s_buffer, mono_samples, capture_us);
 
-                afe.feed(afe_input, 256);
-            } else {
-                // 无AEC模式："MM"格式，双通道交织
-                int16_t mic0_input[256];
-                ringbuffer_read(&g_pcm_ringbuffer, mic0_input, 256);
+                // 从立体声I2S数据直接解交织到采集RingBuffer（MIC0/MIC1/REF同帧）
+                size_t written = capture_deinterleave_to_ring(afe, i2s_buffer, mono_samples, &capture_stamp);
+                if (written > 0) {
+                    afe.notify_input();  // 唤醒afe_task处理新帧
+                }
 
-                int16_t mic1_input[256];
-                size_t mic1_avail = ringbuffer_data_available(&g_mic1_ringbuffer);
-                if (mic1_avail >= 256) {
-                    ringbuffer_read(&g_mic1_ringbuffer, mic1_input, 256);
-                } else {
-                    memset(mic1_input, 0, sizeof(mic1_input));
+                // 前3次写入打印详细信息
+                static int write_count = 0;
+                if (write_count < 3) {
+                    size_t rb_available = mc_ringbuffer_frames_available(&g_capture_ringbuffer);
+                    ESP_LOGI(TAG, "RingBuffer write #%d: mono_samples=%d, written=%zu, avail=%zu",
+                             write_count, mono_samples, written, rb_available);
+                    write_count++;
                 }
 
-                int16_t afe_input[512];
-                for (int i = 0; i < 256; i++) {
-                    afe_input[i * 2]     = mic0_input[i];
-                    afe_input[i * 2 + 1] = mic1_input[i];
+                if (written < (size_t)mono_samples) {
+                    ESP_LOGW(TAG, "RingBuffer full, dropped %d frames", mono_samples);
+                }
+            } else if (n < 0) {
+                static int error_count = 0;
+                if (error_count < 5) {
+                    ESP_LOGW(TAG, "⚠️ I2S读取失败: n=%d", n);
+                    error_count++;
                 }
-                afe.feed(afe_input, 256);
             }
         }
 
-        // === 4. 从AFE获取输出（持续消费直到队列为空，避免溢出）===
-        // AFE有内部任务异步处理，我们需要持续fetch消费输出队列
-        // ⚠️ 重要：必须在每次循环中清空所有待处理数据，否则会导致 "Ringbuffer of AFE(FEED) is full"
+        // === 4. 从AFE输出RingBuffer消费（借用视图，零拷贝）===
+        // afe_task每feed一块即fetch一块，ESP-SR内部ringbuffer不会积压；
+        // 这里只需把输出RingBuffer中已有的样本处理完
         static uint32_t afe_fetch_count = 0;
-        // vad_trigger_count and last_vad_trigger_time moved to function scope
 
         int total_fetched = 0;
         int fetch_iterations = 0;
-        const int MAX_FETCH_ITERATIONS = 10;  // 防止无限循环
-
-        while (fetch_iterations < MAX_FETCH_ITERATIONS) {
-            int16_t afe_output[256];
-            int afe_samples = afe.fetch(afe_output, 256);
 
-            if (afe_samples <= 0) {
-                break;  // 队列已空，退出循环
+        while (true) {
+            ringbuffer_span_t out_span;
+            if (afe.peek_output(AFE_FEED_FRAMES, &out_span) == 0) {
+                break;  // 输出RingBuffer已空
             }
+            // 每次只处理连续的第一段，环绕的第二段留给下一轮
+            const int16_t* afe_output = out_span.ptr1;
+            const int afe_samples = (int)out_span.len1;
+            latency_stamp_t afe_stamp;
+            const bool afe_traced = afe.take_output_stamp(afe_samples, &afe_stamp);
 
             fetch_iterations++;
             total_fetched += afe_samples;
@@ -452,155 +430,79 @@ void audio_main_task(void* arg) {
                          afe_fetch_count, afe_samples, fetch_iterations, total_fetched);
             }
 
-        // === 4.1. 录音超时检查 ===
-            if (mode == AUDIO_MODE_RECORDING && recording_start_time > 0) {
-                uint32_t now = xTaskGetTickCount();
-                if (now - recording_start_time > pdMS_TO_TICKS(MAX_RECORDING_MS)) {
-                    ESP_LOGI(TAG, "Max recording time reached (%lums), entering THINKING", MAX_RECORDING_MS);
-                    mode = AUDIO_MODE_THINKING;
-                    thinking_start_time = xTaskGetTickCount();
-                    afe_accum_count = 0;
-                    recording_start_time = 0;
-                    silence_start_time = 0;
-                    vad_trigger_count = 0;
-
-                    lvgl_ui_update_recording_stats(g_opus_encode_count, false);
-                    lvgl_ui_set_status("Recording done");
-                    xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_VAD_END);
+            // === 4.1. 录音端点：最长录音时间 / VAD静音（仅RECORDING模式）===
+            // WakeNet负责唤醒词检测（通过AFE回调），VAD仅用于录音结束判断
+            if (mode == AUDIO_MODE_RECORDING) {
+                const uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+                const uint32_t recorded_ms = endpointer.duration_ms(now_ms);
+                switch (endpointer.update(now_ms, afe.is_voice_active())) {
+                    case VadEndpointer::Result::MAX_DURATION:
+                        ESP_LOGI(TAG, "Max recording time reached (%lums), entering THINKING", MAX_RECORDING_MS);
+                        mode = AUDIO_MODE_THINKING;
+                        thinking_start_time = xTaskGetTickCount();
+                        uplink.stop();
+
+                        lvgl_ui_update_recording_stats(uplink.encoded_frames(), false);
+                        lvgl_ui_set_status("Recording done");
+                        audio_post_event(AUDIO_EVENT_VAD_END);
+                        break;
+
+                    case VadEndpointer::Result::TOO_SHORT:
+                        // 短录音优化：<500ms录音可能是auto-listen后无人说话，直接回IDLE
+                        ESP_LOGI(TAG, "Short recording (%lums < %lums), skipping server, back to IDLE",
+                                 recorded_ms, SHORT_RECORDING_MS);
+                        mode = AUDIO_MODE_IDLE;
+                        uplink.stop();
+                        lvgl_ui_set_status("Say 'Hi Tony'");
+                        // 通知main task但用专门的bit表示"短录音取消"
+                        audio_post_event(AUDIO_EVENT_VAD_END);
+                        break;
+
+                    case VadEndpointer::Result::SILENCE:
+                        ESP_LOGI(TAG, "静音1秒，entering THINKING mode (recorded %lums)", recorded_ms);
+                        mode = AUDIO_MODE_THINKING;
+                        thinking_start_time = xTaskGetTickCount();
+                        uplink.stop();
+
+                        // 更新屏幕显示为待机状态
+                        lvgl_ui_update_recording_stats(uplink.encoded_frames(), false);
+                        lvgl_ui_set_status("Recording done");
+
+                        // 通知Main Control Task
+                        audio_post_event(AUDIO_EVENT_VAD_END);
+                        break;
+
+                    case VadEndpointer::Result::NONE:
+                        break;
                 }
             }
 
-        // === 4.2. VAD静音检测（仅RECORDING模式）===
-            // WakeNet负责唤醒词检测（通过AFE回调），VAD仅用于录音结束判断
-                if (!afe.is_voice_active()) {
-                    // RECORDING模式下：静音1秒后自动停止录音
-                    if (mode == AUDIO_MODE_RECORDING) {
-                        uint32_t now = xTaskGetTickCount();
-
-                        if (silence_start_time == 0) {
-                            silence_start_time = now;
-                        } else if (now - silence_start_time > pdMS_TO_TICKS(800)) {
-                            // 短录音优化：<500ms录音可能是auto-listen后无人说话，直接回IDLE
-                            uint32_t recording_duration_ms = (now - recording_start_time) * portTICK_PERIOD_MS;
-                            if (recording_duration_ms < 500) {
-                                ESP_LOGI(TAG, "Short recording (%lums < 500ms), skipping server, back to IDLE",
-                                         recording_duration_ms);
-                                mode = AUDIO_MODE_IDLE;
-                                last_vad_trigger_time = now;
-                                vad_trigger_count = 0;
-                                afe_accum_count = 0;
-                                silence_start_time = 0;
-                                lvgl_ui_set_status("Say 'Hi Tony'");
-                                // 通知main task但用专门的bit表示"短录音取消"
-                                xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_VAD_END);
-                            } else {
-                                ESP_LOGI(TAG, "静音1秒，entering THINKING mode (recorded %lums)", recording_duration_ms);
-                                mode = AUDIO_MODE_THINKING;
-                                thinking_start_time = xTaskGetTickCount();
-                                afe_accum_count = 0;
-                                silence_start_time = 0;
-
-                                // 更新屏幕显示为待机状态
-                                lvgl_ui_update_recording_stats(g_opus_encode_count, false);
-                                lvgl_ui_set_status("Recording done");
-
-                                // 通知Main Control Task
-                                xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_VAD_END);
-                            }
-                        }
-                    }
-                } else if (mode == AUDIO_MODE_RECORDING) {
-                    // VAD活动时重置静音计时器
-                    silence_start_time = 0;
+            // === 4.2. Opus编码（仅在RECORDING模式）===
+            // 注：WakeNet检测由AFE内部任务完成，通过回调触发录音
+            if (mode == AUDIO_MODE_RECORDING) {
+                // 首次进入RECORDING模式时打印
+                static bool first_recording = true;
+                if (first_recording) {
+                    ESP_LOGI(TAG, "📼 进入RECORDING模式！开始累积AFE样本进行Opus编码");
+                    first_recording = false;
                 }
 
-                // === 4.2. Opus编码（仅在RECORDING模式）===
-                // 注：WakeNet检测由AFE内部任务完成，通过回调触发录音
-                if (mode == AUDIO_MODE_RECORDING) {
-                    // 首次进入RECORDING模式时打印
-                    static bool first_recording = true;
-                    if (first_recording) {
-                        ESP_LOGI(TAG, "📼 进入RECORDING模式！开始累积AFE样本进行Opus编码");
-                        first_recording = false;
-                    }
-
-                    // 累积AFE输出到enc_frame_size samples（Opus帧大小）
-                    size_t to_copy = (afe_samples < (int)(enc_frame_size - afe_accum_count)) ?
-                                     afe_samples : (enc_frame_size - afe_accum_count);
-
-                    memcpy(&afe_accumulator[afe_accum_count], afe_output, to_copy * sizeof(int16_t));
-                    afe_accum_count += to_copy;
-
-                    // 定期打印累积进度（每次累积时）
-                    static uint32_t accum_log_count = 0;
-                    accum_log_count++;
-                    if (accum_log_count % 10 == 0) {
-                        ESP_LOGD(TAG, "📊 AFE累积进度: %zu/%zu samples (%d%%)",
-                                 afe_accum_count, enc_frame_size, (int)(afe_accum_count * 100 / enc_frame_size));
-                    }
-
-                    // 当累积满enc_frame_size samples时，进行Opus编码
-                    if (afe_accum_count >= enc_frame_size) {
-                        g_opus_encode_count++;
-
-                        // 固定 3x 软件增益 (~9.5 dB)
-                        // 麦克风信号 ~-12 to -15 dBFS → 3x 后 ~-2.5 to -5.5 dBFS
-                        // 固定增益保留动态范围（语音/静音比例不变），避免噪声帧被过度放大
-                        for (size_t i = 0; i < enc_frame_size; i++) {
-                            int32_t amplified = (int32_t)afe_accumulator[i] * 3;
-                            afe_accumulator[i] = (int16_t)(
-                                (amplified > 32767) ? 32767 :
-                                (amplified < -32768) ? -32768 : amplified);
-                        }
-
-                        alignas(16) uint8_t opus_packet[256];  // 20ms帧 ~100字节
-                        int opus_len = opus_enc.encode(afe_accumulator, enc_frame_size,
-                                                       opus_packet, sizeof(opus_packet));
-
-                        if (opus_len > 0) {
-                            // Log first 3 + every 50th encode
-                            if (g_opus_encode_count <= 3 || g_opus_encode_count % 50 == 0) {
-                                ESP_LOGI(TAG, "Opus #%lu: %d bytes", g_opus_encode_count, opus_len);
-                            }
-
-                            // 更新屏幕显示（每5个包更新一次，避免过于频繁）
-                            if (g_opus_encode_count % 5 == 0) {
-                                lvgl_ui_update_recording_stats(g_opus_encode_count, true);
-                            }
-
-                            // 分配Opus消息并发送到Main Task
-                            opus_packet_msg_t* msg = alloc_opus_msg(opus_len);
-                            if (msg) {
-                                memcpy(msg->data, opus_packet, opus_len);
-
-                                if (xQueueSend(g_opus_tx_queue, &msg, 0) != pdTRUE) {
-                                    ESP_LOGW(TAG, "Opus TX queue full, dropping packet");
-                                    free_opus_msg(msg);
-                                } else {
-                                    xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_ENCODE_READY);
-                                }
-                            } else {
-                                ESP_LOGW(TAG, "alloc_opus_msg failed!");
-                            }
-                        } else {
-                            ESP_LOGW(TAG, "❌ Opus编码失败: %d", opus_len);
-                        }
-
-                        // 重置累积器
-                        afe_accum_count = 0;
-                    }
-                }
-        }  // end while (fetch_iterations < MAX_FETCH_ITERATIONS)
+                // AFE输出写入上行帧RingBuffer，由编码级凑帧编码（不在本任务内联编码）
+                uplink.push(afe_output, afe_samples, afe_traced ? &afe_stamp : nullptr);
+            } else if (mode != AUDIO_MODE_PLAYING) {
+                // 等待唤醒时滚动保留最近的AFE输出，录音开始时排在实时帧之前
+                uplink.feed_preroll(afe_output, afe_samples);
+            }
 
-        // === 5. (播放逻辑已移至循环顶部的PLAYING模式专用段) ===
+            afe.consume_output(afe_samples);
+            did_work = true;
+        }  // end while (afe output available)
 
         // === 6. THINKING模式超时 ===
         if (mode == AUDIO_MODE_THINKING) {
             if (xTaskGetTickCount() - thinking_start_time > pdMS_TO_TICKS(THINKING_TIMEOUT_MS)) {
                 ESP_LOGW(TAG, "THINKING timeout (%lums), returning to IDLE", THINKING_TIMEOUT_MS);
                 mode = AUDIO_MODE_IDLE;
-                last_vad_trigger_time = xTaskGetTickCount();
-                vad_trigger_count = 0;
                 lvgl_ui_set_status("Idle...");
             }
         }
@@ -618,25 +520,45 @@ void audio_main_task(void* arg) {
                      frame_count);
             ESP_LOGI(TAG, "I2S reads: %lu (total samples: %lu)",
                      i2s_read_count, i2s_samples_total);
-            ESP_LOGI(TAG, "RingBuffer available: %zu samples",
-                     ringbuffer_data_available(&g_pcm_ringbuffer));
-            ESP_LOGI(TAG, "AFE energy: %d, VAD: %d",
-                     afe.get_audio_energy(), afe.is_voice_active());
+            ESP_LOGI(TAG, "Loop iterations: %lu, idle wakeups: %lu (%lu%%)",
+                     frame_count, idle_iterations,
+                     frame_count ? (idle_iterations * 100 / frame_count) : 0);
+            ESP_LOGI(TAG, "RingBuffer available: %zu frames",
+                     mc_ringbuffer_frames_available(&g_capture_ringbuffer));
+            ESP_LOGI(TAG, "AFE energy: %d, VAD: %d, profile: %s",
+                     afe.get_audio_energy(), afe.is_voice_active(),
+                     AdvancedAFE::profile_name(afe.profile()));
+            ESP_LOGI(TAG, "Opus profile: %s (%dbps), WS send: %lums, AFE load: %lu%%",
+                     OpusRateController::profile_name(rate_ctrl.profile()),
+                     uplink.params().bitrate, rate_ctrl.ws_latency_ms(), afe.get_load_percent());
+            AudioUplink::Stats us = uplink.get_stats();
+            ESP_LOGI(TAG, "Uplink encode: last=%luus avg=%luus max=%luus, backlog max=%lu, overflows=%lu",
+                     us.encode_us_last, us.encode_us_avg, us.encode_us_max,
+                     us.backlog_max, us.ring_overflows);
+            if (mode == AUDIO_MODE_PLAYING) {
+                AudioPlayout::Stats ps = playout.get_stats();
+                ESP_LOGI(TAG, "Playout: played=%lu, plc=%lu, fec=%lu, underruns=%lu, jitter=%lu/%lums",
+                         ps.played_frames, ps.plc_frames, ps.fec_frames, ps.underruns,
+                         ps.buffered_ms, ps.target_ms);
+            }
 
             // 打印内存池统计
             pool_print_stats();
         }
 
-        // Yield to other tasks. During PLAYING mode, the 60ms DMA write
-        // already yields CPU; skip the extra delay to reduce playback jitter.
-        if (mode != AUDIO_MODE_PLAYING) {
-            vTaskDelay(pdMS_TO_TICKS(1));
+        if (!did_work) {
+            idle_iterations++;
         }
+
+        // === 8. 阻塞等待下一个事件 ===
+        // 100ms超时兜底（THINKING超时检查/统计）
+        notify_bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notify_bits, pdMS_TO_TICKS(100));
     }
 
     // 清理（通常不会到达这里）
-    opus_enc.deinit();
-    opus_dec.deinit();
+    uplink.stop();
+    playout.stop();
     ESP_LOGI(TAG, "Audio Main Task exiting");
     vTaskDelete(NULL);
 }
@@ -0,0 +1,344 @@
+#include "audio_playout.h"
+#include "audio_i2s.h"
+#include "music_store.h"
+#include "lvgl_ui.h"
+#include "audio_dsp.h"
+#include "diagnostics.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <string.h>
+#include <cmath>
+
+static const char* TAG = "audio_playout";
+
+// 播放节奏：每次写I2S 20ms（I2S TX DMA共4×128帧≈32ms，20ms块可保持DMA不断流）
+static const uint32_t PLAY_CHUNK_MS = 20;
+
+// 抖动缓冲目标深度（ms），欠载时逐级加深，平稳5秒后逐级回落
+static const uint32_t JITTER_INIT_MS = 120;
+static const uint32_t JITTER_MIN_MS = 60;
+static const uint32_t JITTER_MAX_MS = 300;
+static const uint32_t STABLE_CHUNKS_TO_SHRINK = 250;   // 250 × 20ms = 5s
+
+// 抖动缓冲容量（ms）：需为20ms块和60ms Opus帧的公倍数，保证读写都不跨环绕
+static const uint32_t JITTER_CAPACITY_MS = 480;
+
+// 预缓冲超时：短句可能永远达不到目标深度，超时后有数据就开始播放
+static const uint32_t PREBUFFER_TIMEOUT_MS = 150;
+
+// 欠载时最多连续PLC帧数（60ms/帧），超过后静音并重新预缓冲
+static const uint32_t MAX_PLC_RUN = 2;
+
+// 欠载时等待新包的时间（DMA中仍有最多32ms待播放数据）
+static const uint32_t UNDERRUN_WAIT_MS = 10;
+
+bool AudioPlayout::init(int sample_rate, int channels) {
+    if (task_handle_) {
+        ESP_LOGW(TAG, "Playout already initialized");
+        return true;
+    }
+
+    sample_rate_ = sample_rate;
+    play_chunk_ = (size_t)sample_rate * PLAY_CHUNK_MS / 1000 * channels;
+
+    if (!decoder_.init(sample_rate, channels)) {
+        ESP_LOGE(TAG, "Failed to initialize Opus decoder");
+        return false;
+    }
+
+    size_t capacity = (size_t)sample_rate * JITTER_CAPACITY_MS / 1000 * channels;
+    if (!ringbuffer_init(&jitter_, capacity)) {
+        ESP_LOGE(TAG, "Failed to allocate jitter buffer");
+        decoder_.deinit();
+        return false;
+    }
+
+    // 解码输出缓冲：一个完整Opus帧（60ms），也用于跨环绕时的线性化
+    decode_buf_ = (int16_t*)scratch_alloc("playout.decode", decoder_.frame_size() * sizeof(int16_t));
+    if (!decode_buf_) {
+        ESP_LOGE(TAG, "Failed to allocate decode buffer");
+        decoder_.deinit();
+        return false;
+    }
+
+    target_chunks_ = JITTER_INIT_MS / PLAY_CHUNK_MS;
+
+    // 音乐包存储（PSRAM，分配失败时音乐和TTS一样走播放队列）
+    MusicStore::instance().init((size_t)CONFIG_ECHOEAR_MUSIC_STORE_KB * 1024);
+
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        playout_task,
+        "audio_play",
+        12288,  // 12KB (Opus解码)
+        this,
+        19,     // 高于afe_task(18)，低于audio_main(20)
+        &task_handle_,
+        1       // Core 1
+    );
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create playout task");
+        task_handle_ = nullptr;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Playout initialized: chunk=%zu samples, jitter=%zu samples (%lums), target=%lums",
+             play_chunk_, capacity, JITTER_CAPACITY_MS, JITTER_INIT_MS);
+    return true;
+}
+
+// start/stop以最后一次请求为准（请求由播放任务在下一次循环中执行）
+void AudioPlayout::start() {
+    stop_req_ = false;
+    start_req_ = true;
+    if (task_handle_) xTaskNotifyGive(task_handle_);
+}
+
+void AudioPlayout::stop() {
+    start_req_ = false;
+    stop_req_ = true;
+    if (task_handle_) xTaskNotifyGive(task_handle_);
+}
+
+void AudioPlayout::mark_stream_end() {
+    stream_ending_ = true;
+    if (task_handle_) xTaskNotifyGive(task_handle_);
+}
+
+uint32_t AudioPlayout::pending() const {
+    uint32_t queued = uxQueueMessagesWaiting(g_opus_playback_queue) + MusicStore::instance().packets();
+    size_t buffered = ringbuffer_data_available(const_cast<pcm_ringbuffer_t*>(&jitter_));
+    return queued + (uint32_t)((buffered + play_chunk_ - 1) / (play_chunk_ ? play_chunk_ : 1));
+}
+
+AudioPlayout::Stats AudioPlayout::get_stats() const {
+    Stats s = stats_;
+    s.target_ms = target_chunks_ * PLAY_CHUNK_MS;
+    size_t buffered = ringbuffer_data_available(const_cast<pcm_ringbuffer_t*>(&jitter_));
+    s.buffered_ms = play_chunk_ ? (uint32_t)(buffered * PLAY_CHUNK_MS / play_chunk_) : 0;
+    return s;
+}
+
+void AudioPlayout::playout_task(void* arg) {
+    AudioPlayout* self = (AudioPlayout*)arg;
+    self->run();
+}
+
+void AudioPlayout::reset_session() {
+    decoder_.reset();
+    ringbuffer_reset(&jitter_);  // 本任务同时是抖动缓冲的生产者和消费者
+    jitter_stamps_.reset();
+    prebuffering_ = true;
+    prebuffer_start_ = xTaskGetTickCount();
+    has_decoded_ = false;
+    plc_run_ = 0;
+    stable_chunks_ = 0;
+    lost_pending_ = false;
+    stream_ending_ = false;
+    MusicStore::instance().discard_stale();
+}
+
+void AudioPlayout::decode_packet(const uint8_t* data, size_t len, const latency_stamp_t* stamp) {
+    if (len < 3) return;
+
+    // 上游丢过包：先用本包的带内FEC恢复丢失的那一帧
+    if (lost_pending_ && has_decoded_) {
+        if (decode_into_jitter(data, len, true)) {
+            stats_.fec_frames++;
+        }
+    }
+    lost_pending_ = false;
+
+    if (decode_into_jitter(data, len, false, stamp)) {
+        has_decoded_ = true;
+        stats_.decoded_packets++;
+        if (stats_.decoded_packets <= 3 || stats_.decoded_packets % 50 == 0) {
+            ESP_LOGI(TAG, "TTS decode #%lu: queue=%u/24, store=%lu, jitter=%zu samples",
+                     stats_.decoded_packets,
+                     (unsigned)uxQueueMessagesWaiting(g_opus_playback_queue),
+                     MusicStore::instance().packets(),
+                     ringbuffer_data_available(&jitter_));
+        }
+    }
+}
+
+bool AudioPlayout::decode_into_jitter(const uint8_t* data, size_t len, bool conceal,
+                                      const latency_stamp_t* stamp) {
+    const size_t frame = decoder_.frame_size();
+
+    // 抖动缓冲没有整帧空间时不解码（保持写入位置按帧对齐）
+    ringbuffer_span_t span;
+    if (ringbuffer_reserve(&jitter_, frame, &span) < frame) {
+        return false;
+    }
+
+    int16_t* out = (span.len2 == 0) ? span.ptr1 : decode_buf_;
+    int samples = conceal ? decoder_.conceal(data, len, out, frame)
+                          : decoder_.decode(data, len, out, frame);
+    if (samples <= 0) {
+        return false;
+    }
+    if ((size_t)samples > frame) samples = frame;
+
+    if (out == decode_buf_) {
+        size_t first = (span.len1 < (size_t)samples) ? span.len1 : (size_t)samples;
+        memcpy(span.ptr1, decode_buf_, first * sizeof(int16_t));
+        if ((size_t)samples > first) {
+            memcpy(span.ptr2, decode_buf_ + first, (samples - first) * sizeof(int16_t));
+        }
+    }
+
+    latency_stamp_t decoded;
+    if (stamp && stamp->seq) {
+        decoded = *stamp;
+        decoded.stage_us = latency_now_us();
+        SystemMonitor::instance().record_latency(
+            SystemMonitor::LatencyStage::WS_TO_DECODE, decoded.stage_us - stamp->stage_us, stamp->seq);
+        stamp = &decoded;
+    } else {
+        stamp = nullptr;
+    }
+    jitter_stamps_.push(samples, stamp);
+    ringbuffer_commit(&jitter_, samples);
+    return true;
+}
+
+void AudioPlayout::run() {
+    ESP_LOGI(TAG, "Playout task started on core %d", xPortGetCoreID());
+    AudioI2S& audio_i2s = AudioI2S::instance();
+    uint32_t energy_update_counter = 0;
+
+    while (true) {
+        if (stop_req_) {
+            stop_req_ = false;
+            if (active_) {
+                ESP_LOGI(TAG, "Playout stop: played=%lu plc=%lu fec=%lu underruns=%lu target=%lums",
+                         stats_.played_frames, stats_.plc_frames, stats_.fec_frames,
+                         stats_.underruns, target_chunks_ * PLAY_CHUNK_MS);
+            }
+            active_ = false;
+            reset_session();
+        }
+        if (start_req_) {
+            start_req_ = false;
+            reset_session();
+            active_ = true;
+            // 基准测试的测试音（≤200ms）直接写I2S：先置active_再检查，
+            // 与generate_test_tone的顺序相反，两边总有一方让路
+            __sync_synchronize();
+            while (Diagnostics::instance().tone_active()) {
+                vTaskDelay(pdMS_TO_TICKS(PLAY_CHUNK_MS));
+            }
+        }
+        if (!active_) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // === 1. 预解码：把队列（TTS）和音乐存储中的包解码到抖动缓冲，直到达到目标深度 ===
+        // 队列先于存储：music_start前的提示TTS包先播放
+        const size_t target_samples = target_chunks_ * play_chunk_;
+        MusicStore& music = MusicStore::instance();
+        opus_slice_t slice;
+        while (ringbuffer_data_available(&jitter_) < target_samples) {
+            if (xQueueReceive(g_opus_playback_queue, &slice, 0) == pdTRUE) {
+                decode_packet(slice.data, slice.len, &slice.stamp);
+                opus_slice_release(&slice);  // 最后一个切片归还整个WS接收帧
+                continue;
+            }
+            const uint8_t* pkt;
+            uint16_t pkt_len;
+            latency_stamp_t pkt_stamp;
+            if (!music.peek(&pkt, &pkt_len, &pkt_stamp)) break;
+            decode_packet(pkt, pkt_len, &pkt_stamp);
+            music.consume();
+        }
+
+        size_t buffered = ringbuffer_data_available(&jitter_);
+
+        // === 2. 预缓冲：达到目标深度（或超时/流结束）后才开始出声 ===
+        if (prebuffering_) {
+            uint32_t waited_ms = (xTaskGetTickCount() - prebuffer_start_) * portTICK_PERIOD_MS;
+            if (buffered >= target_samples ||
+                (buffered > 0 && (stream_ending_ || waited_ms > PREBUFFER_TIMEOUT_MS))) {
+                prebuffering_ = false;
+            } else {
+                if (music.packets() == 0) {
+                    xQueuePeek(g_opus_playback_queue, &slice, pdMS_TO_TICKS(PLAY_CHUNK_MS));
+                }
+                continue;
+            }
+        }
+
+        // === 3. 播放一个20ms块（阻塞在DMA上，这就是播放时钟）===
+        if (buffered > 0 && (buffered >= play_chunk_ || stream_ending_)) {
+            ringbuffer_span_t span;
+            size_t n = ringbuffer_peek(&jitter_, play_chunk_, &span);
+            const int16_t* pcm = span.ptr1;
+            if (span.len2) {
+                memcpy(decode_buf_, span.ptr1, span.len1 * sizeof(int16_t));
+                memcpy(decode_buf_ + span.len1, span.ptr2, span.len2 * sizeof(int16_t));
+                pcm = decode_buf_;
+            }
+
+            // 音乐节奏动画：每9块（180ms）计算一次RMS能量
+            if (++energy_update_counter % 9 == 0) {
+                float rms = dsp_rms(pcm, n);
+                lvgl_ui_set_music_energy(rms / 32768.0f);  // 归一化到0.0-1.0
+            }
+
+            audio_i2s.play_frame((const uint8_t*)pcm, n * sizeof(int16_t));
+            // 喂入参考 RingBuffer 供 AEC 回声消除使用
+            ringbuffer_write(&g_ref_ringbuffer, pcm, n);
+            ringbuffer_consume(&jitter_, n);
+
+            latency_stamp_t stamp;
+            if (jitter_stamps_.pop(n, &stamp)) {
+                SystemMonitor& mon = SystemMonitor::instance();
+                const uint32_t now = latency_now_us();
+                mon.record_latency(SystemMonitor::LatencyStage::DECODE_TO_PLAY, now - stamp.stage_us, stamp.seq);
+                mon.record_latency(SystemMonitor::LatencyStage::DOWNLINK_TOTAL, now - stamp.origin_us, stamp.seq);
+            }
+
+            stats_.played_frames++;
+            plc_run_ = 0;
+            if (++stable_chunks_ >= STABLE_CHUNKS_TO_SHRINK &&
+                target_chunks_ > JITTER_MIN_MS / PLAY_CHUNK_MS) {
+                target_chunks_--;
+                stable_chunks_ = 0;
+            }
+            continue;
+        }
+
+        // === 4. 欠载：短暂等待新包，仍没有则PLC补偿 ===
+        // 音乐存储没有通知机制，欠载时至多晚UNDERRUN_WAIT_MS发现新包
+        if (music.packets() > 0 ||
+            xQueuePeek(g_opus_playback_queue, &slice, pdMS_TO_TICKS(UNDERRUN_WAIT_MS)) == pdTRUE) {
+            continue;  // 新包到达，回到预解码
+        }
+        if (stop_req_ || start_req_ || stream_ending_) {
+            continue;  // 流已结束：正常排空，不补偿
+        }
+
+        if (plc_run_ == 0) {
+            stats_.underruns++;
+            stable_chunks_ = 0;
+            if (target_chunks_ < JITTER_MAX_MS / PLAY_CHUNK_MS) {
+                target_chunks_++;
+            }
+            if (stats_.underruns <= 3 || stats_.underruns % 50 == 0) {
+                ESP_LOGW(TAG, "TTS underrun #%lu (played %lu), target -> %lums",
+                         stats_.underruns, stats_.played_frames, target_chunks_ * PLAY_CHUNK_MS);
+            }
+        }
+
+        if (has_decoded_ && plc_run_ < MAX_PLC_RUN && decode_into_jitter(nullptr, 0, true)) {
+            plc_run_++;
+            stats_.plc_frames++;
+        } else {
+            // 补偿用尽：DMA自动输出静音，重新预缓冲到（加深后的）目标深度
+            plc_run_ = 0;
+            prebuffering_ = true;
+            prebuffer_start_ = xTaskGetTickCount();
+        }
+    }
+}
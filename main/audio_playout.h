@@ -0,0 +1,117 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cstdint>
+#include "task_manager.h"
+#include "opus_decoder.h"
+#include "system_monitor.h"
+
+/**
+ * @brief 播放输出级 - 独立任务，Opus预解码 + 自适应PCM抖动缓冲
+ *
+ * 功能：
+ * - 从g_opus_playback_queue和MusicStore（音乐）预先解码到PSRAM PCM抖动缓冲（decode-ahead）
+ * - 以20ms为单位独立节奏写I2S TX，不再阻塞audio_main_task的采集/AFE
+ * - 欠载时用Opus PLC生成补偿帧；上游丢包时用下一包的带内FEC恢复
+ * - 抖动缓冲目标深度自适应：欠载加深，长时间平稳后回落
+ * - 播放后的PCM写入g_ref_ringbuffer供AEC使用（本任务是唯一生产者）
+ */
+class AudioPlayout {
+public:
+    // 播放统计
+    struct Stats {
+        uint32_t played_frames;     // 已播放20ms块数
+        uint32_t decoded_packets;   // 已解码Opus包数
+        uint32_t plc_frames;        // PLC补偿帧数
+        uint32_t fec_frames;        // FEC恢复帧数
+        uint32_t underruns;         // 欠载次数（抖动缓冲为空）
+        uint32_t target_ms;         // 当前抖动缓冲目标深度
+        uint32_t buffered_ms;       // 当前抖动缓冲深度
+    };
+
+    static AudioPlayout& instance() {
+        static AudioPlayout inst;
+        return inst;
+    }
+
+    /**
+     * @brief 初始化解码器、抖动缓冲并启动播放任务（Core 1）
+     */
+    bool init(int sample_rate = 16000, int channels = 1);
+
+    /**
+     * @brief 开始播放（预缓冲到目标深度后出声）
+     */
+    void start();
+
+    /**
+     * @brief 停止播放：丢弃抖动缓冲并重置解码器（在播放任务中执行）
+     */
+    void stop();
+
+    /**
+     * @brief 是否处于播放状态
+     */
+    bool is_active() const { return active_; }
+
+    /**
+     * @brief 标记上游丢弃了一个包（下一包到达时先用FEC恢复）
+     */
+    void mark_packet_lost() { lost_pending_ = true; }
+
+    /**
+     * @brief 标记上游流已结束（tts_end/music_end）：排空抖动缓冲，不再做欠载补偿
+     */
+    void mark_stream_end();
+
+    /**
+     * @brief 待播放数据量：队列中的Opus包数 + 抖动缓冲中的20ms块数
+     * 用于Main Task判断TTS是否播放完毕
+     */
+    uint32_t pending() const;
+
+    /**
+     * @brief 获取播放统计
+     */
+    Stats get_stats() const;
+
+private:
+    AudioPlayout() = default;
+
+    static void playout_task(void* arg);
+    void run();
+
+    // 解码一个上游包（含丢包后的FEC恢复）
+    void decode_packet(const uint8_t* data, size_t len, const latency_stamp_t* stamp);
+
+    // 解码一个包（或PLC/FEC补偿帧）写入抖动缓冲；stamp非空时记录解码延迟并随PCM传到播放
+    bool decode_into_jitter(const uint8_t* data, size_t len, bool conceal,
+                            const latency_stamp_t* stamp = nullptr);
+    void reset_session();
+
+    OpusDecoder decoder_;
+    pcm_ringbuffer_t jitter_ = {};
+    LatencyStampFifo jitter_stamps_;  // 抖动缓冲样本位置 → 延迟时间戳（本任务两端）
+    int16_t* decode_buf_ = nullptr;   // 解码输出临时缓冲（scratch arena，一个Opus帧）
+    size_t play_chunk_ = 0;           // 每次写I2S的样本数（20ms）
+    int sample_rate_ = 16000;
+
+    TaskHandle_t task_handle_ = nullptr;
+
+    volatile bool active_ = false;
+    volatile bool start_req_ = false;
+    volatile bool stop_req_ = false;
+    volatile bool lost_pending_ = false;
+    volatile bool stream_ending_ = false;
+
+    // 抖动缓冲自适应（单位：20ms块）
+    uint32_t target_chunks_ = 0;
+    uint32_t stable_chunks_ = 0;      // 连续无欠载播放块数
+    uint32_t plc_run_ = 0;            // 连续PLC帧数
+    bool prebuffering_ = true;
+    bool has_decoded_ = false;        // 本次会话是否已解码过真实包（PLC需要解码器历史）
+    TickType_t prebuffer_start_ = 0;
+
+    Stats stats_ = {};
+};
@@ -0,0 +1,381 @@
+#include "audio_uplink.h"
+#include "advanced_afe.h"
+#include "audio_dsp.h"
+#include "lvgl_ui.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <sdkconfig.h>
+#include <string.h>
+
+static const char* TAG = "audio_uplink";
+
+// 帧RingBuffer容量：16帧 × 20ms = 320ms积压余量
+static const size_t UPLINK_RING_FRAMES = 16;
+
+// Opus编码输出上限（20ms帧 ~100字节）
+static const size_t UPLINK_PACKET_BYTES = 256;
+
+// 固定 3x 软件增益 (~9.5 dB)
+// 麦克风信号 ~-12 to -15 dBFS → 3x 后 ~-2.5 to -5.5 dBFS
+// 固定增益保留动态范围（语音/静音比例不变），避免噪声帧被过度放大
+static const uint8_t UPLINK_GAIN = 3;
+
+#ifndef CONFIG_ECHOEAR_UPLINK_ENCODE_CORE
+#define CONFIG_ECHOEAR_UPLINK_ENCODE_CORE 0
+#endif
+
+#ifndef CONFIG_ECHOEAR_PREROLL_MS
+#define CONFIG_ECHOEAR_PREROLL_MS 0
+#endif
+
+// from → to 的环上距离（样本数）
+static inline size_t ring_distance(const pcm_ringbuffer_t* rb, size_t from, size_t to) {
+    return (to - from + rb->capacity) % rb->capacity;
+}
+
+bool AudioUplink::init(const AdvancedAFE* afe, int sample_rate, int channels, int bitrate) {
+    if (frame_buf_) {
+        ESP_LOGW(TAG, "Uplink already initialized");
+        return true;
+    }
+    afe_ = afe;
+
+    if (!encoder_.init(sample_rate, channels, bitrate)) {
+        ESP_LOGE(TAG, "Failed to initialize Opus encoder");
+        return false;
+    }
+    frame_size_ = encoder_.frame_size();  // 320 for 20ms @ 16kHz
+
+    // 帧环在积压余量之外再容纳一整段预录音频（录音开始时一次写入）
+    const size_t preroll_samples = (size_t)sample_rate * channels * CONFIG_ECHOEAR_PREROLL_MS / 1000;
+    const size_t preroll_frames = (preroll_samples + frame_size_ - 1) / frame_size_;
+    if (!ringbuffer_init(&ring_, frame_size_ * (UPLINK_RING_FRAMES + preroll_frames))) {
+        ESP_LOGE(TAG, "Failed to allocate uplink frame ring");
+        encoder_.deinit();
+        return false;
+    }
+
+    frame_buf_ = (int16_t*)scratch_alloc("uplink.frame", frame_size_ * sizeof(int16_t));
+    packet_buf_ = (uint8_t*)scratch_alloc("uplink.packet", UPLINK_PACKET_BYTES);
+    if (!frame_buf_ || !packet_buf_) {
+        ESP_LOGE(TAG, "Failed to allocate frame buffer");
+        scratch_free(frame_buf_);
+        scratch_free(packet_buf_);
+        frame_buf_ = nullptr;
+        packet_buf_ = nullptr;
+        encoder_.deinit();
+        return false;
+    }
+
+    // 预录环失败不影响录音，只是没有预录
+    if (preroll_samples > 0 && !ringbuffer_init(&preroll_, preroll_samples + 1)) {
+        ESP_LOGW(TAG, "Failed to allocate %zu-sample pre-roll ring, pre-roll disabled", preroll_samples);
+        preroll_ = {};
+    }
+
+#if CONFIG_ECHOEAR_UPLINK_ENCODE_TASK
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        encode_task,
+        "uplink_enc",
+        32768,  // 32KB (Opus encoder needs ~31KB stack)
+        this,
+        12,     // 高于main_ctrl(10)：编码不被WS发送阻塞
+        &task_handle_,
+        CONFIG_ECHOEAR_UPLINK_ENCODE_CORE
+    );
+    if (ret != pdPASS) {
+        // 任务创建失败时退回内联编码（功能不受影响）
+        ESP_LOGW(TAG, "Failed to create encode task, falling back to inline encoding");
+        task_handle_ = nullptr;
+    }
+#endif
+
+    ESP_LOGI(TAG, "Uplink initialized: frame=%zu samples, ring=%zu frames, pre-roll=%dms, encode=%s (core %d)",
+             frame_size_, UPLINK_RING_FRAMES + preroll_frames,
+             preroll_.buffer ? CONFIG_ECHOEAR_PREROLL_MS : 0, task_handle_ ? "task" : "inline",
+             task_handle_ ? CONFIG_ECHOEAR_UPLINK_ENCODE_CORE : xPortGetCoreID());
+    return true;
+}
+
+// 统计字段单写者，跨任务读写不撕裂即可
+static inline void stat_store(uint32_t* field, uint32_t value) {
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t stat_load(const uint32_t* field) {
+    return __atomic_load_n(field, __ATOMIC_RELAXED);
+}
+
+void AudioUplink::start() {
+    start_pos_ = ring_.write_pos;
+    stat_store(&stats_.backlog_max, 0);  // 生产者字段：在这里而不是编码级清零
+
+    // 预录音频排在实时帧之前（无时间戳：采集时刻早于唤醒，不计入延迟统计）
+    size_t preroll = 0;
+    ringbuffer_span_t span;
+    if (preroll_.buffer && ringbuffer_peek(&preroll_, ringbuffer_data_available(&preroll_), &span) > 0) {
+        preroll = push(span.ptr1, span.len1);
+        if (span.len2) {
+            preroll += push(span.ptr2, span.len2);
+        }
+        ringbuffer_reset(&preroll_);
+    }
+    start_preroll_ = preroll;
+
+    __sync_synchronize();
+    start_req_ = true;
+    if (task_handle_) {
+        xTaskNotifyGive(task_handle_);
+    } else {
+        process();
+    }
+}
+
+void AudioUplink::stop() {
+    stop_pos_ = ring_.write_pos;
+    __atomic_store_n(&stop_seq_, stop_seq_ + 1, __ATOMIC_RELEASE);
+    __sync_synchronize();
+    start_req_ = false;  // 尚未执行的start被本次stop取代
+    stop_req_ = true;
+    if (task_handle_) {
+        xTaskNotifyGive(task_handle_);
+    } else {
+        process();
+    }
+}
+
+size_t AudioUplink::push(const int16_t* pcm, size_t samples, const latency_stamp_t* stamp) {
+    // 时间戳须在commit之前入队，编码级才能按位置取到
+    ringbuffer_span_t dst;
+    size_t written = ringbuffer_reserve(&ring_, samples, &dst);
+    if (written > 0) {
+        memcpy(dst.ptr1, pcm, dst.len1 * sizeof(int16_t));
+        if (dst.len2) {
+            memcpy(dst.ptr2, pcm + dst.len1, dst.len2 * sizeof(int16_t));
+        }
+        stamps_.push(written, stamp);
+        ringbuffer_commit(&ring_, written);
+    }
+    if (written < samples) {
+        const uint32_t overflows = stat_load(&stats_.ring_overflows) + 1;
+        stat_store(&stats_.ring_overflows, overflows);
+        if (overflows <= 3 || overflows % 100 == 0) {
+            ESP_LOGW(TAG, "Uplink ring full, dropped %zu samples (overflow #%lu)",
+                     samples - written, overflows);
+        }
+    }
+
+    size_t backlog = ringbuffer_data_available(&ring_) / frame_size_;
+    if (backlog > stat_load(&stats_.backlog_max)) stat_store(&stats_.backlog_max, backlog);
+
+    if (backlog > 0) {
+        if (task_handle_) {
+            xTaskNotifyGive(task_handle_);
+        } else {
+            process();
+        }
+    }
+    return written;
+}
+
+void AudioUplink::feed_preroll(const int16_t* pcm, size_t samples) {
+    if (!preroll_.buffer || samples == 0) return;
+
+    // 只保留最近capacity-1个样本：先丢最旧的，再写入
+    const size_t keep = preroll_.capacity - 1;
+    if (samples > keep) {
+        pcm += samples - keep;
+        samples = keep;
+    }
+    const size_t avail = ringbuffer_data_available(&preroll_);
+    if (avail + samples > keep) {
+        ringbuffer_consume(&preroll_, avail + samples - keep);
+    }
+    ringbuffer_write(&preroll_, pcm, samples);
+}
+
+void AudioUplink::reset_preroll() {
+    if (preroll_.buffer) {
+        ringbuffer_reset(&preroll_);
+    }
+}
+
+AudioUplink::Stats AudioUplink::get_stats() const {
+    Stats s;
+    s.encoded_frames = stat_load(&stats_.encoded_frames);
+    s.ring_overflows = stat_load(&stats_.ring_overflows);
+    s.tx_drops = stat_load(&stats_.tx_drops);
+    s.encode_us_last = stat_load(&stats_.encode_us_last);
+    s.encode_us_avg = stat_load(&stats_.encode_us_avg);
+    s.encode_us_max = stat_load(&stats_.encode_us_max);
+    s.backlog_max = stat_load(&stats_.backlog_max);
+    s.preroll_samples = stat_load(&stats_.preroll_samples);
+    return s;
+}
+
+void AudioUplink::encode_task(void* arg) {
+    AudioUplink* self = (AudioUplink*)arg;
+    self->run();
+}
+
+void AudioUplink::run() {
+    ESP_LOGI(TAG, "Uplink encode task started on core %d", xPortGetCoreID());
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        process();
+    }
+}
+
+// 帧环的所有消费都经过这里，保持时间戳位置与样本同步
+void AudioUplink::consume(size_t samples, latency_stamp_t* stamp) {
+    ringbuffer_consume(&ring_, samples);
+    if (!stamps_.pop(samples, stamp) && stamp) {
+        stamp->seq = 0;
+    }
+}
+
+void AudioUplink::discard_to(size_t pos) {
+    size_t n = ring_distance(&ring_, ring_.read_pos, pos);
+    // pos不在[read, write]之间时（已被读过）不丢弃
+    if (n <= ringbuffer_data_available(&ring_)) {
+        consume(n, nullptr);
+    }
+}
+
+void AudioUplink::process() {
+    if (stop_req_) {
+        stop_req_ = false;
+        __sync_synchronize();
+        const uint32_t seq = __atomic_load_n(&stop_seq_, __ATOMIC_ACQUIRE);
+        // 编码stop点之前的完整帧，丢弃不足一帧的尾部
+        const size_t until = stop_pos_;
+        size_t pending = ring_distance(&ring_, ring_.read_pos, until);
+        if (pending <= ringbuffer_data_available(&ring_)) {
+            while (pending >= frame_size_) {
+                encode_frame();
+                pending -= frame_size_;
+            }
+            discard_to(until);
+        }
+        catchup_frames_ = 0;
+        if (active_) {
+            ESP_LOGI(TAG, "Uplink stop: %lu frames (pre-roll %lu), encode avg=%luus max=%luus, backlog max=%lu, tx drops=%lu",
+                     stats_.encoded_frames, stats_.preroll_samples / frame_size_,
+                     stats_.encode_us_avg, stats_.encode_us_max,
+                     stat_load(&stats_.backlog_max), stats_.tx_drops);
+        }
+        active_ = false;
+        // 尾包已全部入队（或已计入tx drops），通知主控可以结束本轮上行
+        __atomic_store_n(&stop_done_seq_, seq, __ATOMIC_RELEASE);
+        audio_post_event(AUDIO_EVENT_UPLINK_STOPPED);
+    }
+
+    if (start_req_) {
+        start_req_ = false;
+        discard_to(start_pos_);
+        stat_store(&stats_.encoded_frames, 0);
+        stat_store(&stats_.encode_us_max, 0);
+        stat_store(&stats_.preroll_samples, start_preroll_);
+        catchup_frames_ = start_preroll_ / frame_size_;
+        // 录音开始是重开编码器的安全点：补齐上次延后的复杂度/DTX变更
+        encoder_.apply(OpusRateController::instance().params(), true);
+        active_ = true;
+    }
+
+    if (!active_) {
+        return;
+    }
+
+    while (ringbuffer_data_available(&ring_) >= frame_size_) {
+        // 预录突发（最多~50帧）不能一次塞满8深的g_opus_tx_queue：
+        // 没有空位时先停下，下一次push唤醒时继续，比实时快得多地追上
+        if (catchup_frames_ > 0 && uxQueueSpacesAvailable(g_opus_tx_queue) == 0) {
+            break;
+        }
+        encode_frame();
+    }
+}
+
+void AudioUplink::encode_frame() {
+    // 线性化到内部RAM（对齐缓冲，增益走PIE路径）
+    ringbuffer_span_t span;
+    ringbuffer_peek(&ring_, frame_size_, &span);
+    memcpy(frame_buf_, span.ptr1, span.len1 * sizeof(int16_t));
+    if (span.len2) {
+        memcpy(frame_buf_ + span.len1, span.ptr2, span.len2 * sizeof(int16_t));
+    }
+    latency_stamp_t stamp;
+    consume(frame_size_, &stamp);
+
+    const bool catching_up = catchup_frames_ > 0;
+    if (catching_up) catchup_frames_--;
+
+    dsp_gain_sat(frame_buf_, frame_size_, UPLINK_GAIN);
+
+    uint8_t* opus_packet = packet_buf_;
+    int64_t t0 = esp_timer_get_time();
+    int opus_len = encoder_.encode(frame_buf_, frame_size_, opus_packet, UPLINK_PACKET_BYTES);
+    uint32_t encode_us = (uint32_t)(esp_timer_get_time() - t0);
+
+    if (stamp.seq) {
+        const uint32_t now = latency_now_us();
+        SystemMonitor::instance().record_latency(
+            SystemMonitor::LatencyStage::AFE_TO_ENCODE, now - stamp.stage_us, stamp.seq);
+        stamp.stage_us = now;
+    }
+
+    // 编码级是这些字段的唯一写者，读自己写的值不需要原子
+    stat_store(&stats_.encoded_frames, stats_.encoded_frames + 1);
+    stat_store(&stats_.encode_us_last, encode_us);
+    stat_store(&stats_.encode_us_avg,
+               stats_.encode_us_avg ? (stats_.encode_us_avg * 7 + encode_us) / 8 : encode_us);
+    if (encode_us > stats_.encode_us_max) stat_store(&stats_.encode_us_max, encode_us);
+
+    OpusRateController& rate_ctrl = OpusRateController::instance();
+
+    if (opus_len > 0) {
+        // Log first 3 + every 50th encode
+        if (stats_.encoded_frames <= 3 || stats_.encoded_frames % 50 == 0) {
+            ESP_LOGI(TAG, "Opus #%lu: %d bytes, encode %luus (avg %luus, max %luus)",
+                     stats_.encoded_frames, opus_len, encode_us,
+                     stats_.encode_us_avg, stats_.encode_us_max);
+        }
+
+        // 更新屏幕显示（每5个包更新一次，避免过于频繁）
+        if (stats_.encoded_frames % 5 == 0) {
+            lvgl_ui_update_recording_stats(stats_.encoded_frames, true);
+        }
+
+        // 分配Opus消息并发送到Main Task
+        opus_packet_msg_t* msg = alloc_opus_msg(opus_len);
+        if (msg) {
+            memcpy(msg->data, opus_packet, opus_len);
+            msg->stamp = stamp;  // seq=0时WS发送端不记录
+
+            if (xQueueSend(g_opus_tx_queue, &msg, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "Opus TX queue full, dropping packet");
+                free_opus_msg(msg);
+                stat_store(&stats_.tx_drops, stats_.tx_drops + 1);
+                rate_ctrl.report_tx_drop();
+            } else {
+                audio_post_event(AUDIO_EVENT_ENCODE_READY);
+            }
+        } else {
+            ESP_LOGW(TAG, "alloc_opus_msg failed!");
+        }
+    } else {
+        ESP_LOGW(TAG, "❌ Opus编码失败: %d", opus_len);
+    }
+
+    // 自适应编码档位：降档立即生效（必要时重开编码器），
+    // 升档只改码率，复杂度/DTX留到下次录音开始
+    const OpusRateController::Profile prev_profile = rate_ctrl.profile();
+    UBaseType_t tx_depth = uxQueueMessagesWaiting(g_opus_tx_queue);
+    UBaseType_t tx_cap = tx_depth + uxQueueSpacesAvailable(g_opus_tx_queue);
+    uint32_t afe_load = afe_ ? afe_->get_load_percent() : 0;
+    // 预录追赶期间队列深是主动限速造成的，不代表上行拥塞
+    if (!catching_up && rate_ctrl.update(tx_depth, tx_cap, afe_load)) {
+        encoder_.apply(rate_ctrl.params(), rate_ctrl.profile() > prev_profile);
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cstdint>
+#include "task_manager.h"
+#include "opus_encoder.h"
+#include "system_monitor.h"
+
+class AdvancedAFE;
+
+/**
+ * @brief 上行编码级 - AFE输出 → 帧RingBuffer → Opus编码 → g_opus_tx_queue
+ *
+ * 功能：
+ * - audio_main_task只把AFE输出写入无锁帧RingBuffer（SPSC），不再内联编码，
+ *   慢编码不会推迟下一次AFE fetch、VAD静音判断和I2S读取
+ * - 编码在独立任务中进行（CONFIG_ECHOEAR_UPLINK_ENCODE_TASK，默认Core 0），
+ *   与AFE处理并行；关闭该选项时在push()调用者上下文内联编码（旧行为）
+ * - 3x固定增益、自适应编码档位（OpusRateController）都在编码级完成
+ * - 统计每帧编码耗时（last/avg/max）与帧环积压峰值
+ * - 非录音时保留最近CONFIG_ECHOEAR_PREROLL_MS的AFE输出（PSRAM预录环），
+ *   录音开始时先写入帧环，唤醒词之后紧接着说的话不会被截掉
+ */
+class AudioUplink {
+public:
+    // 编码统计
+    // 每个字段只有一个写者（生产者 = audio_main_task，编码级 = 编码任务），
+    // 跨任务读写都用__atomic（relaxed：计数器之间不需要一致的快照）
+    struct Stats {
+        uint32_t encoded_frames;    // 已编码帧数（本次录音）            [编码级]
+        uint32_t ring_overflows;    // 帧环满丢弃的样本批次数（编码跟不上）[生产者]
+        uint32_t tx_drops;          // g_opus_tx_queue满丢包数            [编码级]
+        uint32_t encode_us_last;    // 最近一帧编码耗时                   [编码级]
+        uint32_t encode_us_avg;     // 编码耗时EWMA                       [编码级]
+        uint32_t encode_us_max;     // 编码耗时峰值                       [编码级]
+        uint32_t backlog_max;       // 帧环积压峰值（帧）                 [生产者]
+        uint32_t preroll_samples;   // 本次录音前置的预录样本数           [编码级]
+    };
+
+    static AudioUplink& instance() {
+        static AudioUplink inst;
+        return inst;
+    }
+
+    /**
+     * @brief 初始化编码器、帧RingBuffer，并按配置启动编码任务
+     * @param afe AFE实例（提供CPU负载给自适应档位）
+     */
+    bool init(const AdvancedAFE* afe, int sample_rate = 16000, int channels = 1, int bitrate = 48000);
+
+    /**
+     * @brief 录音开始：丢弃上次残留，把预录音频写入帧环，应用延后的档位变更（audio_main_task调用）
+     */
+    void start();
+
+    /**
+     * @brief 录音结束：编码已写入的完整帧，丢弃不足一帧的尾部（audio_main_task调用）
+     */
+    void stop();
+
+    /**
+     * @brief 写入AFE输出样本（audio_main_task调用，仅录音期间）
+     * @param stamp 这段样本的延迟时间戳（可为nullptr），随编码后的Opus包传到WS发送
+     * @return 写入的样本数（帧环满时可能小于samples）
+     */
+    size_t push(const int16_t* pcm, size_t samples, const latency_stamp_t* stamp = nullptr);
+
+    /**
+     * @brief 非录音期间写入AFE输出到预录环，满时覆盖最旧样本（audio_main_task调用）
+     */
+    void feed_preroll(const int16_t* pcm, size_t samples);
+
+    /**
+     * @brief 清空预录环（播放开始时调用，避免把播放前的旧音频拼到下次录音前面）
+     */
+    void reset_preroll();
+
+    /**
+     * @brief 编码是否在独立任务中运行
+     */
+    bool is_threaded() const { return task_handle_ != nullptr; }
+
+    /**
+     * @brief 最近一次stop()的尾帧是否仍在编码（主控据此等尾包全部入队后再结束录音）
+     */
+    bool stop_pending() const {
+        return __atomic_load_n(&stop_done_seq_, __ATOMIC_ACQUIRE) !=
+               __atomic_load_n(&stop_seq_, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * @brief 本次录音已编码帧数
+     */
+    uint32_t encoded_frames() const { return __atomic_load_n(&stats_.encoded_frames, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief 获取编码统计
+     */
+    Stats get_stats() const;
+
+    /**
+     * @brief 当前编码参数
+     */
+    const OpusEncoder::Params& params() const { return encoder_.params(); }
+
+private:
+    AudioUplink() = default;
+
+    static void encode_task(void* arg);
+    void run();
+
+    // 处理start/stop请求并编码帧环中的完整帧（编码级上下文）
+    void process();
+    void encode_frame();
+    void discard_to(size_t pos);
+    void consume(size_t samples, latency_stamp_t* stamp);
+
+    OpusEncoder encoder_;
+    const AdvancedAFE* afe_ = nullptr;
+    pcm_ringbuffer_t ring_ = {};
+    LatencyStampFifo stamps_;         // 帧环样本位置 → 延迟时间戳
+    int16_t* frame_buf_ = nullptr;    // 线性化+增益缓冲（scratch arena，16字节对齐，一帧）
+    uint8_t* packet_buf_ = nullptr;   // Opus编码输出（scratch arena，UPLINK_PACKET_BYTES）
+    size_t frame_size_ = 0;           // 每帧样本数（20ms）
+    pcm_ringbuffer_t preroll_ = {};   // 预录环（PSRAM，仅audio_main_task访问）
+    size_t catchup_frames_ = 0;       // 尚未编码的预录帧数（编码级）：期间按g_opus_tx_queue空位限速
+
+    TaskHandle_t task_handle_ = nullptr;
+
+    // 请求由生产者设置、编码级执行；*_pos_为请求时生产者写指针快照，
+    // 编码级据此区分请求前后写入的数据
+    volatile bool start_req_ = false;
+    volatile bool stop_req_ = false;
+    volatile size_t start_pos_ = 0;
+    volatile size_t stop_pos_ = 0;
+    volatile size_t start_preroll_ = 0;   // start时写入帧环的预录样本数
+    volatile bool active_ = false;
+    uint32_t stop_seq_ = 0;               // stop()请求计数（生产者写）
+    uint32_t stop_done_seq_ = 0;          // 已完成的stop请求计数（编码级写）
+
+    Stats stats_ = {};
+};
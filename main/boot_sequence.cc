@@ -0,0 +1,143 @@
+#include "boot_sequence.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <stdio.h>
+
+static const char* TAG = "boot";
+
+// 重启进入配网模式的请求（RTC内存在软件复位后保留，上电时为随机值）
+static const uint32_t PROVISION_REQUEST_MAGIC = 0x50524F56;  // "PROV"
+RTC_NOINIT_ATTR static uint32_t s_provision_request;
+
+static const char* const kStageNames[(int)BootSequence::Stage::COUNT] = {
+    "app_main", "nvs", "queues", "ui", "codec", "tasks",
+    "wifi_start", "touch_wait", "wake_ready", "wifi_ip", "ws_ready",
+};
+
+const char* BootSequence::stage_name(Stage stage) {
+    return stage < Stage::COUNT ? kStageNames[(int)stage] : "?";
+}
+
+// ============================================================================
+// 时间线
+// ============================================================================
+
+void BootSequence::mark(Stage stage) {
+    if (stage >= Stage::COUNT) return;
+    uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (ms == 0) ms = 1;  // 0表示未到达
+    if (!__sync_bool_compare_and_swap(&stage_ms_[(int)stage], 0, ms)) return;
+
+    switch (stage) {
+        case Stage::WAKE_READY:
+            ESP_LOGI(TAG, "Wake word ready at %lums after power-on", ms);
+            break;
+        case Stage::WS_READY:
+            print_report();
+            break;
+        default:
+            ESP_LOGD(TAG, "Stage %s at %lums", stage_name(stage), ms);
+            break;
+    }
+}
+
+uint32_t BootSequence::stage_ms(Stage stage) const {
+    return stage < Stage::COUNT ? stage_ms_[(int)stage] : 0;
+}
+
+void BootSequence::print_report() const {
+    ESP_LOGI(TAG, "=== Boot Timeline (ms since CPU start) ===");
+    uint32_t prev = 0;
+    for (int i = 0; i < (int)Stage::COUNT; i++) {
+        uint32_t ms = stage_ms_[i];
+        if (ms == 0) {
+            ESP_LOGI(TAG, "  %-10s      -", kStageNames[i]);
+            continue;
+        }
+        // 并行阶段的到达顺序与枚举顺序不一定一致，增量可能为负
+        ESP_LOGI(TAG, "  %-10s %6lu  (%+ld)", kStageNames[i], ms, prev ? (long)ms - (long)prev : 0L);
+        prev = ms;
+    }
+}
+
+size_t BootSequence::format_json(char* buf, size_t cap) const {
+    if (!buf || cap < 3) return 0;
+    size_t len = 1;
+    buf[0] = '{';
+    bool any = false;
+    for (int i = 0; i < (int)Stage::COUNT; i++) {
+        uint32_t ms = stage_ms_[i];
+        if (ms == 0) continue;
+        int n = snprintf(buf + len, cap - len, "%s\"%s\":%lu", any ? "," : "", kStageNames[i], ms);
+        if (n < 0 || len + n >= cap - 1) return 0;
+        len += n;
+        any = true;
+    }
+    buf[len++] = '}';
+    buf[len] = '\0';
+    return len;
+}
+
+// ============================================================================
+// 启动任务
+// ============================================================================
+
+void BootSequence::job_task(void* arg) {
+    Job* job = (Job*)arg;
+    job->ok = job->fn();
+    xEventGroupSetBits(job->owner->job_done_, job->done_bit);
+    vTaskDelete(NULL);
+}
+
+bool BootSequence::start_job(const char* name, BaseType_t core, uint32_t stack_size, JobFn fn) {
+    if (job_count_ >= MAX_JOBS) return false;
+    if (!job_done_) {
+        job_done_ = xEventGroupCreate();
+        if (!job_done_) return false;
+    }
+
+    Job* job = &jobs_[job_count_];
+    job->fn = fn;
+    job->done_bit = BIT0 << job_count_;
+    job->owner = this;
+    job->ok = false;
+
+    // 优先级高于app_main(1)：启动任务是关键路径，等待外设时会让出CPU
+    BaseType_t ret = xTaskCreatePinnedToCore(job_task, name, stack_size, job, 5, nullptr, core);
+    if (ret != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start boot job %s, running inline", name);
+        return false;
+    }
+    job_count_++;
+    return true;
+}
+
+bool BootSequence::wait_jobs(uint32_t timeout_ms) {
+    if (job_count_ == 0) return true;
+    const EventBits_t all = (BIT0 << job_count_) - 1;
+    EventBits_t bits = xEventGroupWaitBits(job_done_, all, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    if ((bits & all) != all) return false;
+    for (int i = 0; i < job_count_; i++) {
+        if (!jobs_[i].ok) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// 配网重启
+// ============================================================================
+
+void BootSequence::restart_into_provisioning() {
+    ESP_LOGW(TAG, "Restarting into provisioning mode");
+    s_provision_request = PROVISION_REQUEST_MAGIC;
+    esp_restart();
+}
+
+bool BootSequence::consume_provisioning_request() {
+    const bool requested = (s_provision_request == PROVISION_REQUEST_MAGIC) &&
+                           esp_reset_reason() == ESP_RST_SW;
+    s_provision_request = 0;
+    return requested;
+}
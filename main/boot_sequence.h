@@ -0,0 +1,108 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief 启动编排 - 并行启动阶段 + 启动时间线
+ *
+ * 已有WiFi凭据时（CONFIG_ECHOEAR_BOOT_PARALLEL）互不依赖的阶段并行执行：
+ * - Core 1 启动任务：Codec/I2S初始化 → 创建应用任务（audio_main随即在Core 1加载AFE/WakeNet模型）
+ * - app_main（Core 0）：LVGL/触摸 → WiFi启动（连接在后台进行）→ 配网触摸等待
+ * 触摸等待期间检测到触摸时，设置RTC标志后重启进入配网模式（配网路径仍是原来的顺序启动）
+ *
+ * 时间线记录每个阶段第一次到达的时间（esp_timer，从CPU启动开始计，不含ROM/二级bootloader），
+ * WAKE_READY = 最早可以检测唤醒词，WS_READY = 最早可以对话；到达WS_READY时打印完整时间线
+ */
+class BootSequence {
+public:
+    enum class Stage : uint8_t {
+        APP_MAIN = 0,   // app_main入口
+        NVS,            // NVS就绪
+        QUEUES,         // 全局队列/RingBuffer
+        UI,             // LVGL + 触摸
+        CODEC,          // I2S + Codec
+        TASKS,          // 应用任务已创建
+        WIFI_START,     // WiFi驱动启动，开始连接
+        TOUCH_WAIT,     // 配网触摸等待结束
+        WAKE_READY,     // AFE/WakeNet运行，音频主循环开始
+        WIFI_IP,        // 获取IP
+        WS_READY,       // WebSocket hello完成
+        COUNT
+    };
+
+    // 启动任务函数：返回false表示失败（启动中止）
+    typedef bool (*JobFn)();
+
+    static const int MAX_JOBS = 2;
+
+    static BootSequence& instance() {
+        static BootSequence inst;
+        return inst;
+    }
+
+    /**
+     * @brief 记录阶段到达时间（只记第一次，WiFi重连等不覆盖；任意任务可调用）
+     */
+    void mark(Stage stage);
+
+    /**
+     * @brief 阶段到达时间（ms，0 = 未到达）
+     */
+    uint32_t stage_ms(Stage stage) const;
+
+    static const char* stage_name(Stage stage);
+
+    /**
+     * @brief 在指定核上启动一个启动任务（执行完自行删除）
+     * @return false 任务创建失败（调用者应同步执行fn）
+     */
+    bool start_job(const char* name, BaseType_t core, uint32_t stack_size, JobFn fn);
+
+    /**
+     * @brief 等待所有已启动的启动任务完成
+     * @return false 超时或有任务失败
+     */
+    bool wait_jobs(uint32_t timeout_ms);
+
+    /**
+     * @brief 请求重启进入配网模式（RTC内存标志，重启后由consume_provisioning_request()读取）
+     */
+    [[noreturn]] static void restart_into_provisioning();
+
+    /**
+     * @brief 本次启动是否由restart_into_provisioning()触发（读取后清除）
+     */
+    static bool consume_provisioning_request();
+
+    /**
+     * @brief 打印启动时间线（每阶段时间和相对上一阶段的增量）
+     */
+    void print_report() const;
+
+    /**
+     * @brief 时间线JSON对象：{"app_main":12,"nvs":40,...}（ms，未到达的阶段省略）
+     * @return 写入长度，缓冲区不足返回0
+     */
+    size_t format_json(char* buf, size_t cap) const;
+
+private:
+    BootSequence() = default;
+
+    struct Job {
+        JobFn fn;
+        EventBits_t done_bit;
+        volatile bool ok;
+        BootSequence* owner;
+    };
+
+    static void job_task(void* arg);
+
+    volatile uint32_t stage_ms_[(int)Stage::COUNT] = {};
+    Job jobs_[MAX_JOBS] = {};
+    int job_count_ = 0;
+    EventGroupHandle_t job_done_ = nullptr;
+};
@@ -0,0 +1,850 @@
+#include "diagnostics.h"
+#include "task_manager.h"
+#include "system_monitor.h"
+#include "audio_i2s.h"
+#include "audio_playout.h"
+#include "opus_encoder.h"
+#include "opus_decoder.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_wifi.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+
+static const char* TAG = "diag";
+
+// ============================================================================
+// PerformanceProfiler
+// ============================================================================
+
+#if CONFIG_ECHOEAR_PROFILER
+static const uint32_t PROFILE_RING_SIZE = CONFIG_ECHOEAR_PROFILER_RING_SIZE;
+#else
+static const uint32_t PROFILE_RING_SIZE = 64;
+#endif
+static_assert((PROFILE_RING_SIZE & (PROFILE_RING_SIZE - 1)) == 0, "profiler ring size must be a power of 2");
+
+// 测量点累计值（只增不减，消费者按Baseline取差值，32位回绕不影响差值）
+struct ProfilePoint {
+    const char* name;
+    volatile uint32_t count;
+    volatile uint32_t total_us;
+    volatile uint32_t core_mask;
+};
+
+// 环形样本：seq = 写入序号+1，写入过程中为0（消费者跳过）
+struct ProfileSample {
+    volatile uint32_t seq;
+    uint32_t duration_us;
+    uint8_t point;
+    uint8_t core;
+};
+
+static ProfilePoint s_points[PerformanceProfiler::MAX_POINTS];
+static volatile uint32_t s_point_count = 0;
+static portMUX_TYPE s_point_mux = portMUX_INITIALIZER_UNLOCKED;  // 仅注册时使用
+
+static ProfileSample s_ring[PROFILE_RING_SIZE];
+static volatile uint32_t s_ring_head = 0;  // 下一个写入序号
+
+uint8_t PerformanceProfiler::register_point(const char* name) {
+    uint8_t id = MAX_POINTS;
+    portENTER_CRITICAL(&s_point_mux);
+    for (uint32_t i = 0; i < s_point_count; i++) {
+        if (strcmp(s_points[i].name, name) == 0) {
+            id = (uint8_t)i;
+            break;
+        }
+    }
+    if (id == MAX_POINTS && s_point_count < (uint32_t)MAX_POINTS) {
+        id = (uint8_t)s_point_count;
+        s_points[id].name = name;
+        __sync_synchronize();
+        s_point_count = s_point_count + 1;
+    }
+    portEXIT_CRITICAL(&s_point_mux);
+
+    if (id == MAX_POINTS) {
+        ESP_LOGW(TAG, "Profile point table full, '%s' not measured", name);
+    }
+    return id;
+}
+
+void PerformanceProfiler::record(uint8_t point, uint32_t duration_us) {
+    if (point >= MAX_POINTS) return;
+
+    const uint32_t core = (uint32_t)xPortGetCoreID();
+    ProfilePoint& p = s_points[point];
+    __sync_fetch_and_add(&p.count, 1);
+    __sync_fetch_and_add(&p.total_us, duration_us);
+    if (!(p.core_mask & (1u << core))) {
+        __sync_fetch_and_or(&p.core_mask, 1u << core);
+    }
+
+    // 抢占一个序号，写入期间seq为0；被更新的写入者覆盖时消费者按seq识别
+    const uint32_t idx = __sync_fetch_and_add(&s_ring_head, 1);
+    ProfileSample& s = s_ring[idx & (PROFILE_RING_SIZE - 1)];
+    s.seq = 0;
+    __sync_synchronize();
+    s.duration_us = duration_us;
+    s.point = point;
+    s.core = (uint8_t)core;
+    __sync_synchronize();
+    s.seq = idx + 1;
+}
+
+int PerformanceProfiler::collect(Baseline& base, PointStats* out, int max_count, uint32_t* window_ms) {
+    const int64_t now = esp_timer_get_time();
+    const uint32_t window_us = base.time_us > 0 ? (uint32_t)(now - base.time_us) : 0;
+    const uint32_t head = s_ring_head;
+    __sync_synchronize();
+
+    // 窗口内仍留在环中的样本：(base.ring_head, head]，最多一圈
+    uint32_t first = base.ring_head;
+    if (head - first > PROFILE_RING_SIZE) first = head - PROFILE_RING_SIZE;
+
+    static uint32_t durations[PROFILE_RING_SIZE];  // 只在调用者任务中使用（main_ctrl）
+    const uint32_t points = s_point_count;
+    int n = 0;
+    for (uint32_t i = 0; i < points && n < max_count; i++) {
+        const ProfilePoint& p = s_points[i];
+        const uint32_t count = p.count;
+        const uint32_t total = p.total_us;
+        const uint32_t d_count = count - base.count[i];
+        const uint32_t d_total = total - base.total_us[i];
+        base.count[i] = count;
+        base.total_us[i] = total;
+        if (d_count == 0) continue;
+
+        uint32_t m = 0;
+        for (uint32_t seq = first; seq != head; seq++) {
+            const ProfileSample& s = s_ring[seq & (PROFILE_RING_SIZE - 1)];
+            if (s.seq != seq + 1 || s.point != i) continue;
+            const uint32_t d = s.duration_us;
+            __sync_synchronize();
+            if (s.seq == seq + 1) durations[m++] = d;  // 读取期间未被覆盖
+        }
+
+        PointStats& st = out[n++];
+        st.name = p.name;
+        st.count = d_count;
+        st.avg_us = d_total / d_count;
+        st.p95_us = 0;
+        st.max_us = 0;
+        if (m > 0) {
+            std::sort(durations, durations + m);
+            st.p95_us = durations[(m * 95) / 100];
+            st.max_us = durations[m - 1];
+        }
+        st.cpu_permille = window_us ? (uint32_t)((uint64_t)d_total * 1000 / window_us) : 0;
+        st.core_mask = (uint8_t)p.core_mask;
+    }
+
+    base.time_us = now;
+    base.ring_head = head;
+    if (window_ms) *window_ms = window_us / 1000;
+    return n;
+}
+
+void PerformanceProfiler::print_all_profiles() {
+    static Baseline base = {};
+    PointStats stats[MAX_POINTS];
+    uint32_t window_ms = 0;
+    int n = collect(base, stats, MAX_POINTS, &window_ms);
+    if (n == 0 || window_ms == 0) return;
+
+    ESP_LOGI(TAG, "=== Profile (%lums window) ===", (unsigned long)window_ms);
+    ESP_LOGI(TAG, "%-12s %7s %7s %7s %7s %6s %s", "Scope", "Calls", "Avg", "P95", "Max", "CPU%", "Core");
+    for (int i = 0; i < n; i++) {
+        const PointStats& s = stats[i];
+        ESP_LOGI(TAG, "%-12s %7lu %5luus %5luus %5luus %3lu.%lu%% %s",
+                 s.name, (unsigned long)s.count, (unsigned long)s.avg_us,
+                 (unsigned long)s.p95_us, (unsigned long)s.max_us,
+                 (unsigned long)(s.cpu_permille / 10), (unsigned long)(s.cpu_permille % 10),
+                 s.core_mask == 3 ? "0+1" : (s.core_mask & 2) ? "1" : "0");
+    }
+}
+
+// ============================================================================
+// Diagnostics - 基准测试
+// ============================================================================
+
+static const uint32_t DIAG_TASK_STACK = 32768;   // Opus编码器需要~31KB栈（同uplink_enc）
+static const UBaseType_t DIAG_TASK_PRIORITY = 4; // 低于main_ctrl(10)，不影响WS收发
+static const BaseType_t DIAG_TASK_CORE = 0;      // 音频实时任务在Core 1
+
+// 编解码：每个复杂度编码/解码的帧数
+static const uint8_t kBenchComplexity[Diagnostics::CODEC_BENCH_LEVELS] = {1, 5, 8};
+static const int CODEC_BENCH_BITRATE = 32000;
+static const int CODEC_BENCH_FRAMES = 100;
+static const size_t CODEC_BENCH_MAX_PACKET = 512;
+static const int CODEC_BENCH_DEFAULT = 2;        // benchmark_opus_codec返回值取自该档（c8，默认配置）
+static const int PLC_BENCH_FRAMES = 20;
+
+// RingBuffer / 内存池
+static const size_t RING_BENCH_CAPACITY = 4096;
+static const size_t RING_BENCH_CHUNK = 320;      // 20ms @ 16kHz
+static const int RING_BENCH_ITERATIONS = 2000;
+static const int POOL_BENCH_OPS = 10000;
+
+// 回环：1kHz测试音，80样本（5ms）一段做Goertzel，频点正好落在第5个bin
+static const uint32_t TONE_HZ = 1000;
+static const uint32_t TONE_MS = 200;
+static const int16_t TONE_AMPLITUDE = 8192;      // -12dBFS
+static const size_t TONE_SEGMENT = 80;
+static const float TONE_MIN_POWER = 6.5e6f;      // 约等于MIC0上幅度64的测试音
+static const float TONE_THRESHOLD_RATIO = 16.0f; // 高于环境噪声最大段能量12dB
+static const uint32_t LOOPBACK_BASELINE_MS = 300;
+static const uint32_t LOOPBACK_TIMEOUT_MS = 300; // 测试音写完后继续等待的时间
+static const uint32_t LOOPBACK_GAP_MS = 200;     // 两次测量之间等回声衰减
+
+// WebSocket
+static const size_t UPLINK_BENCH_FRAME = 1024;
+static const uint32_t UPLINK_BENCH_MS = 2000;
+static const uint32_t DOWNLINK_TIMEOUT_MS = 10000;
+
+// 内存泄漏检测：内部RAM空闲减少超过该值判定为泄漏（其他任务的临时分配会带来小幅波动）
+static const int32_t LEAK_TOLERANCE_BYTES = 2048;
+
+static uint32_t elapsed_ms_since(int64_t start_us) {
+    return (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+}
+
+void Diagnostics::add_result(const TestResult& result) {
+    if (result_count_ >= sizeof(results_) / sizeof(results_[0])) {
+        ESP_LOGW(TAG, "Result table full, '%s' dropped", result.name);
+        return;
+    }
+    results_[result_count_++] = result;
+    ESP_LOGI(TAG, "[%s] %s: %s (%lums)", result.passed ? "PASS" : "FAIL", result.name,
+             result.details, (unsigned long)result.duration_ms);
+}
+
+void Diagnostics::add_result(const char* name, bool passed, uint32_t duration_ms, const char* fmt, ...) {
+    TestResult r = {};
+    r.passed = passed;
+    r.name = name;
+    r.duration_ms = duration_ms;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(r.details, sizeof(r.details), fmt, args);
+    va_end(args);
+    add_result(r);
+}
+
+bool Diagnostics::start_benchmark(const char* reason) {
+    if (running_) {
+        ESP_LOGW(TAG, "Benchmark already running");
+        return false;
+    }
+    reason_ = reason ? reason : "";
+    running_ = true;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(diag_task, "diag", DIAG_TASK_STACK, this,
+                                             DIAG_TASK_PRIORITY, &task_handle_, DIAG_TASK_CORE);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create diag task (%lu B stack)", (unsigned long)DIAG_TASK_STACK);
+        task_handle_ = nullptr;
+        running_ = false;
+        return false;
+    }
+    ESP_LOGI(TAG, "Benchmark started (%s)", reason_);
+    return true;
+}
+
+void Diagnostics::diag_task(void* arg) {
+    Diagnostics* self = static_cast<Diagnostics*>(arg);
+    TaskManager& tm = TaskManager::instance();
+
+    // 固定最高频、禁止light sleep：各版本之间的数字才可比
+    tm.pm_hold(TaskManager::PmClient::DIAG, true);
+    self->run_full_diagnostics();
+    tm.pm_hold(TaskManager::PmClient::DIAG, false);
+
+    self->print_diagnostics_report();
+    if (!self->send_report()) {
+        ESP_LOGW(TAG, "Benchmark report not sent (WebSocket unavailable)");
+    }
+
+    self->task_handle_ = nullptr;
+    self->running_ = false;
+    vTaskDelete(nullptr);
+}
+
+bool Diagnostics::run_full_diagnostics() {
+    const int64_t start = esp_timer_get_time();
+    result_count_ = 0;
+    report_ = {};
+
+    // 编解码在前：流水线测试的encoder/decoder结论来自这里
+    benchmark_opus_codec();
+    benchmark_buffers();
+    test_audio_pipeline();
+    benchmark_audio_latency();
+    test_memory_leaks();
+    test_network();
+
+    report_.duration_ms = elapsed_ms_since(start);
+
+    bool all_passed = true;
+    for (uint32_t i = 0; i < result_count_; i++) {
+        all_passed = all_passed && results_[i].passed;
+    }
+    return all_passed;
+}
+
+// ============================================================================
+// Opus编解码
+// ============================================================================
+
+// 合成的类语音信号：三个共振峰频率 + 4Hz音节包络 + 低电平噪声（每帧相同的统计特性）
+static void fill_speech_like(int16_t* out, size_t n, uint32_t* t, uint32_t* noise) {
+    const float sr = (float)HITONY_SAMPLE_RATE;
+    for (size_t i = 0; i < n; i++, (*t)++) {
+        const float ts = (float)*t / sr;
+        const float env = 0.55f + 0.45f * sinf(2.0f * (float)M_PI * 4.0f * ts);
+        float v = 0.5f * sinf(2.0f * (float)M_PI * 220.0f * ts)
+                + 0.3f * sinf(2.0f * (float)M_PI * 730.0f * ts)
+                + 0.2f * sinf(2.0f * (float)M_PI * 1850.0f * ts);
+        *noise = *noise * 1664525u + 1013904223u;
+        v = v * env * 9000.0f + (float)((int32_t)(*noise >> 16) - 32768) * 0.03f;
+        out[i] = (int16_t)v;
+    }
+}
+
+uint32_t Diagnostics::benchmark_opus_codec() {
+    const int64_t start = esp_timer_get_time();
+    OpusDecoder decoder;
+    if (!decoder.init(HITONY_SAMPLE_RATE, 1)) {
+        add_result("opus_codec", false, elapsed_ms_since(start), "decoder init failed");
+        return 0;
+    }
+
+    const size_t dec_cap = decoder.frame_size();
+    int16_t* pcm = (int16_t*)heap_caps_malloc(dec_cap * sizeof(int16_t), MALLOC_CAP_INTERNAL);
+    int16_t* dec_out = (int16_t*)heap_caps_malloc(dec_cap * sizeof(int16_t), MALLOC_CAP_INTERNAL);
+    uint8_t* packet = (uint8_t*)heap_caps_malloc(CODEC_BENCH_MAX_PACKET, MALLOC_CAP_INTERNAL);
+    if (!pcm || !dec_out || !packet) {
+        heap_caps_free(pcm);
+        heap_caps_free(dec_out);
+        heap_caps_free(packet);
+        decoder.deinit();
+        add_result("opus_codec", false, elapsed_ms_since(start), "out of memory");
+        return 0;
+    }
+
+    bool ok = true;
+    for (int lvl = 0; lvl < CODEC_BENCH_LEVELS; lvl++) {
+        CodecBench& b = report_.codec[lvl];
+        b.complexity = kBenchComplexity[lvl];
+
+        OpusEncoder encoder;
+        const OpusEncoder::Params params = {CODEC_BENCH_BITRATE, b.complexity, false};
+        if (!encoder.init(HITONY_SAMPLE_RATE, 1, CODEC_BENCH_BITRATE) || !encoder.apply(params, true) ||
+            encoder.frame_size() > dec_cap) {
+            ESP_LOGE(TAG, "Codec bench: encoder setup failed (c%u)", b.complexity);
+            ok = false;
+            continue;
+        }
+        decoder.reset();
+
+        // 每档使用相同的输入序列
+        uint32_t t = 0, noise = 1;
+        uint64_t enc_total = 0, dec_total = 0, bytes = 0;
+        uint32_t encoded = 0, decoded = 0;
+        for (int f = 0; f < CODEC_BENCH_FRAMES; f++) {
+            fill_speech_like(pcm, encoder.frame_size(), &t, &noise);
+
+            int64_t t0 = esp_timer_get_time();
+            int len = encoder.encode(pcm, encoder.frame_size(), packet, CODEC_BENCH_MAX_PACKET);
+            uint32_t enc_us = (uint32_t)(esp_timer_get_time() - t0);
+            if (len <= 0) continue;
+            enc_total += enc_us;
+            if (enc_us > b.encode_max_us) b.encode_max_us = enc_us;
+            bytes += len;
+            encoded++;
+
+            t0 = esp_timer_get_time();
+            int samples = decoder.decode(packet, len, dec_out, dec_cap);
+            uint32_t dec_us = (uint32_t)(esp_timer_get_time() - t0);
+            if (samples <= 0) continue;
+            dec_total += dec_us;
+            if (dec_us > b.decode_max_us) b.decode_max_us = dec_us;
+            decoded++;
+        }
+        encoder.deinit();
+
+        if (encoded == 0 || decoded == 0) {
+            ESP_LOGE(TAG, "Codec bench: c%u encoded=%lu decoded=%lu",
+                     b.complexity, (unsigned long)encoded, (unsigned long)decoded);
+            ok = false;
+            continue;
+        }
+        b.encode_us = (uint32_t)(enc_total / encoded);
+        b.decode_us = (uint32_t)(dec_total / decoded);
+        b.bytes_per_frame = (uint32_t)(bytes / encoded);
+    }
+
+    // PLC：解码器保留最后一档的历史
+    uint64_t plc_total = 0;
+    uint32_t plc_done = 0;
+    for (int i = 0; i < PLC_BENCH_FRAMES; i++) {
+        int64_t t0 = esp_timer_get_time();
+        if (decoder.conceal(nullptr, 0, dec_out, dec_cap) > 0) {
+            plc_total += (uint32_t)(esp_timer_get_time() - t0);
+            plc_done++;
+        }
+    }
+    report_.plc_us = plc_done ? (uint32_t)(plc_total / plc_done) : 0;
+
+    decoder.deinit();
+    heap_caps_free(pcm);
+    heap_caps_free(dec_out);
+    heap_caps_free(packet);
+
+    const CodecBench& def = report_.codec[CODEC_BENCH_DEFAULT];
+    const uint32_t per_frame_us = def.encode_us + def.decode_us;
+    add_result("opus_codec", ok, elapsed_ms_since(start), "c%u enc=%luus dec=%luus plc=%luus",
+               def.complexity, (unsigned long)def.encode_us, (unsigned long)def.decode_us,
+               (unsigned long)report_.plc_us);
+    return per_frame_us ? 1000000 / per_frame_us : 0;
+}
+
+// ============================================================================
+// RingBuffer / 内存池
+// ============================================================================
+
+void Diagnostics::benchmark_buffers() {
+    int64_t start = esp_timer_get_time();
+
+    // 单任务写入再读出（测量拷贝和指针维护开销，不含跨核缓存同步）
+    pcm_ringbuffer_t rb = {};
+    int16_t* chunk = (int16_t*)heap_caps_calloc(RING_BENCH_CHUNK, sizeof(int16_t), MALLOC_CAP_INTERNAL);
+    if (chunk && ringbuffer_init(&rb, RING_BENCH_CAPACITY)) {
+        uint64_t moved = 0;
+        const int64_t t0 = esp_timer_get_time();
+        for (int i = 0; i < RING_BENCH_ITERATIONS; i++) {
+            moved += ringbuffer_write(&rb, chunk, RING_BENCH_CHUNK);
+            moved += ringbuffer_read(&rb, chunk, RING_BENCH_CHUNK);
+        }
+        const uint32_t dt_us = (uint32_t)(esp_timer_get_time() - t0);
+        report_.ring_ksps = dt_us ? (uint32_t)(moved * 1000 / dt_us) : 0;
+    }
+    ringbuffer_free(&rb);
+    heap_caps_free(chunk);
+    add_result("ring", report_.ring_ksps > 0, elapsed_ms_since(start), "%lu ksamples/s",
+               (unsigned long)report_.ring_ksps);
+
+    // POOL_S_256：Opus包/控制消息最常用的池
+    start = esp_timer_get_time();
+    uint32_t failed = 0;
+    for (int i = 0; i < POOL_BENCH_OPS; i++) {
+        void* p = pool_alloc(POOL_S_256);
+        if (p) {
+            pool_free(p);
+        } else {
+            failed++;
+        }
+    }
+    const uint32_t dt_us = (uint32_t)(esp_timer_get_time() - start);
+    report_.pool_kops = dt_us ? (uint32_t)((uint64_t)POOL_BENCH_OPS * 1000 / dt_us) : 0;
+    add_result("pool", failed == 0, dt_us / 1000, "%lu kops/s, %lu failed",
+               (unsigned long)report_.pool_kops, (unsigned long)failed);
+}
+
+// ============================================================================
+// 音频流水线 / 回环延迟
+// ============================================================================
+
+void Diagnostics::loopback_feed(const int16_t* stereo, size_t frames, uint32_t capture_us) {
+    loopback_blocks_ = loopback_blocks_ + 1;
+    const uint8_t phase = loopback_phase_;
+    const float coeff = 2.0f * cosf(2.0f * (float)M_PI * TONE_HZ / HITONY_SAMPLE_RATE);
+
+    for (size_t off = 0; off + TONE_SEGMENT <= frames; off += TONE_SEGMENT) {
+        float s1 = 0, s2 = 0;
+        for (size_t i = off; i < off + TONE_SEGMENT; i++) {
+            const float s0 = (float)stereo[i * 2] + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+        const float power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+
+        if (phase == LOOPBACK_BASELINE) {
+            if (power > loopback_noise_) loopback_noise_ = power;
+            continue;
+        }
+        if (power > loopback_peak_) loopback_peak_ = power;
+
+        const uint32_t tone_us = loopback_tone_us_;
+        if (tone_us == 0 || loopback_detect_us_ != 0 || power <= loopback_threshold_) continue;
+        // 段起点时间：块读取完成时间减去段起点之后的样本时长
+        const uint32_t seg_us = capture_us - (uint32_t)((frames - off) * 1000000ULL / HITONY_SAMPLE_RATE);
+        if ((int32_t)(seg_us - tone_us) >= 0) loopback_detect_us_ = seg_us;
+    }
+}
+
+void Diagnostics::generate_test_tone(uint32_t frequency, uint32_t duration_ms) {
+    // 先占住I2S再检查播放：main_ctrl看到tone_active_后不再启动TTS
+    tone_active_ = true;
+    __sync_synchronize();
+    if (AudioPlayout::instance().is_active()) {
+        tone_active_ = false;
+        ESP_LOGW(TAG, "Playout active, test tone skipped");
+        return;
+    }
+
+    const size_t chunk = HITONY_SAMPLE_RATE / 50;  // 20ms，与播放任务相同的写入粒度
+    int16_t* buf = (int16_t*)heap_caps_malloc(chunk * sizeof(int16_t), MALLOC_CAP_INTERNAL);
+    if (!buf) {
+        tone_active_ = false;
+        ESP_LOGE(TAG, "Test tone: out of memory");
+        return;
+    }
+
+    AudioI2S& i2s = AudioI2S::instance();
+    const float step = 2.0f * (float)M_PI * frequency / HITONY_SAMPLE_RATE;
+    const size_t total = (size_t)HITONY_SAMPLE_RATE * duration_ms / 1000;
+    float phase = 0;
+    for (size_t done = 0; done < total; done += chunk) {
+        const size_t n = std::min(chunk, total - done);
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = (int16_t)(TONE_AMPLITUDE * sinf(phase));
+            phase += step;
+            if (phase > 2.0f * (float)M_PI) phase -= 2.0f * (float)M_PI;
+        }
+        if (done == 0) loopback_tone_us_ = latency_now_us();
+        i2s.play_frame((const uint8_t*)buf, n * sizeof(int16_t));
+    }
+
+    // 再写一块静音，把测试音尾部推出DMA
+    memset(buf, 0, chunk * sizeof(int16_t));
+    i2s.play_frame((const uint8_t*)buf, chunk * sizeof(int16_t));
+    heap_caps_free(buf);
+    tone_active_ = false;
+}
+
+uint32_t Diagnostics::benchmark_audio_latency() {
+    const int64_t start = esp_timer_get_time();
+    if (AudioPlayout::instance().is_active()) {
+        add_result("loopback", false, 0, "playout active");
+        return 0;
+    }
+
+    uint32_t sum_ms = 0, detected = 0;
+    float snr_db = 0;
+    for (int trial = 0; trial < LOOPBACK_TRIALS; trial++) {
+        loopback_noise_ = 0;
+        loopback_peak_ = 0;
+        loopback_phase_ = LOOPBACK_BASELINE;
+        vTaskDelay(pdMS_TO_TICKS(LOOPBACK_BASELINE_MS));
+
+        const float noise = loopback_noise_;
+        loopback_threshold_ = std::max(noise * TONE_THRESHOLD_RATIO, TONE_MIN_POWER);
+        loopback_tone_us_ = 0;
+        loopback_detect_us_ = 0;
+        __sync_synchronize();
+        loopback_phase_ = LOOPBACK_LISTEN;
+
+        generate_test_tone(TONE_HZ, TONE_MS);
+        for (uint32_t waited = 0; loopback_detect_us_ == 0 && waited < LOOPBACK_TIMEOUT_MS; waited += 10) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        loopback_phase_ = LOOPBACK_OFF;
+
+        const uint32_t detect_us = loopback_detect_us_;
+        const uint32_t tone_us = loopback_tone_us_;
+        if (detect_us != 0 && tone_us != 0) {
+            const uint32_t ms = (detect_us - tone_us + 999) / 1000;
+            report_.loopback_ms[trial] = ms ? ms : 1;
+            sum_ms += report_.loopback_ms[trial];
+            detected++;
+        }
+        if (noise > 0 && loopback_peak_ > 0) {
+            snr_db = 10.0f * log10f(loopback_peak_ / noise);
+        }
+        ESP_LOGI(TAG, "Loopback #%d: %lums (peak/noise %.1fdB)", trial + 1,
+                 (unsigned long)report_.loopback_ms[trial], snr_db);
+
+        vTaskDelay(pdMS_TO_TICKS(LOOPBACK_GAP_MS));
+    }
+
+    report_.loopback_avg_ms = detected ? sum_ms / detected : 0;
+    add_result("loopback", detected == LOOPBACK_TRIALS, elapsed_ms_since(start),
+               "avg=%lums detected=%lu/%d snr=%.0fdB", (unsigned long)report_.loopback_avg_ms,
+               (unsigned long)detected, LOOPBACK_TRIALS, snr_db);
+    return report_.loopback_avg_ms;
+}
+
+Diagnostics::AudioTestResult Diagnostics::test_audio_pipeline() {
+    const int64_t start = esp_timer_get_time();
+    AudioTestResult r = {};
+
+    // 采集：BASELINE阶段只统计块数和噪声，不做检测
+    loopback_blocks_ = 0;
+    loopback_noise_ = 0;
+    loopback_phase_ = LOOPBACK_BASELINE;
+
+    // AFE输出：分段累计写指针前进量（位置按容量取模，单段前进远小于容量）
+    const size_t cap = g_afe_out_ringbuffer.capacity;
+    size_t last = g_afe_out_ringbuffer.write_pos;
+    for (int i = 0; i < 10; i++) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+        const size_t pos = g_afe_out_ringbuffer.write_pos;
+        if (cap) r.output_samples += (uint32_t)((pos - last + cap) % cap);
+        last = pos;
+    }
+    loopback_phase_ = LOOPBACK_OFF;
+    r.input_frames = loopback_blocks_;
+
+    r.i2s_working = r.input_frames > 0;
+    r.afe_working = r.output_samples > 0;
+    r.encoder_working = report_.codec[CODEC_BENCH_DEFAULT].encode_us > 0;
+    r.decoder_working = report_.codec[CODEC_BENCH_DEFAULT].decode_us > 0;
+    add_result("audio_pipeline", r.i2s_working && r.afe_working && r.encoder_working && r.decoder_working,
+               elapsed_ms_since(start), "capture=%lu blk afe=%lu smp",
+               (unsigned long)r.input_frames, (unsigned long)r.output_samples);
+
+    // AFE feed→fetch延迟：采集时间戳 → AFE输出（自上次遥测重置以来的窗口）
+    SystemMonitor::LatencyPercentiles p =
+        SystemMonitor::instance().get_latency_percentiles(SystemMonitor::LatencyStage::CAPTURE_TO_AFE);
+    report_.afe_p50_us = p.p50_us;
+    report_.afe_p95_us = p.p95_us;
+    report_.afe_max_us = p.max_us;
+    add_result("afe_latency", p.count > 0, 0, "p50=%luus p95=%luus max=%luus n=%lu",
+               (unsigned long)p.p50_us, (unsigned long)p.p95_us, (unsigned long)p.max_us,
+               (unsigned long)p.count);
+    return r;
+}
+
+// ============================================================================
+// 内存
+// ============================================================================
+
+bool Diagnostics::test_memory_leaks(uint32_t iterations) {
+    const int64_t start = esp_timer_get_time();
+    const int32_t before = (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    uint32_t pool_failed = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        void* p = pool_alloc((pool_type_t)(i % POOL_COUNT));
+        if (p) {
+            pool_free(p);
+        } else {
+            pool_failed++;
+        }
+
+        void* m = heap_caps_malloc(32 + (i * 37) % 1024, MALLOC_CAP_INTERNAL);
+        heap_caps_free(m);
+
+        // 编解码器的打开/关闭是运行中最大的反复分配（档位切换重开编码器）
+        if (i % 200 == 0) {
+            OpusEncoder enc;
+            if (enc.init(HITONY_SAMPLE_RATE, 1, CODEC_BENCH_BITRATE)) enc.deinit();
+            OpusDecoder dec;
+            if (dec.init(HITONY_SAMPLE_RATE, 1)) dec.deinit();
+        }
+        if (i % 100 == 99) vTaskDelay(1);
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(50));  // 让其他任务归还临时分配
+    const int32_t after = (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    report_.heap_delta = after - before;
+
+    const bool leak = report_.heap_delta < -LEAK_TOLERANCE_BYTES;
+    add_result("memory", !leak && pool_failed == 0, elapsed_ms_since(start), "delta=%ldB pool_fail=%lu",
+               (long)report_.heap_delta, (unsigned long)pool_failed);
+    return leak;
+}
+
+// ============================================================================
+// 网络
+// ============================================================================
+
+void Diagnostics::on_downlink_end() {
+    TaskHandle_t task = task_handle_;
+    if (downlink_active_ && task) xTaskNotifyGive(task);
+}
+
+uint32_t Diagnostics::benchmark_websocket_throughput() {
+    if (!ws_send_) {
+        add_result("ws_throughput", false, 0, "no transport");
+        return 0;
+    }
+    int64_t start = esp_timer_get_time();
+    ws_busy_ = true;
+    __sync_synchronize();
+
+    // 上行：固定大小的文本帧连续发送（服务器忽略bench_data）
+    char* buf = (char*)heap_caps_malloc(UPLINK_BENCH_FRAME + 1, MALLOC_CAP_INTERNAL);
+    uint64_t sent = 0;
+    uint32_t seq = 0;
+    bool send_ok = buf != nullptr;
+    while (send_ok && elapsed_ms_since(start) < UPLINK_BENCH_MS) {
+        int len = snprintf(buf, UPLINK_BENCH_FRAME, "{\"type\":\"bench_data\",\"seq\":%lu,\"pad\":\"",
+                           (unsigned long)seq++);
+        memset(buf + len, 'x', UPLINK_BENCH_FRAME - 2 - len);
+        memcpy(buf + UPLINK_BENCH_FRAME - 2, "\"}", 3);
+        send_ok = ws_send_(buf, UPLINK_BENCH_FRAME);
+        if (send_ok) sent += UPLINK_BENCH_FRAME;
+    }
+    heap_caps_free(buf);
+    uint32_t up_ms = elapsed_ms_since(start);
+    report_.uplink_kbps = up_ms ? (uint32_t)(sent * 8 / up_ms) : 0;
+    add_result("ws_uplink", send_ok && report_.uplink_kbps > 0, up_ms, "%lu kbps, %lu frames",
+               (unsigned long)report_.uplink_kbps, (unsigned long)(sent / UPLINK_BENCH_FRAME));
+
+#if CONFIG_ECHOEAR_BENCHMARK_DOWNLINK_KB > 0
+    // 下行：请求服务器回送N字节（benchmark action=data），以downlink_end结束
+    if (send_ok) {
+        char req[96];
+        int len = snprintf(req, sizeof(req), "{\"type\":\"benchmark\",\"action\":\"downlink\",\"bytes\":%d}",
+                           CONFIG_ECHOEAR_BENCHMARK_DOWNLINK_KB * 1024);
+        downlink_bytes_ = 0;
+        downlink_first_us_ = 0;
+        ulTaskNotifyTake(pdTRUE, 0);
+        __sync_synchronize();
+        downlink_active_ = true;
+
+        start = esp_timer_get_time();
+        bool ended = false;
+        if (ws_send_(req, len)) {
+            ended = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DOWNLINK_TIMEOUT_MS)) > 0;
+        }
+        downlink_active_ = false;
+        const int64_t end = esp_timer_get_time();
+
+        const uint32_t bytes = downlink_bytes_;
+        const int64_t first = downlink_first_us_;
+        if (first > 0) {
+            report_.ttfb_ms = (uint32_t)((first - start) / 1000);
+            const uint32_t down_ms = (uint32_t)((end - first) / 1000);
+            report_.downlink_kbps = down_ms ? (uint32_t)((uint64_t)bytes * 8 / down_ms) : 0;
+        }
+        add_result("ws_downlink", ended && report_.downlink_kbps > 0, elapsed_ms_since(start),
+                   "%lu kbps, %lu B, ttfb=%lums%s", (unsigned long)report_.downlink_kbps,
+                   (unsigned long)bytes, (unsigned long)report_.ttfb_ms, ended ? "" : " (timeout)");
+    }
+#endif
+
+    ws_busy_ = false;
+    return report_.uplink_kbps;
+}
+
+Diagnostics::NetworkTestResult Diagnostics::test_network() {
+    const int64_t start = esp_timer_get_time();
+    NetworkTestResult r = {};
+
+    wifi_ap_record_t ap = {};
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        r.wifi_working = true;
+        r.wifi_rssi = ap.rssi;
+    }
+    add_result("wifi", r.wifi_working, elapsed_ms_since(start), "rssi=%d", r.wifi_rssi);
+
+    if (r.wifi_working) {
+        r.throughput_kbps = benchmark_websocket_throughput();
+        r.ws_working = r.throughput_kbps > 0;
+        r.ping_ms = report_.ttfb_ms;
+    }
+    return r;
+}
+
+// ============================================================================
+// 报告
+// ============================================================================
+
+void Diagnostics::print_diagnostics_report() {
+    const BenchmarkReport& b = report_;
+    ESP_LOGI(TAG, "=== Benchmark (fw %s, %s, %lums) ===", HITONY_FW_VERSION, reason_,
+             (unsigned long)b.duration_ms);
+    for (int i = 0; i < CODEC_BENCH_LEVELS; i++) {
+        const CodecBench& c = b.codec[i];
+        ESP_LOGI(TAG, "opus c%-2u: enc %5luus (max %5lu) dec %5luus (max %5lu) %3luB/frame",
+                 c.complexity, (unsigned long)c.encode_us, (unsigned long)c.encode_max_us,
+                 (unsigned long)c.decode_us, (unsigned long)c.decode_max_us,
+                 (unsigned long)c.bytes_per_frame);
+    }
+    ESP_LOGI(TAG, "plc %luus | ring %lu ksps | pool %lu kops/s | heap delta %ldB",
+             (unsigned long)b.plc_us, (unsigned long)b.ring_ksps, (unsigned long)b.pool_kops,
+             (long)b.heap_delta);
+    ESP_LOGI(TAG, "afe p50/p95/max %lu/%lu/%luus | loopback %lu/%lu/%lums (avg %lu)",
+             (unsigned long)b.afe_p50_us, (unsigned long)b.afe_p95_us, (unsigned long)b.afe_max_us,
+             (unsigned long)b.loopback_ms[0], (unsigned long)b.loopback_ms[1],
+             (unsigned long)b.loopback_ms[2], (unsigned long)b.loopback_avg_ms);
+    ESP_LOGI(TAG, "ws up %lu kbps | down %lu kbps | ttfb %lums",
+             (unsigned long)b.uplink_kbps, (unsigned long)b.downlink_kbps, (unsigned long)b.ttfb_ms);
+
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i < result_count_; i++) {
+        if (results_[i].passed) passed++;
+    }
+    ESP_LOGI(TAG, "Tests: %lu/%lu passed", (unsigned long)passed, (unsigned long)result_count_);
+    for (uint32_t i = 0; i < result_count_; i++) {
+        if (!results_[i].passed) ESP_LOGW(TAG, "  FAIL %s: %s", results_[i].name, results_[i].details);
+    }
+}
+
+/**
+ * 格式（数组按位置编码）：
+ * {"type":"benchmark_report","fw":..,"reason":..,"cpu_mhz":..,"duration_ms":..,
+ *  "codec":[[complexity,enc_us,enc_max,dec_us,dec_max,bytes]..],"plc_us":..,"ring_ksps":..,"pool_kops":..,
+ *  "afe_us":[p50,p95,max],"loopback_ms":[..],"ws_kbps":[up,down],"ttfb_ms":..,"heap_delta":..,
+ *  "tests":[[name,passed,ms,details]..]}
+ */
+bool Diagnostics::send_report() {
+    if (!ws_send_) return false;
+
+    const size_t cap = 2048;
+    char* buf = (char*)heap_caps_malloc(cap, MALLOC_CAP_INTERNAL);
+    if (!buf) return false;
+
+    const BenchmarkReport& b = report_;
+    int len = snprintf(buf, cap,
+                       "{\"type\":\"benchmark_report\",\"fw\":\"%s\",\"reason\":\"%s\",\"cpu_mhz\":%d,"
+                       "\"duration_ms\":%lu,\"codec\":[",
+                       HITONY_FW_VERSION, reason_, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+                       (unsigned long)b.duration_ms);
+    for (int i = 0; i < CODEC_BENCH_LEVELS && len < (int)cap; i++) {
+        const CodecBench& c = b.codec[i];
+        len += snprintf(buf + len, cap - len, "%s[%u,%lu,%lu,%lu,%lu,%lu]", i ? "," : "",
+                        c.complexity, (unsigned long)c.encode_us, (unsigned long)c.encode_max_us,
+                        (unsigned long)c.decode_us, (unsigned long)c.decode_max_us,
+                        (unsigned long)c.bytes_per_frame);
+    }
+    if (len < (int)cap) {
+        len += snprintf(buf + len, cap - len,
+                        "],\"plc_us\":%lu,\"ring_ksps\":%lu,\"pool_kops\":%lu,\"afe_us\":[%lu,%lu,%lu],"
+                        "\"loopback_ms\":[%lu,%lu,%lu],\"ws_kbps\":[%lu,%lu],\"ttfb_ms\":%lu,"
+                        "\"heap_delta\":%ld,\"tests\":[",
+                        (unsigned long)b.plc_us, (unsigned long)b.ring_ksps, (unsigned long)b.pool_kops,
+                        (unsigned long)b.afe_p50_us, (unsigned long)b.afe_p95_us, (unsigned long)b.afe_max_us,
+                        (unsigned long)b.loopback_ms[0], (unsigned long)b.loopback_ms[1],
+                        (unsigned long)b.loopback_ms[2], (unsigned long)b.uplink_kbps,
+                        (unsigned long)b.downlink_kbps, (unsigned long)b.ttfb_ms, (long)b.heap_delta);
+    }
+    for (uint32_t i = 0; i < result_count_ && len < (int)cap; i++) {
+        const TestResult& r = results_[i];
+        len += snprintf(buf + len, cap - len, "%s[\"%s\",%d,%lu,\"%s\"]", i ? "," : "",
+                        r.name, r.passed ? 1 : 0, (unsigned long)r.duration_ms, r.details);
+    }
+    if (len < (int)cap) len += snprintf(buf + len, cap - len, "]}");
+
+    bool ok = false;
+    if (len < (int)cap) {
+        // 发送期间保持ws_busy_：main_ctrl的硬重连会等它返回再销毁客户端
+        ws_busy_ = true;
+        __sync_synchronize();
+        ok = ws_send_(buf, len);
+        ws_busy_ = false;
+    } else {
+        ESP_LOGE(TAG, "Benchmark report exceeds %u B", (unsigned)cap);
+    }
+    heap_caps_free(buf);
+    return ok;
+}
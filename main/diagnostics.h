@@ -1,16 +1,26 @@
 #pragma once
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
 #include <cstdint>
-#include <functional>
+#include <cstddef>
+#include "sdkconfig.h"
 
 /**
- * @brief 系统诊断工具
+ * @brief 系统诊断与基准测试
  *
- * 提供各种诊断和测试功能：
- * - 音频流水线测试
- * - 网络连接测试
- * - 内存泄漏检测
- * - 性能基准测试
+ * 服务器下发{"type":"benchmark","action":"start"}（或CONFIG_ECHOEAR_BENCHMARK_AT_BOOT）时，
+ * 在独立的diag任务中依次运行：
+ * - Opus编解码：多个复杂度下每帧编码/解码耗时（合成语音频段信号）
+ * - PCM RingBuffer / 内存池吞吐量
+ * - AFE feed→fetch延迟（SystemMonitor CAPTURE_TO_AFE分位数）
+ * - 回环延迟：generate_test_tone播放 → MIC0检测到测试音（audio_main_task采集钩子）
+ * - WebSocket上行/下行吞吐量（下行需服务器配合回送）
+ * - 内存泄漏检测、音频流水线/网络健康检查
+ * 结果以{"type":"benchmark_report",...}发回服务器并打印到日志。
+ *
+ * 只在FSM空闲时启动；运行期间main_ctrl忽略唤醒，播放任务不活动（测试音直接写I2S）。
  */
 class Diagnostics {
 public:
@@ -18,7 +28,7 @@ public:
     struct TestResult {
         bool passed;
         const char* name;
-        const char* details;
+        char details[48];
         uint32_t duration_ms;
     };
 
@@ -28,10 +38,8 @@ public:
         bool afe_working;
         bool encoder_working;
         bool decoder_working;
-        uint32_t input_frames;
-        uint32_t output_frames;
-        uint32_t dropped_frames;
-        float audio_quality;
+        uint32_t input_frames;      // 窗口内采集块数
+        uint32_t output_samples;    // 窗口内AFE输出样本数
     };
 
     // 网络测试结果
@@ -39,17 +47,97 @@ public:
         bool wifi_working;
         bool ws_working;
         int8_t wifi_rssi;
-        uint32_t ping_ms;
-        uint32_t throughput_kbps;
+        uint32_t ping_ms;           // 下行请求 → 首字节（含服务器处理）
+        uint32_t throughput_kbps;   // 上行
+    };
+
+    static const int CODEC_BENCH_LEVELS = 3;
+    static const int LOOPBACK_TRIALS = 3;
+
+    // 单个复杂度的编解码结果（每帧平均/最大耗时）
+    struct CodecBench {
+        uint8_t complexity;
+        uint32_t encode_us;
+        uint32_t encode_max_us;
+        uint32_t decode_us;
+        uint32_t decode_max_us;
+        uint32_t bytes_per_frame;
     };
 
+    // 完整基准报告（按固件版本对比）
+    struct BenchmarkReport {
+        CodecBench codec[CODEC_BENCH_LEVELS];
+        uint32_t plc_us;                // PLC补偿一帧耗时
+        uint32_t ring_ksps;             // RingBuffer写+读吞吐（k样本/秒）
+        uint32_t pool_kops;             // pool_alloc+pool_free（k次/秒）
+        uint32_t afe_p50_us;            // 采集 → AFE输出
+        uint32_t afe_p95_us;
+        uint32_t afe_max_us;
+        uint32_t loopback_ms[LOOPBACK_TRIALS];  // 0 = 未检测到
+        uint32_t loopback_avg_ms;
+        uint32_t uplink_kbps;
+        uint32_t downlink_kbps;
+        uint32_t ttfb_ms;
+        int32_t heap_delta;             // 泄漏测试前后内部RAM空闲变化（负数 = 减少）
+        uint32_t duration_ms;
+    };
+
+    // WS文本帧发送（main_ctrl注册，esp_websocket_client发送接口线程安全）
+    typedef bool (*WsSendFn)(const char* data, size_t len);
+
     static Diagnostics& instance() {
         static Diagnostics inst;
         return inst;
     }
 
     /**
-     * @brief 运行完整的系统诊断
+     * @brief 注册WS发送函数（未注册时跳过WebSocket测试，报告只打印）
+     */
+    void set_ws_sender(WsSendFn fn) { ws_send_ = fn; }
+
+    /**
+     * @brief 启动diag任务运行完整基准（已在运行时返回false）
+     * @param reason 触发来源（"server"/"boot"），写入报告
+     */
+    bool start_benchmark(const char* reason);
+
+    bool is_running() const { return running_; }
+
+    /**
+     * @brief WS测试是否在使用客户端（main_ctrl据此推迟销毁重建）
+     */
+    bool ws_in_use() const { return ws_busy_; }
+
+    /**
+     * @brief 测试音正在写I2S（main_ctrl据此不启动TTS播放，避免两路同时写I2S）
+     */
+    bool tone_active() const { return tone_active_; }
+
+    /**
+     * @brief main_ctrl每收到一个WS帧调用：下行测试期间累计字节数
+     */
+    void on_ws_rx(size_t len) {
+        if (!downlink_active_) return;
+        if (downlink_first_us_ == 0) downlink_first_us_ = esp_timer_get_time();
+        downlink_bytes_ += len;
+    }
+
+    /**
+     * @brief 服务器回送完毕（benchmark action=downlink_end）
+     */
+    void on_downlink_end();
+
+    /**
+     * @brief audio_main_task每个采集块调用（立体声交织，MIC0在通道0）
+     * @param capture_us 该块读取完成时间（latency_now_us）
+     */
+    void on_capture(const int16_t* stereo, size_t frames, uint32_t capture_us) {
+        if (loopback_phase_ == LOOPBACK_OFF) return;
+        loopback_feed(stereo, frames, capture_us);
+    }
+
+    /**
+     * @brief 运行完整的系统诊断和基准（diag任务中调用，阻塞数秒）
      *
      * @return 所有测试是否通过
      */
@@ -74,28 +162,33 @@ public:
     bool test_memory_leaks(uint32_t iterations = 1000);
 
     /**
-     * @brief 音频延迟基准测试
+     * @brief 音频回环延迟基准测试（扬声器 → 麦克风）
      *
-     * @return 平均延迟(ms)
+     * @return 平均延迟(ms)，0 = 未检测到测试音
      */
     uint32_t benchmark_audio_latency();
 
     /**
-     * @brief Opus编解码性能测试
+     * @brief Opus编解码性能测试（CODEC_BENCH_LEVELS个复杂度）
      *
-     * @return 每秒可处理的帧数
+     * @return 默认复杂度下每秒可编码+解码的帧数
      */
     uint32_t benchmark_opus_codec();
 
     /**
-     * @brief WebSocket吞吐量测试
+     * @brief RingBuffer和内存池吞吐量测试
+     */
+    void benchmark_buffers();
+
+    /**
+     * @brief WebSocket吞吐量测试（上行逐帧发送，下行请求服务器回送）
      *
-     * @return 吞吐量(kbps)
+     * @return 上行吞吐量(kbps)
      */
     uint32_t benchmark_websocket_throughput();
 
     /**
-     * @brief 生成测试音频信号
+     * @brief 直接写I2S播放正弦测试音（阻塞到写完；播放任务活动时跳过）
      *
      * @param frequency 频率(Hz)
      * @param duration_ms 持续时间(ms)
@@ -107,43 +200,125 @@ public:
      */
     void print_diagnostics_report();
 
+    const BenchmarkReport& report() const { return report_; }
+
 private:
+    enum LoopbackPhase : uint8_t {
+        LOOPBACK_OFF = 0,
+        LOOPBACK_BASELINE,  // 统计环境噪声在测试频点的能量
+        LOOPBACK_LISTEN,    // 测试音已开始播放，等待超过阈值
+    };
+
     Diagnostics() = default;
 
+    static void diag_task(void* arg);
+    void loopback_feed(const int16_t* stereo, size_t frames, uint32_t capture_us);
+    bool send_report();
+
     TestResult results_[32];
     uint32_t result_count_ = 0;
+    BenchmarkReport report_ = {};
+    const char* reason_ = "";
 
     void add_result(const TestResult& result);
+    void add_result(const char* name, bool passed, uint32_t duration_ms, const char* fmt, ...)
+        __attribute__((format(printf, 5, 6)));
+
+    WsSendFn ws_send_ = nullptr;
+    TaskHandle_t task_handle_ = nullptr;
+    volatile bool running_ = false;
+    volatile bool ws_busy_ = false;
+    volatile bool tone_active_ = false;
+
+    // 下行测试（main_ctrl写，diag任务读）
+    volatile bool downlink_active_ = false;
+    volatile int64_t downlink_first_us_ = 0;
+    volatile uint32_t downlink_bytes_ = 0;
+
+    // 回环测试：阶段由diag任务设置，检测结果由audio_main_task写入
+    volatile uint8_t loopback_phase_ = LOOPBACK_OFF;
+    volatile uint32_t loopback_blocks_ = 0;     // 采集块计数（流水线测试复用）
+    volatile float loopback_noise_ = 0;         // BASELINE阶段最大段能量
+    volatile float loopback_peak_ = 0;          // LISTEN阶段最大段能量
+    float loopback_threshold_ = 0;
+    volatile uint32_t loopback_tone_us_ = 0;    // 测试音首帧写入I2S时间
+    volatile uint32_t loopback_detect_us_ = 0;  // 首个超过阈值的段起点（0 = 未检测到）
 };
 
 /**
- * @brief 性能分析器 - 测量代码段执行时间
+ * @brief 性能分析器 - 测量代码段执行时间（PROFILE_SCOPE按作用域计时）
+ *
+ * - 测量点首次执行时注册（函数内static），之后每次只读两次esp_timer
+ * - 每次测量原子累加该点的次数/总耗时，并写入lock-free样本环（多生产者，满时覆盖最旧样本）
+ * - 消费者各自持有Baseline，按窗口取增量：平均值来自累计值，p95/最大值来自窗口内的环形样本
+ * - 任意任务/核可用，不可在ISR中使用
  */
 class PerformanceProfiler {
 public:
-    PerformanceProfiler(const char* name);
-    ~PerformanceProfiler();
+    static const int MAX_POINTS = 16;
 
-    static void print_all_profiles();
+    // 单个测量点的窗口统计
+    struct PointStats {
+        const char* name;
+        uint32_t count;
+        uint32_t avg_us;
+        uint32_t p95_us;        // 窗口内样本（环形缓冲容量内）的p95
+        uint32_t max_us;
+        uint32_t cpu_permille;  // 窗口内累计耗时 / 窗口时长（‰，单核）
+        uint8_t core_mask;      // 出现过样本的核（bit0 = Core 0）
+    };
 
-private:
-    const char* name_;
-    uint32_t start_time_;
-
-    struct Profile {
-        char name[64];
-        uint32_t total_time_ms;
-        uint32_t call_count;
-        uint32_t min_time_ms;
-        uint32_t max_time_ms;
+    // 消费者基线（print_all_profiles和遥测各持有一份，互不影响）
+    struct Baseline {
+        int64_t time_us;
+        uint32_t ring_head;
+        uint32_t count[MAX_POINTS];
+        uint32_t total_us[MAX_POINTS];
     };
 
-    static Profile profiles_[32];
-    static uint32_t profile_count_;
+    explicit PerformanceProfiler(uint8_t point)
+        : point_(point), start_us_((uint32_t)esp_timer_get_time()) {}
+    ~PerformanceProfiler() { record(point_, (uint32_t)esp_timer_get_time() - start_us_); }
+
+    /**
+     * @brief 注册测量点（同名共用一个点），超过MAX_POINTS返回MAX_POINTS（之后的测量被忽略）
+     */
+    static uint8_t register_point(const char* name);
+
+    /**
+     * @brief 记录一次测量（lock-free）
+     */
+    static void record(uint8_t point, uint32_t duration_us);
+
+    /**
+     * @brief 取自base以来的窗口统计，并把base推进到当前
+     * @return 写入out的测量点数（窗口内无样本的点跳过）
+     */
+    static int collect(Baseline& base, PointStats* out, int max_count, uint32_t* window_ms);
 
-    static void update_profile(const char* name, uint32_t time_ms);
+    static void print_all_profiles();
+
+private:
+    uint8_t point_;
+    uint32_t start_us_;
 };
 
-// 便捷宏：自动测量函数执行时间
-#define PROFILE_FUNCTION() PerformanceProfiler __profiler__(__FUNCTION__)
-#define PROFILE_SCOPE(name) PerformanceProfiler __profiler__##__LINE__(name)
+// 便捷宏：自动测量函数/作用域执行时间（CONFIG_ECHOEAR_PROFILER关闭时为空）
+#if CONFIG_ECHOEAR_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                                  \
+    static const uint8_t PROFILE_CONCAT(__profile_point_, __LINE__) =                        \
+        PerformanceProfiler::register_point(name);                                           \
+    PerformanceProfiler PROFILE_CONCAT(__profiler_, __LINE__)(PROFILE_CONCAT(__profile_point_, __LINE__))
+// 调用者已自行计时时直接记录一次耗时
+#define PROFILE_RECORD(name, duration_us)                                                    \
+    do {                                                                                     \
+        static const uint8_t __profile_point = PerformanceProfiler::register_point(name);    \
+        PerformanceProfiler::record(__profile_point, (duration_us));                         \
+    } while (0)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_RECORD(name, duration_us) do { (void)(duration_us); } while (0)
+#endif
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
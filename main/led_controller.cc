@@ -1,7 +1,7 @@
 #include "led_controller.h"
 #include <esp_log.h>
+#include <esp_attr.h>
 #include <driver/ledc.h>
-#include <math.h>
 
 static const char* TAG = "led_ctrl";
 
@@ -12,6 +12,89 @@ static const char* TAG = "led_ctrl";
 #define LED_PWM_FREQ_HZ     5000
 #define LED_PWM_RESOLUTION  LEDC_TIMER_8_BIT
 
+// 任务通知位
+static const uint32_t NOTIFY_FADE_END   = BIT0;  // 硬件渐变结束（ISR）
+static const uint32_t NOTIFY_ANIMATION  = BIT1;  // 动画模式/参数改变
+static const uint32_t NOTIFY_BLINK      = BIT2;  // 临时闪烁请求
+static const uint32_t NOTIFY_BRIGHTNESS = BIT3;  // 亮度改变
+
+// 渐变段的兜底超时：中断丢失（或起止亮度相同不产生中断）时按时推进
+static const uint32_t FADE_SLACK_MS = 50;
+
+// 渐变结束通知目标（ISR中读取）
+static volatile TaskHandle_t s_led_task = nullptr;
+
+static bool IRAM_ATTR led_fade_end_cb(const ledc_cb_param_t* param, void* user_arg) {
+    TaskHandle_t task = s_led_task;
+    if (!task || param->event != LEDC_FADE_END_EVT) return false;
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(task, NOTIFY_FADE_END, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+// ============================================================================
+// 动画段表（与原软件动画的周期/形状一致）
+// ============================================================================
+
+typedef LedController::Segment Segment;
+
+// 呼吸灯：周期3秒，正弦按每1/8周期一段分段线性（LEDC硬件渐变为线性）
+static const Segment kBreathing[] = {
+    {854, 375, true}, {1000, 375, true}, {854, 375, true}, {500, 375, true},
+    {146, 375, true}, {0, 375, true}, {146, 375, true}, {500, 375, true},
+};
+
+// 慢闪：1秒周期
+static const Segment kSlowBlink[] = {
+    {1000, 500, false}, {0, 500, false},
+};
+
+// 快闪：200ms周期
+static const Segment kFastBlink[] = {
+    {1000, 100, false}, {0, 100, false},
+};
+
+// 脉冲：200ms渐亮 + 200ms渐暗 + 400ms熄灭
+static const Segment kPulse[] = {
+    {1000, 200, true}, {0, 200, true}, {0, 400, false},
+};
+
+// 心跳：快速双跳，周期1200ms
+static const Segment kHeartbeat[] = {
+    {1000, 100, false}, {0, 100, false}, {1000, 100, false}, {0, 900, false},
+};
+
+static const Segment kSolid[] = {{1000, 0, false}};
+static const Segment kOff[] = {{0, 0, false}};
+
+// 淡入/淡出：原软件实现每20ms步进1级，满量程约5.1秒；跑完后停在终点（不循环）
+static const Segment kFadeIn[] = {{1000, 5100, true}};
+static const Segment kFadeOut[] = {{0, 5100, true}};
+
+#define SEG_COUNT(table) (uint8_t)(sizeof(table) / sizeof((table)[0]))
+
+struct Program {
+    const Segment* segments;
+    uint8_t count;
+    bool loop;
+};
+
+static Program program_for(LedController::AnimationMode mode) {
+    typedef LedController::AnimationMode Mode;
+    switch (mode) {
+        case Mode::SOLID:      return {kSolid, SEG_COUNT(kSolid), false};
+        case Mode::BREATHING:  return {kBreathing, SEG_COUNT(kBreathing), true};
+        case Mode::SLOW_BLINK: return {kSlowBlink, SEG_COUNT(kSlowBlink), true};
+        case Mode::FAST_BLINK: return {kFastBlink, SEG_COUNT(kFastBlink), true};
+        case Mode::PULSE:      return {kPulse, SEG_COUNT(kPulse), true};
+        case Mode::FADE_IN:    return {kFadeIn, SEG_COUNT(kFadeIn), false};
+        case Mode::FADE_OUT:   return {kFadeOut, SEG_COUNT(kFadeOut), false};
+        case Mode::HEARTBEAT:  return {kHeartbeat, SEG_COUNT(kHeartbeat), true};
+        case Mode::OFF:
+        default:               return {kOff, SEG_COUNT(kOff), false};
+    }
+}
+
 bool LedController::init(gpio_num_t led_pin) {
     led_pin_ = led_pin;
 
@@ -49,7 +132,23 @@ bool LedController::init(gpio_num_t led_pin) {
         return false;
     }
 
-    ESP_LOGI(TAG, "LED controller initialized on GPIO %d", led_pin_);
+    // 硬件渐变服务 + 渐变结束回调（渐变函数会自动打开该通道的FADE_END中断）
+    ret = ledc_fade_func_install(0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install LEDC fade service: %d", ret);
+        return false;
+    }
+
+    ledc_cbs_t cbs = {
+        .fade_cb = led_fade_end_cb,
+    };
+    ret = ledc_cb_register(LED_PWM_MODE, LED_PWM_CHANNEL, &cbs, nullptr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register LEDC fade callback: %d", ret);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "LED controller initialized on GPIO %d (hardware fade)", led_pin_);
     return true;
 }
 
@@ -59,6 +158,7 @@ bool LedController::start() {
         return true;
     }
 
+    running_ = true;
     BaseType_t ret = xTaskCreatePinnedToCore(
         led_task,
         "led_ctrl",
@@ -70,11 +170,14 @@ bool LedController::start() {
     );
 
     if (ret != pdPASS) {
+        running_ = false;
         ESP_LOGE(TAG, "Failed to create LED task");
         return false;
     }
 
-    running_ = true;
+    s_led_task = led_task_handle_;
+    // start()之前设置的动画和闪烁请求
+    notify(NOTIFY_ANIMATION | (blink_count_ ? NOTIFY_BLINK : 0));
     ESP_LOGI(TAG, "LED controller started");
     return true;
 }
@@ -85,138 +188,141 @@ void LedController::stop() {
     }
 
     running_ = false;
+    s_led_task = nullptr;
     if (led_task_handle_) {
         vTaskDelete(led_task_handle_);
         led_task_handle_ = nullptr;
     }
 
     // 关闭LED
-    ledc_set_duty(LED_PWM_MODE, LED_PWM_CHANNEL, 0);
-    ledc_update_duty(LED_PWM_MODE, LED_PWM_CHANNEL);
+    ledc_fade_stop(LED_PWM_MODE, LED_PWM_CHANNEL);
+    ledc_set_duty_and_update(LED_PWM_MODE, LED_PWM_CHANNEL, 0, 0);
 }
 
-void LedController::led_task(void* arg) {
-    LedController* controller = static_cast<LedController*>(arg);
-
-    const TickType_t update_interval = pdMS_TO_TICKS(20);  // 50Hz更新率
-
-    while (controller->running_) {
-        controller->update_led();
-        vTaskDelay(update_interval);
+void LedController::notify(uint32_t bits) {
+    TaskHandle_t task = led_task_handle_;
+    if (task) {
+        xTaskNotify(task, bits, eSetBits);
     }
-
-    vTaskDelete(nullptr);
 }
 
-void LedController::update_led() {
-    // 处理临时闪烁
-    if (blink_count_ > 0) {
-        uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        uint32_t phase = now % (blink_duration_ * 2);
-
-        if (phase < blink_duration_) {
-            apply_brightness(target_brightness_);
-        } else {
-            apply_brightness(0);
-        }
-
-        if (phase < 50) {  // 每个周期开始时减少计数
-            blink_count_--;
-        }
-        return;
-    }
+// ============================================================================
+// 段执行（led_ctrl任务）
+// ============================================================================
 
-    // 正常动画
-    uint8_t brightness = calculate_brightness();
-    apply_brightness(brightness);
-
-    animation_phase_ += (uint32_t)(20 * animation_speed_);  // 每20ms增加
+void LedController::led_task(void* arg) {
+    static_cast<LedController*>(arg)->run();
+    vTaskDelete(nullptr);
 }
 
-uint8_t LedController::calculate_brightness() {
-    switch (current_mode_) {
-        case AnimationMode::OFF:
-            return 0;
+void LedController::run() {
+    while (running_) {
+        // 只在段边界唤醒：保持段等到deadline，渐变段等中断（deadline为兜底），空闲时无限等待
+        TickType_t wait = portMAX_DELAY;
+        if (active_) {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(deadline_ - now) > 0 ? deadline_ - now : 0;
+        }
 
-        case AnimationMode::SOLID:
-            return target_brightness_;
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
 
-        case AnimationMode::BREATHING: {
-            // 正弦呼吸效果，周期约3秒
-            float phase = (animation_phase_ % 3000) / 3000.0f * 2.0f * M_PI;
-            float intensity = (sinf(phase) + 1.0f) / 2.0f;
-            return (uint8_t)(target_brightness_ * intensity);
+        if (bits & (NOTIFY_ANIMATION | NOTIFY_BLINK)) {
+            if (bits & NOTIFY_BLINK) {
+                blink_left_ = __atomic_exchange_n(&blink_count_, 0, __ATOMIC_RELAXED) * 2;
+                blink_ms_ = blink_duration_;
+            }
+            ledc_fade_stop(LED_PWM_MODE, LED_PWM_CHANNEL);
+            // 被打断的渐变可能已挂起一个FADE_END：清掉，免得截断新动画的第一段渐变
+            ulTaskNotifyValueClear(nullptr, NOTIFY_FADE_END);
+            load_animation();
+            continue;
         }
 
-        case AnimationMode::SLOW_BLINK: {
-            // 1秒周期
-            uint32_t phase = animation_phase_ % 1000;
-            return phase < 500 ? target_brightness_ : 0;
+        if (bits & NOTIFY_BRIGHTNESS) {
+            // 保持段立即生效；渐变段在下一段生效
+            if (!fading_) apply_brightness((uint32_t)target_brightness_ * level_ / 1000);
         }
 
-        case AnimationMode::FAST_BLINK: {
-            // 200ms周期
-            uint32_t phase = animation_phase_ % 200;
-            return phase < 100 ? target_brightness_ : 0;
+        if (!active_) continue;
+        const bool timed_out = (int32_t)(deadline_ - xTaskGetTickCount()) <= 0;
+        // 清除之后才到的迟到中断：硬件占空比未到本段目标说明不是本段的FADE_END（由兜底超时推进）
+        const bool fade_done = fading_ && (bits & NOTIFY_FADE_END) &&
+                               ledc_get_duty(LED_PWM_MODE, LED_PWM_CHANNEL) == fade_duty_;
+        if (fade_done || timed_out) {
+            next_segment();
         }
+    }
+}
 
-        case AnimationMode::PULSE: {
-            // 快速脉冲，周期800ms
-            uint32_t phase = animation_phase_ % 800;
-            if (phase < 200) {
-                float intensity = (float)phase / 200.0f;
-                return (uint8_t)(target_brightness_ * intensity);
-            } else if (phase < 400) {
-                float intensity = (float)(400 - phase) / 200.0f;
-                return (uint8_t)(target_brightness_ * intensity);
-            } else {
-                return 0;
-            }
-        }
+void LedController::load_animation() {
+    Program program = program_for(current_mode_);
+    segments_ = program.segments;
+    segment_count_ = program.count;
+    loop_ = program.loop;
+    segment_idx_ = 0;
+    next_segment();
+}
 
-        case AnimationMode::FADE_IN: {
-            if (current_brightness_ < target_brightness_) {
-                current_brightness_++;
-            }
-            return current_brightness_;
-        }
+void LedController::next_segment() {
+    // 临时闪烁优先，闪完从第0段重新开始当前动画
+    if (blink_left_ > 0) {
+        const bool on = (blink_left_ & 1) == 0;
+        blink_left_--;
+        begin_segment(on ? 1000 : 0, blink_ms_ ? blink_ms_ : 1, false);
+        return;
+    }
 
-        case AnimationMode::FADE_OUT: {
-            if (current_brightness_ > 0) {
-                current_brightness_--;
-            }
-            return current_brightness_;
+    if (segment_idx_ >= segment_count_) {
+        if (!loop_) {
+            active_ = false;  // 非循环动画停在最后一段的亮度
+            fading_ = false;
+            return;
         }
+        segment_idx_ = 0;
+    }
 
-        case AnimationMode::HEARTBEAT: {
-            // 心跳效果：快速双跳
-            uint32_t phase = animation_phase_ % 1200;
-            if (phase < 100) {
-                return target_brightness_;
-            } else if (phase < 200) {
-                return 0;
-            } else if (phase < 300) {
-                return target_brightness_;
-            } else {
-                return 0;
-            }
-        }
+    const Segment& seg = segments_[segment_idx_++];
+    uint32_t ms = 0;
+    if (seg.ms > 0) {
+        float speed = animation_speed_;
+        if (speed < 0.1f) speed = 0.1f;
+        ms = (uint32_t)(seg.ms / speed);
+        if (ms == 0) ms = 1;
+    }
+    begin_segment(seg.level, ms, seg.fade);
+}
 
-        default:
-            return 0;
+void LedController::begin_segment(uint16_t level, uint32_t ms, bool fade) {
+    level_ = level;
+    const uint32_t duty = (uint32_t)target_brightness_ * level / 1000;
+    const TickType_t now = xTaskGetTickCount();
+
+    fading_ = fade && ms > 0;
+    if (fading_) {
+        fade_duty_ = duty;
+        // 起止亮度相同时硬件不产生FADE_END中断，由兜底超时推进
+        ledc_set_fade_with_time(LED_PWM_MODE, LED_PWM_CHANNEL, duty, ms);
+        ledc_fade_start(LED_PWM_MODE, LED_PWM_CHANNEL, LEDC_FADE_NO_WAIT);
+        deadline_ = now + pdMS_TO_TICKS(ms + FADE_SLACK_MS);
+        active_ = true;
+        return;
     }
+
+    apply_brightness(duty);
+    active_ = ms > 0;  // ms=0：保持到下一次通知
+    deadline_ = now + pdMS_TO_TICKS(ms);
 }
 
-void LedController::apply_brightness(uint8_t brightness) {
-    ledc_set_duty(LED_PWM_MODE, LED_PWM_CHANNEL, brightness);
-    ledc_update_duty(LED_PWM_MODE, LED_PWM_CHANNEL);
+void LedController::apply_brightness(uint32_t duty) {
+    ledc_set_duty_and_update(LED_PWM_MODE, LED_PWM_CHANNEL, duty, 0);
 }
 
 void LedController::set_animation(AnimationMode mode, uint8_t brightness, float speed) {
     current_mode_ = mode;
     target_brightness_ = brightness;
     animation_speed_ = speed;
-    animation_phase_ = 0;
+    notify(NOTIFY_ANIMATION);
 
     ESP_LOGI(TAG, "Animation set: mode=%d, brightness=%d, speed=%.1f",
              (int)mode, brightness, speed);
@@ -270,6 +376,7 @@ void LedController::set_system_state(SystemState state) {
 
 void LedController::set_brightness(uint8_t brightness) {
     target_brightness_ = brightness;
+    notify(NOTIFY_BRIGHTNESS);
 }
 
 void LedController::set_led(bool on) {
@@ -279,4 +386,5 @@ void LedController::set_led(bool on) {
 void LedController::blink_once(uint8_t count, uint32_t duration_ms) {
     blink_count_ = count;
     blink_duration_ = duration_ms;
+    notify(NOTIFY_BLINK);
 }
@@ -13,6 +13,10 @@
  * - 闪烁
  * - 渐变
  * - 脉冲
+ *
+ * 动画由LEDC硬件渐变引擎执行：每个模式是一串段（硬件渐变到某亮度 / 直接设置并保持），
+ * 渐变结束中断通知led_ctrl任务启动下一段。任务只在段边界唤醒（呼吸灯约2.7次/秒），
+ * 常亮/关闭时一直阻塞到状态改变，不再50Hz轮询
  */
 class LedController {
 public:
@@ -103,29 +107,48 @@ public:
      */
     void blink_once(uint8_t count = 1, uint32_t duration_ms = 100);
 
+    // 动画段：level为target_brightness_的千分比，ms为时长（按speed缩放）
+    // fade=true：硬件渐变到level，渐变结束中断推进；fade=false：直接设置并保持ms（ms=0表示保持到状态改变）
+    struct Segment {
+        uint16_t level;
+        uint16_t ms;
+        bool fade;
+    };
+
 private:
     LedController() = default;
 
     gpio_num_t led_pin_ = GPIO_NUM_NC;
     TaskHandle_t led_task_handle_ = nullptr;
-    bool running_ = false;
-
-    // 当前动画状态
-    AnimationMode current_mode_ = AnimationMode::OFF;
-    uint8_t target_brightness_ = 255;
-    uint8_t current_brightness_ = 0;
-    float animation_speed_ = 1.0f;
-
-    // 动画参数
-    uint32_t animation_phase_ = 0;
-    uint32_t last_update_time_ = 0;
-
-    // 临时闪烁
-    uint8_t blink_count_ = 0;
-    uint32_t blink_duration_ = 0;
+    volatile bool running_ = false;
+
+    // 当前动画状态（set_*写入后通知任务，任务在段边界读取）
+    volatile AnimationMode current_mode_ = AnimationMode::OFF;
+    volatile uint8_t target_brightness_ = 255;
+    volatile float animation_speed_ = 1.0f;
+
+    // 临时闪烁请求
+    volatile uint8_t blink_count_ = 0;
+    volatile uint32_t blink_duration_ = 0;
+
+    // 任务内部的段执行状态（仅led_ctrl任务访问）
+    const Segment* segments_ = nullptr;
+    uint8_t segment_count_ = 0;
+    uint8_t segment_idx_ = 0;
+    uint16_t level_ = 0;            // 当前段亮度（千分比）
+    bool loop_ = false;
+    bool fading_ = false;
+    uint32_t fade_duty_ = 0;        // 当前渐变段的目标占空比（识别迟到的FADE_END）
+    bool active_ = false;           // 有段在执行（false = 阻塞到下一次通知）
+    TickType_t deadline_ = 0;       // 当前段结束时间（渐变段为兜底超时）
+    uint8_t blink_left_ = 0;        // 临时闪烁剩余半周期数
+    uint32_t blink_ms_ = 0;
 
     static void led_task(void* arg);
-    void update_led();
-    uint8_t calculate_brightness();
-    void apply_brightness(uint8_t brightness);
+    void notify(uint32_t bits);
+    void run();
+    void load_animation();
+    void begin_segment(uint16_t level, uint32_t ms, bool fade);
+    void next_segment();
+    void apply_brightness(uint32_t duty);
 };
@@ -3,6 +3,7 @@
 #include "task_manager.h"
 #include "audio_i2s.h"
 #include "wifi_provisioning.h"
+#include "diagnostics.h"
 
 #include <esp_log.h>
 #include <esp_lcd_panel_ops.h>
@@ -15,11 +16,14 @@
 #include <driver/i2c_master.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <esp_timer.h>
 #include <esp_heap_caps.h>
 
 #include <lvgl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 static const char* TAG = "lvgl_ui";
 
@@ -167,6 +171,7 @@ static lv_obj_t* vol_label = nullptr;
 static lv_timer_t* vol_hide_timer = nullptr;
 
 // LVGL互斥锁 - 防止多任务同时访问LVGL（LVGL不是线程安全的）
+// 公开API不再持锁（见UI命令邮箱），只有lvgl_task和初始化路径使用
 static SemaphoreHandle_t s_lvgl_mutex = nullptr;
 
 static bool lvgl_lock(uint32_t timeout_ms = 100) {
@@ -178,6 +183,79 @@ static void lvgl_unlock() {
     if (s_lvgl_mutex) xSemaphoreGive(s_lvgl_mutex);
 }
 
+// ============================================================================
+// UI命令邮箱 - 公开API只写命令槽+置位pending掩码，由lvgl_task统一取出执行
+//
+// 每种命令只保留最新值（合并）：能量取最新、状态文字去重、隐藏=空串/哨兵值，
+// 因此邮箱永不溢出，调用者（音频/网络任务）从不等待LVGL互斥锁或重绘
+// 标量槽用原子读写；字符串槽拷贝用短临界区保护（几十字节memcpy，不阻塞）
+// ============================================================================
+enum UiCmd : uint32_t {
+    UI_CMD_STATE = 0,
+    UI_CMD_STATUS,
+    UI_CMD_EXPRESSION,
+    UI_CMD_VOLUME,
+    UI_CMD_MUSIC_TITLE,
+    UI_CMD_RECORDING_TIME,
+    UI_CMD_MUSIC_ENERGY,
+    UI_CMD_NAMED_EXPR,
+    UI_CMD_BINDING,
+    UI_CMD_COUNT
+};
+#define UI_CMD_BIT(c) (1u << (c))
+
+static const uint32_t UI_REC_TIMER_HIDDEN = 0xFFFFFFFFu;  // 录音计时槽：隐藏
+static const uint32_t LVGL_TASK_MAX_SLEEP_MS = 500;       // lvgl_task最长睡眠（兜底）
+
+static volatile uint32_t s_ui_pending = 0;                // 待执行命令位掩码
+static portMUX_TYPE s_ui_cmd_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_lvgl_task_handle = nullptr;
+
+// 标量槽
+static volatile uint32_t s_cmd_state = UI_STATE_BOOT;
+static volatile uint32_t s_cmd_expr = UI_EXPR_NONE;
+static volatile uint32_t s_cmd_volume = 0;
+static volatile uint32_t s_cmd_rec_seconds = UI_REC_TIMER_HIDDEN;
+static volatile uint32_t s_cmd_energy_bits = 0;           // float位模式
+static volatile uint32_t s_cmd_expr_duration = 0;
+
+// 字符串槽（空串 = 隐藏）
+static char s_cmd_status[64];
+static char s_cmd_title[128];
+static char s_cmd_expr_name[24];
+static char s_cmd_binding[256];
+
+// 统计（posted由多个生产者累加，applied/deduped只在lvgl_task中写）
+static volatile uint32_t s_ui_cmds_posted = 0;
+static uint32_t s_ui_cmds_applied = 0;
+static uint32_t s_ui_status_deduped = 0;
+
+static void ui_post(UiCmd cmd) {
+    __sync_fetch_and_add(&s_ui_cmds_posted, 1);
+    __sync_fetch_and_or(&s_ui_pending, UI_CMD_BIT(cmd));  // 全屏障：槽内容先于pending位可见
+    TaskHandle_t h = s_lvgl_task_handle;
+    if (h) xTaskNotifyGive(h);  // 唤醒lvgl_task（未启动时命令留在邮箱，启动后首轮执行）
+}
+
+static void ui_post_value(UiCmd cmd, volatile uint32_t* slot, uint32_t value) {
+    *slot = value;
+    ui_post(cmd);
+}
+
+static void ui_post_text(UiCmd cmd, char* slot, size_t size, const char* text) {
+    portENTER_CRITICAL(&s_ui_cmd_mux);
+    strlcpy(slot, text ? text : "", size);
+    portEXIT_CRITICAL(&s_ui_cmd_mux);
+    ui_post(cmd);
+}
+
+// lvgl_task端：取出字符串槽内容
+static void ui_take_text(const char* slot, char* out, size_t size) {
+    portENTER_CRITICAL(&s_ui_cmd_mux);
+    strlcpy(out, slot, size);
+    portEXIT_CRITICAL(&s_ui_cmd_mux);
+}
+
 static const char* state_text(ui_state_t state) {
     switch (state) {
         case UI_STATE_BOOT: return "Starting...";
@@ -203,29 +281,167 @@ static void apply_eye_params(lv_obj_t* eye, const NomiEyeParams* p) {
     lv_obj_align(eye, LV_ALIGN_CENTER, p->x_off, NOMI_CENTER_Y + p->y_off);
 }
 
-// Animation callback setters (LVGL anim calls these with interpolated values)
-static void anim_set_left_w(void*, int32_t v)  { cur_left.width = v;  if (eye_left) lv_obj_set_width(eye_left, v); }
-static void anim_set_left_h(void*, int32_t v)  { cur_left.height = v; if (eye_left) lv_obj_set_height(eye_left, v); }
-static void anim_set_left_r(void*, int32_t v)  { cur_left.radius = v; if (eye_left) lv_obj_set_style_radius(eye_left, v, 0); }
-static void anim_set_left_x(void*, int32_t v)  { cur_left.x_off = v;  if (eye_left) lv_obj_align(eye_left, LV_ALIGN_CENTER, v, NOMI_CENTER_Y + cur_left.y_off); }
-static void anim_set_left_y(void*, int32_t v)  { cur_left.y_off = v;  if (eye_left) lv_obj_align(eye_left, LV_ALIGN_CENTER, cur_left.x_off, NOMI_CENTER_Y + v); }
+#if CONFIG_ECHOEAR_EYE_SPRITES
+// --- Eye sprite cache ---
+// 眼睛形状(w,h,r)预先光栅化为PSRAM中的TRUE_COLOR图像（黑底抗锯齿，与屏幕背景一致），
+// 动画只切换图像源和位置：LVGL每帧只blit两个小矩形，不再重新布局和绘制圆角矩形
+#define EYE_SPRITE_SLOTS CONFIG_ECHOEAR_EYE_SPRITE_SLOTS
 
-static void anim_set_right_w(void*, int32_t v) { cur_right.width = v;  if (eye_right) lv_obj_set_width(eye_right, v); }
-static void anim_set_right_h(void*, int32_t v) { cur_right.height = v; if (eye_right) lv_obj_set_height(eye_right, v); }
-static void anim_set_right_r(void*, int32_t v) { cur_right.radius = v; if (eye_right) lv_obj_set_style_radius(eye_right, v, 0); }
-static void anim_set_right_x(void*, int32_t v) { cur_right.x_off = v;  if (eye_right) lv_obj_align(eye_right, LV_ALIGN_CENTER, v, NOMI_CENTER_Y + cur_right.y_off); }
-static void anim_set_right_y(void*, int32_t v) { cur_right.y_off = v;  if (eye_right) lv_obj_align(eye_right, LV_ALIGN_CENTER, cur_right.x_off, NOMI_CENTER_Y + v); }
+struct EyeSprite {
+    lv_img_dsc_t dsc;
+    int16_t w, h, r;      // 缓存键
+    uint32_t last_used;   // LRU
+};
 
-static void start_anim(int32_t from, int32_t to, uint32_t dur, lv_anim_exec_xcb_t cb) {
-    if (from == to) return;
-    lv_anim_t a;
-    lv_anim_init(&a);
-    lv_anim_set_var(&a, nullptr);
-    lv_anim_set_values(&a, from, to);
-    lv_anim_set_time(&a, dur);
-    lv_anim_set_exec_cb(&a, cb);
-    lv_anim_set_path_cb(&a, lv_anim_path_ease_out);
-    lv_anim_start(&a);
+static EyeSprite s_sprites[EYE_SPRITE_SLOTS];
+static int s_sprite_count = 0;
+static int16_t s_sprite_max_w = 0;
+static int16_t s_sprite_max_h = 0;
+static uint32_t s_sprite_clock = 0;
+static uint32_t s_sprite_hits = 0;
+static uint32_t s_sprite_misses = 0;
+static const EyeSprite* s_eye_shown[2] = {nullptr, nullptr};  // 正在显示的精灵（不可淘汰）
+static bool s_eye_sprites_on = false;
+
+// 抗锯齿圆角矩形，按像素中心到内缩矩形的距离计算覆盖率
+static void eye_sprite_raster(lv_color_t* px, int w, int h, int r) {
+    const lv_color_t fg = lv_color_hex(NOMI_EYE_COLOR_HEX);
+    const lv_color_t bg = lv_color_black();
+    if (r * 2 > w) r = w / 2;
+    if (r * 2 > h) r = h / 2;
+
+    for (int y = 0; y < h; y++) {
+        float cy = y + 0.5f;
+        float dy = fmaxf(fmaxf(r - cy, cy - (h - r)), 0.0f);
+        for (int x = 0; x < w; x++) {
+            float cx = x + 0.5f;
+            float dx = fmaxf(fmaxf(r - cx, cx - (w - r)), 0.0f);
+            float cov = 1.0f;
+            if (r > 0 && dx > 0.0f && dy > 0.0f) {
+                cov = 0.5f + r - sqrtf(dx * dx + dy * dy);
+                cov = cov < 0.0f ? 0.0f : (cov > 1.0f ? 1.0f : cov);
+            }
+            px[y * w + x] = (cov >= 1.0f) ? fg : lv_color_mix(fg, bg, (lv_opa_t)(cov * 255.0f));
+        }
+    }
+}
+
+// 分配精灵像素缓冲（按表情库最大尺寸，PSRAM）
+static bool eye_sprites_init() {
+    for (int i = 0; i < EXPR_COUNT; i++) {
+        const NomiEyeParams* eyes[2] = {&NOMI_EXPRESSIONS[i].left, &NOMI_EXPRESSIONS[i].right};
+        for (const NomiEyeParams* e : eyes) {
+            if (e->width > s_sprite_max_w) s_sprite_max_w = e->width;
+            if (e->height > s_sprite_max_h) s_sprite_max_h = e->height;
+        }
+    }
+
+    size_t slot_bytes = (size_t)s_sprite_max_w * s_sprite_max_h * sizeof(lv_color_t);
+    uint8_t* pixels = (uint8_t*)heap_caps_malloc(slot_bytes * EYE_SPRITE_SLOTS, MALLOC_CAP_SPIRAM);
+    if (!pixels) {
+        ESP_LOGW(TAG, "Eye sprite cache alloc failed (%u KB), drawing eyes as objects",
+                 (unsigned)(slot_bytes * EYE_SPRITE_SLOTS / 1024));
+        return false;
+    }
+    for (int i = 0; i < EYE_SPRITE_SLOTS; i++) {
+        memset(&s_sprites[i], 0, sizeof(s_sprites[i]));
+        s_sprites[i].dsc.data = pixels + i * slot_bytes;
+    }
+    ESP_LOGI(TAG, "Eye sprite cache: %d slots x %dx%d (%u KB PSRAM)", EYE_SPRITE_SLOTS,
+             s_sprite_max_w, s_sprite_max_h, (unsigned)(slot_bytes * EYE_SPRITE_SLOTS / 1024));
+    return true;
+}
+
+// 查找或光栅化形状；满时淘汰最久未用且不在显示中的槽位
+static const EyeSprite* eye_sprite_get(int16_t w, int16_t h, int16_t r) {
+    if (w > s_sprite_max_w) w = s_sprite_max_w;
+    if (h > s_sprite_max_h) h = s_sprite_max_h;
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+
+    EyeSprite* victim = nullptr;
+    for (int i = 0; i < s_sprite_count; i++) {
+        EyeSprite* sp = &s_sprites[i];
+        if (sp->w == w && sp->h == h && sp->r == r) {
+            sp->last_used = ++s_sprite_clock;
+            s_sprite_hits++;
+            return sp;
+        }
+        if (sp == s_eye_shown[0] || sp == s_eye_shown[1]) continue;
+        if (!victim || sp->last_used < victim->last_used) victim = sp;
+    }
+    if (s_sprite_count < EYE_SPRITE_SLOTS) {
+        victim = &s_sprites[s_sprite_count++];
+    } else if (victim) {
+        lv_img_cache_invalidate_src(&victim->dsc);
+    } else {
+        return nullptr;
+    }
+
+    s_sprite_misses++;
+    eye_sprite_raster((lv_color_t*)victim->dsc.data, w, h, r);
+    victim->w = w;
+    victim->h = h;
+    victim->r = r;
+    victim->last_used = ++s_sprite_clock;
+    victim->dsc.header.always_zero = 0;
+    victim->dsc.header.cf = LV_IMG_CF_TRUE_COLOR;
+    victim->dsc.header.w = w;
+    victim->dsc.header.h = h;
+    victim->dsc.data_size = (uint32_t)w * h * sizeof(lv_color_t);
+    return victim;
+}
+#endif
+
+static void eye_apply(lv_obj_t* eye, const NomiEyeParams* p) {
+    if (!eye) return;
+#if CONFIG_ECHOEAR_EYE_SPRITES
+    if (s_eye_sprites_on) {
+        int idx = (eye == eye_left) ? 0 : 1;
+        const EyeSprite* sp = eye_sprite_get(p->width, p->height, p->radius);
+        if (!sp) return;
+        if (sp != s_eye_shown[idx] || lv_img_get_src(eye) != &sp->dsc) {
+            s_eye_shown[idx] = sp;
+            lv_img_set_src(eye, &sp->dsc);
+        }
+        lv_obj_align(eye, LV_ALIGN_CENTER, p->x_off, NOMI_CENTER_Y + p->y_off);
+        return;
+    }
+#endif
+    apply_eye_params(eye, p);
+}
+
+// 一次过渡由单个动画驱动：动画值是关键帧序号，两只眼按序号在起止形状之间插值。
+// 精灵模式下量化为EYE_ANIM_STEPS步（形状可复用缓存，每步才重绘一次）
+#if CONFIG_ECHOEAR_EYE_SPRITES
+#define EYE_ANIM_STEPS 8
+#else
+#define EYE_ANIM_STEPS 256
+#endif
+static NomiEyeParams s_anim_from[2];
+static NomiEyeParams s_anim_to[2];
+static int32_t s_anim_step = -1;
+static uint8_t s_eye_anim_var;  // 动画var（lv_anim_start按var+exec_cb替换进行中的过渡）
+
+static int16_t lerp16(int16_t a, int16_t b, int32_t step) {
+    return (int16_t)(a + ((int32_t)(b - a) * step + EYE_ANIM_STEPS / 2) / EYE_ANIM_STEPS);
+}
+
+static void lerp_eye(NomiEyeParams* out, const NomiEyeParams* a, const NomiEyeParams* b, int32_t step) {
+    out->x_off  = lerp16(a->x_off,  b->x_off,  step);
+    out->y_off  = lerp16(a->y_off,  b->y_off,  step);
+    out->width  = lerp16(a->width,  b->width,  step);
+    out->height = lerp16(a->height, b->height, step);
+    out->radius = lerp16(a->radius, b->radius, step);
+}
+
+static void anim_set_eyes(void*, int32_t step) {
+    if (step == s_anim_step) return;
+    s_anim_step = step;
+    lerp_eye(&cur_left, &s_anim_from[0], &s_anim_to[0], step);
+    lerp_eye(&cur_right, &s_anim_from[1], &s_anim_to[1], step);
+    eye_apply(eye_left, &cur_left);
+    eye_apply(eye_right, &cur_right);
 }
 
 // Animate both eyes to a target expression
@@ -235,26 +451,52 @@ static void animate_to_expression(NomiExprId expr_id, uint32_t duration_ms = 200
 
     if (duration_ms == 0) {
         // Instant (used during init)
+        lv_anim_del(&s_eye_anim_var, anim_set_eyes);
         cur_left = expr->left;
         cur_right = expr->right;
-        apply_eye_params(eye_left, &cur_left);
-        apply_eye_params(eye_right, &cur_right);
+        eye_apply(eye_left, &cur_left);
+        eye_apply(eye_right, &cur_right);
+        return;
+    }
+
+    // 从当前（可能是被打断的过渡中间）形状出发
+    if (memcmp(&cur_left, &expr->left, sizeof(cur_left)) == 0 &&
+        memcmp(&cur_right, &expr->right, sizeof(cur_right)) == 0) {
+        lv_anim_del(&s_eye_anim_var, anim_set_eyes);
         return;
     }
+    s_anim_from[0] = cur_left;
+    s_anim_from[1] = cur_right;
+    s_anim_to[0] = expr->left;
+    s_anim_to[1] = expr->right;
+    s_anim_step = -1;
 
-    // Left eye
-    start_anim(cur_left.width,  expr->left.width,  duration_ms, anim_set_left_w);
-    start_anim(cur_left.height, expr->left.height, duration_ms, anim_set_left_h);
-    start_anim(cur_left.radius, expr->left.radius, duration_ms, anim_set_left_r);
-    start_anim(cur_left.x_off,  expr->left.x_off,  duration_ms, anim_set_left_x);
-    start_anim(cur_left.y_off,  expr->left.y_off,  duration_ms, anim_set_left_y);
+    lv_anim_t a;
+    lv_anim_init(&a);
+    lv_anim_set_var(&a, &s_eye_anim_var);
+    lv_anim_set_values(&a, 0, EYE_ANIM_STEPS);
+    lv_anim_set_time(&a, duration_ms);
+    lv_anim_set_exec_cb(&a, anim_set_eyes);
+    lv_anim_set_path_cb(&a, lv_anim_path_ease_out);
+    lv_anim_start(&a);
+}
 
-    // Right eye
-    start_anim(cur_right.width,  expr->right.width,  duration_ms, anim_set_right_w);
-    start_anim(cur_right.height, expr->right.height, duration_ms, anim_set_right_h);
-    start_anim(cur_right.radius, expr->right.radius, duration_ms, anim_set_right_r);
-    start_anim(cur_right.x_off,  expr->right.x_off,  duration_ms, anim_set_right_x);
-    start_anim(cur_right.y_off,  expr->right.y_off,  duration_ms, anim_set_right_y);
+// 创建一只眼睛：精灵模式为lv_img，否则为圆角矩形对象
+static lv_obj_t* create_eye() {
+    lv_obj_t* eye;
+#if CONFIG_ECHOEAR_EYE_SPRITES
+    if (s_eye_sprites_on) {
+        eye = lv_img_create(lv_scr_act());
+        lv_obj_clear_flag(eye, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+        return eye;
+    }
+#endif
+    eye = lv_obj_create(lv_scr_act());
+    lv_obj_set_style_bg_color(eye, lv_color_hex(NOMI_EYE_COLOR_HEX), 0);
+    lv_obj_set_style_bg_opa(eye, LV_OPA_COVER, 0);
+    lv_obj_set_style_border_width(eye, 0, 0);
+    lv_obj_clear_flag(eye, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    return eye;
 }
 
 static void set_expression_visible(ui_expression_t expr) {
@@ -658,7 +900,7 @@ static void touch_read_cb(lv_indev_drv_t* drv, lv_indev_data_t* data) {
                 if (now - last_wake_time > pdMS_TO_TICKS(3000)) {
                     wake_trigger_count++;
                     ESP_LOGI(TAG, "Touch wake #%lu", wake_trigger_count);
-                    xEventGroupSetBits(g_audio_event_bits, AUDIO_EVENT_TOUCH_WAKE);
+                    audio_post_event(AUDIO_EVENT_TOUCH_WAKE);
                     last_wake_time = now;
                 }
             }
@@ -870,24 +1112,212 @@ static void lv_tick_cb(void* arg) {
     lv_tick_inc(2);
 }
 
+// FPS调速：空闲且画面静止（无动画、无触摸、不在设置页）时降低LVGL刷新周期，
+// 眨眼/注视等过渡一开始lv_anim就在运行，下一轮即恢复全速
+// 返回是否修改了刷新周期（lv_timer_handler算出的下次到期时间随之失效）
+static bool fps_governor_update() {
+    lv_disp_t* disp = lv_disp_get_default();
+    if (!disp || !disp->refr_timer) return false;
+
+    bool busy = settings_open || gesture_tracking || lv_anim_count_running() > 0;
+    bool idle_face = !busy &&
+                     (current_state == UI_STATE_WS_CONNECTED || current_state == UI_STATE_WIFI_CONNECTED);
+    // 动画/触摸期间持有最高频PM锁，过渡结束后允许DFS降频
+    TaskManager::instance().pm_hold(TaskManager::PmClient::DISPLAY, busy);
+    uint32_t period = idle_face ? 1000 / CONFIG_ECHOEAR_UI_IDLE_FPS : LV_DISP_DEF_REFR_PERIOD;
+    if (disp->refr_timer->period != period) {
+        lv_timer_set_period(disp->refr_timer, period);
+        ESP_LOGD(TAG, "Refresh period -> %lums", (unsigned long)period);
+        return true;
+    }
+    return false;
+}
+
+static void ui_drain_commands();
+
 static void lvgl_task(void* arg) {
     (void)arg;
+    s_lvgl_task_handle = xTaskGetCurrentTaskHandle();
     while (true) {
+        uint32_t sleep_ms = 10;
         if (lvgl_lock(50)) {
-            lv_timer_handler();
+            ui_drain_commands();
+            sleep_ms = lv_timer_handler();  // 距下一个LVGL定时器（刷新/动画/触摸读取）到期的毫秒数
+            if (fps_governor_update()) sleep_ms = 1;
             lvgl_unlock();
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
+
+        // 睡到下一个到期点；公开API投递命令时通过任务通知提前唤醒
+        if (sleep_ms > LVGL_TASK_MAX_SLEEP_MS) sleep_ms = LVGL_TASK_MAX_SLEEP_MS;
+        TickType_t ticks = pdMS_TO_TICKS(sleep_ms);
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+    }
+}
+
+// ============================================================================
+// 显示刷新：QSPI DMA完成中断通知LVGL，传输一块缓冲的同时渲染另一块
+// ============================================================================
+
+static lv_disp_drv_t s_disp_drv;
+static SemaphoreHandle_t s_flush_done = nullptr;   // 每次flush完成时释放（LVGL wait_cb阻塞等待）
+static portMUX_TYPE s_flush_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_flush_chunks_left = 0;           // 本次flush未完成的DMA传输数
+static int64_t s_flush_start_us = 0;
+
+static uint32_t s_stat_frames = 0;
+static uint32_t s_stat_flushes = 0;
+static uint64_t s_stat_flush_us = 0;
+static uint32_t s_stat_flush_max_us = 0;
+static uint32_t s_stat_render_ms = 0;
+static uint32_t s_stat_waits = 0;
+
+#if CONFIG_ECHOEAR_LCD_BUF_PSRAM
+// 绘制缓冲在PSRAM，按行拷入两块内部DMA中转缓冲轮流发送（拷贝与传输重叠）
+#define LCD_BOUNCE_LINES CONFIG_ECHOEAR_LCD_BOUNCE_LINES
+static lv_color_t* s_bounce[2] = {nullptr, nullptr};
+static SemaphoreHandle_t s_bounce_free = nullptr;  // 空闲中转缓冲数（计数信号量，DMA完成时归还）
+static int s_bounce_next = 0;
+#endif
+
+// 一个DMA传输完成（或提交失败）；最后一个完成时通知LVGL缓冲可复用
+// 在IRAM中：从on_color_trans_done（SPI中断，Flash cache关闭时也可能运行）调用
+static bool IRAM_ATTR flush_chunk_done(bool from_isr) {
+    bool last = false;
+    if (from_isr) portENTER_CRITICAL_ISR(&s_flush_mux); else portENTER_CRITICAL(&s_flush_mux);
+    if (s_flush_chunks_left > 0 && --s_flush_chunks_left == 0) {
+        last = true;
+        uint32_t us = (uint32_t)(esp_timer_get_time() - s_flush_start_us);
+        s_stat_flushes++;
+        s_stat_flush_us += us;
+        if (us > s_stat_flush_max_us) s_stat_flush_max_us = us;
+    }
+    if (from_isr) portEXIT_CRITICAL_ISR(&s_flush_mux); else portEXIT_CRITICAL(&s_flush_mux);
+
+    BaseType_t woken = pdFALSE;
+#if CONFIG_ECHOEAR_LCD_BUF_PSRAM
+    if (s_bounce_free) {
+        if (from_isr) xSemaphoreGiveFromISR(s_bounce_free, &woken); else xSemaphoreGive(s_bounce_free);
+    }
+#endif
+    if (last) {
+        if (from_isr) {
+            // lv_disp_flush_ready()在Flash中：中断里直接清它要清的两个标志（LVGL v8实现相同）
+            s_disp_drv.draw_buf->flushing = 0;
+            s_disp_drv.draw_buf->flushing_last = 0;
+        } else {
+            lv_disp_flush_ready(&s_disp_drv);
+        }
+        if (from_isr) xSemaphoreGiveFromISR(s_flush_done, &woken); else xSemaphoreGive(s_flush_done);
     }
+    return woken == pdTRUE;
+}
+
+static bool IRAM_ATTR on_color_trans_done(esp_lcd_panel_io_handle_t io,
+                                          esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
+    (void)io;
+    (void)edata;
+    (void)user_ctx;
+    if (!s_flush_done) return false;  // LVGL未初始化（lcd_only_test）
+    return flush_chunk_done(true);
 }
 
 static void flush_cb(lv_disp_drv_t* drv, const lv_area_t* area, lv_color_t* color_map) {
+    PROFILE_SCOPE("lcd_flush");  // 只含排队/拷贝，DMA传输时间见显示统计
+    (void)drv;
     int32_t x1 = area->x1;
     int32_t y1 = area->y1;
     int32_t x2 = area->x2 + 1;
     int32_t y2 = area->y2 + 1;
-    esp_lcd_panel_draw_bitmap(panel, x1, y1, x2, y2, color_map);
-    lv_disp_flush_ready(drv);
+    s_flush_start_us = esp_timer_get_time();
+
+#if CONFIG_ECHOEAR_LCD_BUF_PSRAM
+    int32_t w = x2 - x1;
+    portENTER_CRITICAL(&s_flush_mux);
+    s_flush_chunks_left = (y2 - y1 + LCD_BOUNCE_LINES - 1) / LCD_BOUNCE_LINES;
+    portEXIT_CRITICAL(&s_flush_mux);
+
+    const lv_color_t* src = color_map;
+    for (int32_t y = y1; y < y2; y += LCD_BOUNCE_LINES) {
+        int32_t rows = (y2 - y) < LCD_BOUNCE_LINES ? (y2 - y) : LCD_BOUNCE_LINES;
+        xSemaphoreTake(s_bounce_free, portMAX_DELAY);
+        lv_color_t* dst = s_bounce[s_bounce_next];
+        s_bounce_next ^= 1;
+        memcpy(dst, src, (size_t)w * rows * sizeof(lv_color_t));
+        src += (size_t)w * rows;
+        if (esp_lcd_panel_draw_bitmap(panel, x1, y, x2, y + rows, dst) != ESP_OK) {
+            ESP_LOGW(TAG, "draw_bitmap failed (y=%ld)", (long)y);
+            flush_chunk_done(false);
+        }
+    }
+#else
+    portENTER_CRITICAL(&s_flush_mux);
+    s_flush_chunks_left = 1;
+    portEXIT_CRITICAL(&s_flush_mux);
+    if (esp_lcd_panel_draw_bitmap(panel, x1, y1, x2, y2, color_map) != ESP_OK) {
+        ESP_LOGW(TAG, "draw_bitmap failed");
+        flush_chunk_done(false);
+    }
+#endif
+    // 不在此处调用lv_disp_flush_ready：DMA完成中断中调用，LVGL同时渲染到另一块缓冲
+}
+
+// LVGL需要复用仍在传输的缓冲时调用（默认忙等），改为阻塞到DMA完成
+static void flush_wait_cb(lv_disp_drv_t* drv) {
+    (void)drv;
+    s_stat_waits++;
+    xSemaphoreTake(s_flush_done, pdMS_TO_TICKS(20));
+}
+
+static void monitor_cb(lv_disp_drv_t* drv, uint32_t time_ms, uint32_t px) {
+    (void)drv;
+    (void)px;
+    s_stat_frames++;
+    s_stat_render_ms += time_ms;
+}
+
+void lvgl_ui_get_display_stats(ui_display_stats_t* out) {
+    if (!out) return;
+    portENTER_CRITICAL(&s_flush_mux);
+    uint32_t flushes = s_stat_flushes;
+    uint64_t flush_us = s_stat_flush_us;
+    out->flush_max_us = s_stat_flush_max_us;
+    portEXIT_CRITICAL(&s_flush_mux);
+
+    out->frames = s_stat_frames;
+    out->flushes = flushes;
+    out->flush_avg_us = flushes ? (uint32_t)(flush_us / flushes) : 0;
+    out->render_avg_ms = s_stat_frames ? s_stat_render_ms / s_stat_frames : 0;
+    out->waits = s_stat_waits;
+    out->ui_cmds_posted = s_ui_cmds_posted;
+    out->ui_cmds_applied = s_ui_cmds_applied;
+    out->ui_status_deduped = s_ui_status_deduped;
+}
+
+void lvgl_ui_print_display_stats() {
+    static uint32_t last_frames = 0;
+    static int64_t last_us = 0;
+
+    ui_display_stats_t st;
+    lvgl_ui_get_display_stats(&st);
+    int64_t now = esp_timer_get_time();
+    float fps = (last_us > 0 && now > last_us)
+        ? (float)(st.frames - last_frames) * 1000000.0f / (float)(now - last_us) : 0.0f;
+    last_frames = st.frames;
+    last_us = now;
+
+    ESP_LOGI(TAG, "Display: %.1f fps, frames=%lu flushes=%lu flush avg=%luus max=%luus render avg=%lums waits=%lu",
+             fps, (unsigned long)st.frames, (unsigned long)st.flushes,
+             (unsigned long)st.flush_avg_us, (unsigned long)st.flush_max_us,
+             (unsigned long)st.render_avg_ms, (unsigned long)st.waits);
+    ESP_LOGI(TAG, "UI cmds: posted=%lu applied=%lu (coalesced=%lu) status deduped=%lu",
+             (unsigned long)st.ui_cmds_posted, (unsigned long)st.ui_cmds_applied,
+             (unsigned long)(st.ui_cmds_posted - st.ui_cmds_applied), (unsigned long)st.ui_status_deduped);
+#if CONFIG_ECHOEAR_EYE_SPRITES
+    if (s_eye_sprites_on) {
+        ESP_LOGI(TAG, "Eye sprites: %d/%d slots, hits=%lu misses=%lu", s_sprite_count, EYE_SPRITE_SLOTS,
+                 (unsigned long)s_sprite_hits, (unsigned long)s_sprite_misses);
+    }
+#endif
 }
 
 static void set_backlight_level(int level) {
@@ -933,9 +1363,9 @@ static void init_display() {
     ESP_ERROR_CHECK(spi_bus_initialize(HITONY_QSPI_LCD_HOST, &bus_cfg, SPI_DMA_CH_AUTO));
 
 #if HITONY_LCD_USE_QSPI
-    esp_lcd_panel_io_spi_config_t io_cfg = ST77916_PANEL_IO_QSPI_CONFIG(HITONY_QSPI_CS, NULL, NULL);
+    esp_lcd_panel_io_spi_config_t io_cfg = ST77916_PANEL_IO_QSPI_CONFIG(HITONY_QSPI_CS, on_color_trans_done, nullptr);
 #else
-    esp_lcd_panel_io_spi_config_t io_cfg = ST77916_PANEL_IO_SPI_CONFIG(HITONY_QSPI_CS, HITONY_QSPI_DC, NULL, NULL);
+    esp_lcd_panel_io_spi_config_t io_cfg = ST77916_PANEL_IO_SPI_CONFIG(HITONY_QSPI_CS, HITONY_QSPI_DC, on_color_trans_done, nullptr);
 #endif
     io_cfg.pclk_hz = HITONY_LCD_USE_QSPI ? 40000000 : 100000;  // 40MHz QSPI（ST77916支持最高80MHz）
     io_cfg.spi_mode = 0;
@@ -1029,18 +1459,37 @@ void lvgl_ui_init() {
     lv_init();
     init_display();
 
-    size_t buf_pixels = HITONY_DISPLAY_WIDTH * 40;
+    // 双缓冲：一块DMA传输时LVGL渲染另一块（flush完成由on_color_trans_done通知）
+    s_flush_done = xSemaphoreCreateBinary();
+    assert(s_flush_done);
+
+    size_t buf_pixels = HITONY_DISPLAY_WIDTH * CONFIG_ECHOEAR_LCD_BUF_LINES;
+#if CONFIG_ECHOEAR_LCD_BUF_PSRAM
+    buf1 = (lv_color_t*)heap_caps_malloc(buf_pixels * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+    buf2 = (lv_color_t*)heap_caps_malloc(buf_pixels * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+    size_t bounce_pixels = HITONY_DISPLAY_WIDTH * LCD_BOUNCE_LINES;
+    s_bounce[0] = (lv_color_t*)heap_caps_malloc(bounce_pixels * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    s_bounce[1] = (lv_color_t*)heap_caps_malloc(bounce_pixels * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    s_bounce_free = xSemaphoreCreateCounting(2, 2);
+    assert(s_bounce[0] && s_bounce[1] && s_bounce_free);
+    ESP_LOGI(TAG, "Draw buffers: 2x%d lines PSRAM, bounce 2x%d lines internal",
+             CONFIG_ECHOEAR_LCD_BUF_LINES, LCD_BOUNCE_LINES);
+#else
     buf1 = (lv_color_t*)heap_caps_malloc(buf_pixels * sizeof(lv_color_t), MALLOC_CAP_DMA);
     buf2 = (lv_color_t*)heap_caps_malloc(buf_pixels * sizeof(lv_color_t), MALLOC_CAP_DMA);
+    ESP_LOGI(TAG, "Draw buffers: 2x%d lines internal DMA", CONFIG_ECHOEAR_LCD_BUF_LINES);
+#endif
+    assert(buf1 && buf2);
     lv_disp_draw_buf_init(&draw_buf, buf1, buf2, buf_pixels);
 
-    static lv_disp_drv_t disp_drv;
-    lv_disp_drv_init(&disp_drv);
-    disp_drv.hor_res = HITONY_DISPLAY_WIDTH;
-    disp_drv.ver_res = HITONY_DISPLAY_HEIGHT;
-    disp_drv.flush_cb = flush_cb;
-    disp_drv.draw_buf = &draw_buf;
-    lv_disp_drv_register(&disp_drv);
+    lv_disp_drv_init(&s_disp_drv);
+    s_disp_drv.hor_res = HITONY_DISPLAY_WIDTH;
+    s_disp_drv.ver_res = HITONY_DISPLAY_HEIGHT;
+    s_disp_drv.flush_cb = flush_cb;
+    s_disp_drv.wait_cb = flush_wait_cb;
+    s_disp_drv.monitor_cb = monitor_cb;
+    s_disp_drv.draw_buf = &draw_buf;
+    lv_disp_drv_register(&s_disp_drv);
 
     static esp_timer_handle_t tick_timer;
     esp_timer_create_args_t tick_args = {};
@@ -1061,17 +1510,11 @@ void lvgl_ui_init() {
     status_label = nullptr;
 
     // Nomi-style eyes: simple LVGL objects with rounded corners
-    eye_left = lv_obj_create(lv_scr_act());
-    lv_obj_set_style_bg_color(eye_left, lv_color_hex(NOMI_EYE_COLOR_HEX), 0);
-    lv_obj_set_style_bg_opa(eye_left, LV_OPA_COVER, 0);
-    lv_obj_set_style_border_width(eye_left, 0, 0);
-    lv_obj_clear_flag(eye_left, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
-
-    eye_right = lv_obj_create(lv_scr_act());
-    lv_obj_set_style_bg_color(eye_right, lv_color_hex(NOMI_EYE_COLOR_HEX), 0);
-    lv_obj_set_style_bg_opa(eye_right, LV_OPA_COVER, 0);
-    lv_obj_set_style_border_width(eye_right, 0, 0);
-    lv_obj_clear_flag(eye_right, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+#if CONFIG_ECHOEAR_EYE_SPRITES
+    s_eye_sprites_on = eye_sprites_init();
+#endif
+    eye_left = create_eye();
+    eye_right = create_eye();
 
     // Initial state: sleep expression (no animation)
     animate_to_expression(EXPR_SLEEP, 0);
@@ -1145,7 +1588,7 @@ void lvgl_ui_init() {
 
     // 所有UI元素创建完成，现在启动LVGL更新任务
     // 从此刻起，只有lvgl_task负责调用lv_timer_handler()
-    xTaskCreate(lvgl_task, "lvgl", 3072, nullptr, 5, nullptr);
+    xTaskCreate(lvgl_task, "lvgl", 4096, nullptr, 5, nullptr);
     ESP_LOGI(TAG, "LVGL task started (sole handler for lv_timer_handler)");
 }
 
@@ -1205,35 +1648,39 @@ void lvgl_ui_init_touch(void* i2c_bus_handle) {
     lv_indev_drv_init(&indev_drv);
     indev_drv.type = LV_INDEV_TYPE_POINTER;
     indev_drv.read_cb = touch_read_cb;
+    lvgl_lock();  // lvgl_task已在运行
     touch_indev = lv_indev_drv_register(&indev_drv);
+    lvgl_unlock();
     (void)touch_indev;
 }
 
-void lvgl_ui_set_status(const char* text) {
-    if (status_label && lvgl_lock(50)) {
-        lv_label_set_text(status_label, text);
-        lv_obj_align(status_label, LV_ALIGN_TOP_MID, 0, 35);
-        lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
-        lvgl_unlock();
+// ============================================================================
+// 公开API：只投递命令，实际LVGL操作在lvgl_task中执行（ui_apply_*）
+// ============================================================================
+
+static void ui_apply_status(const char* text) {
+    if (!status_label) return;
+    // 去重：文字未变且已显示时不触发重绘
+    if (strcmp(lv_label_get_text(status_label), text) == 0 &&
+        !lv_obj_has_flag(status_label, LV_OBJ_FLAG_HIDDEN)) {
+        s_ui_status_deduped++;
+        return;
     }
+    lv_label_set_text(status_label, text);
+    lv_obj_align(status_label, LV_ALIGN_TOP_MID, 0, 35);
+    lv_obj_clear_flag(status_label, LV_OBJ_FLAG_HIDDEN);
+}
+
+void lvgl_ui_set_status(const char* text) {
+    ui_post_text(UI_CMD_STATUS, s_cmd_status, sizeof(s_cmd_status), text);
 }
 
 void lvgl_ui_set_state(ui_state_t state) {
-    current_state = state;
-    if (lvgl_lock(50)) {
-        lv_async_call(apply_state, nullptr);
-        lvgl_unlock();
-    }
+    ui_post_value(UI_CMD_STATE, &s_cmd_state, (uint32_t)state);
 }
 
 void lvgl_ui_set_expression(ui_expression_t expr) {
-    current_expr = expr;
-    if (lvgl_lock(50)) {
-        if (expr_container) {
-            set_expression_visible(expr);
-        }
-        lvgl_unlock();
-    }
+    ui_post_value(UI_CMD_EXPRESSION, &s_cmd_expr, (uint32_t)expr);
 }
 
 void lvgl_ui_set_touch_cb(ui_touch_cb_t cb) {
@@ -1261,15 +1708,17 @@ void lvgl_ui_set_volume(int level) {
         audio.set_mute(false);
     }
 
-    lvgl_lock();
+    ui_post_value(UI_CMD_VOLUME, &s_cmd_volume, (uint32_t)level);
+
+    ESP_LOGI(TAG, "Volume set to %d%%", level);
+}
+
+static void ui_apply_volume(int level) {
     if (settings_open) {
         update_settings_volume();
     } else {
         show_volume_ui(level, level == 0);
     }
-    lvgl_unlock();
-
-    ESP_LOGI(TAG, "Volume set to %d%%", level);
 }
 
 void lvgl_ui_set_pupil_offset(int x_offset, int y_offset) {
@@ -1307,9 +1756,14 @@ void lvgl_ui_clear_touch_flag() {
 
 // === Music Title Display ===
 
-void lvgl_ui_set_music_title(const char* title) {
-    if (!title || !title[0]) return;
-    if (!lvgl_lock(100)) return;
+static void ui_apply_music_title(const char* title) {
+    if (!title[0]) {
+        music_title_buf[0] = '\0';
+        if (music_title_label) {
+            lv_obj_add_flag(music_title_label, LV_OBJ_FLAG_HIDDEN);
+        }
+        return;
+    }
 
     snprintf(music_title_buf, sizeof(music_title_buf), "%s", title);
 
@@ -1328,21 +1782,22 @@ void lvgl_ui_set_music_title(const char* title) {
     lv_obj_clear_flag(music_title_label, LV_OBJ_FLAG_HIDDEN);
 
     ESP_LOGI(TAG, "Music title display: %s", music_title_buf);
-    lvgl_unlock();
+}
+
+void lvgl_ui_set_music_title(const char* title) {
+    if (!title || !title[0]) return;
+    ui_post_text(UI_CMD_MUSIC_TITLE, s_cmd_title, sizeof(s_cmd_title), title);
 }
 
 void lvgl_ui_hide_music_title() {
-    if (!lvgl_lock(10)) return;
-    music_title_buf[0] = '\0';
-    if (music_title_label) {
-        lv_obj_add_flag(music_title_label, LV_OBJ_FLAG_HIDDEN);
-    }
-    lvgl_unlock();
+    ui_post_text(UI_CMD_MUSIC_TITLE, s_cmd_title, sizeof(s_cmd_title), "");
 }
 
-void lvgl_ui_update_recording_time(uint32_t seconds) {
-    if (!lvgl_lock(100)) {  // Increased timeout to 100ms for reliability
-        ESP_LOGW("lvgl_ui", "Failed to acquire lock for recording timer update");
+static void ui_apply_recording_time(uint32_t seconds) {
+    if (seconds == UI_REC_TIMER_HIDDEN) {
+        if (recording_timer_label) {
+            lv_obj_add_flag(recording_timer_label, LV_OBJ_FLAG_HIDDEN);
+        }
         return;
     }
 
@@ -1364,18 +1819,14 @@ void lvgl_ui_update_recording_time(uint32_t seconds) {
     // Always show the label when this function is called during recording
     // Hide it explicitly via stop_recording_timer or state change
     lv_obj_clear_flag(recording_timer_label, LV_OBJ_FLAG_HIDDEN);
+}
 
-    lvgl_unlock();
+void lvgl_ui_update_recording_time(uint32_t seconds) {
+    ui_post_value(UI_CMD_RECORDING_TIME, &s_cmd_rec_seconds, seconds);
 }
 
 void lvgl_ui_hide_recording_timer() {
-    if (!lvgl_lock(100)) return;
-
-    if (recording_timer_label) {
-        lv_obj_add_flag(recording_timer_label, LV_OBJ_FLAG_HIDDEN);
-    }
-
-    lvgl_unlock();
+    ui_post_value(UI_CMD_RECORDING_TIME, &s_cmd_rec_seconds, UI_REC_TIMER_HIDDEN);
 }
 
 // === Music Rhythm Animation ===
@@ -1399,9 +1850,7 @@ static void create_headphone_icon() {
     lv_obj_add_flag(headphone_icon, LV_OBJ_FLAG_HIDDEN);  // 默认隐藏
 }
 
-void lvgl_ui_set_music_energy(float energy) {
-    if (!lvgl_lock(10)) return;
-
+static void ui_apply_music_energy(float energy) {
     // 仅在MUSIC状态时处理音乐动画（避免TTS也触发）
     if (current_state != UI_STATE_MUSIC) {
         // 非MUSIC状态时确保图标隐藏
@@ -1409,7 +1858,6 @@ void lvgl_ui_set_music_energy(float energy) {
             lv_obj_add_flag(headphone_icon, LV_OBJ_FLAG_HIDDEN);
         }
         music_animation_active = false;
-        lvgl_unlock();
         return;
     }
 
@@ -1431,7 +1879,6 @@ void lvgl_ui_set_music_energy(float energy) {
         }
         music_animation_active = false;
         last_music_energy = 0.0f;
-        lvgl_unlock();
         return;
     }
 
@@ -1470,7 +1917,13 @@ void lvgl_ui_set_music_energy(float energy) {
     }
 
     last_music_energy = energy;
-    lvgl_unlock();
+}
+
+// 音频任务每帧调用：只原子写入最新能量，期间的旧值被覆盖
+void lvgl_ui_set_music_energy(float energy) {
+    uint32_t bits;
+    memcpy(&bits, &energy, sizeof(bits));
+    ui_post_value(UI_CMD_MUSIC_ENERGY, &s_cmd_energy_bits, bits);
 }
 
 // === Named Expression System (server-driven) ===
@@ -1502,10 +1955,7 @@ static NomiExprId name_to_expr(const char* name) {
     return EXPR_NORMAL;
 }
 
-void lvgl_ui_show_expression(const char* name, uint32_t duration_ms) {
-    if (!name || !name[0]) return;
-    if (!lvgl_lock(100)) return;
-
+static void ui_apply_named_expression(const char* name, uint32_t duration_ms) {
     NomiExprId expr = name_to_expr(name);
     ESP_LOGI(TAG, "Expression: '%s' -> %d (duration=%lums)", name, expr, (unsigned long)duration_ms);
 
@@ -1520,20 +1970,27 @@ void lvgl_ui_show_expression(const char* name, uint32_t duration_ms) {
         expr_revert_timer = lv_timer_create(expr_revert_cb, duration_ms, nullptr);
         lv_timer_set_repeat_count(expr_revert_timer, 1);
     }
+}
 
-    lvgl_unlock();
+void lvgl_ui_show_expression(const char* name, uint32_t duration_ms) {
+    if (!name || !name[0]) return;
+    // 名称和时长同在临界区内写入，避免取出时配对错乱
+    portENTER_CRITICAL(&s_ui_cmd_mux);
+    strlcpy(s_cmd_expr_name, name, sizeof(s_cmd_expr_name));
+    s_cmd_expr_duration = duration_ms;
+    portEXIT_CRITICAL(&s_ui_cmd_mux);
+    ui_post(UI_CMD_NAMED_EXPR);
 }
 
 // === Device Binding Info (scrolling text at top, for provisioning mode) ===
 static lv_obj_t* binding_label = nullptr;
 
-void lvgl_ui_show_binding_info(const char* device_id, const char* token, const char* admin_url) {
-    if (!lvgl_lock(100)) return;
-
+static void ui_apply_binding_info(const char* text) {
     if (binding_label) {
         lv_obj_del(binding_label);
         binding_label = nullptr;
     }
+    if (!text[0]) return;  // 空串 = 隐藏
 
     // Single scrolling label at top
     binding_label = lv_label_create(lv_scr_act());
@@ -1542,22 +1999,83 @@ void lvgl_ui_show_binding_info(const char* device_id, const char* token, const c
     lv_obj_set_width(binding_label, 260);  // Constrain width for circular display
     lv_label_set_long_mode(binding_label, LV_LABEL_LONG_SCROLL_CIRCULAR);
 
-    static char scroll_buf[256];
+    lv_label_set_text(binding_label, text);
+    lv_obj_align(binding_label, LV_ALIGN_TOP_MID, 0, 30);
+
+    ESP_LOGI(TAG, "Binding info (scroll): %s", text);
+}
+
+void lvgl_ui_show_binding_info(const char* device_id, const char* token, const char* admin_url) {
+    char scroll_buf[sizeof(s_cmd_binding)];
     snprintf(scroll_buf, sizeof(scroll_buf),
              "ID: %s   Token: %s   Bind: %s",
              device_id, token, admin_url);
-    lv_label_set_text(binding_label, scroll_buf);
-    lv_obj_align(binding_label, LV_ALIGN_TOP_MID, 0, 30);
-
-    ESP_LOGI(TAG, "Binding info (scroll): %s", scroll_buf);
-    lvgl_unlock();
+    ui_post_text(UI_CMD_BINDING, s_cmd_binding, sizeof(s_cmd_binding), scroll_buf);
 }
 
 void lvgl_ui_hide_binding_info() {
-    if (!lvgl_lock(100)) return;
-    if (binding_label) {
-        lv_obj_del(binding_label);
-        binding_label = nullptr;
+    ui_post_text(UI_CMD_BINDING, s_cmd_binding, sizeof(s_cmd_binding), "");
+}
+
+// ============================================================================
+// 命令执行（lvgl_task，持有LVGL锁，在lv_timer_handler之前）
+// ============================================================================
+
+static void ui_drain_commands() {
+    uint32_t pending = __sync_fetch_and_and(&s_ui_pending, 0);
+    if (!pending) return;
+
+    char text[sizeof(s_cmd_binding)];
+
+    // 状态先于状态文字：同一批里后设的文字覆盖状态默认文字
+    if (pending & UI_CMD_BIT(UI_CMD_STATE)) {
+        current_state = (ui_state_t)s_cmd_state;
+        apply_state(nullptr);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_STATUS)) {
+        ui_take_text(s_cmd_status, text, sizeof(s_cmd_status));
+        ui_apply_status(text);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_EXPRESSION)) {
+        current_expr = (ui_expression_t)s_cmd_expr;
+        if (expr_container) {
+            set_expression_visible(current_expr);
+        }
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_VOLUME)) {
+        ui_apply_volume((int)s_cmd_volume);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_MUSIC_TITLE)) {
+        ui_take_text(s_cmd_title, text, sizeof(s_cmd_title));
+        ui_apply_music_title(text);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_RECORDING_TIME)) {
+        ui_apply_recording_time(s_cmd_rec_seconds);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_MUSIC_ENERGY)) {
+        uint32_t bits = s_cmd_energy_bits;
+        float energy;
+        memcpy(&energy, &bits, sizeof(energy));
+        ui_apply_music_energy(energy);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_NAMED_EXPR)) {
+        portENTER_CRITICAL(&s_ui_cmd_mux);
+        strlcpy(text, s_cmd_expr_name, sizeof(s_cmd_expr_name));
+        uint32_t duration_ms = s_cmd_expr_duration;
+        portEXIT_CRITICAL(&s_ui_cmd_mux);
+        ui_apply_named_expression(text, duration_ms);
+        s_ui_cmds_applied++;
+    }
+    if (pending & UI_CMD_BIT(UI_CMD_BINDING)) {
+        ui_take_text(s_cmd_binding, text, sizeof(s_cmd_binding));
+        ui_apply_binding_info(text);
+        s_ui_cmds_applied++;
     }
-    lvgl_unlock();
 }
@@ -43,6 +43,21 @@ void lvgl_ui_update_recording_time(uint32_t seconds);  // Update recording timer
 void lvgl_ui_hide_recording_timer();  // Hide recording timer
 void lcd_only_test();
 
+// Display flush statistics (flush = draw_bitmap until QSPI DMA done)
+typedef struct {
+    uint32_t frames;         // LVGL refresh cycles
+    uint32_t flushes;        // completed flushes (one per dirty area)
+    uint32_t flush_avg_us;   // average draw_bitmap -> DMA done time
+    uint32_t flush_max_us;
+    uint32_t render_avg_ms;  // average refresh time reported by LVGL (render + flush)
+    uint32_t waits;          // times LVGL blocked on a buffer still in transfer
+    uint32_t ui_cmds_posted;     // lvgl_ui_* calls posted to the UI command mailbox
+    uint32_t ui_cmds_applied;    // commands executed by lvgl_task (rest were coalesced)
+    uint32_t ui_status_deduped;  // status updates skipped because the text was unchanged
+} ui_display_stats_t;
+void lvgl_ui_get_display_stats(ui_display_stats_t* out);
+void lvgl_ui_print_display_stats();  // Log stats with frame rate since the previous call
+
 typedef void (*ui_touch_cb_t)(bool pressed);
 void lvgl_ui_set_touch_cb(ui_touch_cb_t cb);
 
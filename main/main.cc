@@ -25,12 +25,16 @@
 #include "system_monitor.h"
 #include "led_controller.h"
 #include "wifi_provisioning.h"
+#include "boot_sequence.h"
 #include <esp_ota_ops.h>
 
 static const char* TAG = "main";
 
 // WiFi 指数退避计数器（连接成功时重置）
 static int s_wifi_backoff_attempt = 0;
+static bool s_wifi_ever_connected = false;  // 首次获取IP之后的GOT_IP都视为恢复
+
+typedef BootSequence::Stage BootStage;
 
 // ============================================================================
 // 基础初始化
@@ -63,6 +67,89 @@ static void init_gpio() {
     ESP_LOGI(TAG, "GPIO initialized");
 }
 
+// ============================================================================
+// WiFi快速重连缓存
+// ============================================================================
+
+#if CONFIG_ECHOEAR_WIFI_FAST_CONNECT
+// 上次连接的AP（按SSID校验），开机第一次连接直接用BSSID+信道，跳过全信道扫描
+// IP由LWIP_DHCP_RESTORE_LAST_IP续用（DHCP INIT-REBOOT），这里记录只用于判断是否命中
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint32_t ip;
+    char ssid[33];
+} wifi_ap_cache_t;
+
+static const uint8_t AP_CACHE_VERSION = 1;
+
+static wifi_ap_cache_t s_ap_cache = {};
+static wifi_config_t s_sta_config = {};  // 不带BSSID的正常配置（首次连接后恢复）
+static bool s_fast_connect = false;      // 当前STA配置锁定了缓存的BSSID/信道
+
+static bool ap_cache_load(wifi_ap_cache_t* out) {
+    nvs_handle_t nvs;
+    if (nvs_open("wifi_fast", NVS_READONLY, &nvs) != ESP_OK) return false;
+    size_t len = sizeof(*out);
+    esp_err_t err = nvs_get_blob(nvs, "ap", out, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*out) && out->version == AP_CACHE_VERSION &&
+           out->channel >= 1 && out->channel <= 14;
+}
+
+static void ap_cache_store(const wifi_ap_cache_t* cache) {
+    nvs_handle_t nvs;
+    if (nvs_open("wifi_fast", NVS_READWRITE, &nvs) != ESP_OK) return;
+    if (cache) {
+        nvs_set_blob(nvs, "ap", cache, sizeof(*cache));
+    } else {
+        nvs_erase_key(nvs, "ap");
+    }
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+// 连接前调用：记下正常配置，缓存命中时改为定向连接
+static void ap_cache_apply(wifi_config_t* cfg) {
+    s_sta_config = *cfg;
+    if (!ap_cache_load(&s_ap_cache) || strcmp(s_ap_cache.ssid, (const char*)cfg->sta.ssid) != 0) {
+        s_ap_cache = {};
+        return;
+    }
+    memcpy(cfg->sta.bssid, s_ap_cache.bssid, sizeof(cfg->sta.bssid));
+    cfg->sta.bssid_set = true;
+    cfg->sta.channel = s_ap_cache.channel;
+    cfg->sta.scan_method = WIFI_FAST_SCAN;
+    s_fast_connect = true;
+    ESP_LOGI(TAG, "Fast connect: " MACSTR " ch%u (last IP " IPSTR ")",
+             MAC2STR(s_ap_cache.bssid), s_ap_cache.channel, IP2STR((esp_ip4_addr_t*)&s_ap_cache.ip));
+}
+
+// 获取IP后调用：AP或IP变化时更新缓存
+static void ap_cache_update(uint32_t ip) {
+    wifi_ap_record_t ap = {};
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+
+    wifi_ap_cache_t cache = {};
+    cache.version = AP_CACHE_VERSION;
+    cache.channel = ap.primary;
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.ip = ip;
+    strlcpy(cache.ssid, (const char*)s_sta_config.sta.ssid, sizeof(cache.ssid));
+
+    if (s_ap_cache.version == AP_CACHE_VERSION) {
+        ESP_LOGI(TAG, "Fast connect %s, DHCP %s cached IP",
+                 memcmp(s_ap_cache.bssid, cache.bssid, 6) == 0 ? "hit" : "missed (AP changed)",
+                 s_ap_cache.ip == ip ? "kept" : "changed");
+    }
+    if (memcmp(&s_ap_cache, &cache, sizeof(cache)) != 0) {
+        ap_cache_store(&cache);
+        s_ap_cache = cache;
+    }
+}
+#endif
+
 // WiFi事件处理器
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data) {
@@ -87,6 +174,21 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         xEventGroupClearBits(g_app_event_group, EVENT_WIFI_CONNECTED);
         xEventGroupSetBits(g_app_event_group, EVENT_WIFI_DISCONNECTED);
 
+#if CONFIG_ECHOEAR_WIFI_FAST_CONNECT
+        // 只有开机第一次连接锁定缓存的BSSID/信道，之后的重连都恢复正常扫描（AP换信道/换AP）
+        if (s_fast_connect) {
+            s_fast_connect = false;
+            esp_wifi_set_config(WIFI_IF_STA, &s_sta_config);
+            if (!s_wifi_ever_connected) {
+                ESP_LOGW(TAG, "Fast connect failed, retrying with full scan");
+                s_ap_cache = {};
+                ap_cache_store(nullptr);
+                esp_wifi_connect();
+                return;
+            }
+        }
+#endif
+
         // 指数退避重连：1s → 2s → 4s → 8s → 16s（上限30s）
         int backoff_s = 1 << (s_wifi_backoff_attempt < 5 ? s_wifi_backoff_attempt : 4);
         if (backoff_s > 30) backoff_s = 30;
@@ -98,10 +200,18 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
         ESP_LOGI(TAG, "✓ WiFi connected! IP: " IPSTR, IP2STR(&event->ip_info.ip));
         s_wifi_backoff_attempt = 0;  // 重置退避计数器
+        BootSequence::instance().mark(BootStage::WIFI_IP);
+#if CONFIG_ECHOEAR_WIFI_FAST_CONNECT
+        ap_cache_update(event->ip_info.ip.addr);
+#endif
 
         // 设置WiFi连接事件位（供main_control_task使用）
+        // 重新获取IP（AP抖动/漫游）时另置RESTORED：旧TCP连接大概率已失效，不等keepalive超时
         xEventGroupClearBits(g_app_event_group, EVENT_WIFI_DISCONNECTED);
-        xEventGroupSetBits(g_app_event_group, EVENT_WIFI_CONNECTED);
+        xEventGroupSetBits(g_app_event_group,
+                           EVENT_WIFI_CONNECTED | (s_wifi_ever_connected ? EVENT_WIFI_RESTORED : 0));
+        s_wifi_ever_connected = true;
+        main_task_notify(MAIN_NOTIFY_APP_EVENT);
     }
 }
 
@@ -150,8 +260,12 @@ static void init_wifi_with_flag(bool force_provisioning) {
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA_WPA2_PSK;
     wifi_config.sta.pmf_cfg.capable = true;
     wifi_config.sta.pmf_cfg.required = false;
+    wifi_config.sta.listen_interval = CONFIG_ECHOEAR_WIFI_IDLE_LISTEN_INTERVAL;  // 空闲时MAX_MODEM的beacon间隔
     wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
     wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+#if CONFIG_ECHOEAR_WIFI_FAST_CONNECT
+    ap_cache_apply(&wifi_config);
+#endif
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -219,6 +333,10 @@ static void init_wifi_with_flag(bool force_provisioning) {
             wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA_WPA2_PSK;
             wifi_config.sta.pmf_cfg.capable = true;
             wifi_config.sta.pmf_cfg.required = false;
+            wifi_config.sta.listen_interval = CONFIG_ECHOEAR_WIFI_IDLE_LISTEN_INTERVAL;
+#if CONFIG_ECHOEAR_WIFI_FAST_CONNECT
+            ap_cache_apply(&wifi_config);
+#endif
 
             ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
                                                        &wifi_event_handler, nullptr));
@@ -239,37 +357,94 @@ static void init_wifi_with_flag(bool force_provisioning) {
 }
 
 // ============================================================================
-// 主函数
+// 启动路径
 // ============================================================================
 
-extern "C" void app_main() {
-    ESP_LOGI(TAG, "");
-    ESP_LOGI(TAG, "╔═══════════════════════════════════════╗");
-    ESP_LOGI(TAG, "║  HiTony Smart Speaker                ║");
-    ESP_LOGI(TAG, "║  ESP32-S3 Dual Core Architecture     ║");
-    ESP_LOGI(TAG, "║  Firmware: %-26s ║", HITONY_FW_VERSION);
-    ESP_LOGI(TAG, "╚═══════════════════════════════════════╝");
-    ESP_LOGI(TAG, "");
+// 并行启动任务（Core 1）：Codec/I2S → 应用任务。audio_main创建后立即开始加载AFE/WakeNet模型，
+// 与app_main上的LVGL/WiFi/触摸等待重叠
+static bool boot_job_audio() {
+    BootSequence& boot = BootSequence::instance();
 
-    // ========================================================================
-    // Phase 1: 基础初始化
-    // ========================================================================
-    ESP_LOGI(TAG, "[Phase 1] Basic Initialization...");
+    // I2C总线已由app_main初始化（init()复用i2c_bus_），IDF i2c_master总线可与触摸并发访问
+    if (!AudioI2S::instance().init()) {
+        ESP_LOGE(TAG, "Failed to initialize I2S!");
+        return false;
+    }
+    boot.mark(BootStage::CODEC);
 
-    init_nvs();
-    init_gpio();
+    TaskManager::instance().init();
+    if (!create_all_tasks()) {
+        ESP_LOGE(TAG, "Failed to create tasks!");
+        return false;
+    }
+    boot.mark(BootStage::TASKS);
+    ESP_LOGI(TAG, "✓ Audio path up (I2S + Codec + tasks)");
+    return true;
+}
 
-    // 打印系统信息
-    esp_chip_info_t chip_info;
-    esp_chip_info(&chip_info);
-    ESP_LOGI(TAG, "Chip: %s, Cores: %d, Revision: %d",
-             CONFIG_IDF_TARGET,
-             chip_info.cores,
-             chip_info.revision);
+/**
+ * @brief 并行启动（已有WiFi凭据）：先按正常模式初始化，触摸等待与音频/WiFi启动重叠
+ *
+ * 触摸等待期间用户触摸 → 等启动任务结束后重启进入配网（不在运行中拆除音频任务）
+ */
+static bool boot_parallel() {
+    BootSequence& boot = BootSequence::instance();
+    ESP_LOGI(TAG, "[Phase 2] Parallel boot (credentials present)");
 
-    ESP_LOGI(TAG, "Free heap: %lu bytes, PSRAM: %lu bytes",
-             esp_get_free_heap_size(),
-             heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    if (!init_global_queues()) {
+        ESP_LOGE(TAG, "Failed to initialize queues!");
+        return false;
+    }
+    boot.mark(BootStage::QUEUES);
+
+    AudioI2S& audio_i2s = AudioI2S::instance();
+    audio_i2s.init_i2c_only();
+
+    // Codec/任务放到Core 1，创建失败则同步执行
+    bool job_started = boot.start_job("boot_audio", 1, 6144, boot_job_audio);
+    if (!job_started && !boot_job_audio()) {
+        return false;
+    }
+
+    lvgl_ui_init();
+    lvgl_ui_init_touch(audio_i2s.i2c_bus());
+    boot.mark(BootStage::UI);
+    lvgl_ui_set_status("Touch to setup WiFi...");
+    lvgl_ui_set_debug_info("");
+
+    // WiFi连接在后台进行，main_ctrl等待EVENT_WIFI_CONNECTED
+    init_wifi_with_flag(false);
+    boot.mark(BootStage::WIFI_START);
+
+#if HITONY_USE_HARDCODED_WIFI
+    bool touched = false;  // 硬编码模式无需配网
+#else
+    bool touched = lvgl_ui_wait_for_touch(1500);
+#endif
+    boot.mark(BootStage::TOUCH_WAIT);
+
+    if (touched) {
+        ESP_LOGI(TAG, "✅ User requested WiFi configuration - restarting into provisioning");
+        lvgl_ui_set_status("Entering WiFi setup mode...");
+        boot.wait_jobs(5000);  // 避免在Codec/Flash操作中途复位
+        BootSequence::restart_into_provisioning();
+    }
+
+    lvgl_ui_set_status("Starting...");
+    lvgl_ui_set_debug_info("Initializing...");
+
+    if (!boot.wait_jobs(10000)) {
+        ESP_LOGE(TAG, "Boot job failed or timed out!");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 顺序启动（无凭据/配网请求/CONFIG_ECHOEAR_BOOT_PARALLEL关闭）：先检测触摸，再决定初始化内容
+ */
+static bool boot_sequential(bool provision_request) {
+    BootSequence& boot = BootSequence::instance();
 
     // ========================================================================
     // Phase 1.5: 初始化LVGL UI和触摸（必须在检测触摸之前）
@@ -288,6 +463,7 @@ extern "C" void app_main() {
     ESP_LOGI(TAG, "Initializing touch sensor...");
     lvgl_ui_init_touch(audio_i2s.i2c_bus());
     ESP_LOGI(TAG, "Touch sensor initialized");
+    boot.mark(BootStage::UI);
 
     // ========================================================================
     // Phase 2: 检测配网模式（优先检测，决定后续初始化）
@@ -300,11 +476,18 @@ extern "C" void app_main() {
 #if HITONY_USE_HARDCODED_WIFI
     bool force_provisioning = false;  // 硬编码模式无需配网
     ESP_LOGI(TAG, "Hardcoded WiFi, skipping touch wait");
+    (void)provision_request;
 #else
-    int touch_wait_ms = wifi_provisioning_is_configured() ? 1500 : 5000;
-    ESP_LOGI(TAG, "Touch wait: %dms (configured=%d)", touch_wait_ms, wifi_provisioning_is_configured());
-    bool force_provisioning = lvgl_ui_wait_for_touch(touch_wait_ms);
+    bool force_provisioning = provision_request;
+    if (force_provisioning) {
+        ESP_LOGI(TAG, "Provisioning requested before restart, skipping touch wait");
+    } else {
+        int touch_wait_ms = wifi_provisioning_is_configured() ? 1500 : 5000;
+        ESP_LOGI(TAG, "Touch wait: %dms (configured=%d)", touch_wait_ms, wifi_provisioning_is_configured());
+        force_provisioning = lvgl_ui_wait_for_touch(touch_wait_ms);
+    }
 #endif
+    boot.mark(BootStage::TOUCH_WAIT);
 
     if (force_provisioning) {
         ESP_LOGI(TAG, "✅ User requested WiFi configuration - PROVISIONING MODE");
@@ -323,8 +506,9 @@ extern "C" void app_main() {
 
         if (!init_global_queues()) {
             ESP_LOGE(TAG, "Failed to initialize queues!");
-            return;
+            return false;
         }
+        boot.mark(BootStage::QUEUES);
     } else {
         ESP_LOGI(TAG, "[Phase 3] Skipping queues (provisioning mode)");
     }
@@ -339,8 +523,9 @@ extern "C" void app_main() {
         // 但由于AudioI2S::init()会检查i2c_bus_是否已存在，所以直接调用init()即可
         if (!audio_i2s.init()) {
             ESP_LOGE(TAG, "Failed to initialize I2S!");
-            return;
+            return false;
         }
+        boot.mark(BootStage::CODEC);
         ESP_LOGI(TAG, "✓ Full I2S initialized (I2C + I2S + Codec)");
     } else {
         ESP_LOGI(TAG, "[Phase 3.5] Skipping I2S init (provisioning mode, I2C-only)");
@@ -358,8 +543,9 @@ extern "C" void app_main() {
         // 创建所有应用任务
         if (!create_all_tasks()) {
             ESP_LOGE(TAG, "Failed to create tasks!");
-            return;
+            return false;
         }
+        boot.mark(BootStage::TASKS);
 
         // NOTE: AFE由audio_main_task内部初始化，不需要全局初始化
         ESP_LOGI(TAG, "All application tasks created");
@@ -373,7 +559,63 @@ extern "C" void app_main() {
     // ========================================================================
     ESP_LOGI(TAG, "[Phase 5] Initializing WiFi...");
     init_wifi_with_flag(force_provisioning);
+    boot.mark(BootStage::WIFI_START);
     ESP_LOGI(TAG, "WiFi initialized");
+    return true;
+}
+
+// ============================================================================
+// 主函数
+// ============================================================================
+
+extern "C" void app_main() {
+    BootSequence& boot = BootSequence::instance();
+    boot.mark(BootStage::APP_MAIN);
+
+    ESP_LOGI(TAG, "");
+    ESP_LOGI(TAG, "╔═══════════════════════════════════════╗");
+    ESP_LOGI(TAG, "║  HiTony Smart Speaker                ║");
+    ESP_LOGI(TAG, "║  ESP32-S3 Dual Core Architecture     ║");
+    ESP_LOGI(TAG, "║  Firmware: %-26s ║", HITONY_FW_VERSION);
+    ESP_LOGI(TAG, "╚═══════════════════════════════════════╝");
+    ESP_LOGI(TAG, "");
+
+    // ========================================================================
+    // Phase 1: 基础初始化
+    // ========================================================================
+    ESP_LOGI(TAG, "[Phase 1] Basic Initialization...");
+
+    init_nvs();
+    init_gpio();
+    boot.mark(BootStage::NVS);
+
+    // 打印系统信息
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+    ESP_LOGI(TAG, "Chip: %s, Cores: %d, Revision: %d",
+             CONFIG_IDF_TARGET,
+             chip_info.cores,
+             chip_info.revision);
+
+    ESP_LOGI(TAG, "Free heap: %lu bytes, PSRAM: %lu bytes",
+             esp_get_free_heap_size(),
+             heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+    // 配网重启请求只在一次启动内有效（读取即清除）
+    bool provision_request = BootSequence::consume_provisioning_request();
+#if CONFIG_ECHOEAR_BOOT_PARALLEL
+#if HITONY_USE_HARDCODED_WIFI
+    bool parallel = true;
+#else
+    bool parallel = !provision_request && wifi_provisioning_is_configured();
+#endif
+#else
+    bool parallel = false;
+#endif
+
+    if (!(parallel ? boot_parallel() : boot_sequential(provision_request))) {
+        return;
+    }
 
     // ========================================================================
     // Phase 6: 启动系统监控和LED控制
@@ -1,9 +1,17 @@
 #include "task_manager.h"
+#include "audio_playout.h"
+#include "opus_encoder.h"
+#include "audio_uplink.h"
 #include "led_controller.h"
 #include "system_monitor.h"
 #include "lvgl_ui.h"
 #include "config.h"
 #include "ota_update.h"
+#include "ws_control.h"
+#include "music_store.h"
+#include "wifi_power.h"
+#include "diagnostics.h"
+#include "boot_sequence.h"
 #include <esp_log.h>
 #include <esp_websocket_client.h>
 #include <esp_timer.h>
@@ -23,6 +31,8 @@ typedef enum {
     FSM_STATE_ERROR,      // 网络错误
 } fsm_state_t;
 
+static const char* const kFsmStateNames[] = {"IDLE", "RECORDING", "SPEAKING", "MUSIC", "ERROR"};
+
 // 当前FSM状态（非static，WebSocket事件处理器需要访问作为状态守卫）
 fsm_state_t g_current_fsm_state = FSM_STATE_IDLE;
 
@@ -34,19 +44,119 @@ static bool g_audio_start_sent = false;  // 追踪audio_start/listen(start)是
 static bool g_tts_end_received = false;  // 追踪tts_end是否已收到（等待队列排空）
 static uint32_t g_speaking_start_time = 0;  // SPEAKING模式进入时间（用于超时检测）
 static char g_session_id[16] = {0};  // 服务器分配的会话ID
+static char g_resume_session_id[16] = {0};  // 断线前的会话ID，重连后在hello中请求恢复
 static bool g_hello_acked = false;  // hello握手是否完成
 static uint32_t g_drain_wait_count = 0;  // SPEAKING→IDLE队列排空计数
-static int64_t g_status_clear_time = 0;  // 非阻塞延迟清除UI状态文本（微秒时间戳）
 static int g_reconnect_attempts = 0;    // 指数退避重连计数（连接成功时重置）
+static bool g_ws_reconnect_now = false;  // 跳过退避立即重连（WiFi恢复/漫游后）
+static bool g_ws_drop_handled = false;   // 本次连接的断开已处理（DISCONNECTED+CLOSED只处理一次，连接成功时清除）
+static const int WS_FAST_RESUME_ATTEMPTS = 2;  // 快速重连次数，之后退回销毁重建
 static bool g_auto_listen_enabled = false;  // TTS结束后回到IDLE等待唤醒词（true会导致噪音循环）
 static bool g_music_was_playing = false;    // 音乐因唤醒中断后标记，TTS结束后恢复音乐
 static uint32_t g_thinking_start_time = 0;  // IDLE(Thinking)模式进入时间（用于超时重置UI）
 static uint32_t g_recording_start_time = 0; // [S0-2] 录音FSM开始时间（15s超时保护）
+static bool g_vad_end_pending = false;      // VAD已结束，等编码级送出尾包后再结束录音
 
 // TTS binary packet counters (file-level for reset on tts_start)
 static uint32_t g_tts_rx_count = 0;    // TTS packets received this session
 static uint32_t g_tts_drop_count = 0;  // TTS packets dropped this session
 
+// TTS下行信用（hello协商）：服务器本会话累计发送的包数不超过已授予额度，
+// 设备按播放队列空位逐步追加额度，入队不再阻塞主循环。额度与g_tts_rx_count同口径，tts_start时重置
+#define TTS_CREDIT_UPDATE_MIN 6    // 额度至少增长这么多包（约120ms音频）才发更新
+#define TTS_CREDIT_POLL_MS 100     // SPEAKING下检查播放进度、追加额度的间隔
+static bool g_tts_credit_enabled = false;
+static uint32_t g_tts_credit = 0;    // 本会话累计授予包数
+static uint32_t g_tts_credit_initial = 0;    // 最近一次hello/listen通告的额度，下一会话的初始额度
+static uint32_t g_tts_credit_overrun = 0;    // 超出额度到达的包数（服务器未遵守信用）
+static uint32_t g_tts_credit_drops_reported = 0;  // 已通告给服务器的丢包数
+
+// 上行Opus包计数（含离线编码未发送的包）
+static uint32_t g_ws_tx_count = 0;
+
+// 上行批量帧：[2B BE len][opus]...，与下行TTS批量格式一致
+// 每包最大256B（AudioUplink编码缓冲），批量缓冲按上限帧数预留
+#define UPLINK_BATCH_MAX_FRAMES 10
+#define UPLINK_OPUS_MAX_BYTES 256
+static uint8_t g_uplink_batch_frames = 1;  // hello协商结果，1 = 每包一帧（旧服务器）
+static uint8_t g_uplink_batch_buf[UPLINK_BATCH_MAX_FRAMES * (2 + UPLINK_OPUS_MAX_BYTES)];
+static uint16_t g_uplink_batch_len = 0;
+static uint8_t g_uplink_batch_count = 0;
+static int64_t g_uplink_batch_start_us = 0;  // 批内首包入批时间
+static latency_stamp_t g_uplink_batch_stamps[UPLINK_BATCH_MAX_FRAMES];
+
+// 二进制控制通道（hello协商结果，false = 控制消息走JSON）
+static bool g_ctrl_binary = false;
+
+// 音乐流控：MusicStore超过高水位时已请求服务器暂停推流
+static bool g_music_flow_paused = false;
+
+// ============================================================================
+// 截止时间表：主循环阻塞到最近的截止时间，期间由任务通知（MAIN_NOTIFY_*）提前唤醒
+// 槽位固定且很少（<8个），线性扫描求最小值比时间轮更省
+// ============================================================================
+
+typedef enum {
+    CTRL_TIMER_HEARTBEAT = 0,   // 1s心跳/统计
+    CTRL_TIMER_STATUS_CLEAR,    // UI状态文本延迟清除
+    CTRL_TIMER_STATE,           // 当前FSM状态的下一个超时/诊断点（多个截止时间取最早）
+    CTRL_TIMER_DRAIN,           // 播放排空轮询（AudioPlayout无排空通知，10ms粒度）
+    CTRL_TIMER_WIFI_PS,         // WiFi省电延迟降级
+    CTRL_TIMER_COUNT
+} ctrl_timer_id_t;
+
+#define CTRL_TIMER_BIT(id) (1u << (id))
+
+static TickType_t g_ctrl_timer_deadline[CTRL_TIMER_COUNT];
+static uint8_t g_ctrl_timer_armed = 0;  // CTRL_TIMER_BIT位图
+
+/**
+ * @brief 设置截止时间（已设置且更早时保留原值）
+ */
+static void ctrl_timer_arm_at(ctrl_timer_id_t id, TickType_t deadline) {
+    if ((g_ctrl_timer_armed & CTRL_TIMER_BIT(id)) &&
+        (int32_t)(g_ctrl_timer_deadline[id] - deadline) <= 0) {
+        return;
+    }
+    g_ctrl_timer_deadline[id] = deadline;
+    g_ctrl_timer_armed |= CTRL_TIMER_BIT(id);
+}
+
+static void ctrl_timer_arm(ctrl_timer_id_t id, uint32_t delay_ms) {
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+    ctrl_timer_arm_at(id, xTaskGetTickCount() + (ticks > 0 ? ticks : 1));
+}
+
+/**
+ * @brief 取出所有已到期的定时器（到期即解除）
+ * @return 到期定时器的CTRL_TIMER_BIT位图
+ */
+static uint32_t ctrl_timer_collect(TickType_t now) {
+    uint32_t fired = 0;
+    for (int id = 0; id < CTRL_TIMER_COUNT; id++) {
+        if ((g_ctrl_timer_armed & CTRL_TIMER_BIT(id)) &&
+            (int32_t)(now - g_ctrl_timer_deadline[id]) >= 0) {
+            fired |= CTRL_TIMER_BIT(id);
+        }
+    }
+    g_ctrl_timer_armed &= ~fired;
+    return fired;
+}
+
+/**
+ * @brief 距最近截止时间的tick数（无定时器时永久等待）
+ */
+static TickType_t ctrl_timer_wait_ticks(TickType_t now) {
+    TickType_t wait = portMAX_DELAY;
+    for (int id = 0; id < CTRL_TIMER_COUNT; id++) {
+        if (!(g_ctrl_timer_armed & CTRL_TIMER_BIT(id))) continue;
+        int32_t left = (int32_t)(g_ctrl_timer_deadline[id] - now);
+        if (left <= 0) return 0;
+        if ((TickType_t)left < wait) wait = (TickType_t)left;
+    }
+    return wait;
+}
+
 // Meeting recording timer
 static esp_timer_handle_t g_meeting_timer = NULL;
 static uint32_t g_meeting_start_time = 0;
@@ -84,6 +194,33 @@ static void stop_recording_timer() {
     ESP_LOGI(TAG, "Meeting recording timer stopped");
 }
 
+// AFE档位跟随FSM状态（会议录音优先），只在档位变化时下发命令
+// 初值与AdvancedAFE初始档位一致；命令队列满时下一轮重试
+static audio_cmd_t s_afe_profile_cmd = AUDIO_CMD_AFE_PROFILE_CONVERSATION;
+
+static void update_afe_profile() {
+    audio_cmd_t want;
+    if (g_meeting_timer_active) {
+        want = AUDIO_CMD_AFE_PROFILE_MEETING;
+    } else {
+        switch (g_current_fsm_state) {
+            case FSM_STATE_RECORDING:
+            case FSM_STATE_SPEAKING:
+                want = AUDIO_CMD_AFE_PROFILE_CONVERSATION;
+                break;
+            case FSM_STATE_MUSIC:
+                want = AUDIO_CMD_AFE_PROFILE_MUSIC;
+                break;
+            default:
+                want = AUDIO_CMD_AFE_PROFILE_IDLE;
+                break;
+        }
+    }
+    if (want != s_afe_profile_cmd && audio_send_cmd(want)) {
+        s_afe_profile_cmd = want;
+    }
+}
+
 static void init_device_identity() {
     uint8_t mac[6];
     esp_efuse_mac_get_default(mac);
@@ -107,7 +244,7 @@ static int s_reasm_total = 0;
 
 static void ws_clear_reassembly_state() {
     if (s_reasm_buf) {
-        pool_free_by_size(s_reasm_buf, s_reasm_total);
+        pool_free(s_reasm_buf);
         s_reasm_buf = nullptr;
     }
     s_reasm_offset = 0;
@@ -115,38 +252,85 @@ static void ws_clear_reassembly_state() {
 }
 
 /**
- * @brief 销毁并重建WebSocket客户端（用于auto-reconnect失败时的硬重连）
+ * @brief 断开时保存会话ID（重连后hello请求恢复），再清空当前会话
+ */
+static void ws_forget_session() {
+    if (g_session_id[0]) {
+        memcpy(g_resume_session_id, g_session_id, sizeof(g_resume_session_id));
+    }
+    g_session_id[0] = '\0';
+}
+
+/**
+ * @brief 填充WebSocket客户端配置（首次连接与硬重连共用）
+ */
+static void ws_fill_config(esp_websocket_client_config_t* ws_cfg) {
+    static char ws_headers[128];
+    snprintf(ws_headers, sizeof(ws_headers),
+             "x-device-id: %s\r\nx-device-token: %s\r\n",
+             g_device_id, g_device_token);
+
+    *ws_cfg = {};
+    ws_cfg->uri = HITONY_WS_URL;
+    ws_cfg->headers = ws_headers;
+    ws_cfg->task_stack = 4096;           // 4KB (瘦回调不做cJSON，足够)
+    ws_cfg->buffer_size = 8192;          // 8KB接收缓冲（容纳多帧TTS数据）
+    ws_cfg->disable_auto_reconnect = true; // 禁用库自动重连（FSM管理重连）
+    ws_cfg->network_timeout_ms = 10000;
+    ws_cfg->ping_interval_sec = 0;       // 禁用WS ping（改用TCP keepalive）
+    ws_cfg->pingpong_timeout_sec = 0;    // 禁用WS pong超时
+    ws_cfg->keep_alive_enable = true;    // TCP keepalive（内核处理，不受应用阻塞影响）
+    ws_cfg->keep_alive_idle = 10;        // 10s空闲开始探测（服务器ASR+LLM需5-10s）
+    ws_cfg->keep_alive_interval = 5;     // 每5s探测
+    ws_cfg->keep_alive_count = 3;        // 3次失败=断连（总超时：10+5*3=25s）
+}
+
+/**
+ * @brief 快速重连：保留客户端对象（配置、事件注册、接收缓冲），只重做TCP+升级握手
+ * @return false 客户端不存在或启动失败（调用者退回硬重连）
+ */
+static bool ws_fast_resume() {
+    if (!g_ws_client) return false;
+
+    ESP_LOGI(TAG, "Fast resume: restarting existing WebSocket client (session=%s)",
+             g_resume_session_id[0] ? g_resume_session_id : "none");
+    // 关闭失效的传输；客户端任务已因断线退出时stop直接返回
+    esp_websocket_client_stop(g_ws_client);
+    g_ws_connected = false;
+    g_hello_acked = false;
+
+    esp_err_t ret = esp_websocket_client_start(g_ws_client);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Fast resume failed to start client: %d", ret);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 销毁并重建WebSocket客户端（快速重连失败后的硬重连）
  */
 static void ws_recreate_client() {
     ESP_LOGW(TAG, "Recreating WebSocket client...");
 
     if (g_ws_client) {
-        esp_websocket_client_stop(g_ws_client);
-        esp_websocket_client_destroy(g_ws_client);
+        // 先置空再检查diag：diag置ws_busy_后才读g_ws_client，两边都有屏障，
+        // 要么diag读到nullptr，要么这里看到ws_busy_并等它的发送返回（单次发送最多1s超时）
+        esp_websocket_client_handle_t old = g_ws_client;
         g_ws_client = nullptr;
+        __sync_synchronize();
+        while (Diagnostics::instance().ws_in_use()) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        esp_websocket_client_stop(old);
+        esp_websocket_client_destroy(old);
     }
     g_ws_connected = false;
     g_hello_acked = false;
-    g_session_id[0] = '\0';
-
-    static char ws_headers[128];
-    snprintf(ws_headers, sizeof(ws_headers),
-             "x-device-id: %s\r\nx-device-token: %s\r\n",
-             g_device_id, g_device_token);
+    ws_forget_session();
 
-    esp_websocket_client_config_t ws_cfg = {};
-    ws_cfg.uri = HITONY_WS_URL;
-    ws_cfg.headers = ws_headers;
-    ws_cfg.task_stack = 4096;           // 4KB (瘦回调不做cJSON，足够)
-    ws_cfg.buffer_size = 8192;          // 8KB接收缓冲（容纳多帧TTS数据）
-    ws_cfg.disable_auto_reconnect = true; // 禁用库自动重连（FSM管理重连）
-    ws_cfg.network_timeout_ms = 10000;
-    ws_cfg.ping_interval_sec = 0;       // 禁用WS ping（改用TCP keepalive）
-    ws_cfg.pingpong_timeout_sec = 0;    // 禁用WS pong超时
-    ws_cfg.keep_alive_enable = true;    // TCP keepalive（内核处理，不受应用阻塞影响）
-    ws_cfg.keep_alive_idle = 10;        // 10s空闲开始探测（服务器ASR+LLM需5-10s）
-    ws_cfg.keep_alive_interval = 5;     // 每5s探测
-    ws_cfg.keep_alive_count = 3;        // 3次失败=断连（总超时：10+5*3=25s）
+    esp_websocket_client_config_t ws_cfg;
+    ws_fill_config(&ws_cfg);
 
     g_ws_client = esp_websocket_client_init(&ws_cfg);
     if (!g_ws_client) {
@@ -169,24 +353,26 @@ static void ws_recreate_client() {
 }
 
 /**
- * @brief 清空播放队列（释放所有待播放的Opus包）
+ * @brief 清空播放队列（释放所有待播放的Opus包）和音乐存储
  */
 static void flush_playback_queue() {
-    opus_packet_msg_t* msg = nullptr;
+    opus_slice_t slice;
     int flushed = 0;
-    while (xQueueReceive(g_opus_playback_queue, &msg, 0) == pdTRUE) {
-        free_opus_msg(msg);
+    while (xQueueReceive(g_opus_playback_queue, &slice, 0) == pdTRUE) {
+        opus_slice_release(&slice);
         flushed++;
     }
-    if (flushed > 0) {
-        ESP_LOGI(TAG, "Flushed %d packets from playback queue", flushed);
+    uint32_t stored = MusicStore::instance().packets();
+    MusicStore::instance().flush();
+    if (flushed > 0 || stored > 0) {
+        ESP_LOGI(TAG, "Flushed %d packets from playback queue, %lu from music store", flushed, stored);
     }
 }
 
 /**
  * @brief 发送JSON消息到WebSocket服务器
  */
-static bool ws_send_json(const char* json_str) {
+static bool ws_send_json(const char* json_str, bool quiet = false) {
     if (!g_ws_client || !esp_websocket_client_is_connected(g_ws_client)) {
         ESP_LOGW(TAG, "WS not connected, drop message");
         return false;
@@ -195,7 +381,48 @@ static bool ws_send_json(const char* json_str) {
     int len = strlen(json_str);
     int ret = esp_websocket_client_send_text(g_ws_client, json_str, len, pdMS_TO_TICKS(200));
     if (ret > 0) {
-        ESP_LOGI(TAG, "-> Server: %s", json_str);
+        if (quiet) {
+            ESP_LOGD(TAG, "-> Server: %s", json_str);
+        } else {
+            ESP_LOGI(TAG, "-> Server: %s", json_str);
+        }
+        return true;
+    }
+    ESP_LOGW(TAG, "WS send fail, ret=%d", ret);
+    return false;
+}
+
+/**
+ * @brief 基准测试的WS发送（diag任务调用；esp_websocket_client发送接口自带互斥）
+ * 测试期间main_ctrl推迟销毁重建客户端（见Diagnostics::ws_in_use）
+ */
+static bool diag_ws_send(const char* data, size_t len) {
+    esp_websocket_client_handle_t client = g_ws_client;
+    if (!client || !esp_websocket_client_is_connected(client)) return false;
+    return esp_websocket_client_send_text(client, data, len, pdMS_TO_TICKS(1000)) == (int)len;
+}
+
+/**
+ * @brief 发送二进制控制帧（ws_ctrl_end()已回填长度）
+ * @param quiet 高频消息（信用更新）只打DEBUG日志
+ */
+static bool ws_send_ctrl(ws_ctrl_writer_t* w, const char* what, bool quiet = false) {
+    if (!ws_ctrl_end(w)) {
+        ESP_LOGW(TAG, "Ctrl frame overflow: %s", what);
+        return false;
+    }
+    if (!g_ws_client || !esp_websocket_client_is_connected(g_ws_client)) {
+        ESP_LOGW(TAG, "WS not connected, drop message");
+        return false;
+    }
+
+    int ret = esp_websocket_client_send_bin(g_ws_client, (const char*)w->buf, w->len, pdMS_TO_TICKS(200));
+    if (ret > 0) {
+        if (quiet) {
+            ESP_LOGD(TAG, "-> Server: [ctrl] %s (%u B)", what, (unsigned)w->len);
+        } else {
+            ESP_LOGI(TAG, "-> Server: [ctrl] %s (%u B)", what, (unsigned)w->len);
+        }
         return true;
     }
     ESP_LOGW(TAG, "WS send fail, ret=%d", ret);
@@ -206,21 +433,68 @@ static bool ws_send_json(const char* json_str) {
  * @brief 发送简单类型消息
  */
 static bool ws_send_type(const char* type) {
+    if (g_ctrl_binary && strcmp(type, "audio_start") == 0) {
+        uint8_t frame[WS_CTRL_HEADER_LEN];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_AUDIO_START);
+        return ws_send_ctrl(&w, type);
+    }
+
     char buf[64];
     snprintf(buf, sizeof(buf), "{\"type\":\"%s\"}", type);
     return ws_send_json(buf);
 }
 
+/**
+ * @brief 设备当前可再接收的TTS包数：播放队列空位，受下行帧所用pool空闲块约束
+ * （单包帧占一个S_256块，批量帧共用一个L_2K块，按每包一块估算是保守上界）
+ */
+static uint32_t tts_credit_window() {
+    uint32_t window = uxQueueSpacesAvailable(g_opus_playback_queue);
+    uint32_t free_blocks = 0;
+    pool_stats_t ps;
+    if (pool_get_stats(POOL_S_256, &ps)) free_blocks += ps.block_count - ps.used;
+    if (pool_get_stats(POOL_L_2K, &ps)) free_blocks += ps.block_count - ps.used;
+    return window < free_blocks ? window : free_blocks;
+}
+
+/**
+ * @brief 发送往返延迟探测（服务器回复pong）
+ */
+static bool ws_send_ping() {
+    WifiPowerPolicy::instance().on_ping_sent();
+    if (g_ctrl_binary) {
+        uint8_t frame[WS_CTRL_HEADER_LEN];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_PING);
+        return ws_send_ctrl(&w, "ping", true);
+    }
+    return ws_send_json("{\"type\":\"ping\"}", true);
+}
+
 /**
  * @brief 发送hello握手消息
  */
 static void ws_send_hello() {
-    char buf[192];
-    snprintf(buf, sizeof(buf),
-             "{\"type\":\"hello\",\"device_id\":\"%s\",\"fw\":\"%s\",\"listen_mode\":\"auto\"}",
-             g_device_id, HITONY_FW_VERSION);
+    char buf[320];
+    g_tts_credit_initial = tts_credit_window();
+    // uplink_batch：设备可接受的上行批量上限，服务器在hello回复中确认实际帧数
+    // tts_credit：设备支持TTS下行信用，值为首个会话的初始额度（包数），服务器回复tts_credit:true启用
+    int len = snprintf(buf, sizeof(buf),
+             "{\"type\":\"hello\",\"device_id\":\"%s\",\"fw\":\"%s\",\"listen_mode\":\"auto\","
+             "\"uplink_batch\":{\"frames\":%d,\"max_ms\":%d},\"ctrl_bin\":%d,\"tts_credit\":%lu",
+             g_device_id, HITONY_FW_VERSION,
+             CONFIG_ECHOEAR_UPLINK_BATCH_FRAMES, CONFIG_ECHOEAR_UPLINK_BATCH_MAX_MS,
+             WS_CTRL_VERSION, (unsigned long)g_tts_credit_initial);
+    // 断线重连：请求恢复上一个会话（服务器回复相同session_id即恢复成功）
+    if (g_resume_session_id[0]) {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        ",\"resume_session\":\"%s\"", g_resume_session_id);
+    }
+    snprintf(buf + len, sizeof(buf) - len, "}");
     ws_send_json(buf);
-    ESP_LOGI(TAG, "Hello sent (fw=%s), waiting for server response...", HITONY_FW_VERSION);
+    ESP_LOGI(TAG, "Hello sent (fw=%s%s%s), waiting for server response...", HITONY_FW_VERSION,
+             g_resume_session_id[0] ? ", resume=" : "", g_resume_session_id);
 }
 
 /**
@@ -230,23 +504,37 @@ static void ws_send_hello() {
  * @param text 可选: 唤醒词文本 (仅在state="detect"时使用)
  */
 static bool ws_send_listen(const char* state, const char* mode = nullptr, const char* text = nullptr) {
+    // 信用已协商时附带下一次回复的初始额度（服务器在tts_start后按此额度开始发送）
+    if (g_tts_credit_enabled) {
+        g_tts_credit_initial = tts_credit_window();
+    }
+
+    if (g_ctrl_binary) {
+        uint8_t frame[128];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_LISTEN);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_STATE, state);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_MODE, mode);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_TEXT, text);
+        if (g_tts_credit_enabled) {
+            ws_ctrl_put_int(&w, WS_CTRL_TAG_TTS_CREDIT, g_tts_credit_initial);
+        }
+        return ws_send_ctrl(&w, "listen");
+    }
+
     char buf[192];
-    if (mode && text) {
-        snprintf(buf, sizeof(buf),
-                 "{\"type\":\"listen\",\"state\":\"%s\",\"mode\":\"%s\",\"text\":\"%s\"}",
-                 state, mode, text);
-    } else if (mode) {
-        snprintf(buf, sizeof(buf),
-                 "{\"type\":\"listen\",\"state\":\"%s\",\"mode\":\"%s\"}",
-                 state, mode);
-    } else if (text) {
-        snprintf(buf, sizeof(buf),
-                 "{\"type\":\"listen\",\"state\":\"%s\",\"text\":\"%s\"}",
-                 state, text);
-    } else {
-        snprintf(buf, sizeof(buf),
-                 "{\"type\":\"listen\",\"state\":\"%s\"}", state);
+    int len = snprintf(buf, sizeof(buf), "{\"type\":\"listen\",\"state\":\"%s\"", state);
+    if (mode) {
+        len += snprintf(buf + len, sizeof(buf) - len, ",\"mode\":\"%s\"", mode);
+    }
+    if (text) {
+        len += snprintf(buf + len, sizeof(buf) - len, ",\"text\":\"%s\"", text);
     }
+    if (g_tts_credit_enabled) {
+        len += snprintf(buf + len, sizeof(buf) - len, ",\"tts_credit\":%lu",
+                        (unsigned long)g_tts_credit_initial);
+    }
+    snprintf(buf + len, sizeof(buf) - len, "}");
     return ws_send_json(buf);
 }
 
@@ -254,6 +542,14 @@ static bool ws_send_listen(const char* state, const char* mode = nullptr, const
  * @brief 发送abort消息（带原因）
  */
 static bool ws_send_abort(const char* reason = nullptr) {
+    if (g_ctrl_binary) {
+        uint8_t frame[96];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_ABORT);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_REASON, reason);
+        return ws_send_ctrl(&w, "abort");
+    }
+
     char buf[128];
     if (reason) {
         snprintf(buf, sizeof(buf),
@@ -264,6 +560,346 @@ static bool ws_send_abort(const char* reason = nullptr) {
     return ws_send_json(buf);
 }
 
+/**
+ * @brief 发送音乐控制消息（pause/resume）
+ */
+static bool ws_send_music_ctrl(const char* action) {
+    if (g_ctrl_binary) {
+        uint8_t frame[32];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_MUSIC_CTRL);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_ACTION, action);
+        return ws_send_ctrl(&w, "music_ctrl");
+    }
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "{\"type\":\"music_ctrl\",\"action\":\"%s\"}", action);
+    return ws_send_json(buf);
+}
+
+/**
+ * @brief 发送音乐流控消息（pause/resume），附当前存储占用百分比
+ */
+static bool ws_send_music_flow(const char* state) {
+    uint8_t fill = MusicStore::instance().fill_percent();
+    if (g_ctrl_binary) {
+        uint8_t frame[32];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_MUSIC_FLOW);
+        ws_ctrl_put_str(&w, WS_CTRL_TAG_STATE, state);
+        ws_ctrl_put_int(&w, WS_CTRL_TAG_LEVEL, fill);
+        return ws_send_ctrl(&w, "music_flow");
+    }
+
+    char buf[80];
+    snprintf(buf, sizeof(buf), "{\"type\":\"music_flow\",\"state\":\"%s\",\"level\":%u}",
+             state, (unsigned)fill);
+    return ws_send_json(buf);
+}
+
+/**
+ * @brief 发送TTS信用更新：本会话累计授予包数 + 已丢弃包数
+ * 格式：{"type":"tts_credit","tts_credit":N,"dropped":D}（与二进制通道的WS_CTRL_TAG_TTS_CREDIT同名）
+ */
+static bool ws_send_tts_credit(uint32_t credit) {
+    if (g_ctrl_binary) {
+        uint8_t frame[32];
+        ws_ctrl_writer_t w;
+        ws_ctrl_begin(&w, frame, sizeof(frame), WS_CTRL_MSG_TTS_CREDIT);
+        ws_ctrl_put_int(&w, WS_CTRL_TAG_TTS_CREDIT, credit);
+        ws_ctrl_put_int(&w, WS_CTRL_TAG_DROPPED, g_tts_drop_count);
+        return ws_send_ctrl(&w, "tts_credit", true);
+    }
+
+    char buf[80];
+    snprintf(buf, sizeof(buf), "{\"type\":\"tts_credit\",\"tts_credit\":%lu,\"dropped\":%lu}",
+             (unsigned long)credit, (unsigned long)g_tts_drop_count);
+    return ws_send_json(buf, true);
+}
+
+/**
+ * @brief 按播放进度追加TTS信用（额度只增不减）
+ * 新额度 = 已收包数 + 当前空位：在途包都计入已授予额度，到达后恰好填满空位
+ * 额度增长不足TTS_CREDIT_UPDATE_MIN且无新丢包时不发送，避免每包一条控制消息
+ */
+static void tts_credit_refresh() {
+    if (!g_tts_credit_enabled || g_tts_end_received) return;
+
+    uint32_t credit = g_tts_rx_count + tts_credit_window();
+    bool grown = (int32_t)(credit - g_tts_credit) >= TTS_CREDIT_UPDATE_MIN;
+    bool new_drops = g_tts_drop_count != g_tts_credit_drops_reported;
+    if (!grown && !new_drops) return;
+
+    if ((int32_t)(credit - g_tts_credit) < 0) credit = g_tts_credit;
+    if (ws_send_tts_credit(credit)) {
+        g_tts_credit = credit;
+        g_tts_credit_drops_reported = g_tts_drop_count;
+    }
+}
+
+/**
+ * @brief 发送音频延迟遥测（各级p50/p95/p99/max，us），成功后开始新的统计窗口
+ * 格式：{"type":"telemetry","latency_us":{"capture_to_afe":{"n":..,"p50":..,...},...}}
+ */
+static bool ws_send_latency_telemetry() {
+    SystemMonitor& mon = SystemMonitor::instance();
+    char buf[768];
+    int len = snprintf(buf, sizeof(buf), "{\"type\":\"telemetry\",\"latency_us\":{");
+    bool any = false;
+    for (int i = 0; i < (int)SystemMonitor::LatencyStage::COUNT; i++) {
+        const SystemMonitor::LatencyStage stage = (SystemMonitor::LatencyStage)i;
+        SystemMonitor::LatencyPercentiles p = mon.get_latency_percentiles(stage);
+        if (p.count == 0) continue;
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "%s\"%s\":{\"n\":%lu,\"p50\":%lu,\"p95\":%lu,\"p99\":%lu,\"max\":%lu}",
+                        any ? "," : "", SystemMonitor::latency_stage_name(stage),
+                        p.count, p.p50_us, p.p95_us, p.p99_us, p.max_us);
+        any = true;
+        if (len >= (int)sizeof(buf) - 2) return false;
+    }
+    if (!any) return false;
+    snprintf(buf + len, sizeof(buf) - len, "}}");
+    if (!ws_send_json(buf)) return false;
+    mon.reset_latency();
+    return true;
+}
+
+/**
+ * @brief 发送内存放置/碎片化遥测
+ * 格式：{"type":"telemetry","mem":{"internal":[free,largest,largest_min,free_min],"psram":[..],"dma":[..],
+ *        "hot":[bytes,fallbacks],"scratch":[used,fallbacks]}}
+ */
+static bool ws_send_memory_telemetry() {
+    SystemMonitor::MemoryStats mem = SystemMonitor::instance().get_memory_stats();
+    mem_placement_stats_t mp;
+    mem_placement_get_stats(&mp);
+
+    char buf[320];
+    int len = snprintf(buf, sizeof(buf), "{\"type\":\"telemetry\",\"mem\":{");
+    for (int i = 0; i < (int)SystemMonitor::HeapCap::COUNT; i++) {
+        const SystemMonitor::HeapCapStats& c = mem.caps[i];
+        len += snprintf(buf + len, sizeof(buf) - len, "\"%s\":[%lu,%lu,%lu,%lu],",
+                        SystemMonitor::heap_cap_name((SystemMonitor::HeapCap)i),
+                        (unsigned long)c.free, (unsigned long)c.largest_block,
+                        (unsigned long)c.largest_min, (unsigned long)c.free_min);
+        if (len >= (int)sizeof(buf)) return false;
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "\"hot\":[%lu,%lu],\"scratch\":[%lu,%lu]}}",
+                    (unsigned long)mp.hot_bytes, (unsigned long)mp.hot_fallbacks,
+                    (unsigned long)mp.scratch_used, (unsigned long)mp.scratch_fallbacks);
+    if (len >= (int)sizeof(buf)) return false;
+    return ws_send_json(buf, true);
+}
+
+/**
+ * @brief 发送启动时间线遥测（每次开机首次握手后一次，ms从CPU启动计）
+ * 格式：{"type":"telemetry","boot_ms":{"app_main":..,"codec":..,"wake_ready":..,...}}
+ */
+static bool ws_send_boot_telemetry() {
+    char timeline[320];
+    if (!BootSequence::instance().format_json(timeline, sizeof(timeline))) return false;
+    char buf[384];
+    snprintf(buf, sizeof(buf), "{\"type\":\"telemetry\",\"boot_ms\":%s}", timeline);
+    return ws_send_json(buf, true);
+}
+
+#if CONFIG_ECHOEAR_PROFILER
+/**
+ * @brief 发送CPU剖析遥测：各核使用率、CPU占用最高的任务、各测量点窗口统计
+ * 数组按位置编码以压缩体积：tasks=[名称,核(-1=任意),‰]，scopes=[名称,次数,avg,p95,max(us),‰]
+ */
+static bool ws_send_profile_telemetry() {
+    static PerformanceProfiler::Baseline s_base = {};
+    const int MAX_TASKS = 8;
+
+    char buf[1024];
+    float c0, c1;
+    TaskManager::instance().get_cpu_usage(c0, c1);
+    int len = snprintf(buf, sizeof(buf), "{\"type\":\"profile\",\"cpu\":[%d,%d],\"tasks\":[",
+                       (int)(c0 + 0.5f), (int)(c1 + 0.5f));
+
+    auto tasks = TaskManager::instance().get_task_stats();
+    for (int i = 0; i < (int)tasks.size() && i < MAX_TASKS; i++) {
+        const TaskManager::TaskStats& t = tasks[i];
+        len += snprintf(buf + len, sizeof(buf) - len, "%s[\"%s\",%d,%d]",
+                        i ? "," : "", t.name, t.core, (int)(t.cpu_usage * 10.0f + 0.5f));
+        if (len >= (int)sizeof(buf) - 2) return false;
+    }
+
+    PerformanceProfiler::PointStats scopes[PerformanceProfiler::MAX_POINTS];
+    uint32_t window_ms = 0;
+    int n = PerformanceProfiler::collect(s_base, scopes, PerformanceProfiler::MAX_POINTS, &window_ms);
+    len += snprintf(buf + len, sizeof(buf) - len, "],\"win_ms\":%lu,\"scopes\":[", (unsigned long)window_ms);
+    for (int i = 0; i < n; i++) {
+        const PerformanceProfiler::PointStats& s = scopes[i];
+        len += snprintf(buf + len, sizeof(buf) - len, "%s[\"%s\",%lu,%lu,%lu,%lu,%lu]",
+                        i ? "," : "", s.name, (unsigned long)s.count, (unsigned long)s.avg_us,
+                        (unsigned long)s.p95_us, (unsigned long)s.max_us, (unsigned long)s.cpu_permille);
+        if (len >= (int)sizeof(buf) - 2) return false;
+    }
+    snprintf(buf + len, sizeof(buf) - len, "]}");
+    return ws_send_json(buf, true);
+}
+#endif
+
+// ============================================================================
+// 上行批量发送（RECORDING期间Opus包合并为一个WS二进制帧）
+// ============================================================================
+
+/**
+ * @brief 发送一个上行二进制帧，并为其中的每个包记录ENCODE_TO_WS/UPLINK_TOTAL
+ */
+static bool uplink_send_frame(const uint8_t* data, size_t len,
+                              const latency_stamp_t* stamps, int count) {
+    if (!g_ws_client || !esp_websocket_client_is_connected(g_ws_client)) {
+        g_ws_tx_count += count;
+        if (g_ws_tx_count % 20 < (uint32_t)count) {
+            ESP_LOGI(TAG, "Offline: %lu Opus packets encoded (not sent)", g_ws_tx_count);
+        }
+        return false;
+    }
+
+    int64_t send_start = esp_timer_get_time();
+    int sent = esp_websocket_client_send_bin(g_ws_client, (const char*)data, len,
+                                             pdMS_TO_TICKS(100));
+    // 上报发送耗时，驱动自适应编码档位
+    OpusRateController::instance().report_ws_send(
+        (uint32_t)(esp_timer_get_time() - send_start), sent > 0);
+
+    if (sent <= 0) {
+        ESP_LOGW(TAG, "Failed to send WebSocket data (%d packets, %u B)", count, (unsigned)len);
+        return false;
+    }
+
+    SystemMonitor& mon = SystemMonitor::instance();
+    const uint32_t now = latency_now_us();
+    for (int i = 0; i < count; i++) {
+        if (!stamps[i].seq) continue;
+        mon.record_latency(SystemMonitor::LatencyStage::ENCODE_TO_WS,
+                           now - stamps[i].stage_us, stamps[i].seq);
+        mon.record_latency(SystemMonitor::LatencyStage::UPLINK_TOTAL,
+                           now - stamps[i].origin_us, stamps[i].seq);
+    }
+    g_ws_tx_count += count;
+    if (g_ws_tx_count % 20 < (uint32_t)count) {
+        ESP_LOGI(TAG, "WS TX: %lu packets sent", g_ws_tx_count);
+    }
+    return true;
+}
+
+/**
+ * @brief 立即发送当前批（VAD结束、录音结束、超时）
+ */
+static void uplink_flush_batch() {
+    if (g_uplink_batch_count == 0) return;
+    uplink_send_frame(g_uplink_batch_buf, g_uplink_batch_len,
+                      g_uplink_batch_stamps, g_uplink_batch_count);
+    g_uplink_batch_len = 0;
+    g_uplink_batch_count = 0;
+}
+
+/**
+ * @brief 丢弃未发送的批（断线、新会话）
+ */
+static void uplink_reset_batch() {
+    g_uplink_batch_len = 0;
+    g_uplink_batch_count = 0;
+}
+
+/**
+ * @brief 提交一个上行Opus包：未协商批量时直接发送，否则追加到当前批
+ *
+ * 批满N帧或批内首包已等待T ms时发送。调用者随后释放msg。
+ */
+static void uplink_submit(const opus_packet_msg_t* msg) {
+    if (g_uplink_batch_frames <= 1) {
+        uplink_send_frame(msg->data, msg->len, &msg->stamp, 1);
+        return;
+    }
+    if (msg->len == 0 || msg->len > UPLINK_OPUS_MAX_BYTES) {
+        ESP_LOGW(TAG, "Uplink batch: skip packet (%u B)", (unsigned)msg->len);
+        return;
+    }
+
+    if (g_uplink_batch_len + 2 + msg->len > sizeof(g_uplink_batch_buf)) {
+        uplink_flush_batch();
+    }
+    if (g_uplink_batch_count == 0) {
+        g_uplink_batch_start_us = esp_timer_get_time();
+    }
+    g_uplink_batch_buf[g_uplink_batch_len++] = (uint8_t)(msg->len >> 8);
+    g_uplink_batch_buf[g_uplink_batch_len++] = (uint8_t)(msg->len & 0xFF);
+    memcpy(&g_uplink_batch_buf[g_uplink_batch_len], msg->data, msg->len);
+    g_uplink_batch_len += msg->len;
+    g_uplink_batch_stamps[g_uplink_batch_count++] = msg->stamp;
+
+    if (g_uplink_batch_count >= g_uplink_batch_frames) {
+        uplink_flush_batch();
+    }
+}
+
+/**
+ * @brief 批内首包等待超过T ms时发送（主循环每轮调用），未到时登记剩余时间为截止点
+ */
+static void uplink_poll_batch() {
+    if (g_uplink_batch_count == 0) return;
+
+    int64_t left_us = CONFIG_ECHOEAR_UPLINK_BATCH_MAX_MS * 1000LL -
+                      (esp_timer_get_time() - g_uplink_batch_start_us);
+    if (left_us <= 0) {
+        uplink_flush_batch();
+    } else {
+        ctrl_timer_arm(CTRL_TIMER_STATE, (uint32_t)((left_us + 999) / 1000));
+    }
+}
+
+/**
+ * @brief 把已编码的上行包全部取出并提交（最多max_packets个）
+ */
+static void uplink_drain_tx_queue(int max_packets) {
+    opus_packet_msg_t* opus_msg = nullptr;
+    int drained = 0;
+    while (drained < max_packets && xQueueReceive(g_opus_tx_queue, &opus_msg, 0) == pdTRUE) {
+        drained++;
+        uplink_submit(opus_msg);
+        free_opus_msg(opus_msg);
+    }
+}
+
+/**
+ * @brief 新一轮录音开始前丢弃上一轮残留的上行包和未发送的批
+ *
+ * 上一轮stop的尾帧可能仍在编码级，先短暂等它入队，避免旧尾包混进新录音开头。
+ */
+static void uplink_discard_stale() {
+    AudioUplink& uplink = AudioUplink::instance();
+    for (int i = 0; i < 20 && uplink.stop_pending(); i++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    opus_packet_msg_t* opus_msg = nullptr;
+    int dropped = 0;
+    while (xQueueReceive(g_opus_tx_queue, &opus_msg, 0) == pdTRUE) {
+        free_opus_msg(opus_msg);
+        dropped++;
+    }
+    if (dropped) {
+        ESP_LOGW(TAG, "Uplink: dropped %d stale packets from previous recording", dropped);
+    }
+    uplink_reset_batch();
+    g_vad_end_pending = false;
+}
+
+/**
+ * @brief 原始消息入队并唤醒主循环（WS任务上下文）
+ */
+static bool ws_rx_push(const ws_raw_msg_t* msg) {
+    if (xQueueSend(g_ws_rx_queue, msg, 0) != pdTRUE) {
+        return false;
+    }
+    main_task_notify(MAIN_NOTIFY_WS_RX);
+    return true;
+}
+
 /**
  * @brief WebSocket事件处理器（瘦身版 — 运行在WS内部任务中）
  *
@@ -272,20 +908,21 @@ static bool ws_send_abort(const char* reason = nullptr) {
  */
 static void websocket_event_handler(void* handler_args, esp_event_base_t base,
                                      int32_t event_id, void* event_data) {
+    PROFILE_SCOPE("ws_event");
     esp_websocket_event_data_t* data = (esp_websocket_event_data_t*)event_data;
 
     switch (event_id) {
         case WEBSOCKET_EVENT_CONNECTED: {
-            ws_raw_msg_t msg = {.data = nullptr, .len = 0, .msg_type = WS_MSG_CONNECTED};
-            xQueueSend(g_ws_rx_queue, &msg, 0);
+            ws_raw_msg_t msg = {.data = nullptr, .len = 0, .msg_type = WS_MSG_CONNECTED, .rx_us = 0};
+            ws_rx_push(&msg);
             break;
         }
 
         case WEBSOCKET_EVENT_DISCONNECTED:
         case WEBSOCKET_EVENT_CLOSED: {
             // Both unexpected disconnect and graceful close (e.g. OTA) need reconnect
-            ws_raw_msg_t msg = {.data = nullptr, .len = 0, .msg_type = WS_MSG_DISCONNECTED};
-            xQueueSend(g_ws_rx_queue, &msg, 0);
+            ws_raw_msg_t msg = {.data = nullptr, .len = 0, .msg_type = WS_MSG_DISCONNECTED, .rx_us = 0};
+            ws_rx_push(&msg);
             break;
         }
 
@@ -305,16 +942,15 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
                 if (data->payload_offset == 0) {
                     // First chunk — allocate reassembly buffer (pool sized by total)
                     if (s_reasm_buf) {
-                        pool_free_by_size(s_reasm_buf, s_reasm_total);
+                        pool_free(s_reasm_buf);
                         s_reasm_buf = nullptr;
                     }
                     if (data->payload_len <= 0 || data->payload_len > 4096) {
                         ESP_LOGW(TAG, "WS frag: payload too large (%d)", data->payload_len);
                         break;
                     }
-                    pool_type_t rtype = (data->payload_len <= 256) ? POOL_S_256
-                                      : (data->payload_len <= 2048) ? POOL_L_2K : POOL_L_4K;
-                    s_reasm_buf = (uint8_t*)pool_alloc(rtype);
+                    s_reasm_buf = (uint8_t*)pool_alloc_by_size(
+                        data->payload_len < 256 ? 256 : data->payload_len);
                     if (!s_reasm_buf) {
                         ESP_LOGW(TAG, "WS frag: pool alloc fail (%d)", data->payload_len);
                         break;
@@ -332,9 +968,10 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
                         .data = s_reasm_buf,
                         .len = (uint16_t)s_reasm_total,
                         .msg_type = WS_MSG_BINARY,
+                        .rx_us = latency_now_us(),
                     };
-                    if (xQueueSend(g_ws_rx_queue, &msg, 0) != pdTRUE) {
-                        pool_free_by_size(s_reasm_buf, s_reasm_total);
+                    if (!ws_rx_push(&msg)) {
+                        pool_free(s_reasm_buf);
                         ESP_LOGW(TAG, "WS frag: queue full after reassembly (%d B)", s_reasm_total);
                     }
                     s_reasm_buf = nullptr;
@@ -345,7 +982,7 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
             }
             // Clear any stale reassembly state on non-fragment
             if (s_reasm_buf) {
-                pool_free_by_size(s_reasm_buf, s_reasm_total);
+                pool_free(s_reasm_buf);
                 s_reasm_buf = nullptr;
                 s_reasm_offset = 0;
                 s_reasm_total = 0;
@@ -362,13 +999,9 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
                 break;
             }
 
-            // 选择pool
-            pool_type_t ptype;
-            if (data->data_len <= 256) ptype = POOL_S_256;
-            else if (data->data_len <= 2048) ptype = POOL_L_2K;
-            else ptype = POOL_L_4K;
-
-            uint8_t* buf = (uint8_t*)pool_alloc(ptype);
+            // 按大小选择pool（最小256B）
+            uint8_t* buf = (uint8_t*)pool_alloc_by_size(
+                data->data_len < 256 ? 256 : data->data_len);
             if (!buf) {
                 ESP_LOGW(TAG, "WS handler: pool alloc fail (%d bytes)", data->data_len);
                 break;
@@ -379,10 +1012,11 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
                 .data = buf,
                 .len = (uint16_t)data->data_len,
                 .msg_type = (uint8_t)(opcode == 0x02 ? WS_MSG_BINARY : WS_MSG_TEXT),
+                .rx_us = latency_now_us(),
             };
 
-            if (xQueueSend(g_ws_rx_queue, &msg, 0) != pdTRUE) {
-                pool_free(ptype, buf);
+            if (!ws_rx_push(&msg)) {
+                pool_free(buf);
                 ESP_LOGW(TAG, "WS RX queue full, dropped %s (%d B)",
                          opcode == 0x02 ? "bin" : "txt", data->data_len);
             }
@@ -410,8 +1044,9 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
 static void handle_ws_connected() {
     ESP_LOGI(TAG, "WebSocket connected to server");
     g_ws_connected = true;
+    g_ws_drop_handled = false;
     g_hello_acked = false;
-    g_session_id[0] = '\0';
+    ws_forget_session();  // 保留待恢复的会话ID，由hello请求恢复
 
     ws_send_hello();
 
@@ -419,10 +1054,31 @@ static void handle_ws_connected() {
     xQueueSend(g_fsm_event_queue, &evt, 0);
 }
 
+/**
+ * @brief OTA是否接管了WS连接（关闭WS下载时不重连，设备在OTA完成后重启）
+ *
+ * CONFIG_ECHOEAR_OTA_KEEP_WS时OTA与会话并存，断线照常重连
+ */
+static bool ota_owns_ws() {
+#if CONFIG_ECHOEAR_OTA_KEEP_WS
+    return false;
+#else
+    return ota_is_running();
+#endif
+}
+
 /**
  * @brief 处理WS断开事件
  */
 static void handle_ws_disconnected() {
+    // 一次断线库会先后发DISCONNECTED和CLOSED（WiFi恢复路径也可能先主动处理）：
+    // 每次连接只处理一次，避免重复清理、重复进入重连和重复计数
+    if (g_ws_drop_handled) {
+        ESP_LOGD(TAG, "WS disconnect already handled for this connection");
+        return;
+    }
+    g_ws_drop_handled = true;
+
     ESP_LOGW(TAG, "WebSocket disconnected! FSM=%d, TTS_rx=%lu, tts_end=%d",
              g_current_fsm_state, g_tts_rx_count, g_tts_end_received);
     ESP_LOGW(TAG, "  Memory: heap=%lu, internal=%lu, largest=%lu",
@@ -431,7 +1087,14 @@ static void handle_ws_disconnected() {
              (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
     g_ws_connected = false;
     g_hello_acked = false;
-    g_session_id[0] = '\0';
+    ws_forget_session();
+
+    // 未发出的上行批作废，重连后重新协商批量大小
+    uplink_reset_batch();
+    g_uplink_batch_frames = 1;
+    g_ctrl_binary = false;
+    g_music_flow_paused = false;
+    g_tts_credit_enabled = false;
 
     // 清理WS帧重组状态（防止reconnect后悬空指针）
     ws_clear_reassembly_state();
@@ -441,7 +1104,7 @@ static void handle_ws_disconnected() {
     int drained = 0;
     while (xQueueReceive(g_ws_rx_queue, &stale, 0) == pdTRUE) {
         if (stale.data) {
-            pool_free_by_size(stale.data, stale.len);
+            pool_free(stale.data);
         }
         drained++;
     }
@@ -455,9 +1118,9 @@ static void handle_ws_disconnected() {
     // 停止音乐动画并隐藏耳机图标
     lvgl_ui_set_music_energy(0.0f);
 
-    // During OTA: WS was intentionally closed to free WiFi buffers.
+    // During OTA (without KEEP_WS): WS was intentionally closed to free WiFi buffers.
     // Don't trigger reconnect — device will reboot after OTA completes.
-    if (ota_is_running()) {
+    if (ota_owns_ws()) {
         ESP_LOGI(TAG, "WS closed during OTA — suppressing reconnect");
         lvgl_ui_set_status("Updating...");
         return;
@@ -475,9 +1138,12 @@ static void handle_ws_disconnected() {
  * 服务器发送批量格式: [2B BE length][opus data][2B BE length][opus data]...
  * 每批约10个包(~2KB)，减少TCP分段数量，解决手机热点限流问题。
  *
- * @return 始终返回false（调用者释放原始batch buffer，个别包已复制到独立pool buffer）
+ * 每个包以(帧, 偏移, 长度)切片入播放队列，不复制、不分配，切片各持有帧的一个引用。
+ *
+ * @return 始终返回false（调用者释放自己的引用，帧在最后一个切片解码后归还）
  */
-static bool handle_ws_binary(uint8_t* data, uint16_t len) {
+static bool handle_ws_binary(uint8_t* data, uint16_t len, uint32_t rx_us) {
+    PROFILE_SCOPE("ws_binary");
     // 状态守卫：SPEAKING和MUSIC都接受音频包
     if (g_current_fsm_state != FSM_STATE_SPEAKING && g_current_fsm_state != FSM_STATE_MUSIC) {
         g_tts_drop_count++;
@@ -494,316 +1160,569 @@ static bool handle_ws_binary(uint8_t* data, uint16_t len) {
 
     // 解析批量格式: [2B BE length][opus data]...
     size_t offset = 0;
+    size_t pkt_offset = 0;
+    uint16_t pkt_len = 0;
     int parsed = 0;
+    bool tail_dropped = false;
 
-    while (offset + 2 <= (size_t)len) {
-        uint16_t pkt_len = ((uint16_t)data[offset] << 8) | data[offset + 1];
-        offset += 2;
+    while (ws_batch_next(data, len, &offset, &pkt_offset, &pkt_len)) {
+        g_tts_rx_count++;
 
-        // 合法性检查
-        if (pkt_len == 0 || offset + pkt_len > (size_t)len) {
-            ESP_LOGW(TAG, "TTS batch: invalid pkt_len=%u at offset=%zu (total=%u)", pkt_len, offset - 2, len);
-            break;
+        // 音乐：拷入PSRAM存储（不阻塞、不占播放队列），接收帧由调用者立即归还
+        if (g_current_fsm_state == FSM_STATE_MUSIC && MusicStore::instance().is_ready()) {
+            static uint32_t music_seq = 0;
+            if (++music_seq == 0) music_seq = 1;
+            latency_stamp_t stamp = {music_seq, rx_us, rx_us};
+            if (MusicStore::instance().push(&data[pkt_offset], pkt_len, stamp)) {
+                parsed++;
+            } else {
+                // 服务器未响应暂停请求才会到这里
+                AudioPlayout::instance().mark_packet_lost();
+                g_tts_drop_count++;
+            }
+            continue;
         }
 
-        g_tts_rx_count++;
-
-        // 使用 alloc_opus_msg 分配独立的 msg + data buffer 并复制数据
-        opus_packet_msg_t* msg = alloc_opus_msg(pkt_len);
-        if (!msg) {
-            ESP_LOGW(TAG, "TTS batch: pool exhausted at packet %d (rx=%lu)", parsed, g_tts_rx_count);
+        // 零拷贝切片：每个包持有接收帧的一个引用，最后一个包解码后整帧归还
+        if (!pool_retain(data)) {
+            ESP_LOGW(TAG, "TTS batch: frame %p not shareable, dropping batch tail", data);
+            tail_dropped = true;
             break;
         }
-        memcpy(msg->data, &data[offset], pkt_len);
-
-        // Wait up to 30ms (half an Opus frame) for a queue slot to open.
-        // On failure, drop only THIS packet and continue parsing remaining packets
-        // (instead of break which loses the entire batch tail).
-        if (xQueueSend(g_opus_playback_queue, &msg, pdMS_TO_TICKS(30)) != pdTRUE) {
-            free_opus_msg(msg);
-            offset += pkt_len;
+        // 下行延迟追踪：序号+WS收到时间，随包传到解码/播放（序号跳过0）
+        static uint32_t downlink_seq = 0;
+        if (++downlink_seq == 0) downlink_seq = 1;
+        opus_slice_t slice = {
+            .data = &data[pkt_offset],
+            .len = pkt_len,
+            .stamp = {downlink_seq, rx_us, rx_us},
+        };
+
+        // 信用模式：服务器只在额度内发送，队列必有空位，不等待（满了说明服务器超额）。
+        // 旧服务器：最多等30ms（半个Opus帧）。
+        // 失败时只丢这一个包，继续解析批内剩余包（而不是break丢掉整个批尾）。
+        bool credited = g_tts_credit_enabled && g_current_fsm_state == FSM_STATE_SPEAKING;
+        if (credited && (int32_t)(g_tts_rx_count - g_tts_credit) > 0) {
+            g_tts_credit_overrun++;
+        }
+        if (!audio_send_playback(&slice, credited ? 0 : pdMS_TO_TICKS(30))) {
+            opus_slice_release(&slice);
+            AudioPlayout::instance().mark_packet_lost();  // 下一包到达时用FEC恢复
+            g_tts_drop_count++;
             continue;
         }
 
         parsed++;
-        offset += pkt_len;
+    }
+    if (!tail_dropped && offset != len) {
+        ESP_LOGW(TAG, "TTS batch: invalid pkt_len at offset=%zu (total=%u)", offset, len);
     }
 
-    if (parsed > 0) {
+    if (g_current_fsm_state == FSM_STATE_MUSIC && MusicStore::instance().is_ready()) {
+        // 高水位：请求服务器暂停推流，低水位恢复在主循环MUSIC分支
+        uint8_t fill = MusicStore::instance().fill_percent();
+        if (!g_music_flow_paused && fill >= MUSIC_STORE_HIGH_WATER_PCT) {
+            ESP_LOGI(TAG, "Music store %u%% full (%lu pkts), pausing stream",
+                     (unsigned)fill, MusicStore::instance().packets());
+            g_music_flow_paused = ws_send_music_flow("pause");
+        }
+        ESP_LOGD(TAG, "Music batch: %d pkts stored, total_rx=%lu, store=%u%%",
+                 parsed, g_tts_rx_count, (unsigned)fill);
+    } else if (parsed > 0) {
         UBaseType_t pb_depth = uxQueueMessagesWaiting(g_opus_playback_queue);
         ESP_LOGI(TAG, "TTS batch: %d pkts parsed, total_rx=%lu, queue=%u/24",
                  parsed, g_tts_rx_count, (unsigned)pb_depth);
     }
 
-    return false;  // 调用者释放原始batch buffer
+    if (g_tts_credit_overrun > 0 && g_current_fsm_state == FSM_STATE_SPEAKING) {
+        static uint32_t last_overrun_logged = 0;
+        if (g_tts_credit_overrun != last_overrun_logged) {
+            ESP_LOGW(TAG, "TTS credit overrun: rx=%lu > tts_credit=%lu (%lu pkts over, drop=%lu)",
+                     g_tts_rx_count, g_tts_credit, g_tts_credit_overrun, g_tts_drop_count);
+            last_overrun_logged = g_tts_credit_overrun;
+        }
+    }
+
+    return false;  // 调用者释放自己持有的引用（各切片的引用在解码后归还）
 }
 
+// ============================================================================
+// 控制消息分发（JSON与二进制TLV共用同一张处理表）
+// ============================================================================
+
+// 二进制tag → JSON键名（"a.b"表示嵌套对象中的字段）
+static const char* const kCtrlTagKeys[WS_CTRL_TAG_COUNT] = {
+    nullptr,
+    "session_id", "text", "reason", "title", "message", "expr", "duration_ms",
+    "level", "version", "url", "status", "notion_pushed", "state", "mode", "action",
+    "uplink_batch.frames", "ctrl_bin", "features.abort", "tts_credit", "dropped",
+};
+
 /**
- * @brief 处理WS文本帧（JSON控制消息）
+ * @brief 控制消息字段访问：处理函数不关心消息来自JSON还是二进制TLV
  */
-static void handle_ws_text(const char* data, uint16_t len) {
-    ESP_LOGI(TAG, "Server JSON: %.*s", len, data);
-
-    cJSON* root = cJSON_ParseWithLength(data, len);
-    if (!root) return;
+struct CtrlFields {
+    cJSON* json = nullptr;                   // JSON消息根对象
+    const ws_ctrl_msg_view_t* bin = nullptr; // 二进制消息（指向接收帧）
+
+    cJSON* json_item(uint8_t tag) const {
+        if (!json || tag >= WS_CTRL_TAG_COUNT || !kCtrlTagKeys[tag]) return nullptr;
+        const char* key = kCtrlTagKeys[tag];
+        const char* dot = strchr(key, '.');
+        if (!dot) return cJSON_GetObjectItem(json, key);
+
+        char parent[24];
+        size_t n = (size_t)(dot - key);
+        if (n >= sizeof(parent)) return nullptr;
+        memcpy(parent, key, n);
+        parent[n] = '\0';
+        cJSON* obj = cJSON_GetObjectItem(json, parent);
+        return obj ? cJSON_GetObjectItem(obj, dot + 1) : nullptr;
+    }
 
-    cJSON* type = cJSON_GetObjectItem(root, "type");
-    if (!cJSON_IsString(type)) {
-        cJSON_Delete(root);
-        return;
+    bool str(uint8_t tag, char* out, size_t cap) const {
+        if (bin) return ws_ctrl_get_str(bin, tag, out, cap);
+        cJSON* item = json_item(tag);
+        if (!cJSON_IsString(item) || cap == 0) return false;
+        strncpy(out, item->valuestring, cap - 1);
+        out[cap - 1] = '\0';
+        return true;
     }
 
-    if (strcmp(type->valuestring, "hello") == 0) {
-        cJSON* sid = cJSON_GetObjectItem(root, "session_id");
-        if (cJSON_IsString(sid)) {
-            strncpy(g_session_id, sid->valuestring, sizeof(g_session_id) - 1);
-            g_session_id[sizeof(g_session_id) - 1] = '\0';
+    bool num(uint8_t tag, int* out) const {
+        if (bin) {
+            int32_t v;
+            if (!ws_ctrl_get_int(bin, tag, &v)) return false;
+            *out = v;
+            return true;
+        }
+        cJSON* item = json_item(tag);
+        if (cJSON_IsNumber(item)) {
+            *out = item->valueint;
+            return true;
+        }
+        if (cJSON_IsBool(item)) {
+            *out = cJSON_IsTrue(item) ? 1 : 0;
+            return true;
         }
-        g_hello_acked = true;
+        return false;
+    }
+
+    bool flag(uint8_t tag) const {
+        int v = 0;
+        return num(tag, &v) && v != 0;
+    }
+};
+
+static void ctrl_on_hello(const CtrlFields& f) {
+    if (!f.str(WS_CTRL_TAG_SESSION_ID, g_session_id, sizeof(g_session_id))) {
+        g_session_id[0] = '\0';
+    }
+    g_hello_acked = true;
+    if (!g_resume_session_id[0]) {
         ESP_LOGI(TAG, "Hello handshake complete, session=%s", g_session_id);
-        lvgl_ui_set_status("Connected");
-        lvgl_ui_set_debug_info("Say 'Hi Tony'");
+    } else if (strcmp(g_resume_session_id, g_session_id) == 0) {
+        ESP_LOGI(TAG, "Hello handshake complete, session %s resumed", g_session_id);
+    } else {
+        ESP_LOGW(TAG, "Hello handshake complete, session %s not resumed (new=%s)",
+                 g_resume_session_id, g_session_id);
+    }
+    g_resume_session_id[0] = '\0';
+
+    // 上行批量协商：服务器回复uplink_batch.frames才启用，否则保持每包一帧
+    uplink_reset_batch();
+    g_uplink_batch_frames = 1;
+    int frames = 0;
+    if (f.num(WS_CTRL_TAG_UPLINK_BATCH, &frames) && frames > 1) {
+        if (frames > CONFIG_ECHOEAR_UPLINK_BATCH_FRAMES) frames = CONFIG_ECHOEAR_UPLINK_BATCH_FRAMES;
+        g_uplink_batch_frames = (uint8_t)frames;
+    }
 
-        cJSON* features = cJSON_GetObjectItem(root, "features");
-        if (features) {
-            cJSON* abort_feat = cJSON_GetObjectItem(features, "abort");
-            if (cJSON_IsTrue(abort_feat)) {
-                ESP_LOGI(TAG, "Server supports abort feature");
-            }
-        }
+    // 二进制控制通道协商：服务器回复相同版本才启用，否则控制消息保持JSON
+    int ctrl_bin = 0;
+    g_ctrl_binary = f.num(WS_CTRL_TAG_CTRL_BIN, &ctrl_bin) && ctrl_bin == WS_CTRL_VERSION;
 
-    } else if (strcmp(type->valuestring, "tts_start") == 0) {
-        ESP_LOGI(TAG, "Server: TTS start");
-        cJSON* text_item = cJSON_GetObjectItem(root, "text");
-        if (cJSON_IsString(text_item)) {
-            ESP_LOGI(TAG, "TTS text: %s", text_item->valuestring);
-        }
+    // TTS信用协商：服务器回复tts_credit为真才启用，否则保持阻塞入队（旧行为）
+    g_tts_credit_enabled = f.flag(WS_CTRL_TAG_TTS_CREDIT);
+    ESP_LOGI(TAG, "Uplink batch: %d frames/msg, control channel: %s, TTS credit: %s",
+             g_uplink_batch_frames, g_ctrl_binary ? "binary" : "JSON",
+             g_tts_credit_enabled ? "on" : "off");
+    lvgl_ui_set_status("Connected");
+    lvgl_ui_set_debug_info("Say 'Hi Tony'");
 
-        // tts_start 和后续 binary 包都经过同一 FIFO 队列(g_ws_rx_queue)，
-        // 顺序天然保持。在此同步设置 SPEAKING 状态，后续 binary 包不会被丢弃。
-        const char* state_names[] = {"IDLE", "RECORDING", "SPEAKING", "MUSIC", "ERROR"};
-        fsm_state_t prev_state = g_current_fsm_state;
-        g_current_fsm_state = FSM_STATE_SPEAKING;
-        g_speaking_start_time = xTaskGetTickCount();
-        g_thinking_start_time = 0;
-        g_tts_end_received = false;
-        g_drain_wait_count = 0;
-        g_tts_rx_count = 0;
-        g_tts_drop_count = 0;
+    if (f.flag(WS_CTRL_TAG_FEATURE_ABORT)) {
+        ESP_LOGI(TAG, "Server supports abort feature");
+    }
 
-        if (prev_state == FSM_STATE_RECORDING) {
-            audio_cmd_t cmd_rec = AUDIO_CMD_STOP_RECORDING;
-            xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
-            g_audio_start_sent = false;
-        }
+    // 首次握手 = 启动完成（打印时间线），重连不再上报
+    static bool s_boot_reported = false;
+    if (!s_boot_reported) {
+        BootSequence::instance().mark(BootSequence::Stage::WS_READY);
+        s_boot_reported = ws_send_boot_telemetry();
+    }
 
-        audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
-        xQueueSend(g_audio_cmd_queue, &cmd_play, 0);
+#if CONFIG_ECHOEAR_BENCHMARK_AT_BOOT
+    // 每次开机首次握手后运行一次（WS吞吐测试需要会话）
+    static bool s_boot_benchmark_done = false;
+    if (!s_boot_benchmark_done && g_current_fsm_state == FSM_STATE_IDLE) {
+        s_boot_benchmark_done = Diagnostics::instance().start_benchmark("boot");
+    }
+#endif
+}
 
-        LedController::instance().set_system_state(LedController::SystemState::SPEAKING);
-        lvgl_ui_set_status("Speaking...");
-
-        ESP_LOGI(TAG, "FSM: %s -> SPEAKING (tts_start)", state_names[prev_state]);
-        ESP_LOGI(TAG, "  Memory: heap=%lu, internal=%lu, largest=%lu",
-                 (unsigned long)esp_get_free_heap_size(),
-                 (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
-                 (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
-
-    } else if (strcmp(type->valuestring, "tts_end") == 0) {
-        ESP_LOGI(TAG, "Server: TTS end (rx=%lu, drop=%lu)", g_tts_rx_count, g_tts_drop_count);
-        cJSON* reason = cJSON_GetObjectItem(root, "reason");
-        if (cJSON_IsString(reason) && strcmp(reason->valuestring, "abort") == 0) {
-            ESP_LOGI(TAG, "TTS end (abort acknowledged)");
+static void ctrl_on_tts_start(const CtrlFields& f) {
+    ESP_LOGI(TAG, "Server: TTS start");
+    char text[192];
+    if (f.str(WS_CTRL_TAG_TEXT, text, sizeof(text))) {
+        ESP_LOGI(TAG, "TTS text: %s", text);
+    }
+
+    // tts_start 和后续 binary 包都经过同一 FIFO 队列(g_ws_rx_queue)，
+    // 顺序天然保持。在此同步设置 SPEAKING 状态，后续 binary 包不会被丢弃。
+    const char* state_names[] = {"IDLE", "RECORDING", "SPEAKING", "MUSIC", "ERROR"};
+    fsm_state_t prev_state = g_current_fsm_state;
+    g_current_fsm_state = FSM_STATE_SPEAKING;
+    g_speaking_start_time = xTaskGetTickCount();
+    g_thinking_start_time = 0;
+    g_tts_end_received = false;
+    g_drain_wait_count = 0;
+    g_tts_rx_count = 0;
+    g_tts_drop_count = 0;
+    g_tts_credit = g_tts_credit_initial;  // 服务器按最近通告的额度开始发送
+    g_tts_credit_overrun = 0;
+    g_tts_credit_drops_reported = 0;
+
+    if (prev_state == FSM_STATE_RECORDING) {
+        uplink_flush_batch();  // 与FSM的TTS_START分支一致：停录前送出最后一批
+        g_vad_end_pending = false;
+        audio_cmd_t cmd_rec = AUDIO_CMD_STOP_RECORDING;
+        audio_send_cmd(cmd_rec);
+        g_audio_start_sent = false;
+    }
+
+    audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
+    audio_send_cmd(cmd_play);
+
+    LedController::instance().set_system_state(LedController::SystemState::SPEAKING);
+    lvgl_ui_set_status("Speaking...");
+
+    ESP_LOGI(TAG, "FSM: %s -> SPEAKING (tts_start)", state_names[prev_state]);
+    ESP_LOGI(TAG, "  Memory: heap=%lu, internal=%lu, largest=%lu",
+             (unsigned long)esp_get_free_heap_size(),
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+}
+
+static void ctrl_on_tts_end(const CtrlFields& f) {
+    ESP_LOGI(TAG, "Server: TTS end (rx=%lu, drop=%lu, tts_credit=%lu, overrun=%lu)",
+             g_tts_rx_count, g_tts_drop_count, g_tts_credit, g_tts_credit_overrun);
+    char reason[24];
+    if (f.str(WS_CTRL_TAG_REASON, reason, sizeof(reason)) && strcmp(reason, "abort") == 0) {
+        ESP_LOGI(TAG, "TTS end (abort acknowledged)");
+    }
+    fsm_event_msg_t evt = {.event = FSM_EVENT_TTS_END};
+    xQueueSend(g_fsm_event_queue, &evt, 0);
+}
+
+static void ctrl_on_music_start(const CtrlFields& f) {
+    ESP_LOGI(TAG, "Server: Music start");
+    char title[96] = "";
+    if (f.str(WS_CTRL_TAG_TITLE, title, sizeof(title))) {
+        ESP_LOGI(TAG, "Music title: %s", title);
+    }
+
+    const char* state_names[] = {"IDLE", "RECORDING", "SPEAKING", "MUSIC", "ERROR"};
+    fsm_state_t prev_state = g_current_fsm_state;
+    g_current_fsm_state = FSM_STATE_MUSIC;
+    g_tts_end_received = false;
+    g_drain_wait_count = 0;
+    g_tts_rx_count = 0;
+    g_tts_drop_count = 0;
+    g_music_was_playing = false;
+    g_music_flow_paused = false;  // 新的音乐流从未暂停状态开始
+
+    // Flush stale FSM events (e.g. TTS_END from hint TTS sent before music_start).
+    // Without this, the hint's tts_end event would be processed after we enter MUSIC
+    // state, causing g_tts_end_received=true and premature music stop.
+    {
+        fsm_event_msg_t stale_evt;
+        int flushed = 0;
+        while (xQueueReceive(g_fsm_event_queue, &stale_evt, 0) == pdTRUE) {
+            flushed++;
+        }
+        if (flushed > 0) {
+            ESP_LOGW(TAG, "music_start: flushed %d stale FSM events", flushed);
         }
+    }
+
+    if (prev_state == FSM_STATE_RECORDING) {
+        uplink_flush_batch();  // 与FSM的TTS_START分支一致：停录前送出最后一批
+        g_vad_end_pending = false;
+        audio_cmd_t cmd_rec = AUDIO_CMD_STOP_RECORDING;
+        audio_send_cmd(cmd_rec);
+        g_audio_start_sent = false;
+    }
+
+    audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
+    audio_send_cmd(cmd_play);
+
+    LedController::instance().set_system_state(LedController::SystemState::SPEAKING);
+    lvgl_ui_set_state(UI_STATE_MUSIC);
+    if (title[0]) {
+        lvgl_ui_set_music_title(title);
+    }
+
+    ESP_LOGI(TAG, "FSM: %s -> MUSIC (music_start)", state_names[prev_state]);
+}
+
+static void ctrl_on_music_end(const CtrlFields&) {
+    ESP_LOGI(TAG, "Server: Music end");
+    lvgl_ui_hide_music_title();
+    if (g_current_fsm_state == FSM_STATE_MUSIC) {
         fsm_event_msg_t evt = {.event = FSM_EVENT_TTS_END};
         xQueueSend(g_fsm_event_queue, &evt, 0);
+    } else {
+        ESP_LOGW(TAG, "music_end ignored (state=%d, not MUSIC)", g_current_fsm_state);
+        g_music_was_playing = false;
+    }
+}
 
-    } else if (strcmp(type->valuestring, "music_start") == 0) {
-        ESP_LOGI(TAG, "Server: Music start");
-        cJSON* title = cJSON_GetObjectItem(root, "title");
-        const char* title_str = "";
-        if (cJSON_IsString(title)) {
-            title_str = title->valuestring;
-            ESP_LOGI(TAG, "Music title: %s", title_str);
-        }
-
-        const char* state_names[] = {"IDLE", "RECORDING", "SPEAKING", "MUSIC", "ERROR"};
-        fsm_state_t prev_state = g_current_fsm_state;
+static void ctrl_on_music_resume(const CtrlFields&) {
+    ESP_LOGI(TAG, "Server: Music resume");
+    if (g_music_was_playing) {
         g_current_fsm_state = FSM_STATE_MUSIC;
         g_tts_end_received = false;
         g_drain_wait_count = 0;
-        g_tts_rx_count = 0;
-        g_tts_drop_count = 0;
         g_music_was_playing = false;
 
-        // Flush stale FSM events (e.g. TTS_END from hint TTS sent before music_start).
-        // Without this, the hint's tts_end event would be processed after we enter MUSIC
-        // state, causing g_tts_end_received=true and premature music stop.
+        // Flush stale FSM events (TTS_END from voice interaction reply)
         {
             fsm_event_msg_t stale_evt;
-            int flushed = 0;
-            while (xQueueReceive(g_fsm_event_queue, &stale_evt, 0) == pdTRUE) {
-                flushed++;
-            }
-            if (flushed > 0) {
-                ESP_LOGW(TAG, "music_start: flushed %d stale FSM events", flushed);
-            }
-        }
-
-        if (prev_state == FSM_STATE_RECORDING) {
-            audio_cmd_t cmd_rec = AUDIO_CMD_STOP_RECORDING;
-            xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
-            g_audio_start_sent = false;
+            while (xQueueReceive(g_fsm_event_queue, &stale_evt, 0) == pdTRUE) {}
         }
 
         audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
-        xQueueSend(g_audio_cmd_queue, &cmd_play, 0);
+        audio_send_cmd(cmd_play);
 
         LedController::instance().set_system_state(LedController::SystemState::SPEAKING);
         lvgl_ui_set_state(UI_STATE_MUSIC);
-        if (title_str[0]) {
-            lvgl_ui_set_music_title(title_str);
-        }
+        ESP_LOGI(TAG, "FSM: -> MUSIC (resume)");
+    } else {
+        ESP_LOGW(TAG, "music_resume ignored (no paused music)");
+    }
+}
 
-        ESP_LOGI(TAG, "FSM: %s -> MUSIC (music_start)", state_names[prev_state]);
+static void ctrl_on_asr_text(const CtrlFields& f) {
+    char text[192];
+    if (f.str(WS_CTRL_TAG_TEXT, text, sizeof(text))) {
+        ESP_LOGI(TAG, "ASR result: %s", text);
+    }
+}
 
-    } else if (strcmp(type->valuestring, "music_end") == 0) {
-        ESP_LOGI(TAG, "Server: Music end");
-        lvgl_ui_hide_music_title();
-        if (g_current_fsm_state == FSM_STATE_MUSIC) {
-            fsm_event_msg_t evt = {.event = FSM_EVENT_TTS_END};
-            xQueueSend(g_fsm_event_queue, &evt, 0);
-        } else {
-            ESP_LOGW(TAG, "music_end ignored (state=%d, not MUSIC)", g_current_fsm_state);
-            g_music_was_playing = false;
+static void ctrl_on_error(const CtrlFields& f) {
+    char message[128];
+    if (f.str(WS_CTRL_TAG_MESSAGE, message, sizeof(message))) {
+        ESP_LOGW(TAG, "Server error: %s", message);
+    }
+    if (g_thinking_start_time > 0) {
+        g_thinking_start_time = 0;
+        LedController::instance().set_system_state(LedController::SystemState::LISTENING);
+        lvgl_ui_set_status("Error");
+        lvgl_ui_set_debug_info("Say 'Hi Tony'");
+        ESP_LOGW(TAG, "Server error during thinking, resetting to IDLE");
+    }
+}
+
+static void ctrl_on_expression(const CtrlFields& f) {
+    char expr[24];
+    if (f.str(WS_CTRL_TAG_EXPR, expr, sizeof(expr))) {
+        // Default 3 seconds, server can override with "duration_ms"
+        uint32_t dur = 3000;
+        int dur_ms = 0;
+        if (f.num(WS_CTRL_TAG_DURATION_MS, &dur_ms) && dur_ms > 0) {
+            dur = (uint32_t)dur_ms;
         }
+        ESP_LOGI(TAG, "Server expression: %s (%lums)", expr, (unsigned long)dur);
+        lvgl_ui_show_expression(expr, dur);
+    }
+}
 
-    } else if (strcmp(type->valuestring, "music_resume") == 0) {
-        ESP_LOGI(TAG, "Server: Music resume");
-        if (g_music_was_playing) {
-            g_current_fsm_state = FSM_STATE_MUSIC;
-            g_tts_end_received = false;
-            g_drain_wait_count = 0;
-            g_music_was_playing = false;
-
-            // Flush stale FSM events (TTS_END from voice interaction reply)
-            {
-                fsm_event_msg_t stale_evt;
-                while (xQueueReceive(g_fsm_event_queue, &stale_evt, 0) == pdTRUE) {}
-            }
+static void ctrl_on_pong(const CtrlFields&) {
+    ESP_LOGD(TAG, "Server pong");
+    WifiPowerPolicy::instance().on_pong();
+}
 
-            audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
-            xQueueSend(g_audio_cmd_queue, &cmd_play, 0);
+static void ctrl_on_volume(const CtrlFields& f) {
+    int vol = 0;
+    if (f.num(WS_CTRL_TAG_LEVEL, &vol)) {
+        if (vol < 0) vol = 0;
+        if (vol > 100) vol = 100;
+        lvgl_ui_set_volume(vol);
+        ESP_LOGI(TAG, "Volume set to %d%%", vol);
+    }
+}
 
-            LedController::instance().set_system_state(LedController::SystemState::SPEAKING);
-            lvgl_ui_set_state(UI_STATE_MUSIC);
-            ESP_LOGI(TAG, "FSM: -> MUSIC (resume)");
+static void ctrl_on_ota_notify(const CtrlFields& f) {
+    char version[32];
+    char url[256];
+    if (f.str(WS_CTRL_TAG_VERSION, version, sizeof(version)) &&
+        f.str(WS_CTRL_TAG_URL, url, sizeof(url))) {
+        ESP_LOGI(TAG, "OTA available: version=%s url=%s", version, url);
+        if (strcmp(version, HITONY_FW_VERSION) != 0) {
+            if (!ota_is_running()) {
+                ota_start_update(url);
+            }
         } else {
-            ESP_LOGW(TAG, "music_resume ignored (no paused music)");
+            ESP_LOGI(TAG, "OTA: already on version %s, skipping", HITONY_FW_VERSION);
         }
+    }
+}
 
-    } else if (strcmp(type->valuestring, "asr_text") == 0) {
-        cJSON* text_item = cJSON_GetObjectItem(root, "text");
-        if (cJSON_IsString(text_item)) {
-            ESP_LOGI(TAG, "ASR result: %s", text_item->valuestring);
+static void ctrl_on_meeting_status(const CtrlFields& f) {
+    char status[24];
+    if (!f.str(WS_CTRL_TAG_STATUS, status, sizeof(status))) return;
+
+    if (strcmp(status, "recording") == 0) {
+        // 开始录音：禁用WakeNet省CPU
+        lvgl_ui_set_state(UI_STATE_RECORDING);
+        start_recording_timer();  // 主循环据此切换到meeting档位
+        ESP_LOGI(TAG, "Meeting recording started (WakeNet disabled)");
+
+    } else if (strcmp(status, "ended") == 0) {
+        // 结束录音：恢复WakeNet
+        stop_recording_timer();
+        lvgl_ui_set_state(UI_STATE_WS_CONNECTED);
+        ESP_LOGI(TAG, "Meeting recording ended (WakeNet re-enabled)");
+
+    } else if (strcmp(status, "transcribing") == 0) {
+        // 转录中
+        lvgl_ui_set_status("Transcribing...");
+        ESP_LOGI(TAG, "Meeting transcribing");
+
+    } else if (strcmp(status, "completed") == 0) {
+        // 转录完成
+        if (f.flag(WS_CTRL_TAG_NOTION_PUSHED)) {
+            lvgl_ui_set_status("Saved to Notion");
+            ESP_LOGI(TAG, "Meeting completed and saved to Notion");
+        } else {
+            lvgl_ui_set_status("Transcribed");
+            ESP_LOGI(TAG, "Meeting completed");
         }
+        // 2秒后非阻塞恢复默认状态
+        ctrl_timer_arm(CTRL_TIMER_STATUS_CLEAR, 2000);
+    }
+}
 
-    } else if (strcmp(type->valuestring, "error") == 0) {
-        cJSON* msg_item = cJSON_GetObjectItem(root, "message");
-        if (cJSON_IsString(msg_item)) {
-            ESP_LOGW(TAG, "Server error: %s", msg_item->valuestring);
+static void ctrl_on_benchmark(const CtrlFields& f) {
+    char action[16];
+    if (!f.str(WS_CTRL_TAG_ACTION, action, sizeof(action))) return;
+
+    Diagnostics& diag = Diagnostics::instance();
+    if (strcmp(action, "start") == 0) {
+        // 回环测试会播放测试音，只在空闲时运行
+        if (g_current_fsm_state != FSM_STATE_IDLE || AudioPlayout::instance().is_active()) {
+            ESP_LOGW(TAG, "Benchmark refused in state %d", g_current_fsm_state);
+            ws_send_json("{\"type\":\"benchmark_report\",\"error\":\"busy\"}");
+            return;
         }
-        if (g_thinking_start_time > 0) {
-            g_thinking_start_time = 0;
-            LedController::instance().set_system_state(LedController::SystemState::LISTENING);
-            lvgl_ui_set_status("Error");
-            lvgl_ui_set_debug_info("Say 'Hi Tony'");
-            ESP_LOGW(TAG, "Server error during thinking, resetting to IDLE");
+        if (!diag.start_benchmark("server")) {
+            ws_send_json("{\"type\":\"benchmark_report\",\"error\":\"running\"}");
         }
+    } else if (strcmp(action, "downlink_end") == 0) {
+        diag.on_downlink_end();
+    }
+    // action=data：下行测试填充数据，字节数已在接收时统计
+}
 
-    } else if (strcmp(type->valuestring, "expression") == 0) {
-        cJSON* expr_item = cJSON_GetObjectItem(root, "expr");
-        if (cJSON_IsString(expr_item)) {
-            // Default 3 seconds, server can override with "duration_ms"
-            uint32_t dur = 3000;
-            cJSON* dur_item = cJSON_GetObjectItem(root, "duration_ms");
-            if (cJSON_IsNumber(dur_item) && dur_item->valueint > 0) {
-                dur = (uint32_t)dur_item->valueint;
-            }
-            ESP_LOGI(TAG, "Server expression: %s (%lums)", expr_item->valuestring, (unsigned long)dur);
-            lvgl_ui_show_expression(expr_item->valuestring, dur);
-        }
+// 服务器控制消息处理表：按消息ID顺序排列（二进制直接下标），JSON按type名查找
+struct CtrlHandler {
+    uint8_t id;
+    const char* type;
+    void (*fn)(const CtrlFields& f);
+};
+
+static const CtrlHandler kCtrlHandlers[] = {
+    {WS_CTRL_MSG_HELLO,          "hello",          ctrl_on_hello},
+    {WS_CTRL_MSG_TTS_START,      "tts_start",      ctrl_on_tts_start},
+    {WS_CTRL_MSG_TTS_END,        "tts_end",        ctrl_on_tts_end},
+    {WS_CTRL_MSG_MUSIC_START,    "music_start",    ctrl_on_music_start},
+    {WS_CTRL_MSG_MUSIC_END,      "music_end",      ctrl_on_music_end},
+    {WS_CTRL_MSG_MUSIC_RESUME,   "music_resume",   ctrl_on_music_resume},
+    {WS_CTRL_MSG_ASR_TEXT,       "asr_text",       ctrl_on_asr_text},
+    {WS_CTRL_MSG_ERROR,          "error",          ctrl_on_error},
+    {WS_CTRL_MSG_EXPRESSION,     "expression",     ctrl_on_expression},
+    {WS_CTRL_MSG_PONG,           "pong",           ctrl_on_pong},
+    {WS_CTRL_MSG_VOLUME,         "volume",         ctrl_on_volume},
+    {WS_CTRL_MSG_OTA_NOTIFY,     "ota_notify",     ctrl_on_ota_notify},
+    {WS_CTRL_MSG_MEETING_STATUS, "meeting_status", ctrl_on_meeting_status},
+    {WS_CTRL_MSG_BENCHMARK,      "benchmark",      ctrl_on_benchmark},
+};
+static_assert(sizeof(kCtrlHandlers) / sizeof(kCtrlHandlers[0]) == WS_CTRL_MSG_SERVER_END - 1,
+              "kCtrlHandlers must cover every server message id");
+
+static const CtrlHandler* ctrl_handler_by_id(uint8_t id) {
+    if (id < WS_CTRL_MSG_HELLO || id >= WS_CTRL_MSG_SERVER_END) return nullptr;
+    const CtrlHandler* h = &kCtrlHandlers[id - WS_CTRL_MSG_HELLO];
+    return (h->id == id) ? h : nullptr;
+}
 
-    } else if (strcmp(type->valuestring, "pong") == 0) {
-        ESP_LOGD(TAG, "Server pong");
-
-    } else if (strcmp(type->valuestring, "volume") == 0) {
-        cJSON* level = cJSON_GetObjectItem(root, "level");
-        if (cJSON_IsNumber(level)) {
-            int vol = level->valueint;
-            if (vol < 0) vol = 0;
-            if (vol > 100) vol = 100;
-            lvgl_ui_set_volume(vol);
-            ESP_LOGI(TAG, "Volume set to %d%%", vol);
-        }
+static const CtrlHandler* ctrl_handler_by_type(const char* type) {
+    for (const CtrlHandler& h : kCtrlHandlers) {
+        if (strcmp(h.type, type) == 0) return &h;
+    }
+    return nullptr;
+}
 
-    } else if (strcmp(type->valuestring, "ota_notify") == 0) {
-        cJSON* version = cJSON_GetObjectItem(root, "version");
-        cJSON* url = cJSON_GetObjectItem(root, "url");
-        if (cJSON_IsString(version) && cJSON_IsString(url)) {
-            ESP_LOGI(TAG, "OTA available: version=%s url=%s", version->valuestring, url->valuestring);
-            if (strcmp(version->valuestring, HITONY_FW_VERSION) != 0) {
-                if (!ota_is_running()) {
-                    ota_start_update(url->valuestring);
-                }
-            } else {
-                ESP_LOGI(TAG, "OTA: already on version %s, skipping", HITONY_FW_VERSION);
-            }
-        }
+/**
+ * @brief 处理WS文本帧（JSON控制消息，二进制通道未协商时的回退路径）
+ */
+static void handle_ws_text(const char* data, uint16_t len) {
+    PROFILE_SCOPE("ws_text");
+    ESP_LOGD(TAG, "Server JSON: %.*s", len, data);
 
-    } else if (strcmp(type->valuestring, "meeting_status") == 0) {
-        cJSON* status = cJSON_GetObjectItem(root, "status");
-        if (cJSON_IsString(status)) {
-            if (strcmp(status->valuestring, "recording") == 0) {
-                // 开始录音：禁用WakeNet省CPU
-                lvgl_ui_set_state(UI_STATE_RECORDING);
-                start_recording_timer();
-                audio_cmd_t meet_cmd = AUDIO_CMD_MEETING_START;
-                xQueueSend(g_audio_cmd_queue, &meet_cmd, 0);
-                ESP_LOGI(TAG, "Meeting recording started (WakeNet disabled)");
-
-            } else if (strcmp(status->valuestring, "ended") == 0) {
-                // 结束录音：恢复WakeNet
-                stop_recording_timer();
-                lvgl_ui_set_state(UI_STATE_WS_CONNECTED);
-                audio_cmd_t meet_cmd = AUDIO_CMD_MEETING_END;
-                xQueueSend(g_audio_cmd_queue, &meet_cmd, 0);
-                ESP_LOGI(TAG, "Meeting recording ended (WakeNet re-enabled)");
-
-            } else if (strcmp(status->valuestring, "transcribing") == 0) {
-                // 转录中
-                lvgl_ui_set_status("Transcribing...");
-                ESP_LOGI(TAG, "Meeting transcribing");
-
-            } else if (strcmp(status->valuestring, "completed") == 0) {
-                // 转录完成
-                cJSON* notion_pushed = cJSON_GetObjectItem(root, "notion_pushed");
-                if (cJSON_IsTrue(notion_pushed)) {
-                    lvgl_ui_set_status("Saved to Notion");
-                    ESP_LOGI(TAG, "Meeting completed and saved to Notion");
-                } else {
-                    lvgl_ui_set_status("Transcribed");
-                    ESP_LOGI(TAG, "Meeting completed");
-                }
-                // 2秒后非阻塞恢复默认状态
-                g_status_clear_time = esp_timer_get_time() + 2000000;
-            }
+    cJSON* root = cJSON_ParseWithLength(data, len);
+    if (!root) {
+        ESP_LOGW(TAG, "Server JSON parse failed (%u B)", (unsigned)len);
+        return;
+    }
+
+    cJSON* type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        const CtrlHandler* h = ctrl_handler_by_type(type->valuestring);
+        if (h) {
+            CtrlFields f;
+            f.json = root;
+            h->fn(f);
+        } else {
+            ESP_LOGW(TAG, "Unknown server message: %.*s", len, data);
         }
     }
 
     cJSON_Delete(root);
 }
 
+/**
+ * @brief 处理WS二进制控制帧（TLV，可连续多条，无堆分配）
+ */
+static void handle_ws_ctrl(const uint8_t* data, uint16_t len) {
+    size_t offset = 0;
+    ws_ctrl_msg_view_t msg;
+    while (ws_ctrl_next(data, len, &offset, &msg)) {
+        const CtrlHandler* h = ctrl_handler_by_id(msg.id);
+        if (!h) {
+            ESP_LOGW(TAG, "Unknown server ctrl id 0x%02X (%u B)", msg.id, msg.len);
+            continue;
+        }
+        ESP_LOGD(TAG, "Server ctrl: %s (%u B)", h->type, msg.len);
+        CtrlFields f;
+        f.bin = &msg;
+        h->fn(f);
+    }
+    if (offset != len) {
+        ESP_LOGW(TAG, "Server ctrl frame malformed at %u/%u", (unsigned)offset, (unsigned)len);
+    }
+}
+
 /**
  * @brief FSM事件处理函数
  */
@@ -811,6 +1730,12 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
     fsm_state_t old_state = *state;
     LedController& led = LedController::instance();
 
+    // 基准测试期间（测试音会被麦克风拾取）不进入录音
+    if (event.event == FSM_EVENT_WAKE_DETECTED && Diagnostics::instance().is_running()) {
+        ESP_LOGI(TAG, "Wake ignored: benchmark running");
+        return;
+    }
+
     switch (*state) {
         case FSM_STATE_IDLE:
             if (event.event == FSM_EVENT_WAKE_DETECTED) {
@@ -823,15 +1748,16 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 // [S0-1] 即时视觉反馈：眼睛快速变大+状态灯变红
                 lvgl_ui_set_state(UI_STATE_LISTENING);
 
-                ringbuffer_reset(&g_pcm_ringbuffer);
+                // 先启动录音（预录音频立即开始编码），握手与编码并行；
+                // 本任务先发完listen再发送Opus包，服务器收到的顺序不变
+                uplink_discard_stale();
+                audio_cmd_t cmd = AUDIO_CMD_START_RECORDING;
+                audio_send_cmd(cmd);
 
                 // Xiaozhi风格协议: listen(detect) + listen(start, auto)
                 ws_send_listen("detect", nullptr, "Hi Tony");
                 g_audio_start_sent = ws_send_listen("start", "auto");
 
-                audio_cmd_t cmd = AUDIO_CMD_START_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd, 0);
-
                 led.set_system_state(LedController::SystemState::RECORDING);
 
             } else if (event.event == FSM_EVENT_TTS_START) {
@@ -842,7 +1768,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
 
                 ESP_LOGI(TAG, "TTS start (from IDLE), entering SPEAKING mode");
                 audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd_play, 0);
+                audio_send_cmd(cmd_play);
 
                 led.set_system_state(LedController::SystemState::SPEAKING);
                 lvgl_ui_set_state(UI_STATE_SPEAKING);
@@ -866,6 +1792,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 g_thinking_start_time = xTaskGetTickCount();  // 记录"Thinking"开始时间
 
                 ESP_LOGI(TAG, "Recording end, entering IDLE(Thinking) mode");
+                uplink_flush_batch();  // listen(stop)之前送出最后一批
 
                 if (!g_audio_start_sent && g_ws_connected) {
                     ESP_LOGW(TAG, "listen(start) was not sent earlier, sending now...");
@@ -876,7 +1803,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 g_audio_start_sent = false;
 
                 audio_cmd_t cmd = AUDIO_CMD_STOP_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                audio_send_cmd(cmd);
 
                 led.set_system_state(LedController::SystemState::THINKING);
                 lvgl_ui_set_state(UI_STATE_WS_CONNECTED);  // Thinking阶段保持WS_CONNECTED灯色
@@ -887,11 +1814,12 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 g_recording_start_time = 0;
 
                 ESP_LOGI(TAG, "TTS start, entering SPEAKING mode");
+                uplink_flush_batch();
                 audio_cmd_t cmd_rec = AUDIO_CMD_STOP_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
+                audio_send_cmd(cmd_rec);
 
                 audio_cmd_t cmd_play = AUDIO_CMD_START_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd_play, 0);
+                audio_send_cmd(cmd_play);
 
                 led.set_system_state(LedController::SystemState::SPEAKING);
                 lvgl_ui_set_state(UI_STATE_SPEAKING);
@@ -899,11 +1827,12 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
             } else if (event.event == FSM_EVENT_WS_DISCONNECTED) {
                 ESP_LOGW(TAG, "WebSocket disconnected during RECORDING, stopping");
                 *state = FSM_STATE_ERROR;
+                uplink_reset_batch();
                 g_audio_start_sent = false;
                 g_recording_start_time = 0;
 
                 audio_cmd_t cmd = AUDIO_CMD_STOP_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                audio_send_cmd(cmd);
 
                 led.set_system_state(LedController::SystemState::NO_NETWORK);
                 lvgl_ui_set_state(UI_STATE_ERROR);
@@ -913,6 +1842,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
         case FSM_STATE_SPEAKING:
             if (event.event == FSM_EVENT_TTS_END) {
                 g_tts_end_received = true;
+                AudioPlayout::instance().mark_stream_end();
                 ESP_LOGI(TAG, "TTS end received, waiting for playback queue to drain...");
 
             } else if (event.event == FSM_EVENT_WAKE_DETECTED) {
@@ -924,7 +1854,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
 
                 // 停止播放
                 audio_cmd_t cmd_stop = AUDIO_CMD_STOP_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd_stop, 0);
+                audio_send_cmd(cmd_stop);
                 flush_playback_queue();
                 lvgl_ui_set_music_energy(0.0f);
                 g_tts_end_received = false;
@@ -934,13 +1864,12 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 // 直接进入RECORDING模式
                 *state = FSM_STATE_RECORDING;
                 g_recording_start_time = xTaskGetTickCount();
-                ringbuffer_reset(&g_pcm_ringbuffer);
+                uplink_discard_stale();
+                audio_cmd_t cmd_rec = AUDIO_CMD_START_RECORDING;
+                audio_send_cmd(cmd_rec);  // 编码先行，握手随后（同上）
                 ws_send_listen("detect", nullptr, "Hi Tony");
                 g_audio_start_sent = ws_send_listen("start", "auto");
 
-                audio_cmd_t cmd_rec = AUDIO_CMD_START_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
-
                 led.set_system_state(LedController::SystemState::RECORDING);
                 lvgl_ui_set_state(UI_STATE_LISTENING);
 
@@ -951,7 +1880,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 g_speaking_start_time = 0;
 
                 audio_cmd_t cmd = AUDIO_CMD_STOP_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                audio_send_cmd(cmd);
                 flush_playback_queue();
 
                 led.set_system_state(LedController::SystemState::NO_NETWORK);
@@ -962,16 +1891,17 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
         case FSM_STATE_MUSIC:
             if (event.event == FSM_EVENT_TTS_END) {
                 g_tts_end_received = true;
+                AudioPlayout::instance().mark_stream_end();
                 ESP_LOGI(TAG, "Music end received, waiting for playback queue to drain...");
 
             } else if (event.event == FSM_EVENT_WAKE_DETECTED) {
                 // 用户在音乐播放期间唤醒 → 暂停音乐，开始录音
                 ESP_LOGI(TAG, "Wake during MUSIC -> pausing music, start recording");
 
-                ws_send_json("{\"type\":\"music_ctrl\",\"action\":\"pause\"}");
+                ws_send_music_ctrl("pause");
 
                 audio_cmd_t cmd_stop = AUDIO_CMD_STOP_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd_stop, 0);
+                audio_send_cmd(cmd_stop);
                 flush_playback_queue();
                 g_tts_end_received = false;
                 g_drain_wait_count = 0;
@@ -979,13 +1909,12 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
 
                 *state = FSM_STATE_RECORDING;
                 g_recording_start_time = xTaskGetTickCount();
-                ringbuffer_reset(&g_pcm_ringbuffer);
+                uplink_discard_stale();
+                audio_cmd_t cmd_rec = AUDIO_CMD_START_RECORDING;
+                audio_send_cmd(cmd_rec);  // 编码先行，握手随后（同上）
                 ws_send_listen("detect", nullptr, "Hi Tony");
                 g_audio_start_sent = ws_send_listen("start", "auto");
 
-                audio_cmd_t cmd_rec = AUDIO_CMD_START_RECORDING;
-                xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
-
                 led.set_system_state(LedController::SystemState::RECORDING);
                 lvgl_ui_set_state(UI_STATE_LISTENING);
 
@@ -997,7 +1926,7 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
                 lvgl_ui_set_music_energy(0.0f);
 
                 audio_cmd_t cmd = AUDIO_CMD_STOP_PLAYBACK;
-                xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                audio_send_cmd(cmd);
                 flush_playback_queue();
 
                 led.set_system_state(LedController::SystemState::NO_NETWORK);
@@ -1027,6 +1956,9 @@ static void fsm_handle_event(fsm_state_t* state, fsm_event_msg_t event) {
  */
 void main_control_task(void* arg) {
     ESP_LOGI(TAG, "Main Control Task started on Core %d", xPortGetCoreID());
+    g_main_task_handle = xTaskGetCurrentTaskHandle();
+    WifiPowerPolicy::instance().init(kFsmStateNames, sizeof(kFsmStateNames) / sizeof(kFsmStateNames[0]));
+    Diagnostics::instance().set_ws_sender(diag_ws_send);
 
     // [S0-5] 从芯片MAC生成唯一设备标识
     init_device_identity();
@@ -1080,24 +2012,8 @@ void main_control_task(void* arg) {
 
     // === 2. 初始化WebSocket客户端 ===
     if (wifi_connected) {
-        static char ws_headers[128];
-        snprintf(ws_headers, sizeof(ws_headers),
-                 "x-device-id: %s\r\nx-device-token: %s\r\n",
-                 g_device_id, g_device_token);
-
-        esp_websocket_client_config_t ws_cfg = {};
-        ws_cfg.uri = HITONY_WS_URL;
-        ws_cfg.headers = ws_headers;
-        ws_cfg.task_stack = 4096;           // 4KB (瘦回调不做cJSON，足够)
-        ws_cfg.buffer_size = 8192;          // 8KB接收缓冲（容纳多帧TTS数据）
-        ws_cfg.disable_auto_reconnect = true; // 禁用库自动重连（FSM管理重连）
-        ws_cfg.network_timeout_ms = 10000;
-        ws_cfg.ping_interval_sec = 0;       // 禁用WS ping（改用TCP keepalive）
-        ws_cfg.pingpong_timeout_sec = 0;    // 禁用WS pong超时
-        ws_cfg.keep_alive_enable = true;    // TCP keepalive（内核处理）
-        ws_cfg.keep_alive_idle = 10;        // 10s空闲开始探测（服务器ASR+LLM需5-10s）
-        ws_cfg.keep_alive_interval = 5;
-        ws_cfg.keep_alive_count = 3;        // 总超时：10+5*3=25s
+        esp_websocket_client_config_t ws_cfg;
+        ws_fill_config(&ws_cfg);
 
         g_ws_client = esp_websocket_client_init(&ws_cfg);
         if (!g_ws_client) {
@@ -1133,18 +2049,18 @@ void main_control_task(void* arg) {
     // === 本地状态变量 ===
     // 使用全局变量，WebSocket事件处理器可以检查状态（状态守卫）
     // g_current_fsm_state 已在文件顶部定义
-    uint32_t heartbeat_counter = 0;
-    uint32_t ws_tx_count = 0;
     // g_drain_wait_count 使用文件级静态变量
+    ctrl_timer_arm(CTRL_TIMER_HEARTBEAT, 1000);
 
     ESP_LOGI(TAG, "Entering main control loop...");
 
     // === 主循环 ===
     while (1) {
+        uint32_t fired = ctrl_timer_collect(xTaskGetTickCount());
+
         // === 0a. 非阻塞延迟检查（UI状态文本定时清除）===
-        if (g_status_clear_time > 0 && esp_timer_get_time() >= g_status_clear_time) {
+        if (fired & CTRL_TIMER_BIT(CTRL_TIMER_STATUS_CLEAR)) {
             lvgl_ui_set_status("");
-            g_status_clear_time = 0;
         }
 
         // === 0b. 处理 WebSocket 接收队列（从瘦回调中转发的原始消息）===
@@ -1153,18 +2069,25 @@ void main_control_task(void* arg) {
             int ws_processed = 0;
             while (ws_processed < 10 && xQueueReceive(g_ws_rx_queue, &raw_msg, 0) == pdTRUE) {
                 ws_processed++;
+                Diagnostics::instance().on_ws_rx(raw_msg.len);
                 switch (raw_msg.msg_type) {
                     case WS_MSG_BINARY: {
-                        bool transferred = handle_ws_binary(raw_msg.data, raw_msg.len);
+                        // 二进制控制帧（魔数0xC5）先于TTS音频分流，不受FSM状态过滤
+                        if (ws_ctrl_is_frame(raw_msg.data, raw_msg.len)) {
+                            handle_ws_ctrl(raw_msg.data, raw_msg.len);
+                            pool_free(raw_msg.data);
+                            break;
+                        }
+                        bool transferred = handle_ws_binary(raw_msg.data, raw_msg.len, raw_msg.rx_us);
                         if (!transferred) {
                             // 所有权未转移（被丢弃或队列满），释放buffer
-                            pool_free_by_size(raw_msg.data, raw_msg.len);
+                            pool_free(raw_msg.data);
                         }
                         break;
                     }
                     case WS_MSG_TEXT:
                         handle_ws_text((char*)raw_msg.data, raw_msg.len);
-                        pool_free_by_size(raw_msg.data, raw_msg.len);
+                        pool_free(raw_msg.data);
                         break;
                     case WS_MSG_CONNECTED:
                         handle_ws_connected();
@@ -1176,15 +2099,34 @@ void main_control_task(void* arg) {
             }
         }
 
+        // === 0.5 WiFi恢复/漫游：旧TCP连接大概率已失效，主动重连而不是等keepalive(25s)或下次唤醒 ===
+        if (xEventGroupGetBits(g_app_event_group) & EVENT_WIFI_RESTORED) {
+            xEventGroupClearBits(g_app_event_group, EVENT_WIFI_RESTORED);
+            if (!ota_owns_ws()) {
+                ESP_LOGW(TAG, "WiFi restored (FSM=%d), reconnecting WebSocket now", g_current_fsm_state);
+                g_reconnect_attempts = 0;
+                g_ws_reconnect_now = true;
+                if (g_current_fsm_state != FSM_STATE_ERROR && g_ws_connected) {
+                    handle_ws_disconnected();  // 清理并进入ERROR，下一轮立即快速重连
+                }
+            }
+        }
+
         // === 1. 处理FSM事件队列 ===
         fsm_event_msg_t event;
         if (xQueueReceive(g_fsm_event_queue, &event, 0) == pdTRUE) {
             fsm_handle_event(&g_current_fsm_state, event);
         }
+        update_afe_profile();
 
         // === 2. 检查Audio Task事件 ===
         EventBits_t audio_bits = xEventGroupGetBits(g_audio_event_bits);
 
+        // 编码就绪只用于唤醒，在取包之前清除：之后入队的包会重新置位并通知
+        if (audio_bits & AUDIO_EVENT_ENCODE_READY) {
+            xEventGroupClearBits(g_audio_event_bits, AUDIO_EVENT_ENCODE_READY);
+        }
+
         if (audio_bits & AUDIO_EVENT_WAKE_DETECTED) {
             xEventGroupClearBits(g_audio_event_bits, AUDIO_EVENT_WAKE_DETECTED);
             // AEC已启用（MR格式），允许所有状态下的语音唤醒（实现barge-in打断）
@@ -1213,6 +2155,21 @@ void main_control_task(void* arg) {
             xEventGroupClearBits(g_audio_event_bits, AUDIO_EVENT_VAD_END);
 
             if (g_current_fsm_state == FSM_STATE_RECORDING) {
+                g_vad_end_pending = true;
+            }
+        }
+
+        if (audio_bits & AUDIO_EVENT_UPLINK_STOPPED) {
+            xEventGroupClearBits(g_audio_event_bits, AUDIO_EVENT_UPLINK_STOPPED);
+        }
+
+        // 语音结束：等编码级确认stop（尾包已入队）后，不等批满/超时立即送出尾部再结束录音，
+        // 否则尾包会留在g_opus_tx_queue里，到下一轮录音开头才发出
+        if (g_vad_end_pending && !AudioUplink::instance().stop_pending()) {
+            g_vad_end_pending = false;
+            if (g_current_fsm_state == FSM_STATE_RECORDING) {
+                uplink_drain_tx_queue((int)uxQueueMessagesWaiting(g_opus_tx_queue));
+                uplink_flush_batch();
                 fsm_event_msg_t end_evt = {.event = FSM_EVENT_RECORDING_END};
                 xQueueSend(g_fsm_event_queue, &end_evt, 0);
             }
@@ -1230,37 +2187,17 @@ void main_control_task(void* arg) {
                     xQueueSend(g_fsm_event_queue, &timeout_evt, 0);
                     break;
                 }
+                if (g_recording_start_time > 0) {
+                    ctrl_timer_arm_at(CTRL_TIMER_STATE, g_recording_start_time + pdMS_TO_TICKS(15000) + 1);
+                }
 
                 if (!g_audio_start_sent && g_ws_client && esp_websocket_client_is_connected(g_ws_client)) {
                     g_audio_start_sent = ws_send_type("audio_start");
                 }
 
-                opus_packet_msg_t* opus_msg = nullptr;
-                int tx_this_loop = 0;
-                while (tx_this_loop < 4 && xQueueReceive(g_opus_tx_queue, &opus_msg, 0) == pdTRUE) {
-                    tx_this_loop++;
-                    if (g_ws_client && esp_websocket_client_is_connected(g_ws_client)) {
-                        int sent = esp_websocket_client_send_bin(g_ws_client,
-                                    (const char*)opus_msg->data, opus_msg->len,
-                                    pdMS_TO_TICKS(100));
-
-                        if (sent > 0) {
-                            ws_tx_count++;
-                            if (ws_tx_count % 20 == 0) {
-                                ESP_LOGI(TAG, "WS TX: %lu packets sent", ws_tx_count);
-                            }
-                        } else {
-                            ESP_LOGW(TAG, "Failed to send WebSocket data");
-                        }
-                    } else {
-                        ws_tx_count++;
-                        if (ws_tx_count % 20 == 0) {
-                            ESP_LOGI(TAG, "Offline: %lu Opus packets encoded (not sent)", ws_tx_count);
-                        }
-                    }
-
-                    free_opus_msg(opus_msg);
-                }
+                // 未协商批量时每轮最多发4包；批量模式下入批只是memcpy，可一次取完
+                uplink_drain_tx_queue(g_uplink_batch_frames > 1 ? UPLINK_BATCH_MAX_FRAMES * 2 : 4);
+                uplink_poll_batch();
                 break;
             }
 
@@ -1280,6 +2217,7 @@ void main_control_task(void* arg) {
                                  (g_ws_client && esp_websocket_client_is_connected(g_ws_client)) ? "Y" : "N");
                         last_speaking_mem_log = now_tick;
                     }
+                    ctrl_timer_arm_at(CTRL_TIMER_STATE, last_speaking_mem_log + pdMS_TO_TICKS(1000) + 1);
                 }
 
                 // 无包警告：2s和4s未收到新TTS包时提前告警（诊断5-packet问题）
@@ -1301,6 +2239,11 @@ void main_control_task(void* arg) {
                     }
                     // 收到新包时重置警告标记（g_speaking_start_time已在handle_ws_binary中重置）
                     if (gap_ms < 500) { warned_2s = false; warned_4s = false; }
+                    if (!warned_2s) {
+                        ctrl_timer_arm_at(CTRL_TIMER_STATE, g_speaking_start_time + pdMS_TO_TICKS(2000) + 1);
+                    } else if (!warned_4s) {
+                        ctrl_timer_arm_at(CTRL_TIMER_STATE, g_speaking_start_time + pdMS_TO_TICKS(4000) + 1);
+                    }
                 }
 
                 // [S0-3] 15秒超时保护（配合流式TTS，首包到达更快但总时长可能更长）
@@ -1316,7 +2259,7 @@ void main_control_task(void* arg) {
                     g_speaking_start_time = 0;
 
                     audio_cmd_t cmd = AUDIO_CMD_STOP_PLAYBACK;
-                    xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                    audio_send_cmd(cmd);
                     flush_playback_queue();
 
                     g_current_fsm_state = FSM_STATE_IDLE;
@@ -1324,37 +2267,46 @@ void main_control_task(void* arg) {
                     lvgl_ui_set_state(UI_STATE_WS_CONNECTED);
                     break;
                 }
+                if (g_speaking_start_time > 0) {
+                    ctrl_timer_arm_at(CTRL_TIMER_STATE, g_speaking_start_time + pdMS_TO_TICKS(15000) + 1);
+                }
+
+                // 按播放进度追加信用（播放任务出队无通知，流未结束时定期检查）
+                if (g_tts_credit_enabled && !g_tts_end_received) {
+                    tts_credit_refresh();
+                    ctrl_timer_arm(CTRL_TIMER_STATE, TTS_CREDIT_POLL_MS);
+                }
 
-                // 等待播放队列排空
+                // 等待播放队列和抖动缓冲排空（排空后再等10个10ms轮询周期）
                 if (g_tts_end_received) {
-                    UBaseType_t queue_count = uxQueueMessagesWaiting(g_opus_playback_queue);
+                    uint32_t queue_count = AudioPlayout::instance().pending();
                     if (queue_count == 0) {
-                        g_drain_wait_count++;
-                        if (g_drain_wait_count >= 10) {  // 100ms buffer
+                        if ((fired & CTRL_TIMER_BIT(CTRL_TIMER_DRAIN)) &&
+                            ++g_drain_wait_count >= 10) {  // 100ms buffer
                             g_tts_end_received = false;
                             g_drain_wait_count = 0;
                             g_speaking_start_time = 0;
 
                             audio_cmd_t cmd = AUDIO_CMD_STOP_PLAYBACK;
-                            xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                            audio_send_cmd(cmd);
 
                             // Auto-listen: TTS结束后自动进入聆听模式
                             if (g_auto_listen_enabled && g_ws_connected) {
                                 ESP_LOGI(TAG, "Playback drained, auto-listen enabled -> entering RECORDING");
                                 g_current_fsm_state = FSM_STATE_RECORDING;
                                 g_recording_start_time = xTaskGetTickCount();
-                                ringbuffer_reset(&g_pcm_ringbuffer);
 
                                 g_audio_start_sent = ws_send_listen("start", "auto");
 
+                                uplink_discard_stale();
                                 audio_cmd_t cmd_rec = AUDIO_CMD_START_RECORDING;
-                                xQueueSend(g_audio_cmd_queue, &cmd_rec, 0);
+                                audio_send_cmd(cmd_rec);
 
                                 led.set_system_state(LedController::SystemState::RECORDING);
                                 lvgl_ui_set_state(UI_STATE_LISTENING);
                             } else if (g_music_was_playing && g_ws_connected) {
                                 ESP_LOGI(TAG, "Playback drained, requesting music resume");
-                                ws_send_json("{\"type\":\"music_ctrl\",\"action\":\"resume\"}");
+                                ws_send_music_ctrl("resume");
                                 g_current_fsm_state = FSM_STATE_IDLE;
                                 led.set_system_state(LedController::SystemState::LISTENING);
                                 lvgl_ui_set_state(UI_STATE_WS_CONNECTED);
@@ -1372,22 +2324,37 @@ void main_control_task(void* arg) {
                     } else {
                         g_drain_wait_count = 0;
                     }
+                    if (g_tts_end_received) {
+                        ctrl_timer_arm(CTRL_TIMER_DRAIN, 10);
+                    }
                 }
                 break;
             }
 
             case FSM_STATE_MUSIC: {
+                // 低水位：恢复推流（存储由播放任务消费，无通知，暂停期间每100ms检查）
+                if (g_music_flow_paused) {
+                    if (MusicStore::instance().fill_percent() <= MUSIC_STORE_LOW_WATER_PCT) {
+                        ESP_LOGI(TAG, "Music store drained to %u%%, resuming stream",
+                                 (unsigned)MusicStore::instance().fill_percent());
+                        g_music_flow_paused = !ws_send_music_flow("resume");
+                    }
+                    if (g_music_flow_paused) {
+                        ctrl_timer_arm(CTRL_TIMER_STATE, 100);
+                    }
+                }
+
                 // 音乐模式：无5秒超时（音乐流间隔不确定），只处理队列排空
                 if (g_tts_end_received) {
-                    UBaseType_t queue_count = uxQueueMessagesWaiting(g_opus_playback_queue);
+                    uint32_t queue_count = AudioPlayout::instance().pending();
                     if (queue_count == 0) {
-                        g_drain_wait_count++;
-                        if (g_drain_wait_count >= 10) {  // 100ms buffer
+                        if ((fired & CTRL_TIMER_BIT(CTRL_TIMER_DRAIN)) &&
+                            ++g_drain_wait_count >= 10) {  // 100ms buffer
                             g_tts_end_received = false;
                             g_drain_wait_count = 0;
 
                             audio_cmd_t cmd = AUDIO_CMD_STOP_PLAYBACK;
-                            xQueueSend(g_audio_cmd_queue, &cmd, 0);
+                            audio_send_cmd(cmd);
 
                             ESP_LOGI(TAG, "Music playback drained, entering IDLE");
                             g_current_fsm_state = FSM_STATE_IDLE;
@@ -1399,6 +2366,9 @@ void main_control_task(void* arg) {
                     } else {
                         g_drain_wait_count = 0;
                     }
+                    if (g_tts_end_received) {
+                        ctrl_timer_arm(CTRL_TIMER_DRAIN, 10);
+                    }
                 }
                 break;
             }
@@ -1415,12 +2385,28 @@ void main_control_task(void* arg) {
                 uint32_t elapsed_ms = (last_reconnect_tick > 0)
                     ? (now - last_reconnect_tick) * portTICK_PERIOD_MS : backoff_ms;
 
-                if (last_reconnect_tick == 0 || elapsed_ms > backoff_ms) {
-                    ESP_LOGW(TAG, "Reconnect attempt #%d (backoff %lums)...",
-                             g_reconnect_attempts + 1, (unsigned long)backoff_ms);
-                    ws_recreate_client();
+                // WiFi未恢复时重连必然失败，等EVENT_WIFI_RESTORED触发，不消耗退避次数
+                if (!(xEventGroupGetBits(g_app_event_group) & EVENT_WIFI_CONNECTED) && g_ws_client) {
+                    break;
+                }
+
+                // 基准测试的WS发送可能仍在使用旧客户端（最多一次发送超时）
+                if (Diagnostics::instance().ws_in_use()) {
+                    ctrl_timer_arm(CTRL_TIMER_STATE, 100);
+                    break;
+                }
+
+                if (g_ws_reconnect_now || last_reconnect_tick == 0 || elapsed_ms > backoff_ms) {
+                    ESP_LOGW(TAG, "Reconnect attempt #%d (%s)...", g_reconnect_attempts + 1,
+                             g_ws_reconnect_now ? "immediate" : "backoff");
+                    g_ws_reconnect_now = false;
+                    // 前两次保留客户端对象快速重连，仍失败再销毁重建
+                    if (g_reconnect_attempts >= WS_FAST_RESUME_ATTEMPTS || !ws_fast_resume()) {
+                        ws_recreate_client();
+                    }
                     last_reconnect_tick = now;
                     g_reconnect_attempts++;
+                    ctrl_timer_arm(CTRL_TIMER_STATE, 1000);
                 } else {
                     // [S1-2] 每秒更新重连倒计时显示
                     static uint32_t last_countdown_s = 0;
@@ -1431,6 +2417,8 @@ void main_control_task(void* arg) {
                         snprintf(buf, sizeof(buf), "Reconnect %lus...", (unsigned long)remaining_s);
                         lvgl_ui_set_status(buf);
                     }
+                    // 下一次倒计时跳变（或退避到期）时醒来
+                    ctrl_timer_arm(CTRL_TIMER_STATE, (backoff_ms - elapsed_ms) % 1000 + 1);
                 }
                 break;
             }
@@ -1445,21 +2433,17 @@ void main_control_task(void* arg) {
                     led.set_system_state(LedController::SystemState::LISTENING);
                     lvgl_ui_set_status("Connected");
                     lvgl_ui_set_debug_info("Say 'Hi Tony'");
-                }
-
-                // [S0-4] 思考动画：瞳孔左右缓慢摆动，表示正在等待服务器响应
-                if (g_thinking_start_time > 0) {
-                    uint32_t elapsed = (xTaskGetTickCount() - g_thinking_start_time) * portTICK_PERIOD_MS;
-                    int x_offset = (int)(8.0f * sinf((float)elapsed / 1000.0f * 3.14159f));
-                    lvgl_ui_set_pupil_offset(x_offset, 0);
+                } else if (g_thinking_start_time > 0) {
+                    // 只在超时到期时醒来
+                    ctrl_timer_arm_at(CTRL_TIMER_STATE, g_thinking_start_time + pdMS_TO_TICKS(10000) + 1);
                 }
 
                 // Safety net: detect WS disconnect in IDLE (e.g. close event missed)
-                // Skip during OTA — WS was intentionally closed
-                if (!g_ws_connected && g_hello_acked && !ota_is_running()) {
+                // Skip during OTA when it closed the WS on purpose
+                if (!g_ws_connected && g_hello_acked && !ota_owns_ws()) {
                     ESP_LOGW(TAG, "IDLE but WS disconnected — forcing ERROR state for reconnect");
                     g_hello_acked = false;
-                    g_session_id[0] = '\0';
+                    ws_forget_session();
                     g_current_fsm_state = FSM_STATE_ERROR;
                     led.set_system_state(LedController::SystemState::NO_NETWORK);
                     lvgl_ui_set_state(UI_STATE_ERROR);
@@ -1476,6 +2460,9 @@ void main_control_task(void* arg) {
                         g_music_was_playing = false;
                         music_flag_set_time = 0;
                     }
+                    if (music_flag_set_time != 0) {
+                        ctrl_timer_arm_at(CTRL_TIMER_STATE, music_flag_set_time + pdMS_TO_TICKS(10000) + 1);
+                    }
                 }
                 break;
             }
@@ -1487,9 +2474,8 @@ void main_control_task(void* arg) {
         // === 4. UI更新（由lvgl_task独立处理，此处不再调用lv_timer_handler）===
 
         // === 5. 系统心跳 ===
-        heartbeat_counter++;
-        if (heartbeat_counter >= 100) {  // 1秒
-            heartbeat_counter = 0;
+        if (fired & CTRL_TIMER_BIT(CTRL_TIMER_HEARTBEAT)) {  // 1秒
+            ctrl_timer_arm(CTRL_TIMER_HEARTBEAT, 1000);
 
             // 每5秒打印心跳
             static uint32_t heartbeat_5s = 0;
@@ -1512,7 +2498,7 @@ void main_control_task(void* arg) {
                 stats_counter = 0;
 
                 ESP_LOGI(TAG, "=== System Stats ===");
-                ESP_LOGI(TAG, "FSM State: %d, WS TX: %lu packets", g_current_fsm_state, ws_tx_count);
+                ESP_LOGI(TAG, "FSM State: %d, WS TX: %lu packets", g_current_fsm_state, g_ws_tx_count);
                 ESP_LOGI(TAG, "Free heap: %lu bytes, PSRAM: %lu bytes",
                          esp_get_free_heap_size(),
                          heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
@@ -1520,7 +2506,13 @@ void main_control_task(void* arg) {
                 // Stack watermarks: uxTaskGetStackHighWaterMark returns minimum
                 // remaining stack in StackType_t units (bytes on ESP32-S3)
                 struct { const char* name; uint32_t stack_bytes; } task_info[] = {
-                    {"audio_main", 32768},
+#if CONFIG_ECHOEAR_UPLINK_ENCODE_TASK
+                    {"audio_main", 19456},
+                    {"uplink_enc", 32768},
+#else
+                    {"audio_main", 35840},
+#endif
+                    {"audio_play", 12288},
                     {"main_ctrl",  12288},
                     {"afe_task",   12288},
                     {"led_ctrl",   2048},
@@ -1536,17 +2528,83 @@ void main_control_task(void* arg) {
                 }
             }
 
-            if (stats_counter % 30 == 0) {
+            // 每30秒打印系统报告（stats_counter每10秒归零，不能用它取模）
+            static uint32_t report_counter = 0;
+            if (++report_counter >= 30) {
+                report_counter = 0;
                 SystemMonitor::instance().print_system_report();
+                WifiPowerPolicy::instance().print_report();
+                TaskManager::instance().print_pm_report();
+                TaskManager::instance().print_task_stats();
+                PerformanceProfiler::print_all_profiles();
+                lvgl_ui_print_display_stats();
+            }
+
+#if CONFIG_ECHOEAR_WIFI_RTT_PROBE_S > 0
+            // 往返延迟探测：按发出时的FSM状态归类，对比省电/低延迟配置下的实际延迟
+            static uint32_t rtt_probe_counter = 0;
+            if (++rtt_probe_counter >= CONFIG_ECHOEAR_WIFI_RTT_PROBE_S && g_hello_acked &&
+                !WifiPowerPolicy::instance().ping_outstanding()) {
+                ws_send_ping();
+                rtt_probe_counter = 0;
+            }
+#endif
+
+#if CONFIG_ECHOEAR_LATENCY_TELEMETRY_INTERVAL > 0
+            // 延迟遥测：空闲时发送，避免与录音/TTS流量竞争
+            static uint32_t telemetry_counter = 0;
+            if (++telemetry_counter >= CONFIG_ECHOEAR_LATENCY_TELEMETRY_INTERVAL &&
+                g_current_fsm_state == FSM_STATE_IDLE && g_hello_acked) {
+                // 内存遥测随延迟遥测一起发送（延迟窗口为空时也发送，不重复计数）
+                bool sent = ws_send_latency_telemetry();
+                if (ws_send_memory_telemetry() || sent) {
+                    telemetry_counter = 0;
+                }
+            }
+#endif
+
+#if CONFIG_ECHOEAR_PROFILER && CONFIG_ECHOEAR_PROFILE_TELEMETRY_INTERVAL > 0
+            // CPU剖析遥测：现场定位Core 1饱和来源（任意状态都发送，饱和往往发生在对话中）
+            static uint32_t profile_counter = 0;
+            if (++profile_counter >= CONFIG_ECHOEAR_PROFILE_TELEMETRY_INTERVAL && g_hello_acked) {
+                if (ws_send_profile_telemetry()) {
+                    profile_counter = 0;
+                }
             }
+#endif
         }
 
-        // 事件驱动等待：有音频事件立即唤醒，否则10ms超时
+        // === 6. 省电策略：录音/播放/等待回复/OTA期间关闭WiFi省电，其余时间modem sleep + CPU降频 ===
+        {
+            bool net_active = g_current_fsm_state == FSM_STATE_RECORDING ||
+                              g_current_fsm_state == FSM_STATE_SPEAKING ||
+                              g_current_fsm_state == FSM_STATE_MUSIC ||
+                              g_thinking_start_time != 0 || ota_is_running();
+            uint32_t linger_ms = WifiPowerPolicy::instance().update(g_current_fsm_state, net_active);
+            if (linger_ms > 0) {
+                ctrl_timer_arm(CTRL_TIMER_WIFI_PS, linger_ms);
+            }
+
+            // CPU最高频只在录音/播放期间保证，其余时间由DFS降频（WakeNet跟不上时AFE自行升频）
+            TaskManager::PmState pm_state = TaskManager::PmState::IDLE;
+            if (g_current_fsm_state == FSM_STATE_RECORDING || g_meeting_timer_active) {
+                pm_state = TaskManager::PmState::RECORDING;
+            } else if (g_current_fsm_state == FSM_STATE_SPEAKING || g_current_fsm_state == FSM_STATE_MUSIC) {
+                pm_state = TaskManager::PmState::PLAYING;
+            }
+            TaskManager::instance().pm_set_state(pm_state);
+        }
+
+        // === 7. 事件驱动等待：WS消息/音频事件/WiFi事件的任务通知立即唤醒，否则睡到最近的截止时间 ===
         // 录音时 AUDIO_EVENT_ENCODE_READY 触发即时发送 Opus 包，减少排队延迟
-        xEventGroupWaitBits(g_audio_event_bits,
-            AUDIO_EVENT_ENCODE_READY | AUDIO_EVENT_WAKE_DETECTED |
-            AUDIO_EVENT_VAD_END | AUDIO_EVENT_TOUCH_WAKE,
-            pdFALSE, pdFALSE, pdMS_TO_TICKS(10));
+        // 本轮未处理完的消息（WS每轮上限10条、FSM每轮1个、上行包按批上限）不等待
+        TickType_t wait = ctrl_timer_wait_ticks(xTaskGetTickCount());
+        if (uxQueueMessagesWaiting(g_ws_rx_queue) > 0 ||
+            uxQueueMessagesWaiting(g_fsm_event_queue) > 0 ||
+            (g_current_fsm_state == FSM_STATE_RECORDING && uxQueueMessagesWaiting(g_opus_tx_queue) > 0)) {
+            wait = 0;
+        }
+        xTaskNotifyWait(0, UINT32_MAX, nullptr, wait);
     }
 
     if (g_ws_client) {
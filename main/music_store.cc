@@ -0,0 +1,165 @@
+#include "music_store.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <string.h>
+
+static const char* TAG = "music_store";
+
+bool MusicStore::init(size_t capacity_bytes) {
+    if (buf_) return true;
+
+    capacity_bytes &= ~(size_t)3;
+    if (capacity_bytes < 4096) {
+        ESP_LOGI(TAG, "Music store disabled");
+        return false;
+    }
+
+    buf_ = (uint8_t*)heap_caps_malloc(capacity_bytes, MALLOC_CAP_SPIRAM);
+    if (!buf_) {
+        ESP_LOGE(TAG, "Failed to allocate %zu bytes in PSRAM", capacity_bytes);
+        return false;
+    }
+    capacity_ = capacity_bytes;
+    write_pos_ = 0;
+    read_pos_ = 0;
+
+    ESP_LOGI(TAG, "Music store: %zu KB PSRAM, watermarks %d%%/%d%%",
+             capacity_ / 1024, MUSIC_STORE_HIGH_WATER_PCT, MUSIC_STORE_LOW_WATER_PCT);
+    return true;
+}
+
+size_t MusicStore::used_bytes() const {
+    size_t w = write_pos_;
+    size_t r = read_pos_;
+    return (w >= r) ? (w - r) : (capacity_ - r + w);
+}
+
+// ============================================================================
+// 生产者
+// ============================================================================
+
+bool MusicStore::push(const uint8_t* data, uint16_t len, const latency_stamp_t& stamp) {
+    if (!buf_ || !data || len == 0) return false;
+
+    const size_t need = record_size(len);
+    size_t w = write_pos_;
+    size_t r = read_pos_;
+    __sync_synchronize();
+
+    // 始终保留至少1字节空隙，w == r 只表示空
+    if (w >= r) {
+        size_t tail = capacity_ - w;
+        if (tail < need + (r == 0 ? 1 : 0)) {
+            // 尾部放不下：写环绕标记（尾部连头都放不下时消费者隐式环绕），从头开始
+            if (r <= need) {
+                stats_.rejected++;
+                return false;
+            }
+            if (tail >= sizeof(Record)) {
+                Record* mark = (Record*)(buf_ + w);
+                mark->len = 0;
+                mark->gen = gen_;
+                mark->flags = FLAG_WRAP;
+            }
+            w = 0;
+        }
+    } else if (r - w <= need) {
+        stats_.rejected++;
+        return false;
+    }
+
+    Record* rec = (Record*)(buf_ + w);
+    rec->len = len;
+    rec->gen = gen_;
+    rec->flags = 0;
+    rec->stamp = stamp;
+    memcpy(buf_ + w + sizeof(Record), data, len);
+
+    w += need;
+    if (w >= capacity_) w = 0;
+
+    __sync_synchronize();  // 记录内容先于写指针对消费者可见
+    write_pos_ = w;
+    pushed_ = pushed_ + 1;
+    stats_.pushed++;
+
+    size_t used = used_bytes();
+    if (used > stats_.high_water_bytes) stats_.high_water_bytes = used;
+    return true;
+}
+
+void MusicStore::flush() {
+    gen_ = gen_ + 1;
+}
+
+// ============================================================================
+// 消费者
+// ============================================================================
+
+bool MusicStore::next_record(size_t* pos, const Record** rec) {
+    size_t r = read_pos_;
+    while (true) {
+        size_t w = write_pos_;
+        __sync_synchronize();  // 先读写指针再读记录内容
+        if (r == w) {
+            read_pos_ = r;
+            return false;
+        }
+
+        if (capacity_ - r < sizeof(Record)) {
+            r = 0;  // 隐式环绕
+            continue;
+        }
+        const Record* hdr = (const Record*)(buf_ + r);
+        if (hdr->flags & FLAG_WRAP) {
+            r = 0;
+            continue;
+        }
+
+        if (r != read_pos_) read_pos_ = r;
+        *pos = r;
+        *rec = hdr;
+        return true;
+    }
+}
+
+bool MusicStore::peek(const uint8_t** data, uint16_t* len, latency_stamp_t* stamp) {
+    if (!buf_) return false;
+
+    size_t pos;
+    const Record* rec;
+    while (next_record(&pos, &rec)) {
+        if (rec->gen != gen_) {
+            consume();  // 清空前入库的记录
+            continue;
+        }
+        *data = buf_ + pos + sizeof(Record);
+        *len = rec->len;
+        *stamp = rec->stamp;
+        return true;
+    }
+    return false;
+}
+
+void MusicStore::consume() {
+    size_t pos;
+    const Record* rec;
+    if (!next_record(&pos, &rec)) return;
+
+    size_t r = pos + record_size(rec->len);
+    if (r >= capacity_) r = 0;
+
+    __sync_synchronize();  // 记录读取完成后才释放空间
+    read_pos_ = r;
+    consumed_ = consumed_ + 1;
+}
+
+void MusicStore::discard_stale() {
+    if (!buf_) return;
+
+    size_t pos;
+    const Record* rec;
+    while (next_record(&pos, &rec) && rec->gen != gen_) {
+        consume();
+    }
+}
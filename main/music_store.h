@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "task_manager.h"
+
+// 水位（占容量百分比）：超过HIGH时请求服务器暂停推流，降到LOW以下请求恢复
+#define MUSIC_STORE_HIGH_WATER_PCT 75
+#define MUSIC_STORE_LOW_WATER_PCT  40
+
+/**
+ * @brief 音乐压缩包存储 - PSRAM中的多秒级Opus包缓冲（Lock-free SPSC）
+ *
+ * - 生产者：main_ctrl（handle_ws_binary在MUSIC状态下拷贝入库，从不阻塞）
+ * - 消费者：AudioPlayout任务（抖动缓冲不足时按序取包解码）
+ * - 入库即拷贝，WS接收帧立即归还pool，突发流量不再占满POOL_S_256和播放队列
+ * - 记录4字节对齐且不跨环绕，消费者直接把记录指针交给解码器
+ * - 清空用代号实现：生产者递增代号，消费者跳过旧代号的记录，两端无需同步
+ */
+class MusicStore {
+public:
+    struct Stats {
+        uint32_t pushed;            // 入库包数
+        uint32_t rejected;          // 存储已满被拒绝的包数
+        uint32_t high_water_bytes;  // 历史最高占用
+    };
+
+    static MusicStore& instance() {
+        static MusicStore inst;
+        return inst;
+    }
+
+    /**
+     * @brief 分配PSRAM存储（capacity为0时不启用，音乐走播放队列）
+     */
+    bool init(size_t capacity_bytes);
+
+    bool is_ready() const { return buf_ != nullptr; }
+
+    // === 生产者（main_ctrl）===
+
+    /**
+     * @brief 拷入一个Opus包
+     * @return false 空间不足（水位控制正常时不应发生）
+     */
+    bool push(const uint8_t* data, uint16_t len, const latency_stamp_t& stamp);
+
+    /**
+     * @brief 丢弃已入库的所有包（消费者在下次取包时跳过）
+     */
+    void flush();
+
+    // === 消费者（AudioPlayout）===
+
+    /**
+     * @brief 查看下一个包（指针在consume()前有效）
+     */
+    bool peek(const uint8_t** data, uint16_t* len, latency_stamp_t* stamp);
+
+    void consume();
+
+    /**
+     * @brief 跳过所有已清空代号的记录（播放会话开始/结束时调用）
+     */
+    void discard_stale();
+
+    // === 统计（任意任务）===
+
+    uint32_t packets() const { return pushed_ - consumed_; }
+    size_t used_bytes() const;
+    size_t capacity() const { return capacity_; }
+    uint8_t fill_percent() const {
+        return capacity_ ? (uint8_t)(used_bytes() * 100 / capacity_) : 0;
+    }
+    Stats get_stats() const { return stats_; }
+
+private:
+    MusicStore() = default;
+
+    struct Record {
+        uint16_t len;           // Opus包长度
+        uint8_t gen;            // 入库时的代号
+        uint8_t flags;          // FLAG_WRAP：后面没有数据，回到缓冲开头
+        latency_stamp_t stamp;
+    };
+    static const uint8_t FLAG_WRAP = 0x01;
+
+    static size_t record_size(uint16_t len) {
+        return (sizeof(Record) + len + 3) & ~(size_t)3;
+    }
+
+    // 读取下一个有效记录位置（跳过环绕标记），空时返回false
+    bool next_record(size_t* pos, const Record** rec);
+
+    uint8_t* buf_ = nullptr;     // PSRAM
+    size_t capacity_ = 0;        // 4字节对齐
+    volatile size_t write_pos_ = 0;        // 仅生产者写
+    volatile size_t read_pos_ = 0;         // 仅消费者写
+    volatile uint8_t gen_ = 0;             // 仅生产者写
+    volatile uint32_t pushed_ = 0;         // 仅生产者写
+    volatile uint32_t consumed_ = 0;       // 仅消费者写
+    Stats stats_ = {};
+};
@@ -1,4 +1,5 @@
 #include "opus_decoder.h"
+#include "diagnostics.h"
 #include <esp_log.h>
 #include <cstring>
 
@@ -83,6 +84,7 @@ void OpusDecoder::reset() {
 
 int OpusDecoder::decode(const uint8_t* opus_data, size_t opus_len,
                         int16_t* pcm_out, size_t pcm_max_samples) {
+    PROFILE_SCOPE("opus_dec");
     if (!decoder_) {
         ESP_LOGE(TAG, "Decoder not initialized");
         return -1;
@@ -128,3 +130,34 @@ int OpusDecoder::decode(const uint8_t* opus_data, size_t opus_len,
 
     return samples_decoded;
 }
+
+int OpusDecoder::conceal(const uint8_t* next_data, size_t next_len,
+                         int16_t* pcm_out, size_t pcm_max_samples) {
+    PROFILE_SCOPE("opus_plc");
+    if (!decoder_ || !pcm_out || pcm_max_samples == 0) {
+        return -1;
+    }
+
+    // ESP_AUDIO_DEC_RECOVERY_PLC: with packet data the decoder uses its in-band FEC
+    // to rebuild the previous (lost) frame; with no data it runs Opus PLC
+    esp_audio_dec_in_raw_t raw = {
+        .buffer = const_cast<uint8_t*>(next_data),
+        .len = next_data ? static_cast<uint32_t>(next_len) : 0,
+        .consumed = 0,
+        .frame_recover = ESP_AUDIO_DEC_RECOVERY_PLC,
+    };
+
+    esp_audio_dec_out_frame_t out_frame = {};
+    out_frame.buffer = reinterpret_cast<uint8_t*>(pcm_out);
+    out_frame.len = static_cast<uint32_t>(pcm_max_samples * sizeof(int16_t));
+    out_frame.decoded_size = 0;
+
+    esp_audio_dec_info_t dec_info = {};
+    esp_audio_err_t ret = esp_opus_dec_decode(decoder_, &raw, &out_frame, &dec_info);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGW(TAG, "Conceal (%s) failed: error=%d", next_data ? "FEC" : "PLC", ret);
+        return -1;
+    }
+
+    return out_frame.decoded_size / sizeof(int16_t);
+}
@@ -17,6 +17,12 @@ public:
     // Returns number of PCM samples decoded (or -1 on error)
     int decode(const uint8_t* opus_data, size_t opus_len, int16_t* pcm_out, size_t pcm_max_samples);
 
+    // Conceal one lost frame.
+    // next_data != nullptr: recover from in-band FEC carried by the following packet
+    // next_data == nullptr: packet loss concealment (PLC) from decoder history
+    // Returns number of PCM samples produced (or -1 on error)
+    int conceal(const uint8_t* next_data, size_t next_len, int16_t* pcm_out, size_t pcm_max_samples);
+
     // Reset decoder state (call between sessions to clear residual state)
     void reset();
 
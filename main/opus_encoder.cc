@@ -1,4 +1,7 @@
 #include "opus_encoder.h"
+#include "diagnostics.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <esp_log.h>
 #include <string.h>
 
@@ -19,25 +22,38 @@ bool OpusEncoder::init(int sample_rate, int channels, int bitrate) {
 
     sample_rate_ = sample_rate;
     channels_ = channels;
-    bitrate_ = bitrate;
 
+    // 高复杂度 (0-10范围)，优先质量（快速说话需要）
+    Params params = {bitrate, 8, false};
+    if (!open(params)) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Opus encoder initialized: %dHz, %dch, %dbps, frame=%zu samples",
+             sample_rate, channels, bitrate, frame_size_);
+
+    return true;
+}
+
+bool OpusEncoder::open(const Params& params) {
     // 配置Opus编码器 (20ms帧, VoIP模式)
     esp_opus_enc_config_t cfg = {
-        .sample_rate = sample_rate,
-        .channel = channels,
+        .sample_rate = sample_rate_,
+        .channel = channels_,
         .bits_per_sample = 16,
-        .bitrate = bitrate,
+        .bitrate = params.bitrate,
         .frame_duration = ESP_OPUS_ENC_FRAME_DURATION_20_MS,  // 20ms帧（减少~40ms编码延迟）
         .application_mode = ESP_OPUS_ENC_APPLICATION_VOIP,
-        .complexity = 8,  // 高复杂度 (0-10范围)，优先质量（快速说话需要）
+        .complexity = params.complexity,
         .enable_fec = true,
-        .enable_dtx = false,
+        .enable_dtx = params.dtx,
         .enable_vbr = true,  // 启用VBR：快速说话时自动提升码率
     };
 
     esp_audio_err_t ret = esp_opus_enc_open(&cfg, sizeof(cfg), &encoder_);
     if (ret != ESP_AUDIO_ERR_OK || !encoder_) {
         ESP_LOGE(TAG, "Failed to open Opus encoder: %d", ret);
+        encoder_ = nullptr;
         return false;
     }
 
@@ -53,15 +69,59 @@ bool OpusEncoder::init(int sample_rate, int channels, int bitrate) {
     }
 
     // in_size是字节数，转换为样本数
-    frame_size_ = in_size / (channels * sizeof(int16_t));
+    frame_size_ = in_size / (channels_ * sizeof(int16_t));
+    params_ = params;
+    return true;
+}
 
-    ESP_LOGI(TAG, "Opus encoder initialized: %dHz, %dch, %dbps, frame=%zu samples (%d bytes)",
-             sample_rate, channels, bitrate, frame_size_, in_size);
+bool OpusEncoder::set_bitrate(int bitrate) {
+    if (!encoder_) {
+        return false;
+    }
+    if (bitrate == params_.bitrate) {
+        return true;
+    }
+    esp_audio_err_t ret = esp_opus_enc_set_bitrate(encoder_, bitrate);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGW(TAG, "Failed to set bitrate %d: %d", bitrate, ret);
+        return false;
+    }
+    params_.bitrate = bitrate;
+    return true;
+}
+
+bool OpusEncoder::apply(const Params& params, bool allow_reopen) {
+    if (!encoder_) {
+        return false;
+    }
+
+    const bool needs_reopen = params.complexity != params_.complexity || params.dtx != params_.dtx;
+    if (!needs_reopen || !allow_reopen) {
+        // 只改码率（复杂度/DTX留到下次允许重开时）
+        return set_bitrate(params.bitrate);
+    }
 
+    // 复杂度/DTX没有运行时接口：在帧边界重开编码器（丢失编码器历史，约一帧过渡）
+    Params old = params_;
+    esp_opus_enc_close(encoder_);
+    encoder_ = nullptr;
+    if (!open(params)) {
+        ESP_LOGE(TAG, "Reopen with new params failed, restoring previous");
+        if (!open(old)) {
+            // 编码器已关闭：encode()每帧用原参数重试打开，恢复前上行帧全部失败
+            ESP_LOGE(TAG, "FATAL: restoring previous encoder failed, uplink stalled until reopen succeeds");
+            reopen_pending_ = true;
+            reopen_failures_ = 0;
+        }
+        return false;
+    }
+    ESP_LOGI(TAG, "Encoder reconfigured: %dbps, complexity=%d, DTX=%s",
+             params.bitrate, params.complexity, params.dtx ? "on" : "off");
     return true;
 }
 
 void OpusEncoder::deinit() {
+    reopen_pending_ = false;
     if (encoder_) {
         esp_opus_enc_close(encoder_);
         encoder_ = nullptr;
@@ -70,9 +130,21 @@ void OpusEncoder::deinit() {
 
 int OpusEncoder::encode(const int16_t* pcm_in, size_t pcm_samples,
                         uint8_t* opus_out, size_t opus_max_len) {
+    PROFILE_SCOPE("opus_enc");
     if (!encoder_) {
-        ESP_LOGE(TAG, "Encoder not initialized");
-        return -1;
+        if (!reopen_pending_) {
+            ESP_LOGE(TAG, "Encoder not initialized");
+            return -1;
+        }
+        // apply()重开失败后的恢复（params_仍是上一次成功打开的参数）
+        if (!open(params_)) {
+            if (reopen_failures_++ % 50 == 0) {  // 约每秒一次
+                ESP_LOGE(TAG, "Encoder reopen failed (%lu attempts)", (unsigned long)reopen_failures_);
+            }
+            return -1;
+        }
+        ESP_LOGW(TAG, "Encoder reopened after %lu failed attempts", (unsigned long)reopen_failures_);
+        reopen_pending_ = false;
     }
 
     if (!pcm_in || !opus_out) {
@@ -119,3 +191,105 @@ int OpusEncoder::encode(const int16_t* pcm_in, size_t pcm_samples,
 
     return out_frame.encoded_bytes;
 }
+
+// ============================================================================
+// OpusRateController - 自适应编码档位
+// ============================================================================
+
+static const OpusEncoder::Params kProfiles[OpusRateController::PROFILE_COUNT] = {
+    {48000, 8, false},  // HIGH：快速说话识别最优
+    {32000, 5, false},  // NORMAL
+    {24000, 3, true},   // LOW：降复杂度，静音DTX
+    {16000, 1, true},   // MIN：上行严重拥塞
+};
+
+static const uint32_t STEP_DOWN_INTERVAL_MS = 500;   // 降档最小间隔
+static const uint32_t STEP_UP_HOLD_MS = 3000;        // 压力消退持续多久后升档
+
+// 各压力信号到档位的阈值（达到第i个阈值 → 至少档位i+1）
+static const uint32_t QUEUE_PCT_LEVELS[] = {38, 63, 88};           // 3/8, 5/8, 7/8
+static const uint32_t WS_LATENCY_MS_LEVELS[] = {20, 50, 100};
+static const uint32_t AFE_LOAD_PCT_LEVELS[] = {70, 80, 90};
+
+static uint8_t level_for(uint32_t value, const uint32_t (&levels)[3]) {
+    uint8_t lvl = 0;
+    while (lvl < 3 && value >= levels[lvl]) lvl++;
+    return lvl;
+}
+
+const OpusEncoder::Params& OpusRateController::params() const {
+    return kProfiles[profile_];
+}
+
+const char* OpusRateController::profile_name(Profile p) {
+    switch (p) {
+        case PROFILE_HIGH:   return "HIGH";
+        case PROFILE_NORMAL: return "NORMAL";
+        case PROFILE_LOW:    return "LOW";
+        case PROFILE_MIN:    return "MIN";
+        default:             return "?";
+    }
+}
+
+void OpusRateController::report_ws_send(uint32_t latency_us, bool ok) {
+    // 发送失败按超时计（100ms）
+    if (!ok && latency_us < 100000) latency_us = 100000;
+    // EWMA α=1/8（单写者：main_control_task）
+    ws_latency_ewma_us_ = (ws_latency_ewma_us_ * 7 + latency_us) / 8;
+}
+
+void OpusRateController::reset() {
+    profile_ = PROFILE_HIGH;
+    last_change_tick_ = 0;
+    relief_since_tick_ = 0;
+    drop_pending_ = false;
+}
+
+bool OpusRateController::update(uint32_t queue_depth, uint32_t queue_capacity, uint32_t afe_load_pct) {
+    const uint32_t queue_pct = queue_capacity ? queue_depth * 100 / queue_capacity : 0;
+    const uint32_t latency_ms = ws_latency_ms();
+
+    uint8_t target = level_for(queue_pct, QUEUE_PCT_LEVELS);
+    uint8_t lvl = level_for(latency_ms, WS_LATENCY_MS_LEVELS);
+    if (lvl > target) target = lvl;
+    lvl = level_for(afe_load_pct, AFE_LOAD_PCT_LEVELS);
+    if (lvl > target) target = lvl;
+
+    // 已经丢包：至少比当前降一档
+    if (drop_pending_) {
+        drop_pending_ = false;
+        if (target <= profile_ && profile_ < PROFILE_MIN) target = profile_ + 1;
+    }
+
+    const uint32_t now = xTaskGetTickCount();
+    Profile next = profile_;
+
+    if (target > profile_) {
+        relief_since_tick_ = 0;
+        if (last_change_tick_ == 0 ||
+            (now - last_change_tick_) * portTICK_PERIOD_MS >= STEP_DOWN_INTERVAL_MS) {
+            next = (Profile)(profile_ + 1);
+        }
+    } else if (target < profile_) {
+        if (relief_since_tick_ == 0) {
+            relief_since_tick_ = now;
+        } else if ((now - relief_since_tick_) * portTICK_PERIOD_MS >= STEP_UP_HOLD_MS) {
+            next = (Profile)(profile_ - 1);
+            relief_since_tick_ = now;  // 每次升一档后重新计时
+        }
+    } else {
+        relief_since_tick_ = 0;
+    }
+
+    if (next == profile_) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Opus profile %s -> %s (%dbps, c%d, DTX %s): queue=%lu/%lu, ws=%lums, afe=%lu%%",
+             profile_name(profile_), profile_name(next),
+             kProfiles[next].bitrate, kProfiles[next].complexity, kProfiles[next].dtx ? "on" : "off",
+             queue_depth, queue_capacity, latency_ms, afe_load_pct);
+    profile_ = next;
+    last_change_tick_ = now;
+    return true;
+}
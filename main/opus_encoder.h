@@ -7,6 +7,13 @@
 
 class OpusEncoder {
 public:
+    // 运行时可调的编码参数
+    struct Params {
+        int bitrate;      // bps
+        int complexity;   // 0-10
+        bool dtx;         // 静音时不连续传输
+    };
+
     OpusEncoder();
     ~OpusEncoder();
 
@@ -20,10 +27,92 @@ public:
     // Get expected PCM frame size for current configuration
     size_t frame_size() const { return frame_size_; }
 
+    // Change bitrate in place (encoder state preserved)
+    bool set_bitrate(int bitrate);
+
+    // Apply runtime params. Bitrate alone is changed in place; complexity/DTX
+    // require reopening the encoder (state reset), only done if allow_reopen.
+    // Returns false if nothing could be applied. If the reopen fails and the
+    // previous params cannot be restored either, encode() keeps retrying the
+    // previous params (returning -1 until it succeeds).
+    bool apply(const Params& params, bool allow_reopen);
+
+    const Params& params() const { return params_; }
+
 private:
+    bool open(const Params& params);
+
     void* encoder_ = nullptr;
     int sample_rate_ = 16000;
     int channels_ = 1;
-    int bitrate_ = 24000;
+    Params params_ = {24000, 8, false};
     size_t frame_size_ = 0;  // PCM samples per frame
+    bool reopen_pending_ = false;    // apply()未能恢复编码器，encode()重试打开
+    uint32_t reopen_failures_ = 0;
+};
+
+/**
+ * @brief 自适应Opus编码档位控制器
+ *
+ * 根据上行压力选择编码档位（码率/复杂度/DTX），用降码率代替上行丢包：
+ * - g_opus_tx_queue深度（编码级uplink_enc任务AudioUplink::encode_task每帧上报）
+ * - WebSocket发送耗时EWMA（main_control_task每次发送上报）
+ * - AFE处理负载（Core 1 CPU余量）
+ * 压力上升时每500ms最多降一档（立即生效），压力消退持续3秒后才升一档。
+ */
+class OpusRateController {
+public:
+    enum Profile : uint8_t {
+        PROFILE_HIGH = 0,    // 48kbps, c8
+        PROFILE_NORMAL,      // 32kbps, c5
+        PROFILE_LOW,         // 24kbps, c3, DTX
+        PROFILE_MIN,         // 16kbps, c1, DTX
+        PROFILE_COUNT
+    };
+
+    static OpusRateController& instance() {
+        static OpusRateController inst;
+        return inst;
+    }
+
+    /**
+     * @brief 上报一次WebSocket发送（main_control_task调用）
+     * @param latency_us 发送阻塞时间
+     * @param ok 是否发送成功
+     */
+    void report_ws_send(uint32_t latency_us, bool ok);
+
+    /**
+     * @brief 上报一次上行丢包（TX队列满）
+     */
+    void report_tx_drop() { drop_pending_ = true; }
+
+    /**
+     * @brief 根据当前压力更新档位（uplink_enc任务AudioUplink::encode_task每编码一帧调用）
+     * @param queue_depth g_opus_tx_queue当前深度
+     * @param queue_capacity g_opus_tx_queue容量
+     * @param afe_load_pct AFE处理负载（0-100+）
+     * @return 档位是否变化
+     */
+    bool update(uint32_t queue_depth, uint32_t queue_capacity, uint32_t afe_load_pct);
+
+    /**
+     * @brief 会话开始时恢复默认档位
+     */
+    void reset();
+
+    Profile profile() const { return profile_; }
+    const OpusEncoder::Params& params() const;
+    static const char* profile_name(Profile p);
+
+    uint32_t ws_latency_ms() const { return ws_latency_ewma_us_ / 1000; }
+
+private:
+    OpusRateController() = default;
+
+    Profile profile_ = PROFILE_HIGH;
+    uint32_t last_change_tick_ = 0;
+    uint32_t relief_since_tick_ = 0;      // 压力低于当前档位的起始时间（0=未消退）
+    volatile uint32_t ws_latency_ewma_us_ = 0;
+    volatile bool drop_pending_ = false;
 };
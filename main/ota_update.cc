@@ -1,6 +1,10 @@
 /**
  * @file ota_update.cc
  * @brief OTA firmware update — download via HTTP, flash to inactive partition, reboot.
+ *
+ * 下载与写入并行：ota_task读网络填充PSRAM缓冲，ota_write任务写Flash，
+ * 两块缓冲在free/full队列之间轮转。断线后用HTTP Range从已收到的字节续传，
+ * 下载限速使WebSocket会话在OTA期间保持可用。
  */
 
 #include "ota_update.h"
@@ -11,10 +15,17 @@
 #include <esp_ota_ops.h>
 #include <esp_http_client.h>
 #include <esp_websocket_client.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <esp_system.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <sdkconfig.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 // External WebSocket client from main_control_task — stop before OTA download
 // to free WiFi buffers (ESP32 minimal config can't handle concurrent connections)
@@ -26,14 +37,263 @@ static const char* TAG = "ota";
 static bool s_ota_running = false;
 static char s_ota_url[256] = {0};
 
-// Download buffer — allocated in PSRAM
+// Download buffers — allocated in PSRAM, one filled by the network while the other is flashed
 #define OTA_BUF_SIZE 8192
+#define OTA_BUF_COUNT 2
+
+typedef struct {
+    char* data;
+    int len;        // <=0: 结束标记（写入任务退出）
+} ota_chunk_t;
+
+static QueueHandle_t s_free_q = nullptr;     // 空闲缓冲（写入任务 → 下载任务）
+static QueueHandle_t s_full_q = nullptr;     // 待写缓冲（下载任务 → 写入任务）
+static SemaphoreHandle_t s_writer_done = nullptr;
+static esp_ota_handle_t s_ota_handle = 0;
+static volatile esp_err_t s_write_err = ESP_OK;
+static volatile int s_written = 0;
+
+// 下载状态（跨HTTP会话保持）
+typedef struct {
+    int received;       // 已交给写入任务的字节数 = 续传偏移
+    int image_size;     // 镜像总大小（首次响应得到，未知为-1）
+    int last_progress;
+    bool delta;         // 服务器声明的是差分镜像
+} ota_download_t;
+
+
+// ============================================================================
+// Flash写入任务
+// ============================================================================
+
+static void ota_writer_task(void* arg) {
+    ota_chunk_t chunk;
+    while (xQueueReceive(s_full_q, &chunk, portMAX_DELAY) == pdTRUE) {
+        if (chunk.len <= 0) break;
+
+        // 出错后继续归还缓冲，让下载任务尽快发现错误并退出
+        if (s_write_err == ESP_OK) {
+            esp_err_t err = esp_ota_write(s_ota_handle, chunk.data, chunk.len);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+                s_write_err = err;
+            } else {
+                s_written += chunk.len;
+            }
+        }
+        xQueueSend(s_free_q, &chunk, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_writer_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 通知写入任务退出并等待已排队的数据全部写完
+ */
+static void ota_writer_finish(void) {
+    ota_chunk_t end = {.data = nullptr, .len = 0};
+    xQueueSend(s_full_q, &end, portMAX_DELAY);
+    xSemaphoreTake(s_writer_done, portMAX_DELAY);
+}
+
+
+// ============================================================================
+// 下载（单次HTTP会话，支持Range续传）
+// ============================================================================
+
+static esp_err_t ota_http_event(esp_http_client_event_t* evt) {
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && evt->header_key && evt->header_value &&
+        strcasecmp(evt->header_key, "X-Image-Format") == 0) {
+        ota_download_t* dl = (ota_download_t*)evt->user_data;
+        dl->delta = (strcasecmp(evt->header_value, "delta") == 0);
+    }
+    return ESP_OK;
+}
 
+/**
+ * @brief 限速：按会话开始以来的字节数计算应耗时间，提前则睡眠补齐
+ */
+static void ota_throttle(int64_t session_start_us, int session_bytes) {
+#if CONFIG_ECHOEAR_OTA_RATE_KBPS > 0
+    int64_t due_us = (int64_t)session_bytes * 1000000 / (CONFIG_ECHOEAR_OTA_RATE_KBPS * 1024LL);
+    int64_t ahead_us = due_us - (esp_timer_get_time() - session_start_us);
+    if (ahead_us >= 1000) {
+        vTaskDelay(pdMS_TO_TICKS(ahead_us / 1000));
+    }
+#else
+    (void)session_start_us;
+    (void)session_bytes;
+#endif
+}
+
+static void ota_report_progress(ota_download_t* dl) {
+    if (dl->image_size <= 0) return;
+    int progress = (int)((int64_t)dl->received * 100 / dl->image_size);
+    if (progress != dl->last_progress && progress % 5 == 0) {
+        dl->last_progress = progress;
+        char status[32];
+        snprintf(status, sizeof(status), "%d%%", progress);
+        lvgl_ui_set_status(status);
+        ESP_LOGI(TAG, "OTA progress: %d%% (%d/%d, flashed %d)",
+                 progress, dl->received, dl->image_size, s_written);
+    }
+}
+
+/**
+ * @brief 从dl->received续传一段
+ * @return ESP_OK 镜像已完整收到；ESP_ERR_INVALID_RESPONSE 等不可重试错误；其他可重试
+ */
+static esp_err_t ota_download_session(ota_download_t* dl) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+
+    esp_http_client_config_t http_config = {};
+    http_config.url = s_ota_url;
+    http_config.timeout_ms = 15000;  // 可续传，卡住时尽早断开重连
+    http_config.buffer_size = OTA_BUF_SIZE;
+    http_config.buffer_size_tx = 1024;
+    http_config.keep_alive_enable = true;
+    http_config.event_handler = ota_http_event;
+    http_config.user_data = dl;
+
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to init HTTP client");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 告诉服务器当前运行的槽位和版本；本固件只接受完整镜像（服务器据此不下发差分包）
+    esp_http_client_set_header(client, "X-Running-Version", HITONY_FW_VERSION);
+    esp_http_client_set_header(client, "X-Accept-Image-Format", "full");
+    if (running) {
+        esp_http_client_set_header(client, "X-Running-Slot", running->label);
+    }
+
+    char range[32];
+    if (dl->received > 0) {
+        snprintf(range, sizeof(range), "bytes=%d-", dl->received);
+        esp_http_client_set_header(client, "Range", range);
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "HTTP open failed: %s", esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    int content_length = esp_http_client_fetch_headers(client);
+    int status_code = esp_http_client_get_status_code(client);
+    ESP_LOGI(TAG, "HTTP status=%d, content_length=%d, offset=%d", status_code, content_length, dl->received);
+
+    // 206：从offset开始；200：服务器忽略Range，从头发送，丢弃已收到的部分
+    int skip = 0;
+    if (status_code == 206 && dl->received > 0) {
+        if (dl->image_size < 0 && content_length > 0) {
+            dl->image_size = dl->received + content_length;
+        }
+    } else if (status_code == 200) {
+        skip = dl->received;
+        if (content_length > 0) {
+            if (dl->image_size > 0 && content_length != dl->image_size) {
+                ESP_LOGE(TAG, "Image size changed (%d -> %d), aborting", dl->image_size, content_length);
+                err = ESP_ERR_INVALID_RESPONSE;
+                goto out;
+            }
+            dl->image_size = content_length;
+        }
+    } else if (status_code == 416 && dl->image_size > 0 && dl->received >= dl->image_size) {
+        err = ESP_OK;  // 上次会话已收完全部数据，只是未收到结束标志
+        goto out;
+    } else {
+        ESP_LOGE(TAG, "HTTP error: status %d", status_code);
+        err = (status_code >= 400 && status_code < 500) ? ESP_ERR_INVALID_RESPONSE : ESP_FAIL;
+        goto out;
+    }
+
+    if (dl->delta) {
+        // 不可重试：写入前拒绝，OTA槽位保持不变
+        ESP_LOGE(TAG, "Server sent a delta image (X-Image-Format: delta); this firmware only "
+                      "accepts full images, aborting update");
+        err = ESP_ERR_NOT_SUPPORTED;
+        goto out;
+    }
+
+    {
+        int64_t session_start_us = esp_timer_get_time();
+        int session_bytes = 0;
+        ota_chunk_t chunk = {.data = nullptr, .len = 0};
+        err = ESP_FAIL;
+
+        while (s_write_err == ESP_OK) {
+            if (!chunk.data) {
+                xQueueReceive(s_free_q, &chunk, portMAX_DELAY);
+                chunk.len = 0;
+            }
+
+            int read_len = esp_http_client_read(client, chunk.data + chunk.len, OTA_BUF_SIZE - chunk.len);
+            if (read_len < 0) {
+                ESP_LOGW(TAG, "HTTP read error at %d bytes", dl->received + chunk.len);
+                break;
+            }
+            if (read_len == 0) {
+                if (esp_http_client_is_complete_data_received(client)) {
+                    err = ESP_OK;
+                } else {
+                    ESP_LOGW(TAG, "Connection closed prematurely at %d bytes", dl->received + chunk.len);
+                }
+                break;
+            }
+            session_bytes += read_len;
+
+            // 服务器不支持Range时跳过已写入的前缀
+            if (skip > 0) {
+                int drop = read_len < skip ? read_len : skip;
+                skip -= drop;
+                read_len -= drop;
+                memmove(chunk.data + chunk.len, chunk.data + chunk.len + drop, read_len);
+            }
+            chunk.len += read_len;
+
+            if (chunk.len == OTA_BUF_SIZE) {
+                dl->received += chunk.len;
+                xQueueSend(s_full_q, &chunk, portMAX_DELAY);
+                chunk.data = nullptr;
+                ota_report_progress(dl);
+            }
+            ota_throttle(session_start_us, session_bytes);
+        }
+
+        // 未满的缓冲：正常结束或出错时都把已收到的数据交给写入任务，续传从其后开始
+        if (chunk.data) {
+            if (chunk.len > 0 && s_write_err == ESP_OK) {
+                dl->received += chunk.len;
+                xQueueSend(s_full_q, &chunk, portMAX_DELAY);
+            } else {
+                xQueueSend(s_free_q, &chunk, portMAX_DELAY);
+            }
+        }
+        if (s_write_err != ESP_OK) {
+            err = ESP_ERR_INVALID_STATE;
+        }
+        ota_report_progress(dl);
+    }
+
+out:
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+
+// ============================================================================
+// OTA主任务
+// ============================================================================
 
 static void ota_task(void* arg) {
     ESP_LOGI(TAG, "OTA update starting: %s", s_ota_url);
     lvgl_ui_set_status("Updating...");
 
+#if !CONFIG_ECHOEAR_OTA_KEEP_WS
     // Stop WebSocket to free WiFi buffers for HTTP download
     // ESP32 with minimal WiFi config can't handle concurrent TCP connections reliably
     if (g_ws_client) {
@@ -43,9 +303,13 @@ static void ota_task(void* arg) {
         vTaskDelay(pdMS_TO_TICKS(500));  // Let WiFi stack settle
         ESP_LOGI(TAG, "WebSocket stopped, proceeding with download");
     }
+#endif
 
     esp_err_t err;
-    esp_ota_handle_t ota_handle = 0;
+    char* bufs[OTA_BUF_COUNT] = {};
+    bool writer_started = false;
+    ota_download_t dl = {.received = 0, .image_size = -1, .last_progress = -1, .delta = false};
+    int attempts = 0;
     const esp_partition_t* update_partition = esp_ota_get_next_update_partition(NULL);
 
     if (!update_partition) {
@@ -59,156 +323,117 @@ static void ota_task(void* arg) {
              (unsigned long)update_partition->address,
              (unsigned long)update_partition->size);
 
-    // Configure HTTP client
-    {
-        esp_http_client_config_t http_config = {};
-        http_config.url = s_ota_url;
-        http_config.timeout_ms = 60000;  // 60s timeout for large firmware files
-        http_config.buffer_size = OTA_BUF_SIZE;
-        http_config.buffer_size_tx = 1024;
-        http_config.keep_alive_enable = true;
-
-        esp_http_client_handle_t client = esp_http_client_init(&http_config);
-        if (!client) {
-            ESP_LOGE(TAG, "Failed to init HTTP client");
-            lvgl_ui_set_status("HTTP error");
-            goto fail;
-        }
-
-        err = esp_http_client_open(client, 0);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "HTTP open failed: %s", esp_err_to_name(err));
-            lvgl_ui_set_status("Connect failed");
-            esp_http_client_cleanup(client);
-            goto fail;
-        }
-
-        int content_length = esp_http_client_fetch_headers(client);
-        int status_code = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "HTTP status=%d, content_length=%d", status_code, content_length);
-
-        if (status_code != 200) {
-            ESP_LOGE(TAG, "HTTP error: status %d", status_code);
-            lvgl_ui_set_status("Server error");
-            esp_http_client_close(client);
-            esp_http_client_cleanup(client);
-            goto fail;
-        }
-
-        // Begin OTA write
-        err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
-            lvgl_ui_set_status("Flash error");
-            esp_http_client_close(client);
-            esp_http_client_cleanup(client);
-            goto fail;
-        }
+    s_free_q = xQueueCreate(OTA_BUF_COUNT, sizeof(ota_chunk_t));
+    s_full_q = xQueueCreate(OTA_BUF_COUNT + 1, sizeof(ota_chunk_t));  // +1：结束标记
+    s_writer_done = xSemaphoreCreateBinary();
+    if (!s_free_q || !s_full_q || !s_writer_done) {
+        ESP_LOGE(TAG, "Failed to create OTA queues");
+        goto fail;
+    }
 
-        // Download and write in chunks
-        char* buf = (char*)heap_caps_malloc(OTA_BUF_SIZE, MALLOC_CAP_SPIRAM);
-        if (!buf) {
-            buf = (char*)malloc(OTA_BUF_SIZE);
+    for (int i = 0; i < OTA_BUF_COUNT; i++) {
+        bufs[i] = (char*)heap_caps_malloc(OTA_BUF_SIZE, MALLOC_CAP_SPIRAM);
+        if (!bufs[i]) {
+            bufs[i] = (char*)malloc(OTA_BUF_SIZE);
         }
-        if (!buf) {
+        if (!bufs[i]) {
             ESP_LOGE(TAG, "Failed to allocate download buffer");
-            esp_ota_abort(ota_handle);
-            esp_http_client_close(client);
-            esp_http_client_cleanup(client);
             goto fail;
         }
+        ota_chunk_t chunk = {.data = bufs[i], .len = 0};
+        xQueueSend(s_free_q, &chunk, 0);
+    }
 
-        int total_read = 0;
-        int last_progress = -1;
-        int read_retries = 0;
-        while (true) {
-            int read_len = esp_http_client_read(client, buf, OTA_BUF_SIZE);
-            if (read_len < 0) {
-                read_retries++;
-                ESP_LOGW(TAG, "HTTP read error (retry %d/3, downloaded %d bytes so far)", read_retries, total_read);
-                if (read_retries >= 3) {
-                    ESP_LOGE(TAG, "HTTP read failed after 3 retries, aborting OTA");
-                    err = ESP_FAIL;
-                    break;
-                }
-                vTaskDelay(pdMS_TO_TICKS(1000));  // Wait 1s before retry
-                continue;
-            }
-            read_retries = 0;  // Reset retry counter on success
-
-            if (read_len == 0) {
-                // Connection closed or transfer complete
-                if (esp_http_client_is_complete_data_received(client)) {
-                    ESP_LOGI(TAG, "Download complete: %d bytes", total_read);
-                } else {
-                    ESP_LOGW(TAG, "Connection closed prematurely at %d bytes", total_read);
-                    err = ESP_FAIL;
-                }
-                break;
-            }
-
-            err = esp_ota_write(ota_handle, buf, read_len);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
-                break;
-            }
-
-            total_read += read_len;
-
-            // Update progress on LCD (every 5%)
-            if (content_length > 0) {
-                int progress = (total_read * 100) / content_length;
-                if (progress != last_progress && progress % 5 == 0) {
-                    last_progress = progress;
-                    char status[32];
-                    snprintf(status, sizeof(status), "%d%%", progress);
-                    lvgl_ui_set_status(status);
-                    ESP_LOGI(TAG, "OTA progress: %d%% (%d/%d)", progress, total_read, content_length);
-                }
-            }
+    // Begin OTA write
+    err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &s_ota_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        lvgl_ui_set_status("Flash error");
+        goto fail;
+    }
+    s_write_err = ESP_OK;
+    s_written = 0;
 
-            // Yield to other tasks periodically
-            if (total_read % (OTA_BUF_SIZE * 8) == 0) {
-                vTaskDelay(pdMS_TO_TICKS(10));
-            }
+    if (xTaskCreate(ota_writer_task, "ota_write", 4096, NULL, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create OTA writer task");
+        esp_ota_abort(s_ota_handle);
+        goto fail;
+    }
+    writer_started = true;
+
+    // Download with resume: each session continues from the last byte handed to the writer
+    while (true) {
+        int before = dl.received;
+        err = ota_download_session(&dl);
+        if (err == ESP_OK) break;
+        if (err == ESP_ERR_INVALID_RESPONSE || err == ESP_ERR_NOT_SUPPORTED ||
+            err == ESP_ERR_INVALID_STATE) {
+            break;  // 不可重试：服务器拒绝/镜像格式不支持/Flash写入失败
         }
 
-        free(buf);
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-
-        if (err != ESP_OK) {
-            esp_ota_abort(ota_handle);
-            lvgl_ui_set_status("Write error");
-            goto fail;
+        if (dl.received > before) attempts = 0;  // 有进展则重置重试计数
+        if (++attempts > CONFIG_ECHOEAR_OTA_RESUME_RETRIES) {
+            ESP_LOGE(TAG, "Download failed after %d resume attempts at %d bytes", attempts - 1, dl.received);
+            break;
         }
+        int backoff_ms = 1000 << (attempts - 1 < 3 ? attempts - 1 : 3);
+        ESP_LOGW(TAG, "Resuming download at %d bytes in %dms (attempt %d/%d)",
+                 dl.received, backoff_ms, attempts, CONFIG_ECHOEAR_OTA_RESUME_RETRIES);
+        lvgl_ui_set_status("Resuming...");
+        vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+    }
 
-        // Finalize OTA
-        err = esp_ota_end(ota_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
-            if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-                ESP_LOGE(TAG, "Image validation failed — corrupt download?");
-            }
-            lvgl_ui_set_status("Verify failed");
-            goto fail;
-        }
+    // 等待写入任务写完已排队的缓冲
+    ota_writer_finish();
+    writer_started = false;
+    if (err == ESP_OK && s_write_err != ESP_OK) {
+        err = s_write_err;
+    }
 
-        // Set boot partition
-        err = esp_ota_set_boot_partition(update_partition);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
-            lvgl_ui_set_status("Boot failed");
-            goto fail;
+    if (err != ESP_OK) {
+        esp_ota_abort(s_ota_handle);
+        lvgl_ui_set_status(s_write_err != ESP_OK ? "Write error" :
+                           dl.delta ? "Bad image" : "Download failed");
+        goto fail;
+    }
+    ESP_LOGI(TAG, "Download complete: %d bytes", dl.received);
+
+    // Finalize OTA
+    err = esp_ota_end(s_ota_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            ESP_LOGE(TAG, "Image validation failed — corrupt download?");
         }
+        lvgl_ui_set_status("Verify failed");
+        goto fail;
+    }
 
-        ESP_LOGI(TAG, "OTA update successful! Firmware size: %d bytes. Rebooting in 2s...", total_read);
-        lvgl_ui_set_status("Rebooting...");
-        vTaskDelay(pdMS_TO_TICKS(2000));
-        esp_restart();
+    // Set boot partition
+    err = esp_ota_set_boot_partition(update_partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        lvgl_ui_set_status("Boot failed");
+        goto fail;
     }
 
+    ESP_LOGI(TAG, "OTA update successful! Firmware size: %d bytes. Rebooting in 2s...", s_written);
+    lvgl_ui_set_status("Rebooting...");
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+
 fail:
+    if (writer_started) {
+        ota_writer_finish();
+        esp_ota_abort(s_ota_handle);
+    }
+    for (int i = 0; i < OTA_BUF_COUNT; i++) {
+        free(bufs[i]);
+    }
+    if (s_free_q) { vQueueDelete(s_free_q); s_free_q = nullptr; }
+    if (s_full_q) { vQueueDelete(s_full_q); s_full_q = nullptr; }
+    if (s_writer_done) { vSemaphoreDelete(s_writer_done); s_writer_done = nullptr; }
+
     s_ota_running = false;
     vTaskDelay(pdMS_TO_TICKS(5000));
     lvgl_ui_set_status("Ready");
@@ -5,16 +5,27 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <string.h>
+#include <stdio.h>
 
 static const char* TAG = "sys_monitor";
 
+static const char* const kLatencyStageNames[] = {
+    "capture_to_afe",
+    "afe_to_encode",
+    "encode_to_ws",
+    "uplink_total",
+    "ws_to_decode",
+    "decode_to_play",
+    "downlink_total",
+};
+
 bool SystemMonitor::init() {
     ESP_LOGI(TAG, "Initializing system monitor");
 
     // 初始化统计数据
     memset(&cpu_stats_, 0, sizeof(cpu_stats_));
     memset(&memory_stats_, 0, sizeof(memory_stats_));
-    memset(&audio_latency_, 0, sizeof(audio_latency_));
+    reset_latency();
     memset(&network_stats_, 0, sizeof(network_stats_));
 
     return true;
@@ -29,7 +40,7 @@ bool SystemMonitor::start() {
     BaseType_t ret = xTaskCreatePinnedToCore(
         monitor_task,
         "sys_monitor",
-        2048,  // 减小到2KB节省内存
+        3072,  // 包含uxTaskGetSystemState采样
         this,
         5,  // 中等优先级
         &monitor_task_handle_,
@@ -73,27 +84,23 @@ void SystemMonitor::monitor_task(void* arg) {
 }
 
 void SystemMonitor::update_stats() {
-    // 更新内存统计
-    memory_stats_.internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
-    memory_stats_.internal_total = heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
-    memory_stats_.psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
-    memory_stats_.psram_total = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
-    memory_stats_.largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
-
-    if (memory_stats_.internal_total > 0) {
-        memory_stats_.internal_usage =
-            (1.0f - (float)memory_stats_.internal_free / memory_stats_.internal_total) * 100.0f;
+    // 更新内存统计（含各capability最大块历史最小值）
+    fill_memory_stats(memory_stats_);
+
+    // 每分钟记录一次内部RAM最大块（5s × 12）
+    if (largest_history_ticks_++ % 12 == 0) {
+        largest_history_[largest_history_next_] = memory_stats_.largest_free_block;
+        largest_history_next_ = (largest_history_next_ + 1) % LARGEST_HISTORY;
+        if (largest_history_count_ < LARGEST_HISTORY) largest_history_count_++;
     }
 
-    if (memory_stats_.psram_total > 0) {
-        memory_stats_.psram_usage =
-            (1.0f - (float)memory_stats_.psram_free / memory_stats_.psram_total) * 100.0f;
+    // CPU使用率：FreeRTOS运行时间统计，每核 = 100% - IDLE任务占比
+    TaskManager& tm = TaskManager::instance();
+    if (tm.sample_cpu()) {
+        uint32_t window_ms;
+        tm.get_cpu_usage(cpu_stats_.core0_usage, cpu_stats_.core1_usage);
+        tm.get_idle_time(cpu_stats_.idle_time_core0, cpu_stats_.idle_time_core1, window_ms);
     }
-
-    // CPU使用率需要基于任务运行时间计算
-    // 这里简化处理，可以后续使用FreeRTOS的vTaskGetRunTimeStats优化
-    cpu_stats_.core0_usage = 0.0f;  // TODO: 实现真实的CPU使用率
-    cpu_stats_.core1_usage = 0.0f;
 }
 
 SystemMonitor::CpuStats SystemMonitor::get_cpu_stats() {
@@ -103,23 +110,71 @@ SystemMonitor::CpuStats SystemMonitor::get_cpu_stats() {
 SystemMonitor::MemoryStats SystemMonitor::get_memory_stats() {
     // 实时更新
     MemoryStats stats;
-    stats.internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    fill_memory_stats(stats);
+    return stats;
+}
+
+static const uint32_t kHeapCaps[(int)SystemMonitor::HeapCap::COUNT] = {
+    MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_SPIRAM,
+    MALLOC_CAP_DMA,
+};
+
+static const char* const kHeapCapNames[(int)SystemMonitor::HeapCap::COUNT] = {
+    "internal",
+    "psram",
+    "dma",
+};
+
+const char* SystemMonitor::heap_cap_name(HeapCap cap) {
+    return cap < HeapCap::COUNT ? kHeapCapNames[(int)cap] : "?";
+}
+
+void SystemMonitor::fill_memory_stats(MemoryStats& stats) {
+    const uint32_t now_s = (uint32_t)(esp_timer_get_time() / 1000000);
+
+    for (int i = 0; i < (int)HeapCap::COUNT; i++) {
+        HeapCapStats& c = stats.caps[i];
+        c.free = heap_caps_get_free_size(kHeapCaps[i]);
+        c.largest_block = heap_caps_get_largest_free_block(kHeapCaps[i]);
+        c.free_min = heap_caps_get_minimum_free_size(kHeapCaps[i]);
+        c.fragmentation = c.free > 0 ? (1.0f - (float)c.largest_block / c.free) * 100.0f : 0.0f;
+
+        // 历史最小值（0 = 尚未采样），CAS保证多个任务同时读取时只保留更小的值
+        uint32_t prev = __atomic_load_n(&largest_min_[i], __ATOMIC_RELAXED);
+        while ((prev == 0 || c.largest_block < prev) &&
+               !__atomic_compare_exchange_n(&largest_min_[i], &prev, c.largest_block, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+        if (prev == 0 || c.largest_block < prev) {
+            largest_min_at_s_[i] = now_s;
+        }
+        c.largest_min = largest_min_[i];
+        c.largest_min_at_s = largest_min_at_s_[i];
+    }
+
+    const HeapCapStats& in = stats.caps[(int)HeapCap::INTERNAL];
+    const HeapCapStats& ps = stats.caps[(int)HeapCap::PSRAM];
+    stats.internal_free = in.free;
     stats.internal_total = heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
-    stats.psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    stats.psram_free = ps.free;
     stats.psram_total = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
-    stats.largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    stats.largest_free_block = in.largest_block;
 
-    if (stats.internal_total > 0) {
-        stats.internal_usage =
-            (1.0f - (float)stats.internal_free / stats.internal_total) * 100.0f;
-    }
+    stats.internal_usage = stats.internal_total > 0 ?
+        (1.0f - (float)stats.internal_free / stats.internal_total) * 100.0f : 0.0f;
+    stats.psram_usage = stats.psram_total > 0 ?
+        (1.0f - (float)stats.psram_free / stats.psram_total) * 100.0f : 0.0f;
+}
 
-    if (stats.psram_total > 0) {
-        stats.psram_usage =
-            (1.0f - (float)stats.psram_free / stats.psram_total) * 100.0f;
+int SystemMonitor::get_largest_block_history(uint32_t* out, int max_count) {
+    if (!out || max_count <= 0) return 0;
+    int n = largest_history_count_ < max_count ? largest_history_count_ : max_count;
+    int start = (largest_history_next_ - n + LARGEST_HISTORY) % LARGEST_HISTORY;
+    for (int i = 0; i < n; i++) {
+        out[i] = largest_history_[(start + i) % LARGEST_HISTORY];
     }
-
-    return stats;
+    return n;
 }
 
 void SystemMonitor::get_queue_stats(QueueStats* stats, size_t max_count, size_t* actual_count) {
@@ -139,7 +194,15 @@ void SystemMonitor::get_queue_stats(QueueStats* stats, size_t max_count, size_t*
 }
 
 SystemMonitor::AudioLatencyStats SystemMonitor::get_audio_latency() {
-    return audio_latency_;
+    AudioLatencyStats stats;
+    stats.capture_to_afe_ms = get_latency_percentiles(LatencyStage::CAPTURE_TO_AFE).p50_us / 1000;
+    stats.afe_to_encode_ms = get_latency_percentiles(LatencyStage::AFE_TO_ENCODE).p50_us / 1000;
+    stats.encode_to_ws_ms = get_latency_percentiles(LatencyStage::ENCODE_TO_WS).p50_us / 1000;
+    stats.ws_to_decode_ms = get_latency_percentiles(LatencyStage::WS_TO_DECODE).p50_us / 1000;
+    stats.decode_to_play_ms = get_latency_percentiles(LatencyStage::DECODE_TO_PLAY).p50_us / 1000;
+    stats.total_latency_ms = get_latency_percentiles(LatencyStage::UPLINK_TOTAL).p50_us / 1000;
+    stats.downlink_latency_ms = get_latency_percentiles(LatencyStage::DOWNLINK_TOTAL).p50_us / 1000;
+    return stats;
 }
 
 SystemMonitor::NetworkStats SystemMonitor::get_network_stats() {
@@ -190,6 +253,22 @@ void SystemMonitor::print_system_report() {
     ESP_LOGI(TAG, "  PSRAM:    %lu / %lu bytes (%.1f%% used)",
              mem.psram_total - mem.psram_free, mem.psram_total,
              mem.psram_usage);
+    for (int i = 0; i < (int)HeapCap::COUNT; i++) {
+        const HeapCapStats& c = mem.caps[i];
+        ESP_LOGI(TAG, "  %-8s  free=%lu (min %lu), largest=%lu (min %lu @%lus), frag=%.0f%%",
+                 kHeapCapNames[i], c.free, c.free_min, c.largest_block,
+                 c.largest_min, c.largest_min_at_s, c.fragmentation);
+    }
+    uint32_t history[LARGEST_HISTORY];
+    int history_n = get_largest_block_history(history, LARGEST_HISTORY);
+    if (history_n > 1) {
+        char line[LARGEST_HISTORY * 8 + 1];
+        int len = 0;
+        for (int i = 0; i < history_n && len < (int)sizeof(line); i++) {
+            len += snprintf(line + len, sizeof(line) - len, " %lu", history[i] / 1024);
+        }
+        ESP_LOGI(TAG, "  Internal largest block trend (KB/min):%s", line);
+    }
 
     // CPU报告
     CpuStats cpu = get_cpu_stats();
@@ -211,6 +290,20 @@ void SystemMonitor::print_system_report() {
         }
     }
 
+    // 音频延迟报告（us）
+    bool latency_header = false;
+    for (int i = 0; i < LAT_STAGES; i++) {
+        LatencyPercentiles p = get_latency_percentiles((LatencyStage)i);
+        if (p.count == 0) continue;
+        if (!latency_header) {
+            ESP_LOGI(TAG, "Audio latency (us):");
+            latency_header = true;
+        }
+        ESP_LOGI(TAG, "  %-14s n=%-6lu p50=%-7lu p95=%-7lu p99=%-7lu max=%-7lu seq=%lu",
+                 kLatencyStageNames[i], p.count, p.p50_us, p.p95_us, p.p99_us,
+                 p.max_us, p.last_seq);
+    }
+
     // 健康状态
     HealthStatus health = get_health_status();
     const char* health_str[] = {"EXCELLENT", "GOOD", "WARNING", "CRITICAL"};
@@ -241,7 +334,97 @@ void SystemMonitor::record_queue_usage(const char* name, uint32_t current, uint3
     }
 }
 
-void SystemMonitor::record_audio_timestamp(const char* stage) {
-    // TODO: 实现音频时间戳记录用于延迟计算
-    // 可以使用环形缓冲区记录每个阶段的时间戳
+// ============================================================================
+// 音频延迟直方图
+// ============================================================================
+
+int SystemMonitor::latency_bucket(uint32_t us) {
+    if (us < (LAT_LINEAR_BUCKETS << 6)) {
+        return us >> 6;
+    }
+    const int e = 31 - __builtin_clz(us);  // ≥10
+    const int octave = e - 10;
+    if (octave >= LAT_OCTAVES) {
+        return LAT_BUCKETS - 1;
+    }
+    const int sub = (us >> (e - 2)) & (LAT_SUB_BUCKETS - 1);
+    return LAT_LINEAR_BUCKETS + octave * LAT_SUB_BUCKETS + sub;
+}
+
+uint32_t SystemMonitor::latency_bucket_upper(int bucket) {
+    if (bucket < LAT_LINEAR_BUCKETS) {
+        return (uint32_t)(bucket + 1) << 6;
+    }
+    const int octave = (bucket - LAT_LINEAR_BUCKETS) / LAT_SUB_BUCKETS;
+    const int sub = (bucket - LAT_LINEAR_BUCKETS) % LAT_SUB_BUCKETS;
+    const int e = octave + 10;
+    return (1u << e) + (uint32_t)(sub + 1) * (1u << (e - 2));
+}
+
+void SystemMonitor::record_latency(LatencyStage stage, uint32_t latency_us, uint32_t seq) {
+    if (stage >= LatencyStage::COUNT || (int32_t)latency_us < 0) {
+        return;  // 时间戳乱序（负延迟）不计入
+    }
+    LatencyHistogram& h = latency_[(int)stage];
+    __atomic_fetch_add(&h.buckets[latency_bucket(latency_us)], 1, __ATOMIC_RELAXED);
+    uint32_t prev = __atomic_load_n(&h.max_us, __ATOMIC_RELAXED);
+    while (latency_us > prev &&
+           !__atomic_compare_exchange_n(&h.max_us, &prev, latency_us, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    __atomic_store_n(&h.last_seq, seq, __ATOMIC_RELAXED);
+}
+
+SystemMonitor::LatencyPercentiles SystemMonitor::get_latency_percentiles(LatencyStage stage) {
+    LatencyPercentiles p = {};
+    if (stage >= LatencyStage::COUNT) {
+        return p;
+    }
+    const LatencyHistogram& h = latency_[(int)stage];
+
+    // 快照（与写入并发时各桶可能有±1的偏差，不影响分位数）
+    uint32_t snap[LAT_BUCKETS];
+    uint32_t total = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        snap[i] = __atomic_load_n(&h.buckets[i], __ATOMIC_RELAXED);
+        total += snap[i];
+    }
+    p.count = total;
+    p.max_us = __atomic_load_n(&h.max_us, __ATOMIC_RELAXED);
+    p.last_seq = __atomic_load_n(&h.last_seq, __ATOMIC_RELAXED);
+    if (total == 0) {
+        return p;
+    }
+
+    const uint32_t rank50 = (total * 50 + 99) / 100;
+    const uint32_t rank95 = (total * 95 + 99) / 100;
+    const uint32_t rank99 = (total * 99 + 99) / 100;
+    uint32_t cum = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        if (snap[i] == 0) continue;
+        cum += snap[i];
+        uint32_t upper = latency_bucket_upper(i);
+        if (upper > p.max_us) upper = p.max_us;
+        if (!p.p50_us && cum >= rank50) p.p50_us = upper;
+        if (!p.p95_us && cum >= rank95) p.p95_us = upper;
+        if (!p.p99_us && cum >= rank99) {
+            p.p99_us = upper;
+            break;
+        }
+    }
+    return p;
+}
+
+void SystemMonitor::reset_latency() {
+    for (int s = 0; s < LAT_STAGES; s++) {
+        LatencyHistogram& h = latency_[s];
+        for (int i = 0; i < LAT_BUCKETS; i++) {
+            __atomic_store_n(&h.buckets[i], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&h.max_us, 0, __ATOMIC_RELAXED);
+    }
+}
+
+const char* SystemMonitor::latency_stage_name(LatencyStage stage) {
+    return stage < LatencyStage::COUNT ? kLatencyStageNames[(int)stage] : "unknown";
 }
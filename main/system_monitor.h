@@ -2,7 +2,10 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <esp_timer.h>
 #include <cstdint>
+#include <cstddef>
+#include "task_manager.h"
 
 /**
  * @brief 系统监控器 - 实时性能和健康状态监控
@@ -29,21 +32,43 @@ public:
     struct CpuStats {
         float core0_usage;      // Core 0 使用率 (0-100%)
         float core1_usage;      // Core 1 使用率 (0-100%)
-        uint32_t idle_time_core0;
+        uint32_t idle_time_core0;  // 最近采样窗口内IDLE任务运行时间（ms）
         uint32_t idle_time_core1;
     };
 
+    // 按heap capability分类
+    enum class HeapCap : uint8_t {
+        INTERNAL = 0,   // MALLOC_CAP_INTERNAL
+        PSRAM,          // MALLOC_CAP_SPIRAM
+        DMA,            // MALLOC_CAP_DMA（I2S/LCD/WiFi缓冲，只能在内部RAM）
+        COUNT
+    };
+
+    // 单个capability的碎片化统计
+    struct HeapCapStats {
+        uint32_t free;              // 空闲字节
+        uint32_t largest_block;     // 当前最大可分配块
+        uint32_t largest_min;       // 最大块历史最小值（开机以来）
+        uint32_t largest_min_at_s;  // 历史最小值出现时的运行时间 (s)
+        uint32_t free_min;          // 空闲字节历史最小值（heap_caps_get_minimum_free_size）
+        float fragmentation;        // 碎片率 = 1 - 最大块/空闲 (0-100%)
+    };
+
     // 内存统计
     struct MemoryStats {
         uint32_t internal_free;     // 内部RAM空闲 (bytes)
         uint32_t internal_total;    // 内部RAM总量
         uint32_t psram_free;        // PSRAM空闲
         uint32_t psram_total;       // PSRAM总量
-        uint32_t largest_free_block;
+        uint32_t largest_free_block;  // 内部RAM最大可分配块
         float internal_usage;       // 内部RAM使用率 (0-100%)
         float psram_usage;          // PSRAM使用率 (0-100%)
+        HeapCapStats caps[(int)HeapCap::COUNT];
     };
 
+    // 内部RAM最大块趋势：每分钟一个采样，保留最近LARGEST_HISTORY个（长时间运行的碎片化趋势）
+    static const int LARGEST_HISTORY = 12;
+
     // 队列统计
     struct QueueStats {
         const char* name;
@@ -53,14 +78,37 @@ public:
         float usage;                // 使用率 (0-100%)
     };
 
-    // 音频延迟统计
+    // 音频流水线延迟阶段（每级由单一任务记录）
+    enum class LatencyStage : uint8_t {
+        CAPTURE_TO_AFE,     // I2S读取 → AFE fetch输出（afe_task）
+        AFE_TO_ENCODE,      // AFE输出 → Opus编码完成（编码级）
+        ENCODE_TO_WS,       // 编码完成 → esp_websocket_client_send_bin返回（main_ctrl）
+        UPLINK_TOTAL,       // I2S读取 → WS发送完成
+        WS_TO_DECODE,       // WS收到 → Opus解码进抖动缓冲（audio_play）
+        DECODE_TO_PLAY,     // 解码 → 首个样本写入I2S DMA（audio_play）
+        DOWNLINK_TOTAL,     // WS收到 → 写入I2S DMA
+        COUNT
+    };
+
+    // 单级延迟分位数（us，桶上界近似，相对误差≤25%）
+    struct LatencyPercentiles {
+        uint32_t count;
+        uint32_t p50_us;
+        uint32_t p95_us;
+        uint32_t p99_us;
+        uint32_t max_us;
+        uint32_t last_seq;      // 最近一次记录的序号
+    };
+
+    // 音频延迟统计（各级p50）
     struct AudioLatencyStats {
         uint32_t capture_to_afe_ms;     // 采集到AFE延迟
         uint32_t afe_to_encode_ms;      // AFE到编码延迟
         uint32_t encode_to_ws_ms;       // 编码到WebSocket延迟
         uint32_t ws_to_decode_ms;       // WebSocket到解码延迟
         uint32_t decode_to_play_ms;     // 解码到播放延迟
-        uint32_t total_latency_ms;      // 总延迟
+        uint32_t total_latency_ms;      // 总延迟（上行：采集到WebSocket）
+        uint32_t downlink_latency_ms;   // 下行总延迟（WebSocket到播放）
     };
 
     // 网络统计
@@ -105,6 +153,14 @@ public:
      */
     MemoryStats get_memory_stats();
 
+    /**
+     * @brief 内部RAM最大块趋势（由旧到新）
+     * @return 有效采样数（≤LARGEST_HISTORY）
+     */
+    int get_largest_block_history(uint32_t* out, int max_count);
+
+    static const char* heap_cap_name(HeapCap cap);
+
     /**
      * @brief 获取所有队列统计
      */
@@ -136,9 +192,24 @@ public:
     void record_queue_usage(const char* name, uint32_t current, uint32_t max);
 
     /**
-     * @brief 记录音频时间戳（用于延迟计算）
+     * @brief 记录一次阶段延迟（无锁，任意任务/核调用）
+     */
+    void record_latency(LatencyStage stage, uint32_t latency_us, uint32_t seq);
+
+    /**
+     * @brief 获取单级延迟分位数（自上次reset_latency以来）
+     */
+    LatencyPercentiles get_latency_percentiles(LatencyStage stage);
+
+    /**
+     * @brief 清空延迟直方图（开始新的统计窗口）
+     */
+    void reset_latency();
+
+    /**
+     * @brief 阶段名称（日志/遥测键名）
      */
-    void record_audio_timestamp(const char* stage);
+    static const char* latency_stage_name(LatencyStage stage);
 
 private:
     SystemMonitor() = default;
@@ -149,9 +220,35 @@ private:
     // 内部统计
     CpuStats cpu_stats_ = {};
     MemoryStats memory_stats_ = {};
-    AudioLatencyStats audio_latency_ = {};
     NetworkStats network_stats_ = {};
 
+    // 碎片化追踪：各capability最大块/空闲的历史最小值（任意任务读取内存统计时更新）
+    volatile uint32_t largest_min_[(int)HeapCap::COUNT] = {};
+    volatile uint32_t largest_min_at_s_[(int)HeapCap::COUNT] = {};
+    uint32_t largest_history_[LARGEST_HISTORY] = {};
+    int largest_history_count_ = 0;
+    int largest_history_next_ = 0;
+    uint32_t largest_history_ticks_ = 0;  // update_stats次数（每12次 = 1分钟采样一次）
+
+    void fill_memory_stats(MemoryStats& stats);
+
+    // 延迟直方图：<1ms按64us线性分桶，1ms以上每倍程4个子桶（至~4s）
+    static const int LAT_LINEAR_BUCKETS = 16;
+    static const int LAT_SUB_BUCKETS = 4;
+    static const int LAT_OCTAVES = 12;
+    static const int LAT_BUCKETS = LAT_LINEAR_BUCKETS + LAT_OCTAVES * LAT_SUB_BUCKETS;
+    static const int LAT_STAGES = (int)LatencyStage::COUNT;
+
+    struct LatencyHistogram {
+        uint32_t buckets[LAT_BUCKETS];
+        uint32_t max_us;
+        uint32_t last_seq;
+    };
+    LatencyHistogram latency_[LAT_STAGES] = {};
+
+    static int latency_bucket(uint32_t us);
+    static uint32_t latency_bucket_upper(int bucket);
+
     // 队列峰值记录
     struct QueuePeakRecord {
         char name[32];
@@ -164,3 +261,73 @@ private:
     static void monitor_task(void* arg);
     void update_stats();
 };
+
+/**
+ * @brief 延迟追踪时钟（esp_timer低32位，与latency_stamp_t一致）
+ */
+static inline uint32_t latency_now_us() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+/**
+ * @brief 样本位置 → 延迟时间戳的SPSC FIFO（与一个RingBuffer配对）
+ *
+ * 生产者在commit n个样本之前调用push(n, stamp)（stamp为nullptr时只推进位置），
+ * 消费者每消费（含丢弃）n个样本调用pop(n, out)，取出起点落在已消费区间内的最早时间戳。
+ * 位置是两端各自累计的样本数，只要每次写入/消费都上报就保持一致。
+ * FIFO满时丢弃新时间戳（只少一次采样，不影响样本流）。
+ */
+class LatencyStampFifo {
+public:
+    void push(size_t samples, const latency_stamp_t* stamp) {
+        if (stamp) {
+            const uint32_t w = write_idx_;
+            if (w - read_idx_ < CAPACITY) {
+                entries_[w % CAPACITY].pos = write_pos_;
+                entries_[w % CAPACITY].stamp = *stamp;
+                __sync_synchronize();
+                write_idx_ = w + 1;
+            }
+        }
+        write_pos_ += samples;
+    }
+
+    bool pop(size_t samples, latency_stamp_t* out) {
+        const uint32_t end = read_pos_ + (uint32_t)samples;
+        const uint32_t w = write_idx_;
+        __sync_synchronize();
+        uint32_t r = read_idx_;
+        bool found = false;
+        while (r != w && (int32_t)(entries_[r % CAPACITY].pos - end) < 0) {
+            if (!found && out) {
+                *out = entries_[r % CAPACITY].stamp;
+                found = true;
+            }
+            r++;
+        }
+        __sync_synchronize();
+        read_idx_ = r;
+        read_pos_ = end;
+        return found;
+    }
+
+    /**
+     * @brief 清空（仅当生产者和消费者是同一任务时调用）
+     */
+    void reset() {
+        read_idx_ = write_idx_;
+        read_pos_ = write_pos_;
+    }
+
+private:
+    static const uint32_t CAPACITY = 16;  // 2的幂，索引自然回绕
+    struct Entry {
+        uint32_t pos;
+        latency_stamp_t stamp;
+    };
+    Entry entries_[CAPACITY] = {};
+    volatile uint32_t write_idx_ = 0;
+    volatile uint32_t read_idx_ = 0;
+    uint32_t write_pos_ = 0;  // 生产者累计样本数
+    uint32_t read_pos_ = 0;   // 消费者累计样本数
+};
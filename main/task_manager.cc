@@ -1,11 +1,23 @@
 #include "task_manager.h"
 #include <esp_log.h>
 #include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include "sdkconfig.h"
 
 static const char* TAG = "task_mgr";
 
+static const char* const kPmStateNames[] = {"IDLE", "RECORDING", "PLAYING"};
+static const char* const kPmClientNames[] = {"audio", "wakenet", "ws", "display", "diag"};
+
+// WakeNet升频释放余量（百分点）：折算到最低频的负载低于阈值减此值才降频，避免在阈值附近振荡
+static const uint32_t AFE_BOOST_RELEASE_MARGIN = 15;
+
 bool TaskManager::init() {
+    init_power_management();
     ESP_LOGI(TAG, "Task Manager initialized");
     return true;
 }
@@ -43,6 +55,7 @@ bool TaskManager::create_task(const TaskDef& def) {
 
     if (def.handle && *def.handle) {
         tasks_.push_back(*def.handle);
+        known_tasks_.push_back({*def.handle, def.stack_size});
     }
 
     ESP_LOGI(TAG, "Created task: %s (stack=%u, prio=%u, core=%d)",
@@ -60,27 +73,131 @@ bool TaskManager::create_tasks(const std::vector<TaskDef>& defs) {
     return true;
 }
 
+// ============================================================================
+// CPU统计（FreeRTOS运行时间统计，需要configUSE_TRACE_FACILITY + configGENERATE_RUN_TIME_STATS）
+// ============================================================================
+
+bool TaskManager::sample_cpu() {
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    if (!status_buf_) {
+        status_buf_ = (TaskStatus_t*)heap_caps_malloc(sizeof(TaskStatus_t) * MAX_TRACKED_TASKS,
+                                                      MALLOC_CAP_SPIRAM);
+        if (!status_buf_) {
+            ESP_LOGE(TAG, "Failed to allocate task status buffer");
+            return false;
+        }
+    }
+
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(status_buf_, MAX_TRACKED_TASKS, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, CPU stats skipped", MAX_TRACKED_TASKS);
+        return false;
+    }
+
+    // 运行时间计数器基于esp_timer（us），窗口时长 = 总计数差值（单核视角）
+    const configRUN_TIME_COUNTER_TYPE window = total - prev_total_;
+    const bool first = (prev_total_ == 0);
+    prev_total_ = total;
+
+    // 只有监控任务调用，用static避免占用其较小的栈
+    static TaskStats stats[MAX_TRACKED_TASKS];
+    static RunTimePrev next_prev[MAX_TRACKED_TASKS];
+    configRUN_TIME_COUNTER_TYPE idle_delta[2] = {0, 0};
+    TaskHandle_t idle_handle[2] = {xTaskGetIdleTaskHandleForCore(0),
+                                   portNUM_PROCESSORS > 1 ? xTaskGetIdleTaskHandleForCore(1) : nullptr};
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& t = status_buf_[i];
+
+        configRUN_TIME_COUNTER_TYPE prev = t.ulRunTimeCounter;  // 新任务：从本窗口起计
+        for (int j = 0; j < prev_count_; j++) {
+            if (prev_[j].handle == t.xHandle) {
+                prev = prev_[j].runtime;
+                break;
+            }
+        }
+        const configRUN_TIME_COUNTER_TYPE delta = t.ulRunTimeCounter - prev;
+        next_prev[i] = {t.xHandle, t.ulRunTimeCounter};
+
+        TaskStats& s = stats[i];
+        strlcpy(s.name, t.pcTaskName, sizeof(s.name));
+        s.priority = t.uxCurrentPriority;
+        s.stack_size = 0;
+        for (const auto& k : known_tasks_) {
+            if (k.handle == t.xHandle) {
+                s.stack_size = k.stack_size;
+                break;
+            }
+        }
+        s.stack_free = t.usStackHighWaterMark;  // ESP-IDF中StackType_t为字节
+        s.runtime = (uint32_t)(t.ulRunTimeCounter / 1000);
+#if configTASKLIST_INCLUDE_COREID
+        s.core = (t.xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)t.xCoreID;
+#else
+        s.core = -1;
+#endif
+        s.cpu_usage = (!first && window > 0) ? (float)delta * 100.0f / (float)window : 0.0f;
+
+        for (int c = 0; c < 2; c++) {
+            if (idle_handle[c] && t.xHandle == idle_handle[c]) idle_delta[c] = delta;
+        }
+    }
+
+    std::sort(stats, stats + count, [](const TaskStats& a, const TaskStats& b) {
+        return a.cpu_usage > b.cpu_usage;
+    });
+
+    memcpy(prev_, next_prev, sizeof(RunTimePrev) * count);
+    prev_count_ = (int)count;
+    if (first || window == 0) return true;
+
+    portENTER_CRITICAL(&cpu_mux_);
+    memcpy(snapshot_, stats, sizeof(TaskStats) * count);
+    snapshot_count_ = (int)count;
+    for (int c = 0; c < 2; c++) {
+        float idle_pct = (float)idle_delta[c] * 100.0f / (float)window;
+        core_usage_[c] = (c < portNUM_PROCESSORS) ? (idle_pct < 100.0f ? 100.0f - idle_pct : 0.0f) : 0.0f;
+        idle_ms_[c] = (uint32_t)(idle_delta[c] / 1000);
+    }
+    window_ms_ = (uint32_t)(window / 1000);
+    portEXIT_CRITICAL(&cpu_mux_);
+    return true;
+#else
+    return false;
+#endif
+}
+
 std::vector<TaskManager::TaskStats> TaskManager::get_task_stats() {
-    std::vector<TaskStats> stats;
-    // TODO: uxTaskGetSystemState需要在sdkconfig中启用configUSE_TRACE_FACILITY
-    // 暂时返回空列表
-    ESP_LOGW(TAG, "Task stats not available (configUSE_TRACE_FACILITY disabled)");
-    return stats;
+    TaskStats copy[MAX_TRACKED_TASKS];
+    portENTER_CRITICAL(&cpu_mux_);
+    int n = snapshot_count_;
+    memcpy(copy, snapshot_, sizeof(TaskStats) * n);
+    portEXIT_CRITICAL(&cpu_mux_);
+    return std::vector<TaskStats>(copy, copy + n);
 }
 
 void TaskManager::print_task_stats() {
     auto stats = get_task_stats();
+    if (stats.empty()) {
+        ESP_LOGI(TAG, "Task stats not available yet (needs FreeRTOS run time stats)");
+        return;
+    }
 
-    ESP_LOGI(TAG, "Task Statistics:");
-    ESP_LOGI(TAG, "%-16s %5s %8s %8s %6s", "Name", "Prio", "Stack", "Free", "CPU%");
+    float c0, c1;
+    get_cpu_usage(c0, c1);
+    ESP_LOGI(TAG, "Task Statistics (Core0 %.1f%%, Core1 %.1f%%, window %lums):",
+             c0, c1, (unsigned long)window_ms_);
+    ESP_LOGI(TAG, "%-16s %4s %5s %8s %8s %6s", "Name", "Core", "Prio", "Stack", "Free", "CPU%");
     ESP_LOGI(TAG, "========================================================");
 
     for (const auto& stat : stats) {
-        ESP_LOGI(TAG, "%-16s %5u %8u %8u %6.2f",
+        ESP_LOGI(TAG, "%-16s %4s %5u %8lu %8lu %6.2f",
                  stat.name,
+                 stat.core < 0 ? "-" : (stat.core == 0 ? "0" : "1"),
                  stat.priority,
-                 stat.stack_size,
-                 stat.stack_free,
+                 (unsigned long)stat.stack_size,
+                 (unsigned long)stat.stack_free,
                  stat.cpu_usage);
     }
 }
@@ -90,7 +207,7 @@ void TaskManager::monitor_stack_usage() {
 
     for (const auto& stat : stats) {
         // 警告：栈使用超过80%
-        if (stat.stack_free < stat.stack_size * 0.2f) {
+        if (stat.stack_size > 0 && stat.stack_free < stat.stack_size * 0.2f) {
             ESP_LOGW(TAG, "Task %s: stack usage high! Free=%u/%u",
                      stat.name, stat.stack_free, stat.stack_size);
         }
@@ -98,7 +215,159 @@ void TaskManager::monitor_stack_usage() {
 }
 
 void TaskManager::get_cpu_usage(float& core0_usage, float& core1_usage) {
-    // TODO: 实现每个核心的CPU使用率计算
-    core0_usage = 0.0f;
-    core1_usage = 0.0f;
+    portENTER_CRITICAL(&cpu_mux_);
+    core0_usage = core_usage_[0];
+    core1_usage = core_usage_[1];
+    portEXIT_CRITICAL(&cpu_mux_);
+}
+
+void TaskManager::get_idle_time(uint32_t& core0_ms, uint32_t& core1_ms, uint32_t& window_ms) {
+    portENTER_CRITICAL(&cpu_mux_);
+    core0_ms = idle_ms_[0];
+    core1_ms = idle_ms_[1];
+    window_ms = window_ms_;
+    portEXIT_CRITICAL(&cpu_mux_);
+}
+
+// ============================================================================
+// 电源管理
+// ============================================================================
+
+bool TaskManager::init_power_management() {
+    pm_state_since_us_ = esp_timer_get_time();
+    pm_state_entries_[(int)PmState::IDLE] = 1;
+
+#if CONFIG_PM_ENABLE && CONFIG_ECHOEAR_PM_DFS
+    esp_pm_config_t cfg = {};
+    cfg.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    cfg.min_freq_mhz = CONFIG_ECHOEAR_PM_MIN_FREQ_MHZ;
+#if CONFIG_ECHOEAR_PM_LIGHT_SLEEP
+    cfg.light_sleep_enable = true;
+#endif
+    esp_err_t cfg_err = esp_pm_configure(&cfg);
+    if (cfg_err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_pm_configure failed: %s (running at fixed frequency)", esp_err_to_name(cfg_err));
+    } else {
+        ESP_LOGI(TAG, "PM: DFS %d-%d MHz, light sleep %s", cfg.min_freq_mhz, cfg.max_freq_mhz,
+                 cfg.light_sleep_enable ? "on" : "off");
+    }
+#endif
+
+    // 锁在未配置DFS时也能创建（此时不改变频率），未启用CONFIG_PM_ENABLE返回ESP_ERR_NOT_SUPPORTED
+    for (int i = 0; i < PM_CLIENTS; i++) {
+        esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, kPmClientNames[i], &cpu_locks_[i]);
+        if (err == ESP_OK) {
+            err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, kPmClientNames[i], &sleep_locks_[i]);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGI(TAG, "PM locks unavailable (%s), power policy disabled", esp_err_to_name(err));
+            for (int j = 0; j <= i; j++) {
+                if (cpu_locks_[j]) esp_pm_lock_delete(cpu_locks_[j]);
+                if (sleep_locks_[j]) esp_pm_lock_delete(sleep_locks_[j]);
+                cpu_locks_[j] = nullptr;
+                sleep_locks_[j] = nullptr;
+            }
+            return false;
+        }
+    }
+    // release：锁句柄写入对看到pm_enabled()为真的任务可见（并行启动时lvgl_task可能已在调用pm_hold）
+    __atomic_store_n(&pm_enabled_, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool TaskManager::pm_enabled() const {
+    return __atomic_load_n(&pm_enabled_, __ATOMIC_ACQUIRE);
+}
+
+void TaskManager::pm_hold(PmClient client, bool hold) {
+    const int c = (int)client;
+    if (!pm_enabled() || c >= PM_CLIENTS || held_[c] == hold) return;
+
+    int64_t now = esp_timer_get_time();
+    if (hold) {
+        esp_pm_lock_acquire(cpu_locks_[c]);
+        esp_pm_lock_acquire(sleep_locks_[c]);
+        hold_since_us_[c] = now;
+        hold_count_[c]++;
+    } else {
+        esp_pm_lock_release(cpu_locks_[c]);
+        esp_pm_lock_release(sleep_locks_[c]);
+        hold_time_us_[c] += now - hold_since_us_[c];
+    }
+    held_[c] = hold;
+}
+
+void TaskManager::pm_set_state(PmState state) {
+    if (state == pm_state_ || state >= PmState::COUNT) return;
+
+    int64_t now = esp_timer_get_time();
+    pm_state_time_us_[(int)pm_state_] += now - pm_state_since_us_;
+    pm_state_since_us_ = now;
+    pm_state_ = state;
+    pm_state_entries_[(int)state]++;
+
+    pm_hold(PmClient::AUDIO, state != PmState::IDLE);
+    ESP_LOGD(TAG, "PM state -> %s", kPmStateNames[(int)state]);
+}
+
+void TaskManager::pm_report_afe_load(uint32_t load_pct) {
+    if (!pm_enabled()) return;
+
+    const int w = (int)PmClient::WAKENET;
+    int64_t now = esp_timer_get_time();
+    if (load_pct >= CONFIG_ECHOEAR_PM_AFE_BOOST_LOAD) {
+        if (!held_[w]) {
+            afe_boosts_++;
+            ESP_LOGI(TAG, "AFE load %lu%%, boosting CPU for WakeNet", (unsigned long)load_pct);
+        }
+        // 升频后负载立即下降，按固定时长保持，避免每个chunk来回切换频率
+        afe_boost_until_us_ = now + (int64_t)CONFIG_ECHOEAR_PM_AFE_BOOST_HOLD_S * 1000000;
+        pm_hold(PmClient::WAKENET, true);
+    } else if (held_[w]) {
+        // 持锁期间测得的是最高频下的负载，按频率比折算回最低频：
+        // 降频后仍会超阈值（留AFE_BOOST_RELEASE_MARGIN余量）时保持升频并顺延，不释放
+        const uint32_t projected_pct = load_pct * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ /
+                                       CONFIG_ECHOEAR_PM_MIN_FREQ_MHZ;
+        if (projected_pct + AFE_BOOST_RELEASE_MARGIN >= CONFIG_ECHOEAR_PM_AFE_BOOST_LOAD) {
+            afe_boost_until_us_ = now + (int64_t)CONFIG_ECHOEAR_PM_AFE_BOOST_HOLD_S * 1000000;
+        } else if (now >= afe_boost_until_us_) {
+            ESP_LOGI(TAG, "AFE load %lu%% (~%lu%% at %d MHz), releasing WakeNet boost",
+                     (unsigned long)load_pct, (unsigned long)projected_pct,
+                     CONFIG_ECHOEAR_PM_MIN_FREQ_MHZ);
+            pm_hold(PmClient::WAKENET, false);
+        }
+    }
+}
+
+void TaskManager::print_pm_report() {
+    if (!pm_enabled()) return;
+
+    int64_t now = esp_timer_get_time();
+    uint64_t state_us[PM_STATES];
+    uint64_t total_us = 0;
+    for (int i = 0; i < PM_STATES; i++) {
+        state_us[i] = pm_state_time_us_[i];
+        if (i == (int)pm_state_) state_us[i] += now - pm_state_since_us_;
+        total_us += state_us[i];
+    }
+    if (total_us == 0) return;
+
+    ESP_LOGI(TAG, "=== Power (state=%s, AFE boosts=%lu) ===",
+             kPmStateNames[(int)pm_state_], (unsigned long)afe_boosts_);
+    for (int i = 0; i < PM_STATES; i++) {
+        ESP_LOGI(TAG, "%-9s: %6lus (%3lu%%) x%lu", kPmStateNames[i],
+                 (unsigned long)(state_us[i] / 1000000), (unsigned long)(state_us[i] * 100 / total_us),
+                 (unsigned long)pm_state_entries_[i]);
+    }
+    for (int i = 0; i < PM_CLIENTS; i++) {
+        // 持有时间可能由其他任务同时更新，报告值允许有一轮误差
+        uint64_t held_us = hold_time_us_[i];
+        if (held_[i]) held_us += now - hold_since_us_[i];
+        ESP_LOGI(TAG, "lock %-7s: %6lus (%3lu%%) x%lu%s", kPmClientNames[i],
+                 (unsigned long)(held_us / 1000000), (unsigned long)(held_us * 100 / total_us),
+                 (unsigned long)hold_count_[i], held_[i] ? " [held]" : "");
+    }
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
 }
@@ -4,7 +4,9 @@
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <freertos/event_groups.h>
+#include <esp_pm.h>
 #include <vector>
+#include "audio_buffers.h"
 
 /**
  * @brief 任务管理器 - 统一管理所有应用任务
@@ -14,6 +16,8 @@
  * - 双核任务分配
  * - 任务优先级管理
  * - 任务监控和统计
+ * - 电源管理策略：DFS（最低CONFIG_ECHOEAR_PM_MIN_FREQ_MHZ）+ 自动light sleep，
+ *   各模块通过PM锁按需拉到最高频
  */
 class TaskManager {
 public:
@@ -28,16 +32,19 @@ public:
         TaskHandle_t* handle;          // 任务句柄指针
     };
 
-    // 任务统计信息
+    // 任务统计信息（最近一个采样窗口，见sample_cpu）
     struct TaskStats {
         char name[16];
         UBaseType_t priority;
-        uint32_t stack_size;
-        uint32_t stack_free;      // 剩余栈空间
-        uint32_t runtime;         // 运行时间（ms）
-        float cpu_usage;          // CPU使用率（%）
+        uint32_t stack_size;      // 栈大小（字节，仅TaskManager创建的任务，其余为0）
+        uint32_t stack_free;      // 剩余栈空间（历史最小值，字节）
+        uint32_t runtime;         // 累计运行时间（ms）
+        float cpu_usage;          // 窗口内CPU使用率（%，占单核）
+        int8_t core;              // 绑定核心（-1 = 任意）
     };
 
+    static const int MAX_TRACKED_TASKS = 40;
+
     static TaskManager& instance() {
         static TaskManager inst;
         return inst;
@@ -59,7 +66,13 @@ public:
     bool create_tasks(const std::vector<TaskDef>& defs);
 
     /**
-     * @brief 获取任务统计信息
+     * @brief 采样FreeRTOS运行时间统计，计算上次采样以来每个任务和每个核的CPU使用率
+     * 由SystemMonitor监控任务周期调用（唯一采样者）；未启用运行时间统计时返回false
+     */
+    bool sample_cpu();
+
+    /**
+     * @brief 获取最近一次采样的任务统计（按CPU使用率降序）
      */
     std::vector<TaskStats> get_task_stats();
 
@@ -74,27 +87,126 @@ public:
     void monitor_stack_usage();
 
     /**
-     * @brief 获取系统CPU使用率
+     * @brief 获取最近一次采样的各核CPU使用率（100% - IDLE任务占比）
      */
     void get_cpu_usage(float& core0_usage, float& core1_usage);
 
+    /**
+     * @brief 获取最近一次采样窗口内各核IDLE任务运行时间（ms）及窗口时长
+     */
+    void get_idle_time(uint32_t& core0_ms, uint32_t& core1_ms, uint32_t& window_ms);
+
+    // ========================================================================
+    // 电源管理
+    // ========================================================================
+
+    // 电源状态（由main_control按FSM状态设置）
+    enum class PmState : uint8_t {
+        IDLE = 0,   // 等唤醒词/断网：允许降频和light sleep
+        RECORDING,  // 录音（含会议录音）
+        PLAYING,    // TTS/音乐播放
+        COUNT
+    };
+
+    // PM锁持有者：每个持有者只由一个任务操作（括号内），hold状态无需加锁
+    enum class PmClient : uint8_t {
+        AUDIO = 0,  // 音频流水线，RECORDING/PLAYING期间持有（main_ctrl）
+        WAKENET,    // 待机时AFE负载过高，临时升频保证WakeNet实时（afe_task）
+        WS,         // WebSocket低延迟收发（main_ctrl，见WifiPowerPolicy）
+        DISPLAY,    // UI动画/触摸期间（lvgl）
+        DIAG,       // 基准测试期间固定最高频，结果可重复（diag）
+        COUNT
+    };
+
+    /**
+     * @brief 配置DFS/light sleep并创建各持有者的PM锁（init()中调用）
+     * 未启用CONFIG_PM_ENABLE时锁不可用，pm_*接口变为空操作
+     */
+    bool init_power_management();
+
+    /**
+     * @brief 设置电源状态：非IDLE时持有AUDIO锁，并累计各状态停留时间
+     */
+    void pm_set_state(PmState state);
+
+    /**
+     * @brief 持有/释放某个持有者的PM锁（幂等，只在变化时调用esp_pm）
+     */
+    void pm_hold(PmClient client, bool hold);
+
+    /**
+     * @brief AFE每处理一个chunk上报负载：超过CONFIG_ECHOEAR_PM_AFE_BOOST_LOAD时
+     * 持有WAKENET锁至少CONFIG_ECHOEAR_PM_AFE_BOOST_HOLD_S秒；
+     * 按最高/最低频之比折算后降频仍会超阈值时保持持锁
+     */
+    void pm_report_afe_load(uint32_t load_pct);
+
+    /**
+     * @brief 打印各电源状态停留时间和各PM锁持有时间
+     */
+    void print_pm_report();
+
 private:
     TaskManager() = default;
     std::vector<TaskHandle_t> tasks_;
+
+    // TaskManager创建的任务栈大小（get_task_stats补全stack_size）
+    struct KnownTask {
+        TaskHandle_t handle;
+        uint32_t stack_size;
+    };
+    std::vector<KnownTask> known_tasks_;
+
+    // CPU采样：只在sample_cpu中写，快照由cpu_mux_保护
+    struct RunTimePrev {
+        TaskHandle_t handle;
+        configRUN_TIME_COUNTER_TYPE runtime;
+    };
+    TaskStatus_t* status_buf_ = nullptr;
+    RunTimePrev prev_[MAX_TRACKED_TASKS] = {};
+    int prev_count_ = 0;
+    configRUN_TIME_COUNTER_TYPE prev_total_ = 0;
+
+    portMUX_TYPE cpu_mux_ = portMUX_INITIALIZER_UNLOCKED;
+    TaskStats snapshot_[MAX_TRACKED_TASKS] = {};
+    int snapshot_count_ = 0;
+    float core_usage_[2] = {};
+    uint32_t idle_ms_[2] = {};
+    uint32_t window_ms_ = 0;
+
+    static const int PM_STATES = (int)PmState::COUNT;
+    static const int PM_CLIENTS = (int)PmClient::COUNT;
+
+    bool pm_enabled() const;
+    bool pm_enabled_ = false;                               // PM锁创建成功（__atomic访问，见pm_enabled()）
+    esp_pm_lock_handle_t cpu_locks_[PM_CLIENTS] = {};       // ESP_PM_CPU_FREQ_MAX
+    esp_pm_lock_handle_t sleep_locks_[PM_CLIENTS] = {};     // ESP_PM_NO_LIGHT_SLEEP
+    volatile bool held_[PM_CLIENTS] = {};
+    int64_t hold_since_us_[PM_CLIENTS] = {};
+    uint64_t hold_time_us_[PM_CLIENTS] = {};
+    uint32_t hold_count_[PM_CLIENTS] = {};
+
+    PmState pm_state_ = PmState::IDLE;
+    int64_t pm_state_since_us_ = 0;
+    uint64_t pm_state_time_us_[PM_STATES] = {};
+    uint32_t pm_state_entries_[PM_STATES] = {};
+
+    int64_t afe_boost_until_us_ = 0;
+    uint32_t afe_boosts_ = 0;
 };
 
 // ============================================================================
 // 全局任务定义（2任务架构）
 // ============================================================================
 
-void audio_main_task(void* arg);      // Audio Task (Core 1) - 48KB栈
+void audio_main_task(void* arg);      // Audio Task (Core 1) - 36KB栈
 void main_control_task(void* arg);    // Main Control Task (Core 0) - 12KB栈
 
 // ============================================================================
 // 全局队列定义（2任务架构）
 // ============================================================================
 
-// 旧架构保留队列（仅AdvancedAFE使用）
+// 旧架构保留队列（仅AdvancedAFE非流式模式使用）
 extern QueueHandle_t g_afe_output_queue;       // AFE → audio_main_task
 
 // 系统事件组
@@ -114,46 +226,20 @@ extern EventGroupHandle_t g_app_event_group;   // WiFi/WebSocket全局事件
 #define EVENT_TOUCH_RELEASED      BIT10
 #define EVENT_RECORDING_START     BIT11
 #define EVENT_RECORDING_END       BIT12
+#define EVENT_WIFI_RESTORED       BIT13  // 断线/漫游后重新获取IP（main_control清除），旧WS连接需立即重连
 
 // ============================================================================
-// PCM RingBuffer 和 Memory Pool 定义
+// 全局PCM RingBuffer（RingBuffer / Memory Pool的类型和接口见audio_buffers.h）
 // ============================================================================
 
-// PCM RingBuffer（Lock-free SPSC，单生产者单消费者无锁环形缓冲区）
-typedef struct {
-    int16_t* buffer;           // PSRAM buffer
-    size_t capacity;           // 样本数
-    volatile size_t write_pos; // 写指针（仅生产者写）
-    volatile size_t read_pos;  // 读指针（仅消费者写）
-} pcm_ringbuffer_t;
-
-extern pcm_ringbuffer_t g_pcm_ringbuffer;
-
 // 参考音频 RingBuffer (AEC用，存储扬声器播放的PCM)
 extern pcm_ringbuffer_t g_ref_ringbuffer;
 
-// MIC1 RingBuffer (双麦克风)
-extern pcm_ringbuffer_t g_mic1_ringbuffer;
-
-// 固定内存池（5个池，78KB PSRAM总计）
-typedef enum {
-    POOL_S_64 = 0,   // 64B × 32块 = 2KB（消息结构体）
-    POOL_S_128,      // 128B × 32块 = 4KB
-    POOL_S_256,      // 256B × 32块 = 8KB（Opus包）
-    POOL_L_2K,       // 2KB × 16块 = 32KB（音频缓冲）
-    POOL_L_4K,       // 4KB × 8块 = 32KB（大音频缓冲）
-    POOL_COUNT
-} pool_type_t;
-
-typedef struct {
-    void* memory;          // 预分配PSRAM块
-    uint32_t block_size;   // 每块大小
-    uint32_t block_count;  // 总块数
-    uint32_t free_bitmap;  // 空闲块位图（最大32块）
-    SemaphoreHandle_t mutex;
-} memory_pool_t;
+// 采集 RingBuffer（I2S → AFE，MMR/MM交织帧）
+extern pcm_mc_ringbuffer_t g_capture_ringbuffer;
 
-extern memory_pool_t g_memory_pools[POOL_COUNT];
+// AFE输出 RingBuffer（afe_task → audio_main_task，单声道处理后PCM）
+extern pcm_ringbuffer_t g_afe_out_ringbuffer;
 
 // ============================================================================
 // Audio Task 与 Main Task 通信接口
@@ -165,13 +251,16 @@ typedef enum {
     AUDIO_CMD_STOP_RECORDING,
     AUDIO_CMD_START_PLAYBACK,
     AUDIO_CMD_STOP_PLAYBACK,
-    AUDIO_CMD_MEETING_START,    // 会议模式：禁用WakeNet省CPU
-    AUDIO_CMD_MEETING_END,      // 会议结束：恢复WakeNet
+    // AFE功耗/性能档位（见AdvancedAFE::Profile）
+    AUDIO_CMD_AFE_PROFILE_IDLE,          // 待机监听：WakeNet+VAD，关闭NS
+    AUDIO_CMD_AFE_PROFILE_CONVERSATION,  // 对话：NS+VAD+WakeNet，播放时AEC
+    AUDIO_CMD_AFE_PROFILE_MEETING,       // 会议录音：NS+VAD，禁用WakeNet省CPU
+    AUDIO_CMD_AFE_PROFILE_MUSIC,         // 音乐：AEC+WakeNet（打断）
 } audio_cmd_t;
 
 extern QueueHandle_t g_audio_cmd_queue;         // Main → Audio命令（长度4）
 extern QueueHandle_t g_opus_tx_queue;           // Audio → Main编码包（长度8）
-extern QueueHandle_t g_opus_playback_queue;     // Main → Audio播放包（长度32）
+extern QueueHandle_t g_opus_playback_queue;     // Main → Audio播放切片opus_slice_t（按值，长度24）
 extern EventGroupHandle_t g_audio_event_bits;   // Audio → Main事件
 
 // 音频事件位（Audio Task → Main Task）
@@ -180,6 +269,22 @@ extern EventGroupHandle_t g_audio_event_bits;   // Audio → Main事件
 #define AUDIO_EVENT_VAD_END        BIT2
 #define AUDIO_EVENT_ENCODE_READY   BIT3
 #define AUDIO_EVENT_TOUCH_WAKE     BIT4   // 触摸唤醒（不受SPEAKING/MUSIC过滤）
+#define AUDIO_EVENT_UPLINK_STOPPED BIT5   // 编码级完成stop：尾包已全部入队g_opus_tx_queue
+
+// Audio Task 任务通知位（唤醒audio_main_task的工作来源，xTaskNotify eSetBits）
+#define AUDIO_NOTIFY_I2S_RX        BIT0   // I2S RX DMA buffer完成（ISR）
+#define AUDIO_NOTIFY_AFE_OUT       BIT1   // AFE输出RingBuffer有新数据
+#define AUDIO_NOTIFY_CMD           BIT3   // 控制命令入队
+
+extern TaskHandle_t g_audio_task_handle;        // audio_main_task句柄（任务启动后有效）
+
+// Main Control Task 任务通知位（唤醒main_control_task的工作来源，xTaskNotify eSetBits）
+// 主循环每次唤醒都会检查所有来源，通知位只决定何时醒来
+#define MAIN_NOTIFY_WS_RX          BIT0   // g_ws_rx_queue有新消息
+#define MAIN_NOTIFY_AUDIO_EVENT    BIT1   // g_audio_event_bits有新事件
+#define MAIN_NOTIFY_APP_EVENT      BIT2   // g_app_event_group变化（WiFi连接/恢复）
+
+extern TaskHandle_t g_main_task_handle;         // main_control_task句柄（任务启动后有效）
 
 // FSM事件类型（Main Task内部）
 typedef enum {
@@ -217,6 +322,7 @@ typedef struct {
     uint8_t* data;       // 数据指针（pool分配，CONNECTED/DISCONNECTED时为NULL）
     uint16_t len;        // 数据长度
     uint8_t msg_type;    // WS_MSG_*
+    uint32_t rx_us;      // WS事件回调收到时间（延迟追踪起点，esp_timer低32位）
 } ws_raw_msg_t;
 
 extern QueueHandle_t g_ws_rx_queue;      // WS原始消息队列（长度48）
@@ -225,19 +331,37 @@ extern QueueHandle_t g_ws_rx_queue;      // WS原始消息队列（长度48）
 // 消息定义（2任务架构）
 // ============================================================================
 
+// 延迟追踪时间戳（随采集块/下行包在流水线中传递，见SystemMonitor::LatencyStage）
+// 时间取esp_timer_get_time()低32位（差值按无符号回绕计算，~71分钟内有效）
+typedef struct {
+    uint32_t seq;        // 序号（上行：I2S采集块，下行：WS收到的Opus包），0=未追踪
+    uint32_t origin_us;  // 起点：I2S读取完成 / WS收到
+    uint32_t stage_us;   // 上一级完成时间
+} latency_stamp_t;
+
 // 音频数据消息
 typedef struct {
     int16_t* data;       // 音频数据指针（需要释放）
     size_t samples;      // 样本数
     int channels;        // 声道数
     uint32_t timestamp;  // 时间戳
+    latency_stamp_t stamp;  // 延迟追踪
 } audio_data_msg_t;
 
+// 下行Opus包切片（播放队列按值传递）：data指向WS接收帧（pool块）内部，
+// 每个切片持有该帧的一个引用，解码后用opus_slice_release归还，最后一个切片释放整帧
+typedef struct {
+    uint8_t* data;       // 包起始地址（共享帧内部）
+    uint16_t len;        // 包长度
+    latency_stamp_t stamp;  // 延迟追踪
+} opus_slice_t;
+
 // Opus包消息
 typedef struct {
     uint8_t* data;       // Opus数据指针（需要释放）
     size_t len;          // 数据长度
     uint32_t timestamp;  // 时间戳
+    latency_stamp_t stamp;  // 延迟追踪
 } opus_packet_msg_t;
 
 // ============================================================================
@@ -265,71 +389,52 @@ void suspend_audio_tasks();
 bool init_advanced_afe();
 
 /**
- * @brief 分配音频数据消息（从PSRAM）
+ * @brief 唤醒audio_main_task（任务通知置位，非ISR上下文）
  */
-audio_data_msg_t* alloc_audio_msg(size_t samples, int channels);
+void audio_task_notify(uint32_t bits);
 
 /**
- * @brief 释放音频数据消息
+ * @brief 唤醒main_control_task（任务通知置位，非ISR上下文）
  */
-void free_audio_msg(audio_data_msg_t* msg);
+void main_task_notify(uint32_t bits);
 
 /**
- * @brief 分配Opus包消息（从PSRAM）
+ * @brief 置位音频事件（g_audio_event_bits）并唤醒main_control_task
  */
-opus_packet_msg_t* alloc_opus_msg(size_t len);
+void audio_post_event(EventBits_t bits);
 
 /**
- * @brief 释放Opus包消息
+ * @brief 发送Audio控制命令并唤醒audio_main_task
  */
-void free_opus_msg(opus_packet_msg_t* msg);
+bool audio_send_cmd(audio_cmd_t cmd);
 
 /**
- * @brief 初始化PCM RingBuffer
+ * @brief 投递Opus播放切片（由AudioPlayout任务消费）
+ * 成功时切片持有的帧引用转移给播放队列，失败时仍归调用者
  */
-bool ringbuffer_init(pcm_ringbuffer_t* rb, size_t capacity);
+bool audio_send_playback(const opus_slice_t* slice, TickType_t wait);
 
 /**
- * @brief 零拷贝写入RingBuffer（Audio Task使用）
+ * @brief 归还切片持有的帧引用
  */
-size_t ringbuffer_write(pcm_ringbuffer_t* rb, const int16_t* data, size_t samples);
+void opus_slice_release(opus_slice_t* slice);
 
 /**
- * @brief 零拷贝读取RingBuffer（Main Task使用）
- */
-size_t ringbuffer_read(pcm_ringbuffer_t* rb, int16_t* out, size_t samples);
-
-/**
- * @brief 查询RingBuffer可读样本数
- */
-size_t ringbuffer_data_available(pcm_ringbuffer_t* rb);
-
-/**
- * @brief 重置RingBuffer读写指针
- */
-void ringbuffer_reset(pcm_ringbuffer_t* rb);
-
-/**
- * @brief 初始化固定内存池
- */
-bool init_memory_pools();
-
-/**
- * @brief 从内存池分配块
+ * @brief 分配音频数据消息（从PSRAM）
  */
-void* pool_alloc(pool_type_t type);
+audio_data_msg_t* alloc_audio_msg(size_t samples, int channels);
 
 /**
- * @brief 归还内存池块
+ * @brief 释放音频数据消息
  */
-void pool_free(pool_type_t type, void* ptr);
+void free_audio_msg(audio_data_msg_t* msg);
 
 /**
- * @brief 根据数据大小释放pool块（用于ws_raw_msg_t释放）
+ * @brief 分配Opus包消息（从PSRAM）
  */
-void pool_free_by_size(void* ptr, size_t len);
+opus_packet_msg_t* alloc_opus_msg(size_t len);
 
 /**
- * @brief 打印内存池使用统计
+ * @brief 释放Opus包消息
  */
-void pool_print_stats();
+void free_opus_msg(opus_packet_msg_t* msg);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief 录音端点判断 - VAD静音计时 + 最长录音时间（纯计时逻辑，不依赖FreeRTOS，主机基准也使用）
+ *
+ * audio_main_task在RECORDING模式下每个AFE输出块调用update()：
+ * - 录音超过max_recording_ms → MAX_DURATION
+ * - 连续静音超过silence_ms：录音不足min_recording_ms → TOO_SHORT（auto-listen后无人说话，直接回IDLE），
+ *   否则 → SILENCE（进入THINKING）
+ * 返回非NONE后自动停止，直到下次start()。时间为调用者的单调毫秒时钟（回绕安全）。
+ */
+class VadEndpointer {
+public:
+    enum class Result : uint8_t {
+        NONE = 0,
+        SILENCE,        // 说话结束
+        TOO_SHORT,      // 静音结束但录音过短
+        MAX_DURATION,   // 达到最长录音时间
+    };
+
+    struct Config {
+        uint32_t silence_ms;
+        uint32_t min_recording_ms;
+        uint32_t max_recording_ms;
+    };
+
+    explicit VadEndpointer(const Config& cfg) : cfg_(cfg) {}
+
+    void start(uint32_t now_ms) {
+        active_ = true;
+        silent_ = false;
+        start_ms_ = now_ms;
+    }
+
+    void stop() { active_ = false; }
+    bool active() const { return active_; }
+    uint32_t duration_ms(uint32_t now_ms) const { return now_ms - start_ms_; }
+
+    Result update(uint32_t now_ms, bool voice_active) {
+        if (!active_) return Result::NONE;
+
+        if (now_ms - start_ms_ > cfg_.max_recording_ms) {
+            active_ = false;
+            return Result::MAX_DURATION;
+        }
+        if (voice_active) {
+            silent_ = false;  // VAD活动时重置静音计时器
+            return Result::NONE;
+        }
+        if (!silent_) {
+            silent_ = true;
+            silence_start_ms_ = now_ms;
+            return Result::NONE;
+        }
+        if (now_ms - silence_start_ms_ > cfg_.silence_ms) {
+            active_ = false;
+            return (now_ms - start_ms_ < cfg_.min_recording_ms) ? Result::TOO_SHORT : Result::SILENCE;
+        }
+        return Result::NONE;
+    }
+
+private:
+    Config cfg_;
+    bool active_ = false;
+    bool silent_ = false;
+    uint32_t start_ms_ = 0;
+    uint32_t silence_start_ms_ = 0;
+};
@@ -0,0 +1,162 @@
+#include "wifi_power.h"
+#include "task_manager.h"
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp_timer.h>
+#include "sdkconfig.h"
+
+static const char* TAG = "wifi_power";
+
+static const int64_t PING_TIMEOUT_US = 5000000;
+static const int64_t PS_RETRY_US = 1000000;  // esp_wifi_set_ps失败后同一目标的重试间隔
+
+bool WifiPowerPolicy::init(const char* const* state_names, int state_count) {
+    state_names_ = state_names;
+    state_count_ = state_count < MAX_STATES ? state_count : MAX_STATES;
+    base_priority_ = uxTaskPriorityGet(nullptr);
+
+    ESP_LOGI(TAG, "WiFi PS policy: idle=MAX_MODEM (listen_interval=%d), active=NONE, linger=%dms",
+             CONFIG_ECHOEAR_WIFI_IDLE_LISTEN_INTERVAL, CONFIG_ECHOEAR_WIFI_PS_LINGER_MS);
+    return true;
+}
+
+void WifiPowerPolicy::account(int64_t now_us) {
+    if (state_ >= 0 && state_ < state_count_) {
+        stats_[state_].time_us += now_us - state_since_us_;
+    }
+    state_since_us_ = now_us;
+}
+
+bool WifiPowerPolicy::apply(Profile p) {
+    esp_err_t err = esp_wifi_set_ps(p == Profile::ACTIVE ? WIFI_PS_NONE : WIFI_PS_MAX_MODEM);
+    if (err != ESP_OK) {
+        // WiFi未启动时每次都会失败：同一目标只警告一次，由update()限速重试
+        if (!ps_failed_ || p != failed_profile_) {
+            ESP_LOGW(TAG, "esp_wifi_set_ps(%s) failed: %s, will retry",
+                     p == Profile::ACTIVE ? "NONE" : "MAX_MODEM", esp_err_to_name(err));
+        }
+        ps_failed_ = true;
+        failed_profile_ = p;
+        retry_at_us_ = esp_timer_get_time() + PS_RETRY_US;
+        return false;
+    }
+    if (ps_failed_) {
+        ESP_LOGI(TAG, "esp_wifi_set_ps(%s) applied after earlier failure",
+                 p == Profile::ACTIVE ? "NONE" : "MAX_MODEM");
+        ps_failed_ = false;
+    }
+
+    if (p != profile_ || !applied_) {
+        TaskManager::instance().pm_hold(TaskManager::PmClient::WS, p == Profile::ACTIVE);
+        vTaskPrioritySet(nullptr, p == Profile::ACTIVE ? base_priority_ + 1 : base_priority_);
+    }
+    return true;
+}
+
+uint32_t WifiPowerPolicy::update(int state, bool active) {
+    int64_t now = esp_timer_get_time();
+
+    if (state != state_) {
+        account(now);
+        state_ = state;
+        if (state >= 0 && state < state_count_) stats_[state].entries++;
+    }
+
+    Profile want = profile_;
+    if (active) {
+        want = Profile::ACTIVE;
+        idle_after_us_ = 0;
+    } else if (profile_ == Profile::ACTIVE) {
+        if (idle_after_us_ == 0) {
+            idle_after_us_ = now + (int64_t)CONFIG_ECHOEAR_WIFI_PS_LINGER_MS * 1000;
+        }
+        if (now >= idle_after_us_) {
+            want = Profile::IDLE;
+            idle_after_us_ = 0;
+        }
+    }
+
+    const bool retry_wait = ps_failed_ && want == failed_profile_ && now < retry_at_us_;
+    if ((want != profile_ || !applied_) && !retry_wait) {
+        Profile prev = profile_;
+        bool was_applied = applied_;
+        if (apply(want)) {
+            if (was_applied && want != prev) {
+                switches_++;
+                ESP_LOGI(TAG, "WiFi PS -> %s (state=%s)",
+                         want == Profile::ACTIVE ? "NONE" : "MAX_MODEM",
+                         (state >= 0 && state < state_count_) ? state_names_[state] : "?");
+            }
+            profile_ = want;
+            applied_ = true;
+        }
+    }
+
+    if (idle_after_us_ > 0) {
+        uint32_t left_ms = (uint32_t)((idle_after_us_ - now + 999) / 1000);
+        return left_ms > 0 ? left_ms : 1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// 往返延迟
+// ============================================================================
+
+void WifiPowerPolicy::on_ping_sent() {
+    ping_sent_us_ = esp_timer_get_time();
+    ping_state_ = state_;
+}
+
+bool WifiPowerPolicy::ping_outstanding() {
+    if (ping_sent_us_ == 0) return false;
+    if (esp_timer_get_time() - ping_sent_us_ > PING_TIMEOUT_US) {
+        ping_sent_us_ = 0;  // 丢失
+        return false;
+    }
+    return true;
+}
+
+void WifiPowerPolicy::on_pong() {
+    if (ping_sent_us_ == 0) return;
+    uint32_t rtt = (uint32_t)(esp_timer_get_time() - ping_sent_us_);
+    ping_sent_us_ = 0;
+
+    if (ping_state_ < 0 || ping_state_ >= state_count_) return;
+    StateStats& s = stats_[ping_state_];
+    s.rtt_count++;
+    s.rtt_sum_us += rtt;
+    if (rtt > s.rtt_max_us) s.rtt_max_us = rtt;
+    ESP_LOGD(TAG, "RTT %lu us (%s)", (unsigned long)rtt, state_names_[ping_state_]);
+}
+
+// ============================================================================
+// 报告
+// ============================================================================
+
+WifiPowerPolicy::StateStats WifiPowerPolicy::get_state_stats(int state) const {
+    if (state < 0 || state >= state_count_) return StateStats{};
+    StateStats s = stats_[state];
+    if (state == state_) s.time_us += esp_timer_get_time() - state_since_us_;
+    return s;
+}
+
+void WifiPowerPolicy::print_report() {
+    account(esp_timer_get_time());
+
+    ESP_LOGI(TAG, "=== WiFi Power (profile=%s, switches=%lu) ===",
+             profile_ == Profile::ACTIVE ? "ACTIVE" : "IDLE", (unsigned long)switches_);
+    for (int i = 0; i < state_count_; i++) {
+        const StateStats& s = stats_[i];
+        if (s.entries == 0) continue;
+        if (s.rtt_count > 0) {
+            ESP_LOGI(TAG, "%-9s: %6lus x%-4lu rtt avg=%lums max=%lums (n=%lu)",
+                     state_names_[i], (unsigned long)(s.time_us / 1000000), (unsigned long)s.entries,
+                     (unsigned long)(s.rtt_sum_us / s.rtt_count / 1000),
+                     (unsigned long)(s.rtt_max_us / 1000), (unsigned long)s.rtt_count);
+        } else {
+            ESP_LOGI(TAG, "%-9s: %6lus x%-4lu rtt -",
+                     state_names_[i], (unsigned long)(s.time_us / 1000000), (unsigned long)s.entries);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cstdint>
+
+/**
+ * @brief WiFi省电策略 - 跟随FSM状态切换省电/低延迟配置
+ *
+ * - ACTIVE（录音/TTS/音乐/等待回复）：WIFI_PS_NONE，持有TaskManager的WS PM锁（CPU最高频、禁止light sleep），
+ *   main_ctrl（WS发送方）优先级+1，上行包不排在心跳/UI之后
+ * - IDLE（等唤醒词/断网）：WIFI_PS_MAX_MODEM，按listen_interval（长DTIM）醒来收beacon，释放PM锁
+ * - 离开ACTIVE后保持CONFIG_ECHOEAR_WIFI_PS_LINGER_MS再降级，避免TTS→自动聆听来回切换
+ * - 统计每个FSM状态的停留时间和ping/pong往返延迟（按发出ping时的状态归类）
+ *
+ * 仅在main_ctrl任务中调用（无锁）
+ */
+class WifiPowerPolicy {
+public:
+    enum class Profile : uint8_t {
+        IDLE = 0,
+        ACTIVE,
+    };
+
+    static const int MAX_STATES = 8;
+
+    // 每个FSM状态的统计
+    struct StateStats {
+        uint64_t time_us;       // 累计停留时间
+        uint32_t entries;       // 进入次数
+        uint32_t rtt_count;     // 该状态下完成的往返测量数
+        uint64_t rtt_sum_us;
+        uint32_t rtt_max_us;
+    };
+
+    static WifiPowerPolicy& instance() {
+        static WifiPowerPolicy inst;
+        return inst;
+    }
+
+    /**
+     * @brief 记录状态名和基础优先级（PM锁由TaskManager统一管理）
+     * @param state_names FSM状态名（下标即状态值），用于报告
+     */
+    bool init(const char* const* state_names, int state_count);
+
+    /**
+     * @brief 每轮主循环调用：记录状态停留时间，按需切换配置
+     * @param state 当前FSM状态
+     * @param active 是否需要低延迟（调用者结合等待回复/OTA等上下文判断）
+     * @return 距延迟降级的毫秒数（0 = 无待处理切换），调用者据此安排唤醒
+     */
+    uint32_t update(int state, bool active);
+
+    /**
+     * @brief 往返延迟测量：发出ping时调用
+     */
+    void on_ping_sent();
+
+    /**
+     * @brief 收到pong时调用（无未完成的ping时忽略）
+     */
+    void on_pong();
+
+    /**
+     * @brief 是否有未完成的ping（超过5秒视为丢失）
+     */
+    bool ping_outstanding();
+
+    Profile profile() const { return profile_; }
+    StateStats get_state_stats(int state) const;
+
+    /**
+     * @brief 打印每状态停留时间、往返延迟和配置切换次数
+     */
+    void print_report();
+
+private:
+    WifiPowerPolicy() = default;
+
+    bool apply(Profile p);
+    void account(int64_t now_us);
+
+    const char* const* state_names_ = nullptr;
+    int state_count_ = 0;
+    StateStats stats_[MAX_STATES] = {};
+
+    int state_ = -1;
+    int64_t state_since_us_ = 0;
+    Profile profile_ = Profile::IDLE;
+    bool applied_ = false;          // 当前配置是否已成功下发（WiFi未启动时下发失败，限速重试）
+    bool ps_failed_ = false;        // 上次下发失败（failed_profile_为失败的目标）
+    Profile failed_profile_ = Profile::IDLE;
+    int64_t retry_at_us_ = 0;       // 同一目标的下次重试时间
+    int64_t idle_after_us_ = 0;     // 延迟降级时间点（0 = 无）
+    uint32_t switches_ = 0;
+
+    UBaseType_t base_priority_ = 0;
+
+    int64_t ping_sent_us_ = 0;      // 0 = 无未完成的ping
+    int ping_state_ = 0;
+};
@@ -0,0 +1,150 @@
+#include "ws_control.h"
+#include <string.h>
+
+// ============================================================================
+// 解码
+// ============================================================================
+
+bool ws_batch_next(const uint8_t* data, size_t len, size_t* offset, size_t* pkt_offset, uint16_t* pkt_len) {
+    if (!data || !offset || !pkt_offset || !pkt_len) return false;
+
+    size_t pos = *offset;
+    if (pos + 2 > len) return false;
+    uint16_t n = ((uint16_t)data[pos] << 8) | data[pos + 1];
+    if (n == 0 || pos + 2 + n > len) {
+        return false;  // 非法长度或截断的包
+    }
+
+    *pkt_offset = pos + 2;
+    *pkt_len = n;
+    *offset = pos + 2 + n;
+    return true;
+}
+
+bool ws_ctrl_next(const uint8_t* data, size_t len, size_t* offset, ws_ctrl_msg_view_t* out) {
+    if (!data || !offset || !out) return false;
+
+    size_t pos = *offset;
+    if (pos + WS_CTRL_HEADER_LEN > len || data[pos] != WS_CTRL_MAGIC) {
+        return false;
+    }
+    uint16_t payload_len = ((uint16_t)data[pos + 2] << 8) | data[pos + 3];
+    if (pos + WS_CTRL_HEADER_LEN + payload_len > len) {
+        return false;  // 截断的消息
+    }
+
+    out->id = data[pos + 1];
+    out->payload = &data[pos + WS_CTRL_HEADER_LEN];
+    out->len = payload_len;
+    *offset = pos + WS_CTRL_HEADER_LEN + payload_len;
+    return true;
+}
+
+bool ws_ctrl_find(const ws_ctrl_msg_view_t* msg, uint8_t tag, const uint8_t** value, uint8_t* value_len) {
+    if (!msg) return false;
+
+    size_t pos = 0;
+    while (pos + 2 <= msg->len) {
+        uint8_t t = msg->payload[pos];
+        uint8_t l = msg->payload[pos + 1];
+        if (pos + 2 + l > msg->len) {
+            return false;  // TLV越界
+        }
+        if (t == tag) {
+            *value = &msg->payload[pos + 2];
+            *value_len = l;
+            return true;
+        }
+        pos += 2 + l;
+    }
+    return false;
+}
+
+bool ws_ctrl_get_int(const ws_ctrl_msg_view_t* msg, uint8_t tag, int32_t* out) {
+    const uint8_t* v;
+    uint8_t l;
+    if (!ws_ctrl_find(msg, tag, &v, &l)) return false;
+
+    switch (l) {
+        case 1: *out = v[0]; return true;
+        case 2: *out = ((int32_t)v[0] << 8) | v[1]; return true;
+        case 4: *out = (int32_t)(((uint32_t)v[0] << 24) | ((uint32_t)v[1] << 16) |
+                                 ((uint32_t)v[2] << 8) | v[3]);
+                return true;
+        default: return false;
+    }
+}
+
+bool ws_ctrl_get_str(const ws_ctrl_msg_view_t* msg, uint8_t tag, char* out, size_t cap) {
+    const uint8_t* v;
+    uint8_t l;
+    if (!out || cap == 0 || !ws_ctrl_find(msg, tag, &v, &l)) return false;
+
+    size_t n = (l < cap - 1) ? l : cap - 1;
+    memcpy(out, v, n);
+    out[n] = '\0';
+    return true;
+}
+
+// ============================================================================
+// 编码
+// ============================================================================
+
+static void put_byte(ws_ctrl_writer_t* w, uint8_t b) {
+    if (w->len < w->cap) {
+        w->buf[w->len++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+void ws_ctrl_begin(ws_ctrl_writer_t* w, uint8_t* buf, size_t cap, uint8_t id) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = false;
+    ws_ctrl_append(w, id);
+}
+
+void ws_ctrl_append(ws_ctrl_writer_t* w, uint8_t id) {
+    w->msg_start = w->len;
+    put_byte(w, WS_CTRL_MAGIC);
+    put_byte(w, id);
+    put_byte(w, 0);  // payload长度在end()回填
+    put_byte(w, 0);
+}
+
+void ws_ctrl_put_int(ws_ctrl_writer_t* w, uint8_t tag, uint32_t value) {
+    // 最短编码：1/2/4字节
+    uint8_t n = (value <= 0xFF) ? 1 : (value <= 0xFFFF) ? 2 : 4;
+    put_byte(w, tag);
+    put_byte(w, n);
+    for (int i = n - 1; i >= 0; i--) {
+        put_byte(w, (uint8_t)(value >> (i * 8)));
+    }
+}
+
+void ws_ctrl_put_str(ws_ctrl_writer_t* w, uint8_t tag, const char* str) {
+    if (!str) return;
+    size_t n = strlen(str);
+    if (n > 255) {
+        w->overflow = true;
+        return;
+    }
+    put_byte(w, tag);
+    put_byte(w, (uint8_t)n);
+    if (w->len + n <= w->cap) {
+        memcpy(&w->buf[w->len], str, n);
+        w->len += n;
+    } else {
+        w->overflow = true;
+    }
+}
+
+bool ws_ctrl_end(ws_ctrl_writer_t* w) {
+    if (w->overflow) return false;
+    size_t payload_len = w->len - w->msg_start - WS_CTRL_HEADER_LEN;
+    w->buf[w->msg_start + 2] = (uint8_t)(payload_len >> 8);
+    w->buf[w->msg_start + 3] = (uint8_t)(payload_len & 0xFF);
+    return true;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief 二进制控制通道（TLV编解码），与JSON控制消息并存
+ *
+ * 帧格式（WS二进制帧，一帧可连续携带多条消息）：
+ *   [0xC5][msg_id:1][payload_len:2 BE][TLV...]
+ *   TLV = [tag:1][len:1][value:len]
+ *   整数按大端写入1/2/4字节，字符串不含结尾'\0'（最长255字节）
+ *
+ * 首字节0xC5与TTS批量帧区分：批量帧首字节是Opus包长度的高字节，
+ * 包长<4KB（pool上限）时恒<0x10。
+ *
+ * hello中交换ctrl_bin版本号，双方都支持时控制消息改走二进制，
+ * hello本身以及遥测等低频复杂消息保持JSON。
+ */
+
+#define WS_CTRL_MAGIC       0xC5
+#define WS_CTRL_VERSION     1
+#define WS_CTRL_HEADER_LEN  4
+
+// 消息ID：0x01-0x3F 服务器→设备，0x40-0x7F 设备→服务器
+typedef enum : uint8_t {
+    WS_CTRL_MSG_HELLO = 0x01,
+    WS_CTRL_MSG_TTS_START,
+    WS_CTRL_MSG_TTS_END,
+    WS_CTRL_MSG_MUSIC_START,
+    WS_CTRL_MSG_MUSIC_END,
+    WS_CTRL_MSG_MUSIC_RESUME,
+    WS_CTRL_MSG_ASR_TEXT,
+    WS_CTRL_MSG_ERROR,
+    WS_CTRL_MSG_EXPRESSION,
+    WS_CTRL_MSG_PONG,
+    WS_CTRL_MSG_VOLUME,
+    WS_CTRL_MSG_OTA_NOTIFY,
+    WS_CTRL_MSG_MEETING_STATUS,
+    WS_CTRL_MSG_BENCHMARK,          // 基准测试：action=start/data/downlink_end
+    WS_CTRL_MSG_SERVER_END,         // 服务器消息ID上界（不含）
+
+    WS_CTRL_MSG_LISTEN = 0x40,
+    WS_CTRL_MSG_ABORT,
+    WS_CTRL_MSG_AUDIO_START,
+    WS_CTRL_MSG_MUSIC_CTRL,
+    WS_CTRL_MSG_PING,
+    WS_CTRL_MSG_MUSIC_FLOW,         // 音乐流控：state=pause/resume，level=存储占用%
+    WS_CTRL_MSG_TTS_CREDIT,         // TTS下行信用：tts_credit=本会话累计授予包数，dropped=已丢包数
+} ws_ctrl_msg_t;
+
+// 字段tag（所有消息共用一套编号）
+typedef enum : uint8_t {
+    WS_CTRL_TAG_SESSION_ID = 0x01,  // str
+    WS_CTRL_TAG_TEXT,               // str
+    WS_CTRL_TAG_REASON,             // str
+    WS_CTRL_TAG_TITLE,              // str
+    WS_CTRL_TAG_MESSAGE,            // str
+    WS_CTRL_TAG_EXPR,               // str
+    WS_CTRL_TAG_DURATION_MS,        // int
+    WS_CTRL_TAG_LEVEL,              // int
+    WS_CTRL_TAG_VERSION,            // str
+    WS_CTRL_TAG_URL,                // str
+    WS_CTRL_TAG_STATUS,             // str
+    WS_CTRL_TAG_NOTION_PUSHED,      // int (0/1)
+    WS_CTRL_TAG_STATE,              // str
+    WS_CTRL_TAG_MODE,               // str
+    WS_CTRL_TAG_ACTION,             // str
+    WS_CTRL_TAG_UPLINK_BATCH,       // int，上行批量帧数
+    WS_CTRL_TAG_CTRL_BIN,           // int，二进制控制通道版本
+    WS_CTRL_TAG_FEATURE_ABORT,      // int (0/1)
+    WS_CTRL_TAG_TTS_CREDIT,         // int，TTS信用（hello协商/listen初始额度/累计授予）
+    WS_CTRL_TAG_DROPPED,            // int，本会话丢弃的TTS包数
+    WS_CTRL_TAG_COUNT
+} ws_ctrl_tag_t;
+
+// 一条已解析消息（payload指向接收帧，不复制）
+typedef struct {
+    uint8_t id;
+    const uint8_t* payload;
+    uint16_t len;
+} ws_ctrl_msg_view_t;
+
+// 编码器：写入调用者提供的缓冲区，溢出时置overflow，end()返回false
+typedef struct {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    size_t msg_start;
+    bool overflow;
+} ws_ctrl_writer_t;
+
+/**
+ * @brief 是否为二进制控制帧（首字节魔数）
+ */
+static inline bool ws_ctrl_is_frame(const uint8_t* data, size_t len) {
+    return data && len >= WS_CTRL_HEADER_LEN && data[0] == WS_CTRL_MAGIC;
+}
+
+/**
+ * @brief 取出下行音频批量帧中的下一个Opus包
+ *
+ * TTS/音乐批量帧格式：[2B BE len][opus]...（len > 0）
+ * @param offset 输入/输出：当前解析位置（从0开始）
+ * @param pkt_offset 输出：包数据在帧内的起始位置
+ * @return false 已到帧尾或长度非法（offset停在出错的长度字段，调用者据offset != len判断）
+ */
+bool ws_batch_next(const uint8_t* data, size_t len, size_t* offset, size_t* pkt_offset, uint16_t* pkt_len);
+
+/**
+ * @brief 取出帧内下一条消息
+ * @param offset 输入/输出：当前解析位置（从0开始）
+ * @return false 已到帧尾或格式错误
+ */
+bool ws_ctrl_next(const uint8_t* data, size_t len, size_t* offset, ws_ctrl_msg_view_t* out);
+
+/**
+ * @brief 查找字段（线性扫描，消息只有几个字段）
+ */
+bool ws_ctrl_find(const ws_ctrl_msg_view_t* msg, uint8_t tag, const uint8_t** value, uint8_t* value_len);
+
+/**
+ * @brief 读取整数字段（1/2/4字节大端）
+ */
+bool ws_ctrl_get_int(const ws_ctrl_msg_view_t* msg, uint8_t tag, int32_t* out);
+
+/**
+ * @brief 读取字符串字段到out（截断到cap-1并补'\0'）
+ */
+bool ws_ctrl_get_str(const ws_ctrl_msg_view_t* msg, uint8_t tag, char* out, size_t cap);
+
+/**
+ * @brief 开始一条消息（可在同一缓冲区连续写多条）
+ */
+void ws_ctrl_begin(ws_ctrl_writer_t* w, uint8_t* buf, size_t cap, uint8_t id);
+
+/**
+ * @brief 在已有缓冲区后追加一条消息
+ */
+void ws_ctrl_append(ws_ctrl_writer_t* w, uint8_t id);
+
+void ws_ctrl_put_int(ws_ctrl_writer_t* w, uint8_t tag, uint32_t value);
+void ws_ctrl_put_str(ws_ctrl_writer_t* w, uint8_t tag, const char* str);
+
+/**
+ * @brief 结束当前消息（回填payload长度）
+ * @return false 缓冲区不足（整帧不应发送）
+ */
+bool ws_ctrl_end(ws_ctrl_writer_t* w);